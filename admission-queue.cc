@@ -0,0 +1,367 @@
+#include "admission-queue.h"
+#include <algorithm>
+
+namespace ns3 {
+
+    AdmissionQueue::AdmissionQueue(void)
+    {
+        m_policy = TAIL_DROP;
+        m_capacity = 0;
+        m_watermark = 0.75;
+        m_quantum = 2048;
+        m_depth = 0;
+        m_sequence = 0;
+        m_lastDequeue = Seconds(0);
+        m_backlogged = false;
+        m_meanGap = 0;
+        m_gapSamples = 0;
+        m_admitted = 0;
+        m_rejected = 0;
+        m_evicted = 0;
+        m_maxDepth = 0;
+        m_served = 0;
+        m_totalWait = 0;
+        m_maxWait = 0;
+    }
+
+    AdmissionQueue::~AdmissionQueue(void)
+    {
+    }
+
+    bool
+    AdmissionQueue::ParsePolicy(const std::string &name, Policy &policy)
+    {
+        if (name == "taildrop")
+        {
+            policy = TAIL_DROP;
+        }
+        else if (name == "priority")
+        {
+            policy = PAYMENT_PRIORITY;
+        }
+        else if (name == "fair")
+        {
+            policy = FAIR_SHARE;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    const char*
+    AdmissionQueue::GetPolicyName(Policy policy)
+    {
+        switch (policy)
+        {
+            case TAIL_DROP: return "taildrop";
+            case PAYMENT_PRIORITY: return "priority";
+            case FAIR_SHARE: return "fair";
+        }
+        return "unknown";
+    }
+
+    void
+    AdmissionQueue::SetPolicy(Policy policy)
+    {
+        m_policy = policy;
+    }
+
+    AdmissionQueue::Policy
+    AdmissionQueue::GetPolicy(void) const
+    {
+        return m_policy;
+    }
+
+    void
+    AdmissionQueue::SetCapacity(uint32_t capacity)
+    {
+        m_capacity = capacity;
+    }
+
+    void
+    AdmissionQueue::SetWatermark(double watermark)
+    {
+        m_watermark = std::min(std::max(watermark, 0.0), 1.0);
+    }
+
+    void
+    AdmissionQueue::SetQuantum(uint32_t bytes)
+    {
+        m_quantum = std::max(bytes, 1u);
+    }
+
+    AdmissionQueue::Outcome
+    AdmissionQueue::Enqueue(const Request &request, Request &evicted)
+    {
+        if (m_capacity == 0 || m_depth < m_capacity)
+        {
+            Push(request);
+            m_admitted++;
+            return ADMITTED;
+        }
+
+        bool evict = false;
+        if (m_policy == PAYMENT_PRIORITY)
+        {
+            evict = request.payment > -std::prev(m_byPayment.end())->first.first;
+        }
+        else if (m_policy == FAIR_SHARE)
+        {
+            // Longest queue drop: the arrival goes unless another node has more waiting
+            uint32_t longest = 0;
+            for (auto &flow : m_flows)
+            {
+                longest = std::max(longest, (uint32_t)flow.second.requests.size());
+            }
+            evict = GetDepth(request.rsuNodeId) < longest;
+        }
+
+        if (!evict)
+        {
+            m_rejected++;
+            return REJECTED;
+        }
+        evicted = PopVictim();
+        Push(request);
+        m_admitted++;
+        m_evicted++;
+        return EVICTED;
+    }
+
+    bool
+    AdmissionQueue::Dequeue(Request &request, Time now)
+    {
+        if (!PopNext(request))
+        {
+            return false;
+        }
+        m_depth--;
+
+        if (m_backlogged)
+        {
+            double gap = (now - m_lastDequeue).GetSeconds();
+            m_meanGap = m_gapSamples > 0 ? 0.875 * m_meanGap + 0.125 * gap : gap;
+            m_gapSamples++;
+        }
+        m_backlogged = m_depth > 0;
+        m_lastDequeue = now;
+
+        double wait = (now - request.arrival).GetSeconds();
+        m_served++;
+        m_totalWait += wait;
+        m_maxWait = std::max(m_maxWait, wait);
+        return true;
+    }
+
+    bool
+    AdmissionQueue::IsEmpty(void) const
+    {
+        return m_depth == 0;
+    }
+
+    uint32_t
+    AdmissionQueue::GetDepth(void) const
+    {
+        return m_depth;
+    }
+
+    uint32_t
+    AdmissionQueue::GetDepth(uint32_t rsuNodeId) const
+    {
+        switch (m_policy)
+        {
+            case TAIL_DROP:
+                return std::count_if(m_fifo.begin(), m_fifo.end(),
+                                     [rsuNodeId](const Request &request) { return request.rsuNodeId == rsuNodeId; });
+            case PAYMENT_PRIORITY:
+                return std::count_if(m_byPayment.begin(), m_byPayment.end(),
+                                     [rsuNodeId](const std::pair<const std::pair<double, uint64_t>, Request> &entry) {
+                                         return entry.second.rsuNodeId == rsuNodeId;
+                                     });
+            case FAIR_SHARE:
+            {
+                std::map<uint32_t, Flow>::const_iterator flow = m_flows.find(rsuNodeId);
+                return flow != m_flows.end() ? flow->second.requests.size() : 0;
+            }
+        }
+        return 0;
+    }
+
+    bool
+    AdmissionQueue::IsCongested(uint32_t rsuNodeId) const
+    {
+        if (m_capacity == 0 || m_depth < m_watermark * m_capacity)
+        {
+            return false;
+        }
+        if (m_policy != FAIR_SHARE)
+        {
+            return true;
+        }
+        return GetDepth(rsuNodeId) >= m_watermark * m_capacity / std::max((size_t)1, m_flows.size());
+    }
+
+    Time
+    AdmissionQueue::GetDrainTime(uint32_t rsuNodeId) const
+    {
+        // Under round robin the node's backlog leaves one request per round of every backlogged node
+        double requests = m_policy == FAIR_SHARE ? (double)GetDepth(rsuNodeId) * m_flows.size() : m_depth;
+        return Seconds(requests * m_meanGap);
+    }
+
+    uint64_t
+    AdmissionQueue::GetAdmitted(void) const
+    {
+        return m_admitted;
+    }
+
+    uint64_t
+    AdmissionQueue::GetRejected(void) const
+    {
+        return m_rejected;
+    }
+
+    uint64_t
+    AdmissionQueue::GetEvicted(void) const
+    {
+        return m_evicted;
+    }
+
+    uint32_t
+    AdmissionQueue::GetMaxDepth(void) const
+    {
+        return m_maxDepth;
+    }
+
+    double
+    AdmissionQueue::GetMeanWait(void) const
+    {
+        return m_served > 0 ? m_totalWait / m_served : 0;
+    }
+
+    double
+    AdmissionQueue::GetMaxWait(void) const
+    {
+        return m_maxWait;
+    }
+
+    void
+    AdmissionQueue::Push(const Request &request)
+    {
+        switch (m_policy)
+        {
+            case TAIL_DROP:
+                m_fifo.push_back(request);
+                break;
+            case PAYMENT_PRIORITY:
+                m_byPayment.insert(std::make_pair(std::make_pair(-request.payment, m_sequence++), request));
+                break;
+            case FAIR_SHARE:
+            {
+                Flow &flow = m_flows[request.rsuNodeId];
+                if (flow.requests.empty())
+                {
+                    flow.deficit = 0;
+                    flow.granted = false;
+                    m_activeFlows.push_back(request.rsuNodeId);
+                }
+                flow.requests.push_back(request);
+                break;
+            }
+        }
+        m_depth++;
+        m_maxDepth = std::max(m_maxDepth, m_depth);
+    }
+
+    AdmissionQueue::Request
+    AdmissionQueue::PopVictim(void)
+    {
+        Request victim;
+        if (m_policy == PAYMENT_PRIORITY)
+        {
+            std::multimap<std::pair<double, uint64_t>, Request>::iterator lowest = std::prev(m_byPayment.end());
+            victim = lowest->second;
+            m_byPayment.erase(lowest);
+        }
+        else
+        {
+            std::map<uint32_t, Flow>::iterator longest = m_flows.begin();
+            for (std::map<uint32_t, Flow>::iterator flow = m_flows.begin(); flow != m_flows.end(); ++flow)
+            {
+                if (flow->second.requests.size() > longest->second.requests.size())
+                {
+                    longest = flow;
+                }
+            }
+            victim = longest->second.requests.back();
+            longest->second.requests.pop_back();
+            if (longest->second.requests.empty())
+            {
+                m_activeFlows.erase(std::find(m_activeFlows.begin(), m_activeFlows.end(), longest->first));
+                m_flows.erase(longest);
+            }
+        }
+        m_depth--;
+        return victim;
+    }
+
+    bool
+    AdmissionQueue::PopNext(Request &request)
+    {
+        switch (m_policy)
+        {
+            case TAIL_DROP:
+                if (m_fifo.empty())
+                {
+                    return false;
+                }
+                request = m_fifo.front();
+                m_fifo.pop_front();
+                return true;
+            case PAYMENT_PRIORITY:
+                if (m_byPayment.empty())
+                {
+                    return false;
+                }
+                request = m_byPayment.begin()->second;
+                m_byPayment.erase(m_byPayment.begin());
+                return true;
+            case FAIR_SHARE:
+                break;
+        }
+
+        // Deficit round robin, one request at a time: the node at the front gets its quantum
+        // once per round and keeps the turn while its deficit covers its next request
+        while (!m_activeFlows.empty())
+        {
+            uint32_t rsuNodeId = m_activeFlows.front();
+            Flow &flow = m_flows[rsuNodeId];
+            uint32_t size = flow.requests.front().message.size();
+            if (flow.deficit >= size)
+            {
+                flow.deficit -= size;
+                request = flow.requests.front();
+                flow.requests.pop_front();
+                if (flow.requests.empty())
+                {
+                    m_activeFlows.pop_front();
+                    m_flows.erase(rsuNodeId);
+                }
+                return true;
+            }
+            if (!flow.granted)
+            {
+                flow.deficit += m_quantum;
+                flow.granted = true;
+                continue;
+            }
+            flow.granted = false;
+            m_activeFlows.pop_front();
+            m_activeFlows.push_back(rsuNodeId);
+        }
+        return false;
+    }
+
+}
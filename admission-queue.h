@@ -0,0 +1,150 @@
+#ifndef ADMISSION_QUEUE_H
+#define ADMISSION_QUEUE_H
+
+#include "ns3/nstime.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace ns3 {
+
+    /*
+     * The bounded queue REQUEST_BLOCKs wait in before the cloud server ingests them.
+     *
+     *     TAIL_DROP         first come first served; a request that finds the queue full
+     *                       is turned away
+     *     PAYMENT_PRIORITY  the highest payment first; a full queue gives up its lowest
+     *                       payment for a higher one
+     *     FAIR_SHARE        deficit round robin over the rsu nodes, a quantum of bytes per
+     *                       round; a full queue gives up the last request of the node with
+     *                       the longest backlog, so a node that sends more than its share
+     *                       only delays itself
+     *
+     * The queue also tells the server which nodes to slow down: under the first two
+     * policies every sender once the queue is past its watermark, under FAIR_SHARE
+     * only the nodes whose backlog is past their share of it. The time it would take
+     * to drain a backlog comes from the rate requests left the queue at while it was
+     * not empty.
+     */
+    class AdmissionQueue
+    {
+        public:
+            enum Policy
+            {
+                TAIL_DROP,
+                PAYMENT_PRIORITY,
+                FAIR_SHARE,
+            };
+
+            struct Request
+            {
+                uint32_t rsuNodeId;
+                int transId;
+                double payment;
+                std::string message;            // the REQUEST_BLOCK as received
+                Time arrival;
+            };
+
+            enum Outcome
+            {
+                ADMITTED,
+                REJECTED,                       // the request was turned away
+                EVICTED,                        // the request was admitted in place of evicted
+            };
+
+            AdmissionQueue(void);
+            virtual ~AdmissionQueue(void);
+
+            /*
+             * "taildrop", "priority" or "fair"; false if name is none of them.
+             */
+            static bool ParsePolicy(const std::string &name, Policy &policy);
+            static const char* GetPolicyName(Policy policy);
+
+            void SetPolicy(Policy policy);
+            Policy GetPolicy(void) const;
+            /*
+             * Requests the queue holds, 0 for no bound.
+             */
+            void SetCapacity(uint32_t capacity);
+            /*
+             * Share of the capacity past which senders are asked to slow down.
+             */
+            void SetWatermark(double watermark);
+            /*
+             * Bytes a node may send per round of FAIR_SHARE.
+             */
+            void SetQuantum(uint32_t bytes);
+
+            Outcome Enqueue(const Request &request, Request &evicted);
+            /*
+             * The next request by the policy; false if the queue is empty.
+             */
+            bool Dequeue(Request &request, Time now);
+
+            bool IsEmpty(void) const;
+            uint32_t GetDepth(void) const;
+            uint32_t GetDepth(uint32_t rsuNodeId) const;
+
+            /*
+             * True if the node should slow down.
+             */
+            bool IsCongested(uint32_t rsuNodeId) const;
+            /*
+             * The time the backlog ahead of the node's next request takes to drain, 0 until
+             * the drain rate is known.
+             */
+            Time GetDrainTime(uint32_t rsuNodeId) const;
+
+            uint64_t GetAdmitted(void) const;
+            uint64_t GetRejected(void) const;
+            uint64_t GetEvicted(void) const;
+            uint32_t GetMaxDepth(void) const;
+            double GetMeanWait(void) const;
+            double GetMaxWait(void) const;
+
+        protected:
+            struct Flow
+            {
+                std::deque<Request> requests;
+                uint32_t deficit;               // bytes
+                bool granted;                   // got its quantum in this round
+            };
+
+            void Push(const Request &request);
+            /*
+             * Takes out the request the policy gives up first when the queue is full.
+             */
+            Request PopVictim(void);
+            bool PopNext(Request &request);
+
+            Policy m_policy;
+            uint32_t m_capacity;
+            double m_watermark;
+            uint32_t m_quantum;
+
+            std::deque<Request> m_fifo;                                 // TAIL_DROP
+            std::multimap<std::pair<double, uint64_t>, Request> m_byPayment;  // PAYMENT_PRIORITY, key (-payment, arrival order)
+            std::map<uint32_t, Flow> m_flows;                           // FAIR_SHARE, by rsu node
+            std::deque<uint32_t> m_activeFlows;                         // FAIR_SHARE, round robin order
+            uint32_t m_depth;
+            uint64_t m_sequence;
+
+            Time m_lastDequeue;
+            bool m_backlogged;                  // requests were left behind by the last dequeue
+            double m_meanGap;                   // seconds between dequeues of a backlog
+            uint64_t m_gapSamples;
+
+            uint64_t m_admitted;
+            uint64_t m_rejected;
+            uint64_t m_evicted;
+            uint32_t m_maxDepth;
+            uint64_t m_served;
+            double m_totalWait;
+            double m_maxWait;
+    };
+
+}
+
+#endif /* ADMISSION_QUEUE_H */
@@ -0,0 +1,309 @@
+#include "benchmarks.h"
+#include "block-executor.h"
+#include "ecdsa.h"
+#include "sha256.h"
+#include "smart-contract.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+    static double
+    ElapsedMilliSeconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int
+    RunBenchmark(const std::string &name, uint32_t size)
+    {
+        if (name == "ecdsa")
+        {
+            return RunEcdsaBenchmark(size);
+        }
+        if (name == "sha256")
+        {
+            return RunSha256Benchmark(size);
+        }
+        if (name == "contract")
+        {
+            return RunContractBenchmark(size);
+        }
+        if (name == "execution")
+        {
+            return RunExecutionBenchmark(size);
+        }
+
+        std::cerr << "Unknown benchmark " << name << std::endl;
+        return 1;
+    }
+
+    int
+    RunEcdsaBenchmark(uint32_t size)
+    {
+        const uint32_t numOfKeys = 8;
+        std::vector<SignatureCheck> checks;
+        std::pair<PublicKey, long> key;
+
+        // A few keys signing many messages, one in four signatures tampered with
+        for (uint32_t i = 0; i < size; i++)
+        {
+            if (i % (size / numOfKeys + 1) == 0)
+            {
+                key = ECDSA::generateKey();
+            }
+            PublicKey &publicKey = key.first;
+            long hashMsg = ECDSA::randRange(0, publicKey.p - 1);
+            std::pair<long, long> signature = ECDSA::generateSignature(publicKey, key.second, hashMsg);
+            if (i % 4 == 3)
+            {
+                signature.second = ECDSA::randRange(1, publicKey.n - 1);
+            }
+            checks.push_back({hashMsg, publicKey.p, publicKey.a, publicKey.n, publicKey.G.first, publicKey.G.second,
+                              publicKey.Q.first, publicKey.Q.second, signature.first, signature.second});
+        }
+
+        std::unique_ptr<bool[]> expected(new bool[checks.size()]);
+        std::unique_ptr<bool[]> results(new bool[checks.size()]);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ECDSA::checkSignatureBatchScalar(checks.data(), checks.size(), expected.get());
+        double scalarTime = ElapsedMilliSeconds(start);
+
+        uint32_t valid = 0;
+        for (size_t i = 0; i < checks.size(); i++)
+        {
+            valid += expected[i];
+        }
+        std::cout << "ECDSA batch verification of " << checks.size() << " signatures (" << valid << " valid)" << std::endl;
+        std::cout << "  scalar loop: " << scalarTime << " ms" << std::endl;
+
+        int status = 0;
+        const char *kernels[] = {"scalar", "avx2", "avx512"};
+        for (const char *kernel : kernels)
+        {
+            if (!ECDSA::setBatchKernel(kernel))
+            {
+                std::cout << "  " << kernel << ": not supported by this CPU" << std::endl;
+                continue;
+            }
+
+            start = std::chrono::steady_clock::now();
+            ECDSA::checkSignatureBatch(checks.data(), checks.size(), results.get());
+            double time = ElapsedMilliSeconds(start);
+
+            uint32_t mismatches = 0;
+            for (size_t i = 0; i < checks.size(); i++)
+            {
+                mismatches += results[i] != expected[i];
+            }
+            std::cout << "  " << kernel << ": " << time << " ms, speedup " << scalarTime / time
+                      << ", mismatches " << mismatches << std::endl;
+            if (mismatches)
+            {
+                status = 1;
+            }
+        }
+        ECDSA::setBatchKernel("auto");
+        std::cout << "  default kernel: " << ECDSA::batchKernelName() << std::endl;
+
+        return status;
+    }
+
+    int
+    RunSha256Benchmark(uint32_t size)
+    {
+        const unsigned int lengths[] = {32, 64, 256, 1024, 4096};
+        const char *backends[] = {"scalar", "sse2", "avx2", "shani"};
+        std::mt19937 random(1);
+        int status = 0;
+
+        for (const char *backend : backends)
+        {
+            if (!SHA256::setBackend(backend))
+            {
+                std::cout << "SHA256 " << backend << ": not supported by this CPU" << std::endl;
+            }
+        }
+
+        for (unsigned int length : lengths)
+        {
+            std::vector<unsigned char> data((size_t)size * length);
+            std::vector<const unsigned char *> messages(size);
+            std::vector<unsigned int> messageLengths(size, length);
+            for (size_t i = 0; i < data.size(); i++)
+            {
+                data[i] = (unsigned char)random();
+            }
+            for (uint32_t i = 0; i < size; i++)
+            {
+                messages[i] = &data[(size_t)i * length];
+            }
+
+            std::vector<unsigned char> expected((size_t)size * SHA256::DIGEST_SIZE);
+            std::vector<unsigned char> digests(expected.size());
+            SHA256::setBackend("scalar");
+            SHA256::hashBatch(messages.data(), messageLengths.data(), size, expected.data());
+
+            std::cout << "SHA256 of " << size << " messages of " << length << " bytes" << std::endl;
+            for (const char *backend : backends)
+            {
+                if (!SHA256::setBackend(backend))
+                {
+                    continue;
+                }
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                SHA256::hashBatch(messages.data(), messageLengths.data(), size, digests.data());
+                double batchTime = ElapsedMilliSeconds(start);
+                uint32_t mismatches = 0;
+                for (uint32_t i = 0; i < size; i++)
+                {
+                    mismatches += memcmp(&digests[i * SHA256::DIGEST_SIZE], &expected[i * SHA256::DIGEST_SIZE],
+                                         SHA256::DIGEST_SIZE) != 0;
+                }
+
+                start = std::chrono::steady_clock::now();
+                for (uint32_t i = 0; i < size; i++)
+                {
+                    SHA256 ctx;
+                    ctx.init();
+                    ctx.update(messages[i], length);
+                    ctx.final(&digests[i * SHA256::DIGEST_SIZE]);
+                }
+                double streamTime = ElapsedMilliSeconds(start);
+                for (uint32_t i = 0; i < size; i++)
+                {
+                    mismatches += memcmp(&digests[i * SHA256::DIGEST_SIZE], &expected[i * SHA256::DIGEST_SIZE],
+                                         SHA256::DIGEST_SIZE) != 0;
+                }
+
+                double megaBytes = (double)data.size() / 1e6;
+                std::cout << "  " << backend << ": batch " << megaBytes / (batchTime / 1e3) << " MB/s, one by one "
+                          << megaBytes / (streamTime / 1e3) << " MB/s, mismatches " << mismatches << std::endl;
+                if (mismatches)
+                {
+                    status = 1;
+                }
+            }
+        }
+        SHA256::setBackend("auto");
+        std::cout << "  default backend: " << SHA256::backendName() << std::endl;
+
+        return status;
+    }
+
+    int
+    RunContractBenchmark(uint32_t size)
+    {
+        const double threshold = 2.0;
+        std::map<std::string, double> constants;
+        constants["threshold"] = threshold;
+
+        SmartContract contract;
+        std::string error;
+        if (!contract.Compile(SmartContract::DefaultSource(), constants, error))
+        {
+            std::cerr << "Default contract rejected: " << error << std::endl;
+            return 1;
+        }
+
+        // Payments around the bounds, one in eight timestamps out of range
+        std::mt19937 random(1);
+        std::vector<Transaction> transactions;
+        std::unique_ptr<bool[]> expected(new bool[size]);
+        uint32_t valid = 0;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            double payment = std::uniform_real_distribution<double>(0, 4)(random) * (i % 16 == 5 ? 50000 : 1);
+            double timestamp = i % 8 == 3 ? 2e9 : std::uniform_real_distribution<double>(0, 1e6)(random);
+            transactions.push_back(Transaction(random() % 16 + 1, i, timestamp, payment, random() % 16));
+            expected[i] = payment >= threshold && payment < 100000.0 && timestamp >= 0.0 && timestamp < 1000000000.0;
+            valid += expected[i];
+        }
+
+        std::unique_ptr<bool[]> results(new bool[size]);
+        uint32_t mismatches = 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < size; i++)
+        {
+            results[i] = contract.Evaluate(transactions[i]);
+        }
+        double scalarTime = ElapsedMilliSeconds(start);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            mismatches += results[i] != expected[i];
+        }
+
+        start = std::chrono::steady_clock::now();
+        contract.Evaluate(transactions.data(), size, results.get());
+        double batchTime = ElapsedMilliSeconds(start);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            mismatches += results[i] != expected[i];
+        }
+
+        std::cout << "Contract of " << contract.GetNumberOfInstructions() << " instructions on " << size
+                  << " transactions (" << valid << " valid)" << std::endl;
+        std::cout << "  one by one: " << scalarTime << " ms, " << scalarTime * 1e6 / size << " ns per transaction" << std::endl;
+        std::cout << "  batch: " << batchTime << " ms, " << batchTime * 1e6 / size << " ns per transaction" << std::endl;
+        std::cout << "  mismatches " << mismatches << std::endl;
+
+        return mismatches ? 1 : 0;
+    }
+
+    int
+    RunExecutionBenchmark(uint32_t size)
+    {
+        const uint32_t work = 64;
+        unsigned int threads = std::max(std::thread::hardware_concurrency(), 4u);
+        size = std::max(size, 2u);
+
+        std::cout << "Block of " << size << " payments, " << work << " SHA256 rounds each, " << threads << " threads on "
+                  << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+        int status = 0;
+        for (uint32_t accounts : {4 * size, 256u, 32u, 8u, 2u})
+        {
+            std::mt19937 random(accounts);
+            std::vector<Transaction> transactions;
+            for (uint32_t i = 0; i < size; i++)
+            {
+                uint32_t payer = random() % accounts;
+                uint32_t payee = (payer + 1 + random() % (accounts - 1)) % accounts;
+                transactions.push_back(Transaction(payer, i, i, std::uniform_real_distribution<double>(1, 200)(random), payee));
+            }
+
+            BlockExecutor sequential;
+            sequential.SetInitialBalance(1000);
+            sequential.SetWorkPerTransaction(work);
+            BlockExecutor::State expected;
+            BlockExecutor::Result reference = sequential.ExecuteSequential(transactions, expected);
+
+            BlockExecutor parallel;
+            parallel.SetInitialBalance(1000);
+            parallel.SetWorkPerTransaction(work);
+            parallel.SetNumberOfThreads(threads);
+            BlockExecutor::State state;
+            BlockExecutor::Result result = parallel.Execute(transactions, state);
+
+            bool same = state == expected && result.settled == reference.settled;
+            status |= same ? 0 : 1;
+
+            std::cout << "  " << accounts << " accounts: sequential " << reference.seconds * 1e3 << " ms, parallel "
+                      << result.seconds * 1e3 << " ms, speedup " << reference.seconds / result.seconds << ", "
+                      << result.aborts << " aborts, " << result.dependencies << " waits, "
+                      << (double)result.executions / size << " executions per transaction"
+                      << (same ? "" : ", MISMATCH") << std::endl;
+        }
+
+        return status;
+    }
+
+}
@@ -0,0 +1,44 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <string>
+#include <cstdint>
+
+namespace ns3 {
+
+    /*
+     * Offline micro-benchmarks, run from main.cc with --benchmark=<name> instead of the simulation.
+     * Returns the process exit status: 0 on success, 1 if the benchmark failed or is unknown.
+     */
+    int RunBenchmark(const std::string &name, uint32_t size);
+
+    /*
+     * Times ECDSA::checkSignatureBatch on every kernel the CPU supports against the scalar
+     * loop, on `size` signatures with a share of them forged, and checks that all agree.
+     */
+    int RunEcdsaBenchmark(uint32_t size);
+
+    /*
+     * Times SHA256 on every backend the CPU supports, `size` messages of each of a few
+     * lengths, both through SHA256::hashBatch and one message at a time through
+     * init/update/final, and checks every digest against the portable code.
+     */
+    int RunSha256Benchmark(uint32_t size);
+
+    /*
+     * Times SmartContract::Evaluate on the default contract, one transaction at a time
+     * and in one batch, on `size` transactions of which some break the contract, and
+     * checks both against the original hand-written condition.
+     */
+    int RunContractBenchmark(uint32_t size);
+
+    /*
+     * Times BlockExecutor::Execute against ExecuteSequential on blocks of `size` payments
+     * between fewer and fewer accounts, so more and more of them conflict, and checks
+     * that both leave the same balances.
+     */
+    int RunExecutionBenchmark(uint32_t size);
+
+}
+
+#endif /* BENCHMARKS_H */
@@ -0,0 +1,127 @@
+#include "block-builder.h"
+#include <algorithm>
+
+namespace ns3 {
+
+    BlockBuilder::BlockBuilder(void)
+    {
+        m_maxTransactions = 0;
+        m_maxSizeBytes = 0;
+        m_minInterval = Seconds(0);
+        m_maxInterval = Seconds(0);
+        m_sizeBytes = Block::HEADER_SIZE;
+        m_lastArrival = Seconds(-1);
+        m_meanGap = 0;
+        m_gapSamples = 0;
+    }
+
+    BlockBuilder::~BlockBuilder(void)
+    {
+    }
+
+    void
+    BlockBuilder::SetLimits(uint32_t maxTransactions, uint32_t maxSizeBytes)
+    {
+        m_maxTransactions = maxTransactions;
+        m_maxSizeBytes = maxSizeBytes;
+    }
+
+    void
+    BlockBuilder::SetInterval(Time minInterval, Time maxInterval)
+    {
+        m_minInterval = minInterval;
+        m_maxInterval = std::max(minInterval, maxInterval);
+    }
+
+    bool
+    BlockBuilder::Fits(const Transaction &transaction) const
+    {
+        return m_transactions.empty() || m_maxSizeBytes == 0
+               || m_sizeBytes + transaction.GetTransSizeByte() <= m_maxSizeBytes;
+    }
+
+    void
+    BlockBuilder::Add(const Transaction &transaction, Time now)
+    {
+        if (m_lastArrival >= Seconds(0))
+        {
+            // The same weight TCP gives a new round trip sample
+            double gap = (now - m_lastArrival).GetSeconds();
+            m_meanGap = m_gapSamples > 0 ? 0.875 * m_meanGap + 0.125 * gap : gap;
+            m_gapSamples++;
+        }
+        m_lastArrival = now;
+
+        if (m_transactions.empty())
+        {
+            m_deadline = now + AdaptiveInterval();
+        }
+        m_transactions.push_back(transaction);
+        m_sizeBytes += transaction.GetTransSizeByte();
+    }
+
+    bool
+    BlockBuilder::IsFull(void) const
+    {
+        return (m_maxTransactions > 0 && m_transactions.size() >= m_maxTransactions)
+               || (m_maxSizeBytes > 0 && m_sizeBytes >= m_maxSizeBytes);
+    }
+
+    bool
+    BlockBuilder::IsEmpty(void) const
+    {
+        return m_transactions.empty();
+    }
+
+    Time
+    BlockBuilder::GetDeadline(void) const
+    {
+        return m_deadline;
+    }
+
+    std::vector<Transaction>
+    BlockBuilder::Take(void)
+    {
+        std::vector<Transaction> transactions;
+        transactions.swap(m_transactions);
+        m_sizeBytes = Block::HEADER_SIZE;
+        return transactions;
+    }
+
+    uint32_t
+    BlockBuilder::GetNumberOfTransactions(void) const
+    {
+        return m_transactions.size();
+    }
+
+    uint32_t
+    BlockBuilder::GetSizeBytes(void) const
+    {
+        return m_sizeBytes;
+    }
+
+    double
+    BlockBuilder::GetArrivalRate(void) const
+    {
+        return m_meanGap > 0 ? 1.0 / m_meanGap : 0;
+    }
+
+    Time
+    BlockBuilder::AdaptiveInterval(void) const
+    {
+        if (m_maxTransactions == 0)
+        {
+            return m_maxInterval;
+        }
+
+        // The share of a full block the current rate brings in over the longest interval
+        double load = 0;
+        if (m_gapSamples > 0)
+        {
+            load = m_meanGap > 0 ? m_maxInterval.GetSeconds() / m_meanGap / m_maxTransactions : 1;
+        }
+        Time interval = Seconds(m_maxInterval.GetSeconds() * std::min(load, 1.0));
+        return std::max(interval, m_minInterval);
+    }
+
+}
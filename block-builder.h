@@ -0,0 +1,80 @@
+#ifndef BLOCK_BUILDER_H
+#define BLOCK_BUILDER_H
+
+#include "blockchain.h"
+#include "ns3/nstime.h"
+#include <cstdint>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Collects verified transactions into the next block.
+     *
+     * A block is cut when it holds the maximum number of transactions, when the next
+     * transaction would take it past the maximum size, or when its deadline passes,
+     * whichever comes first. The deadline is set when the first transaction opens
+     * the block: the longest interval under a load that fills blocks by count within
+     * it, and shorter in proportion as the arrival rate falls, down to the shortest
+     * interval, since waiting for transactions that are unlikely to come only adds
+     * latency. The arrival rate is a moving average of the gaps between transactions.
+     */
+    class BlockBuilder
+    {
+        public:
+            BlockBuilder(void);
+            virtual ~BlockBuilder(void);
+
+            /*
+             * 0 for either limit leaves it out.
+             */
+            void SetLimits(uint32_t maxTransactions, uint32_t maxSizeBytes);
+            void SetInterval(Time minInterval, Time maxInterval);
+
+            /*
+             * True if the transaction fits in the open block, or if the block is empty.
+             */
+            bool Fits(const Transaction &transaction) const;
+            void Add(const Transaction &transaction, Time now);
+            bool IsFull(void) const;
+            bool IsEmpty(void) const;
+
+            /*
+             * When the open block has to be cut, fixed when its first transaction arrived.
+             */
+            Time GetDeadline(void) const;
+
+            /*
+             * The transactions of the open block, in arrival order, which leaves it empty.
+             */
+            std::vector<Transaction> Take(void);
+
+            uint32_t GetNumberOfTransactions(void) const;
+            /*
+             * The block header and every transaction.
+             */
+            uint32_t GetSizeBytes(void) const;
+            /*
+             * Transactions per second, 0 until two have arrived at different times.
+             */
+            double GetArrivalRate(void) const;
+
+        protected:
+            Time AdaptiveInterval(void) const;
+
+            uint32_t m_maxTransactions;
+            uint32_t m_maxSizeBytes;
+            Time m_minInterval;
+            Time m_maxInterval;
+
+            std::vector<Transaction> m_transactions;
+            uint32_t m_sizeBytes;
+            Time m_deadline;
+            Time m_lastArrival;
+            double m_meanGap;               // seconds
+            uint64_t m_gapSamples;
+    };
+
+}
+
+#endif /* BLOCK_BUILDER_H */
@@ -0,0 +1,793 @@
+#include "block-executor.h"
+#include "ecdsa.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ns3 {
+
+    /*
+     * The writes of every transaction of the block, per account, and what each
+     * transaction read and wrote in its last execution.
+     */
+    class BlockExecutor::MultiVersionMemory
+    {
+        public:
+            enum ReadStatus
+            {
+                OK,
+                NOT_FOUND,          // no transaction before the reader wrote the account
+                ESTIMATE,           // the last writer before the reader was aborted
+            };
+
+            struct ReadDescriptor
+            {
+                uint32_t slot;
+                bool fromStorage;
+                uint32_t writer;
+                uint32_t incarnation;
+            };
+
+            typedef std::vector<std::pair<uint32_t, double>> WriteSet;     // (slot, balance)
+
+            MultiVersionMemory(uint32_t numberOfSlots, uint32_t numberOfTransactions)
+                : m_slots(new Slot[numberOfSlots]),
+                  m_sets(new Sets[numberOfTransactions])
+            {
+            }
+
+            ReadStatus
+            Read(uint32_t slot, uint32_t index, double &value, uint32_t &writer, uint32_t &incarnation)
+            {
+                std::lock_guard<std::mutex> lock(m_slots[slot].mutex);
+                std::map<uint32_t, Entry> &versions = m_slots[slot].versions;
+                std::map<uint32_t, Entry>::iterator it = versions.lower_bound(index);
+                if (it == versions.begin())
+                {
+                    return NOT_FOUND;
+                }
+                --it;
+                writer = it->first;
+                if (it->second.estimate)
+                {
+                    return ESTIMATE;
+                }
+                incarnation = it->second.incarnation;
+                value = it->second.value;
+                return OK;
+            }
+
+            /*
+             * Stores the result of an execution; true if it wrote an account the previous
+             * incarnation did not, which the transactions after it have to be validated against.
+             */
+            bool
+            Record(uint32_t index, uint32_t incarnation, std::vector<ReadDescriptor> &reads, const WriteSet &writes)
+            {
+                std::vector<uint32_t> written;
+                for (const std::pair<uint32_t, double> &write : writes)
+                {
+                    std::lock_guard<std::mutex> lock(m_slots[write.first].mutex);
+                    Entry &entry = m_slots[write.first].versions[index];
+                    entry.incarnation = incarnation;
+                    entry.value = write.second;
+                    entry.estimate = false;
+                    written.push_back(write.first);
+                }
+                std::sort(written.begin(), written.end());
+
+                std::lock_guard<std::mutex> lock(m_sets[index].mutex);
+                bool wroteNewLocation = false;
+                for (uint32_t slot : written)
+                {
+                    wroteNewLocation |= !std::binary_search(m_sets[index].written.begin(), m_sets[index].written.end(), slot);
+                }
+                for (uint32_t slot : m_sets[index].written)
+                {
+                    if (!std::binary_search(written.begin(), written.end(), slot))
+                    {
+                        std::lock_guard<std::mutex> slotLock(m_slots[slot].mutex);
+                        m_slots[slot].versions.erase(index);
+                    }
+                }
+                m_sets[index].written.swap(written);
+                m_sets[index].read.swap(reads);
+                return wroteNewLocation;
+            }
+
+            void
+            ConvertWritesToEstimates(uint32_t index)
+            {
+                std::lock_guard<std::mutex> lock(m_sets[index].mutex);
+                for (uint32_t slot : m_sets[index].written)
+                {
+                    std::lock_guard<std::mutex> slotLock(m_slots[slot].mutex);
+                    m_slots[slot].versions[index].estimate = true;
+                }
+            }
+
+            /*
+             * True if every read of the last execution would still see the same version.
+             */
+            bool
+            ValidateReadSet(uint32_t index)
+            {
+                std::vector<ReadDescriptor> reads;
+                {
+                    std::lock_guard<std::mutex> lock(m_sets[index].mutex);
+                    reads = m_sets[index].read;
+                }
+
+                for (const ReadDescriptor &read : reads)
+                {
+                    double value;
+                    uint32_t writer = 0, incarnation = 0;
+                    ReadStatus status = Read(read.slot, index, value, writer, incarnation);
+                    if (read.fromStorage ? status != NOT_FOUND
+                                         : status != OK || writer != read.writer || incarnation != read.incarnation)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /*
+             * The value of the last transaction of the block that wrote the slot.
+             */
+            bool
+            Latest(uint32_t slot, double &value) const
+            {
+                const std::map<uint32_t, Entry> &versions = m_slots[slot].versions;
+                if (versions.empty())
+                {
+                    return false;
+                }
+                value = versions.rbegin()->second.value;
+                return true;
+            }
+
+        protected:
+            struct Entry
+            {
+                uint32_t incarnation;
+                double value;
+                bool estimate;
+            };
+
+            struct Slot
+            {
+                std::mutex mutex;
+                std::map<uint32_t, Entry> versions;     // by transaction index
+            };
+
+            struct Sets
+            {
+                std::mutex mutex;
+                std::vector<ReadDescriptor> read;
+                std::vector<uint32_t> written;          // sorted slots
+            };
+
+            std::unique_ptr<Slot[]> m_slots;
+            std::unique_ptr<Sets[]> m_sets;
+    };
+
+    /*
+     * Hands out execution and validation tasks, lowest transaction first.
+     */
+    class BlockExecutor::Scheduler
+    {
+        public:
+            enum Kind
+            {
+                NONE,
+                EXECUTION,
+                VALIDATION,
+            };
+
+            struct Task
+            {
+                Kind kind;
+                uint32_t index;
+                uint32_t incarnation;
+            };
+
+            explicit Scheduler(uint32_t numberOfTransactions)
+                : m_size(numberOfTransactions),
+                  m_executionIndex(0),
+                  m_validationIndex(0),
+                  m_decreaseCount(0),
+                  m_activeTasks(0),
+                  m_done(false),
+                  m_status(new Status[numberOfTransactions]),
+                  m_dependencies(new Dependencies[numberOfTransactions])
+            {
+            }
+
+            bool
+            Done(void) const
+            {
+                return m_done.load();
+            }
+
+            Task
+            NextTask(void)
+            {
+                if (m_validationIndex.load() < m_executionIndex.load())
+                {
+                    return NextVersionToValidate();
+                }
+                return NextVersionToExecute();
+            }
+
+            /*
+             * Parks transaction index until blocking has executed again; false if it already has.
+             */
+            bool
+            AddDependency(uint32_t index, uint32_t blocking)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_dependencies[blocking].mutex);
+                    {
+                        std::lock_guard<std::mutex> statusLock(m_status[blocking].mutex);
+                        if (m_status[blocking].state == EXECUTED)
+                        {
+                            return false;
+                        }
+                    }
+                    {
+                        std::lock_guard<std::mutex> statusLock(m_status[index].mutex);
+                        m_status[index].state = ABORTING;
+                    }
+                    m_dependencies[blocking].waiting.push_back(index);
+                }
+                m_activeTasks--;
+                return true;
+            }
+
+            Task
+            FinishExecution(uint32_t index, uint32_t incarnation, bool wroteNewLocation)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_status[index].mutex);
+                    m_status[index].state = EXECUTED;
+                }
+
+                std::vector<uint32_t> waiting;
+                {
+                    std::lock_guard<std::mutex> lock(m_dependencies[index].mutex);
+                    waiting.swap(m_dependencies[index].waiting);
+                }
+                ResumeDependencies(waiting);
+
+                if (m_validationIndex.load() > index)
+                {
+                    if (!wroteNewLocation)
+                    {
+                        // Only this transaction has to be validated again
+                        Task task = {VALIDATION, index, incarnation};
+                        return task;
+                    }
+                    DecreaseValidationIndex(index);
+                }
+                m_activeTasks--;
+                return None();
+            }
+
+            /*
+             * Claims the abort of a failed validation; false if another validator already did.
+             */
+            bool
+            TryValidationAbort(uint32_t index, uint32_t incarnation)
+            {
+                std::lock_guard<std::mutex> lock(m_status[index].mutex);
+                if (m_status[index].incarnation == incarnation && m_status[index].state == EXECUTED)
+                {
+                    m_status[index].state = ABORTING;
+                    return true;
+                }
+                return false;
+            }
+
+            Task
+            FinishValidation(uint32_t index, bool aborted)
+            {
+                if (aborted)
+                {
+                    SetReady(index);
+                    DecreaseValidationIndex(index + 1);
+                    if (m_executionIndex.load() > index)
+                    {
+                        Task task = TryIncarnate(index);
+                        if (task.kind != NONE)
+                        {
+                            return task;
+                        }
+                    }
+                }
+                m_activeTasks--;
+                return None();
+            }
+
+        protected:
+            enum State
+            {
+                READY_TO_EXECUTE,
+                EXECUTING,
+                EXECUTED,
+                ABORTING,
+            };
+
+            struct Status
+            {
+                std::mutex mutex;
+                uint32_t incarnation = 0;
+                State state = READY_TO_EXECUTE;
+            };
+
+            struct Dependencies
+            {
+                std::mutex mutex;
+                std::vector<uint32_t> waiting;
+            };
+
+            static Task
+            None(void)
+            {
+                Task task = {NONE, 0, 0};
+                return task;
+            }
+
+            Task
+            TryIncarnate(uint32_t index)
+            {
+                if (index < m_size)
+                {
+                    std::lock_guard<std::mutex> lock(m_status[index].mutex);
+                    if (m_status[index].state == READY_TO_EXECUTE)
+                    {
+                        m_status[index].state = EXECUTING;
+                        Task task = {EXECUTION, index, m_status[index].incarnation};
+                        return task;
+                    }
+                }
+                return None();
+            }
+
+            Task
+            NextVersionToExecute(void)
+            {
+                if (m_executionIndex.load() >= m_size)
+                {
+                    CheckDone();
+                    return None();
+                }
+                m_activeTasks++;
+                Task task = TryIncarnate(m_executionIndex++);
+                if (task.kind == NONE)
+                {
+                    m_activeTasks--;
+                }
+                return task;
+            }
+
+            Task
+            NextVersionToValidate(void)
+            {
+                if (m_validationIndex.load() >= m_size)
+                {
+                    CheckDone();
+                    return None();
+                }
+                m_activeTasks++;
+                uint32_t index = m_validationIndex++;
+                if (index < m_size)
+                {
+                    std::lock_guard<std::mutex> lock(m_status[index].mutex);
+                    if (m_status[index].state == EXECUTED)
+                    {
+                        Task task = {VALIDATION, index, m_status[index].incarnation};
+                        return task;
+                    }
+                }
+                m_activeTasks--;
+                return None();
+            }
+
+            void
+            SetReady(uint32_t index)
+            {
+                std::lock_guard<std::mutex> lock(m_status[index].mutex);
+                m_status[index].incarnation++;
+                m_status[index].state = READY_TO_EXECUTE;
+            }
+
+            void
+            ResumeDependencies(const std::vector<uint32_t> &waiting)
+            {
+                if (waiting.empty())
+                {
+                    return;
+                }
+                for (uint32_t index : waiting)
+                {
+                    SetReady(index);
+                }
+                DecreaseExecutionIndex(*std::min_element(waiting.begin(), waiting.end()));
+            }
+
+            void
+            DecreaseExecutionIndex(uint32_t target)
+            {
+                uint32_t current = m_executionIndex.load();
+                while (target < current && !m_executionIndex.compare_exchange_weak(current, target))
+                {
+                }
+                m_decreaseCount++;
+            }
+
+            void
+            DecreaseValidationIndex(uint32_t target)
+            {
+                uint32_t current = m_validationIndex.load();
+                while (target < current && !m_validationIndex.compare_exchange_weak(current, target))
+                {
+                }
+                m_decreaseCount++;
+            }
+
+            void
+            CheckDone(void)
+            {
+                // The count catches an index that went back down while the others were read
+                uint64_t observed = m_decreaseCount.load();
+                if (std::min(m_executionIndex.load(), m_validationIndex.load()) >= m_size
+                    && m_activeTasks.load() == 0 && observed == m_decreaseCount.load())
+                {
+                    m_done = true;
+                }
+            }
+
+            const uint32_t m_size;
+            std::atomic<uint32_t> m_executionIndex;
+            std::atomic<uint32_t> m_validationIndex;
+            std::atomic<uint64_t> m_decreaseCount;
+            std::atomic<int64_t> m_activeTasks;
+            std::atomic<bool> m_done;
+            std::unique_ptr<Status[]> m_status;
+            std::unique_ptr<Dependencies[]> m_dependencies;
+    };
+
+    BlockExecutor::BlockExecutor(void)
+    {
+        m_numberOfThreads = 1;
+        m_initialBalance = 0;
+        m_contract = nullptr;
+        m_workPerTransaction = 0;
+        m_totalTransactions = 0;
+        m_totalExecutions = 0;
+        m_totalSeconds = 0;
+    }
+
+    BlockExecutor::~BlockExecutor(void)
+    {
+    }
+
+    void
+    BlockExecutor::SetNumberOfThreads(unsigned int numberOfThreads)
+    {
+        m_numberOfThreads = numberOfThreads > 0 ? numberOfThreads : 1;
+    }
+
+    unsigned int
+    BlockExecutor::GetNumberOfThreads(void) const
+    {
+        return m_numberOfThreads;
+    }
+
+    void
+    BlockExecutor::SetInitialBalance(double balance)
+    {
+        m_initialBalance = balance;
+    }
+
+    void
+    BlockExecutor::SetContract(const SmartContract *contract)
+    {
+        m_contract = contract;
+    }
+
+    void
+    BlockExecutor::SetWorkPerTransaction(uint32_t rounds)
+    {
+        m_workPerTransaction = rounds;
+    }
+
+    uint64_t
+    BlockExecutor::GetTotalTransactions(void) const
+    {
+        return m_totalTransactions;
+    }
+
+    uint64_t
+    BlockExecutor::GetTotalExecutions(void) const
+    {
+        return m_totalExecutions;
+    }
+
+    double
+    BlockExecutor::GetTotalSeconds(void) const
+    {
+        return m_totalSeconds;
+    }
+
+    void
+    BlockExecutor::Work(const Transaction &transaction) const
+    {
+        if (m_workPerTransaction == 0)
+        {
+            return;
+        }
+        Sha256Digest digest = ECDSA::sha256Digest(transaction.GetSigningPayload());
+        for (uint32_t i = 1; i < m_workPerTransaction; i++)
+        {
+            SHA256 ctx;
+            ctx.init();
+            ctx.update(digest.data(), digest.size());
+            ctx.final(digest.data());
+        }
+    }
+
+    template <typename Read>
+    bool
+    BlockExecutor::Run(const Transaction &transaction, Read read, std::vector<std::pair<uint32_t, double>> &writes,
+                       bool &settled) const
+    {
+        settled = false;
+        writes.clear();
+
+        Work(transaction);
+        if (m_contract && !m_contract->Evaluate(transaction))
+        {
+            return true;
+        }
+
+        uint32_t payer = GetPayerAccount(transaction);
+        uint32_t payee = GetPayeeAccount(transaction);
+        double payment = transaction.GetPayment();
+
+        double balance;
+        if (!read(payer, balance))
+        {
+            return false;
+        }
+        if (payment < 0 || balance < payment)
+        {
+            return true;
+        }
+        settled = true;
+        if (payer == payee)
+        {
+            return true;
+        }
+
+        double received;
+        if (!read(payee, received))
+        {
+            return false;
+        }
+        writes.push_back(std::make_pair(payer, balance - payment));
+        writes.push_back(std::make_pair(payee, received + payment));
+        return true;
+    }
+
+    uint32_t
+    BlockExecutor::GetPayerAccount(const Transaction &transaction)
+    {
+        return (uint32_t)transaction.GetRsuNodeId();
+    }
+
+    uint32_t
+    BlockExecutor::GetPayeeAccount(const Transaction &transaction)
+    {
+        return WINNER_ACCOUNT | (uint32_t)transaction.GetWinnerId();
+    }
+
+    BlockExecutor::Result
+    BlockExecutor::ExecuteSequential(const std::vector<Transaction> &transactions, State &state)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        Result result;
+        result.settled.resize(transactions.size());
+        result.executions = transactions.size();
+        result.aborts = 0;
+        result.dependencies = 0;
+
+        auto read = [&](uint32_t account, double &value)
+        {
+            State::const_iterator it = state.find(account);
+            value = it != state.end() ? it->second : m_initialBalance;
+            return true;
+        };
+
+        std::vector<std::pair<uint32_t, double>> writes;
+        for (uint32_t i = 0; i < transactions.size(); i++)
+        {
+            bool settled;
+            Run(transactions[i], read, writes, settled);
+            result.settled[i] = settled;
+            for (const std::pair<uint32_t, double> &write : writes)
+            {
+                state[write.first] = write.second;
+            }
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        Account(result, transactions.size());
+        return result;
+    }
+
+    BlockExecutor::Result
+    BlockExecutor::Execute(const std::vector<Transaction> &transactions, State &state)
+    {
+        if (m_numberOfThreads == 1 || transactions.size() < 2)
+        {
+            return ExecuteSequential(transactions, state);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const uint32_t size = transactions.size();
+
+        // Every account the block can touch gets a slot, read from the state before the block
+        std::map<uint32_t, uint32_t> slotOfAccount;
+        std::vector<uint32_t> accounts;
+        for (const Transaction &transaction : transactions)
+        {
+            for (uint32_t account : {GetPayerAccount(transaction), GetPayeeAccount(transaction)})
+            {
+                if (slotOfAccount.insert(std::make_pair(account, (uint32_t)accounts.size())).second)
+                {
+                    accounts.push_back(account);
+                }
+            }
+        }
+        std::vector<double> storage(accounts.size());
+        for (uint32_t slot = 0; slot < accounts.size(); slot++)
+        {
+            State::const_iterator it = state.find(accounts[slot]);
+            storage[slot] = it != state.end() ? it->second : m_initialBalance;
+        }
+
+        MultiVersionMemory memory(accounts.size(), size);
+        Scheduler scheduler(size);
+        std::unique_ptr<char[]> settled(new char[size]());
+        std::atomic<uint64_t> executions(0);
+        std::atomic<uint64_t> aborts(0);
+        std::atomic<uint64_t> dependencies(0);
+
+        auto tryExecute = [&](Scheduler::Task task)
+        {
+            std::vector<MultiVersionMemory::ReadDescriptor> reads;
+            std::vector<std::pair<uint32_t, double>> writes;
+            uint32_t blocking = 0;
+
+            auto read = [&](uint32_t account, double &value)
+            {
+                MultiVersionMemory::ReadDescriptor descriptor;
+                descriptor.slot = slotOfAccount.find(account)->second;
+                MultiVersionMemory::ReadStatus status = memory.Read(descriptor.slot, task.index, value,
+                                                                    descriptor.writer, descriptor.incarnation);
+                if (status == MultiVersionMemory::ESTIMATE)
+                {
+                    blocking = descriptor.writer;
+                    return false;
+                }
+                descriptor.fromStorage = status == MultiVersionMemory::NOT_FOUND;
+                if (descriptor.fromStorage)
+                {
+                    value = storage[descriptor.slot];
+                }
+                reads.push_back(descriptor);
+                return true;
+            };
+
+            while (true)
+            {
+                reads.clear();
+                bool isSettled;
+                executions++;
+                if (Run(transactions[task.index], read, writes, isSettled))
+                {
+                    for (std::pair<uint32_t, double> &write : writes)
+                    {
+                        write.first = slotOfAccount.find(write.first)->second;
+                    }
+                    settled[task.index] = isSettled;
+                    bool wroteNewLocation = memory.Record(task.index, task.incarnation, reads, writes);
+                    return scheduler.FinishExecution(task.index, task.incarnation, wroteNewLocation);
+                }
+
+                dependencies++;
+                if (scheduler.AddDependency(task.index, blocking))
+                {
+                    Scheduler::Task none = {Scheduler::NONE, 0, 0};
+                    return none;
+                }
+                // The writer finished meanwhile, run again straight away
+            }
+        };
+
+        auto needsReexecution = [&](Scheduler::Task task)
+        {
+            bool aborted = !memory.ValidateReadSet(task.index) && scheduler.TryValidationAbort(task.index, task.incarnation);
+            if (aborted)
+            {
+                aborts++;
+                memory.ConvertWritesToEstimates(task.index);
+            }
+            return scheduler.FinishValidation(task.index, aborted);
+        };
+
+        auto worker = [&]()
+        {
+            Scheduler::Task task = {Scheduler::NONE, 0, 0};
+            while (!scheduler.Done())
+            {
+                if (task.kind == Scheduler::EXECUTION)
+                {
+                    task = tryExecute(task);
+                }
+                else if (task.kind == Scheduler::VALIDATION)
+                {
+                    task = needsReexecution(task);
+                }
+                if (task.kind == Scheduler::NONE)
+                {
+                    task = scheduler.NextTask();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < m_numberOfThreads; i++)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (uint32_t slot = 0; slot < accounts.size(); slot++)
+        {
+            double value;
+            if (memory.Latest(slot, value))
+            {
+                state[accounts[slot]] = value;
+            }
+        }
+
+        Result result;
+        result.settled.assign(settled.get(), settled.get() + size);
+        result.executions = executions;
+        result.aborts = aborts;
+        result.dependencies = dependencies;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        Account(result, size);
+        return result;
+    }
+
+    void
+    BlockExecutor::Account(const Result &result, uint32_t numberOfTransactions)
+    {
+        m_totalTransactions += numberOfTransactions;
+        m_totalExecutions += result.executions;
+        m_totalSeconds += result.seconds;
+    }
+
+}
@@ -0,0 +1,105 @@
+#ifndef BLOCK_EXECUTOR_H
+#define BLOCK_EXECUTOR_H
+
+#include "blockchain.h"
+#include "smart-contract.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Settles the payments of a block: a transaction that passes the contract moves
+     * its payment from the balance of rsuNodeId to the balance of winnerId, and does
+     * nothing if the payer cannot cover it. Winners and rsu nodes are numbered from 1
+     * alike, so the account of a winner is its id with WINNER_ACCOUNT set.
+     *
+     * Execute runs the transactions optimistically on several threads, the way
+     * Block-STM does. Every transaction reads the balances through a multi-version
+     * store that holds the writes of each transaction of the block, and sees the
+     * latest write of a transaction before it in the block. A transaction whose reads
+     * no longer match once it finished is aborted, its writes are marked as estimates
+     * and it runs again; a transaction that reads an estimate waits for the writer.
+     * Validation and execution indices only move backwards to the lowest transaction
+     * that needs them, so the committed state is the state of running the block in
+     * order, for any number of threads.
+     */
+    class BlockExecutor
+    {
+        public:
+            typedef std::map<uint32_t, double> State;      // balance of every account
+
+            static const uint32_t WINNER_ACCOUNT = 1u << 31;
+
+            struct Result
+            {
+                std::vector<bool> settled;      // per transaction, false if it moved nothing
+                uint64_t executions;            // including the ones that were aborted
+                uint64_t aborts;                // executions that failed validation
+                uint64_t dependencies;          // executions that waited for an estimate
+                double seconds;                 // wall time
+            };
+
+            BlockExecutor(void);
+            virtual ~BlockExecutor(void);
+
+            void SetNumberOfThreads(unsigned int numberOfThreads);
+            unsigned int GetNumberOfThreads(void) const;
+
+            /*
+             * The balance of an account that is not in the state yet.
+             */
+            void SetInitialBalance(double balance);
+            /*
+             * Transactions that fail the contract move nothing; none accepts every transaction.
+             */
+            void SetContract(const SmartContract *contract);
+            /*
+             * SHA256 rounds over the signing payload per execution, a stand-in for
+             * contracts that cost more than the settlement itself.
+             */
+            void SetWorkPerTransaction(uint32_t rounds);
+
+            Result Execute(const std::vector<Transaction> &transactions, State &state);
+            Result ExecuteSequential(const std::vector<Transaction> &transactions, State &state);
+
+            /*
+             * The accounts a transaction moves its payment between.
+             */
+            static uint32_t GetPayerAccount(const Transaction &transaction);
+            static uint32_t GetPayeeAccount(const Transaction &transaction);
+
+            uint64_t GetTotalTransactions(void) const;
+            uint64_t GetTotalExecutions(void) const;
+            double GetTotalSeconds(void) const;
+
+        protected:
+            class Scheduler;
+            class MultiVersionMemory;
+
+            /*
+             * Runs one transaction, reading balances through `read`, which returns false if
+             * the balance is not known yet. Returns false if a read failed; otherwise writes
+             * holds the new (account, balance) pairs and settled whether the payment was made.
+             */
+            template <typename Read>
+            bool Run(const Transaction &transaction, Read read, std::vector<std::pair<uint32_t, double>> &writes,
+                     bool &settled) const;
+
+            void Work(const Transaction &transaction) const;
+            void Account(const Result &result, uint32_t numberOfTransactions);
+
+            unsigned int m_numberOfThreads;
+            double m_initialBalance;
+            const SmartContract *m_contract;
+            uint32_t m_workPerTransaction;
+
+            uint64_t m_totalTransactions;
+            uint64_t m_totalExecutions;
+            double m_totalSeconds;
+    };
+
+}
+
+#endif /* BLOCK_EXECUTOR_H */
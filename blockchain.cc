@@ -5,6 +5,9 @@
 #include "ns3/address.h"
 #include "ns3/log.h"
 #include "blockchain.h"
+#include <cstring>
+#include <iomanip>
+#include <sstream>
 
 namespace ns3{
 
@@ -30,6 +33,17 @@ namespace ns3{
         Transaction(0, 0, 0, 0, 0);
     }
     
+    Transaction::Transaction(const Transaction &tranSource)
+    {
+        m_rsuNodeId = tranSource.m_rsuNodeId;
+        m_transId = tranSource.m_transId;
+        m_transSizeByte = tranSource.m_transSizeByte;
+        m_timeStamp = tranSource.m_timeStamp;
+        m_payment = tranSource.m_payment;
+        m_winnerId = tranSource.m_winnerId;
+        m_validatation = tranSource.m_validatation;
+    }
+
     Transaction::~Transaction()
     {
     }
@@ -112,6 +126,15 @@ namespace ns3{
         m_validatation = true;
     }
 
+    std::string
+    Transaction::GetSigningPayload(void) const
+    {
+        std::ostringstream payload;
+        payload << std::setprecision(17) << m_rsuNodeId << ":" << m_transId << ":" << m_timeStamp << ":"
+                << m_payment << ":" << m_winnerId;
+        return payload.str();
+    }
+
     Transaction&
     Transaction::operator= (const Transaction &tranSource)
     {
@@ -151,12 +174,14 @@ namespace ns3{
         m_timeReceived = timeReceived;
         m_receivedFromIpv4 = receivedFromIpv4;
         m_totalTransactions = 0;
+        m_difficulty = 0;
+        m_parentHash.fill(0);
+        m_stateRoot.fill(0);
 
     }
 
-    Block::Block()
+    Block::Block() : Block(0,0,0,0,0,0,0, Ipv4Address("0.0.0.0"))
     {
-        Block(0,0,0,0,0,0,0, Ipv4Address("0.0.0.0"));
     }
 
     Block::Block(const Block &blockSource)
@@ -164,12 +189,16 @@ namespace ns3{
         m_blockHeight = blockSource.m_blockHeight;
         m_minerId = blockSource.m_minerId;
         m_nonce = blockSource.m_nonce;
+        m_difficulty = blockSource.m_difficulty;
+        m_parentHash = blockSource.m_parentHash;
+        m_stateRoot = blockSource.m_stateRoot;
         m_parentBlockMinerId = blockSource.m_parentBlockMinerId;
         m_blockSizeBytes = blockSource.m_blockSizeBytes;
         m_timeStamp = blockSource.m_timeStamp;
         m_timeReceived = blockSource.m_timeReceived;
         m_receivedFromIpv4 = blockSource.m_receivedFromIpv4;
         m_transactions = blockSource.m_transactions;
+        m_settled = blockSource.m_settled;
         m_totalTransactions = 0;
         
     }
@@ -202,6 +231,108 @@ namespace ns3{
         m_nonce = nonce;
     }
 
+    uint32_t
+    Block::GetDifficulty(void) const
+    {
+        return m_difficulty;
+    }
+
+    void
+    Block::SetDifficulty(uint32_t difficulty)
+    {
+        m_difficulty = difficulty;
+    }
+
+    const Sha256Digest&
+    Block::GetParentHash(void) const
+    {
+        return m_parentHash;
+    }
+
+    void
+    Block::SetParentHash(const Sha256Digest &parentHash)
+    {
+        m_parentHash = parentHash;
+    }
+
+    const Sha256Digest&
+    Block::GetStateRoot(void) const
+    {
+        return m_stateRoot;
+    }
+
+    void
+    Block::SetStateRoot(const Sha256Digest &stateRoot)
+    {
+        m_stateRoot = stateRoot;
+    }
+
+    static uint8_t*
+    PutUint32(uint8_t *out, uint32_t value)
+    {
+        for (int i = 3; i >= 0; i--)
+        {
+            *out++ = (uint8_t)(value >> (8 * i));
+        }
+        return out;
+    }
+
+    Block::Header
+    Block::GetHeader(void) const
+    {
+        const uint32_t version = 1;
+        Header header;
+        uint8_t *out = header.data();
+        uint64_t timeStampBits;
+        Sha256Digest transactionsDigest = GetTransactionsDigest();
+
+        memcpy(&timeStampBits, &m_timeStamp, sizeof(timeStampBits));
+
+        out = PutUint32(out, version);
+        out = PutUint32(out, m_blockHeight);
+        out = PutUint32(out, m_minerId);
+        out = PutUint32(out, m_parentBlockMinerId);
+        out = std::copy(m_parentHash.begin(), m_parentHash.end(), out);
+        out = std::copy(transactionsDigest.begin(), transactionsDigest.end(), out);
+        out = std::copy(m_stateRoot.begin(), m_stateRoot.end(), out);
+        out = PutUint32(out, (uint32_t)(timeStampBits >> 32));
+        out = PutUint32(out, (uint32_t)timeStampBits);
+        out = PutUint32(out, m_blockSizeBytes);
+        out = PutUint32(out, m_difficulty);
+        PutUint32(out, m_nonce);
+
+        return header;
+    }
+
+    Sha256Digest
+    Block::GetHash(void) const
+    {
+        Header header = GetHeader();
+        Sha256Digest digest;
+        SHA256 ctx;
+
+        ctx.init();
+        ctx.update(header.data(), header.size());
+        ctx.final(digest.data());
+        return digest;
+    }
+
+    Sha256Digest
+    Block::GetTransactionsDigest(void) const
+    {
+        Sha256Digest digest;
+        SHA256 ctx;
+
+        ctx.init();
+        for (auto const &tran : m_transactions)
+        {
+            std::string payload = tran.GetSigningPayload() + "\n";
+            ctx.update(reinterpret_cast<const unsigned char *>(payload.data()), payload.size());
+        }
+        ctx.final(digest.data());
+        return digest;
+    }
+
     int
     Block::GetMinerId(void) const
     {
@@ -280,6 +411,18 @@ namespace ns3{
         m_transactions = transactions;
     }
 
+    const std::vector<bool>&
+    Block::GetSettled(void) const
+    {
+        return m_settled;
+    }
+
+    void
+    Block::SetSettled(const std::vector<bool> &settled)
+    {
+        m_settled = settled;
+    }
+
     bool
     Block::IsParent(const Block &block) const
     {
@@ -377,11 +520,16 @@ namespace ns3{
         m_blockHeight = blockSource.m_blockHeight;
         m_minerId = blockSource.m_minerId;
         m_nonce = blockSource.m_nonce;
+        m_difficulty = blockSource.m_difficulty;
+        m_parentHash = blockSource.m_parentHash;
+        m_stateRoot = blockSource.m_stateRoot;
         m_parentBlockMinerId = blockSource.m_parentBlockMinerId;
         m_blockSizeBytes = blockSource.m_blockSizeBytes;
         m_timeStamp = blockSource.m_timeStamp;
         m_timeReceived = blockSource.m_timeReceived;
         m_receivedFromIpv4 = blockSource.m_receivedFromIpv4;
+        m_transactions = blockSource.m_transactions;
+        m_settled = blockSource.m_settled;
 
         return *this;
     }
@@ -405,6 +553,7 @@ namespace ns3{
     Blockchain::Blockchain(void)
     {
         m_totalBlocks = 0;
+        m_snapshotInterval = 0;
         Block genesisBlock(0,0,0,0,0,0,0, Ipv4Address("0.0.0.0"));
         AddBlock(genesisBlock);
     }
@@ -599,6 +748,16 @@ namespace ns3{
         return &m_blocks[m_blocks.size()-1][0];
     }
 
+    const Block*
+    Blockchain::GetBlockAtHeight(int height) const
+    {
+        if (height < 0 || height >= (int)m_blocks.size() || m_blocks[height].empty())
+        {
+            return nullptr;
+        }
+        return &m_blocks[height][0];
+    }
+
     void
     Blockchain::AddBlock(const Block& newBlock)
     {
@@ -626,6 +785,75 @@ namespace ns3{
             m_blocks[newBlock.GetBlockHeight()].push_back(newBlock);
         }
         m_totalBlocks++;
+
+        if (newBlock.GetBlockHeight() == m_ledger.GetHeight() + 1)
+        {
+            m_ledger.Apply(newBlock.GetBlockHeight(), newBlock.GetTransactions(), newBlock.GetSettled());
+            if (m_snapshotInterval > 0 && m_ledger.GetHeight() % m_snapshotInterval == 0)
+            {
+                m_snapshots[m_ledger.GetHeight()] = m_ledger;
+                if (m_snapshots.size() > SNAPSHOTS_KEPT)
+                {
+                    m_snapshots.erase(m_snapshots.begin());
+                }
+            }
+        }
+    }
+
+    void
+    Blockchain::RemoveBlocksAbove(int height)
+    {
+        // The genesis block stays
+        height = std::max(height, 0);
+        while ((int)m_blocks.size() > height + 1)
+        {
+            m_totalBlocks -= m_blocks.back().size();
+            m_blocks.pop_back();
+        }
+        // An empty height below the top is a gap AddBlock filled with no block
+        while (m_blocks.back().empty())
+        {
+            m_blocks.pop_back();
+        }
+
+        m_snapshots.erase(m_snapshots.upper_bound(height), m_snapshots.end());
+        if (m_ledger.GetHeight() > height)
+        {
+            RebuildLedger();
+        }
+    }
+
+    const PaymentLedger&
+    Blockchain::GetLedger(void) const
+    {
+        return m_ledger;
+    }
+
+    void
+    Blockchain::SetSnapshotInterval(uint32_t blocks)
+    {
+        m_snapshotInterval = blocks;
+    }
+
+    const PaymentLedger*
+    Blockchain::GetLatestSnapshot(void) const
+    {
+        return m_snapshots.empty() ? nullptr : &m_snapshots.rbegin()->second;
+    }
+
+    int
+    Blockchain::RebuildLedger(void)
+    {
+        m_ledger = m_snapshots.empty() ? PaymentLedger() : m_snapshots.rbegin()->second;
+
+        // The ledger follows the first block of every height, the one AddBlock applied
+        int applied = 0;
+        for (int height = m_ledger.GetHeight() + 1; height < (int)m_blocks.size() && !m_blocks[height].empty(); height++)
+        {
+            m_ledger.Apply(height, m_blocks[height][0].GetTransactions(), m_blocks[height][0].GetSettled());
+            applied++;
+        }
+        return applied;
     }
 
     void
@@ -666,6 +894,18 @@ namespace ns3{
             case REQUEST_TRANS: return "REQUEST_TRANS";
             case RESPONSE_TRANS: return "RESPONSE_TRANS";
             case REQUEST_BLOCK: return "REQUEST_BLOCK";
+            case REGISTER_KEY: return "REGISTER_KEY";
+            case LEADER_HINT: return "LEADER_HINT";
+            case RAFT_REQUEST_VOTE: return "RAFT_REQUEST_VOTE";
+            case RAFT_VOTE: return "RAFT_VOTE";
+            case RAFT_APPEND_ENTRIES: return "RAFT_APPEND_ENTRIES";
+            case RAFT_APPEND_REPLY: return "RAFT_APPEND_REPLY";
+            case SHARD_HEAD: return "SHARD_HEAD";
+            case CHECKPOINT: return "CHECKPOINT";
+            case BACKPRESSURE: return "BACKPRESSURE";
+            case RELAY_BLOCK: return "RELAY_BLOCK";
+            case RELAY_ACK: return "RELAY_ACK";
+            case SHRED: return "SHRED";
 
         }
 
@@ -4,9 +4,12 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <string>
 #include "ns3/address.h"
 #include "ipv4-address-helper-custom.h"
 #include "common.h"
+#include "sha256.h"
+#include "payment-ledger.h"
 
 namespace ns3 {
 
@@ -79,10 +82,15 @@ namespace ns3 {
         double  meanOrderingTime;
         double  meanValidationTime;
         double  meanLatency;
+        int     nodeConfirmedTransaction;
         int     nodeType;
         double  meanNumberofTransactions;
-        int responseCount;
-        int numberOfPeers;
+        long    committedBlocks;                // by the leaders of the ordering cluster
+        long    committedTransactions;
+        double  meanCommitLatency;              // from proposing a block to its commit
+        long    commitLatencySamples;
+        double  meanHopDelay;                   // of the last hop of each block received
+        double  meanBlockHops;                  // from the cloud server to this node
     
     } nodeStatistics;
 
@@ -105,6 +113,7 @@ namespace ns3 {
 
             Transaction(int rsuNodeId, int transId, double timeStamp, double payment, int winnerId);
             Transaction();
+            Transaction(const Transaction &tranSource);                    //Copy Constructor
             virtual ~Transaction(void);
 
             int GetRsuNodeId(void) const;
@@ -126,6 +135,11 @@ namespace ns3 {
             void SetWinnerId(int m_winnerId);
             void SetValidation();
 
+            /*
+             * The bytes endorsers sign: the transaction fields in a fixed order and format.
+             */
+            std::string GetSigningPayload(void) const;
+
             Transaction& operator = (const Transaction &tranSource);     //Assignment Constructor
 
             friend bool operator == (const Transaction &tran1, const Transaction &tran2);
@@ -145,6 +159,16 @@ namespace ns3 {
     class Block
     {
         public:
+            /*
+             * The header is what proof of work hashes: version, height, miner id, parent miner id,
+             * parent hash, transactions digest, state root, timestamp, size, difficulty and nonce,
+             * big-endian. The nonce is last and starts right after the first two 64-byte SHA256
+             * blocks, so a miner hashes those once and only the final one per nonce.
+             */
+            static const uint32_t HEADER_SIZE = 132;
+            static const uint32_t NONCE_OFFSET = HEADER_SIZE - 4;
+            typedef std::array<uint8_t, HEADER_SIZE> Header;
+
             Block(int blockHeight, int minerId, int nonce, int parentBlockMinerId, int blockSizeBytes,
                 double timeStamp, double timeReceived, Ipv4Address receivedFromIpv4);
             Block();
@@ -157,6 +181,29 @@ namespace ns3 {
             int GetNonce(void) const;
             void SetNonce(int nonce);
 
+            /*
+             * Number of leading zero bits the block hash must have, 0 for an unmined block.
+             */
+            uint32_t GetDifficulty(void) const;
+            void SetDifficulty(uint32_t difficulty);
+
+            const Sha256Digest& GetParentHash(void) const;
+            void SetParentHash(const Sha256Digest &parentHash);
+
+            /*
+             * Root of the payment ledger once the block's transactions are applied.
+             */
+            const Sha256Digest& GetStateRoot(void) const;
+            void SetStateRoot(const Sha256Digest &stateRoot);
+
+            Header GetHeader(void) const;
+            Sha256Digest GetHash(void) const;
+
+            /*
+             * SHA256 over the signing payloads of the transactions, in block order.
+             */
+            Sha256Digest GetTransactionsDigest(void) const;
+
             int GetMinerId(void) const;
             void SetMinerId(int minerId);
 
@@ -176,6 +223,13 @@ namespace ns3 {
 
             std::vector<Transaction> GetTransactions(void) const;
             void SetTransactions(const std::vector<Transaction> &transactions);
+
+            /*
+             * Per transaction, whether the executor made its payment; the payment ledger only
+             * counts the settled ones. Empty until the block is executed.
+             */
+            const std::vector<bool>& GetSettled(void) const;
+            void SetSettled(const std::vector<bool> &settled);
             /*
             * Checks if the block provided as the argument is the parent of this block object
             */
@@ -207,6 +261,9 @@ namespace ns3 {
             int         m_blockHeight;                  //the height of the block
             int         m_minerId;                      //the ID of the miner which mined this block
             int         m_nonce;                        //the nonce of the block
+            uint32_t    m_difficulty;                   //the leading zero bits the block hash has to have
+            Sha256Digest m_parentHash;                  //the hash of the parent block header
+            Sha256Digest m_stateRoot;                   //the root of the payment ledger after this block
             int         m_parentBlockMinerId;           //the ID of the miner which mined the parent of this block
             int         m_blockSizeBytes;               //the size of the block in bytes
             int         m_totalTransactions;
@@ -214,6 +271,7 @@ namespace ns3 {
             double      m_timeReceived;              //the time that the block was received from the node
             Ipv4Address m_receivedFromIpv4;       //the ipv4 of the node which sent the block to the receiving node
             std::vector<Transaction> m_transactions;
+            std::vector<bool> m_settled;         //per transaction, whether its payment was made
     };
 
     class Blockchain : public Block
@@ -255,12 +313,45 @@ namespace ns3 {
 
             const Block* GetCurrentTopBlock(void) const;
 
+            /*
+             * The first block added at the height, the one the ledger follows; nullptr if
+             * there is none.
+             */
+            const Block* GetBlockAtHeight(int height) const;
+
             void AddBlock(const Block& newBlock);
 
+            /*
+             * Drops every block above the height, with the snapshots taken above it, and
+             * rebuilds the ledger; for a replica whose blocks were not committed.
+             */
+            void RemoveBlocksAbove(int height);
+
             void AddOrphan(const Block& newBlock);
 
             void RemoveOrphan (const Block& newBlock);
 
+            /*
+             * What the main chain paid per account, updated by AddBlock for every block
+             * that extends the height the ledger is at.
+             */
+            const PaymentLedger& GetLedger(void) const;
+
+            /*
+             * Keeps a copy of the ledger every `blocks` blocks, the last SNAPSHOTS_KEPT of them;
+             * 0 keeps none.
+             */
+            void SetSnapshotInterval(uint32_t blocks);
+            /*
+             * The most recent snapshot, nullptr if there is none yet.
+             */
+            const PaymentLedger* GetLatestSnapshot(void) const;
+            /*
+             * Rebuilds the ledger from the latest snapshot, or the genesis block without one,
+             * by applying the blocks above it; returns the number of blocks applied.
+             */
+            int RebuildLedger(void);
+
             //void PrintOrphans(void);
 
             //void GetBlocksInForks(void);
@@ -271,9 +362,14 @@ namespace ns3 {
 
         protected:
         
+            static const uint32_t SNAPSHOTS_KEPT = 4;
+
             int                             m_totalBlocks;
             std::vector<std::vector<Block>> m_blocks;
             std::vector<Block>              m_orphans;                 
+            PaymentLedger                   m_ledger;
+            uint32_t                        m_snapshotInterval;
+            std::map<int, PaymentLedger>    m_snapshots;                //by height
     };
 
 }
@@ -0,0 +1,149 @@
+#include "checkpoint-chain.h"
+#include <algorithm>
+#include <cstring>
+
+namespace ns3 {
+
+    static uint8_t*
+    PutUint64(uint8_t *out, uint64_t value)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            *out++ = (uint8_t)(value >> shift);
+        }
+        return out;
+    }
+
+    CheckpointChain::CheckpointChain(void)
+    {
+        SetNumberOfShards(1);
+    }
+
+    CheckpointChain::~CheckpointChain(void)
+    {
+    }
+
+    void
+    CheckpointChain::SetNumberOfShards(uint32_t shards)
+    {
+        m_heads.clear();
+        m_checkpoints.clear();
+        for (uint32_t shardId = 0; shardId < std::max(shards, 1u); shardId++)
+        {
+            ShardHead head = {};
+            head.shardId = shardId;
+            m_heads.push_back(head);
+        }
+    }
+
+    uint32_t
+    CheckpointChain::GetNumberOfShards(void) const
+    {
+        return m_heads.size();
+    }
+
+    bool
+    CheckpointChain::UpdateHead(const ShardHead &head)
+    {
+        if (head.shardId >= m_heads.size() || head.height <= m_heads[head.shardId].height)
+        {
+            return false;
+        }
+        m_heads[head.shardId] = head;
+        return true;
+    }
+
+    const CheckpointChain::ShardHead&
+    CheckpointChain::GetHead(uint32_t shardId) const
+    {
+        return m_heads.at(shardId);
+    }
+
+    bool
+    CheckpointChain::Seal(double timeStamp, Checkpoint &checkpoint)
+    {
+        bool moved = false;
+        for (const ShardHead &head : m_heads)
+        {
+            moved = moved || head.height > GetAnchoredHeight(head.shardId);
+        }
+        if (!moved)
+        {
+            return false;
+        }
+
+        checkpoint.number = GetHeight() + 1;
+        checkpoint.timeStamp = timeStamp;
+        checkpoint.heads = m_heads;
+        checkpoint.parentHash = m_checkpoints.empty() ? Sha256Digest() : m_checkpoints.back().hash;
+        checkpoint.hash = ComputeHash(checkpoint);
+        m_checkpoints.push_back(checkpoint);
+        return true;
+    }
+
+    bool
+    CheckpointChain::Append(const Checkpoint &checkpoint)
+    {
+        Sha256Digest parentHash = m_checkpoints.empty() ? Sha256Digest() : m_checkpoints.back().hash;
+        if (checkpoint.number != GetHeight() + 1 || checkpoint.parentHash != parentHash
+            || checkpoint.heads.size() != m_heads.size() || ComputeHash(checkpoint) != checkpoint.hash)
+        {
+            return false;
+        }
+
+        m_checkpoints.push_back(checkpoint);
+        for (const ShardHead &head : checkpoint.heads)
+        {
+            UpdateHead(head);
+        }
+        return true;
+    }
+
+    uint64_t
+    CheckpointChain::GetHeight(void) const
+    {
+        return m_checkpoints.size();
+    }
+
+    const CheckpointChain::Checkpoint*
+    CheckpointChain::GetLatest(void) const
+    {
+        return m_checkpoints.empty() ? nullptr : &m_checkpoints.back();
+    }
+
+    int
+    CheckpointChain::GetAnchoredHeight(uint32_t shardId) const
+    {
+        return m_checkpoints.empty() ? 0 : m_checkpoints.back().heads.at(shardId).height;
+    }
+
+    Sha256Digest
+    CheckpointChain::ComputeHash(const Checkpoint &checkpoint)
+    {
+        // number, time stamp bits, parent hash, then shard id, height, block hash and state root of each head
+        std::vector<uint8_t> bytes(16 + 32 + checkpoint.heads.size() * (16 + 32 + 32));
+        uint8_t *out = bytes.data();
+        uint64_t timeStampBits;
+
+        memcpy(&timeStampBits, &checkpoint.timeStamp, sizeof(timeStampBits));
+        out = PutUint64(out, checkpoint.number);
+        out = PutUint64(out, timeStampBits);
+        out = std::copy(checkpoint.parentHash.begin(), checkpoint.parentHash.end(), out);
+        for (const ShardHead &head : checkpoint.heads)
+        {
+            out = PutUint64(out, head.shardId);
+            out = PutUint64(out, (uint64_t)(int64_t)head.height);
+            out = std::copy(head.blockHash.begin(), head.blockHash.end(), out);
+            out = std::copy(head.stateRoot.begin(), head.stateRoot.end(), out);
+        }
+
+        Sha256Digest digest;
+        SHA256 ctx;
+
+        ctx.init();
+        ctx.update(bytes.data(), bytes.size());
+        ctx.final(digest.data());
+        return digest;
+    }
+
+}
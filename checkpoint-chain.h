@@ -0,0 +1,80 @@
+#ifndef CHECKPOINT_CHAIN_H
+#define CHECKPOINT_CHAIN_H
+
+#include "sha256.h"
+#include <cstdint>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * The global chain of the sharded ordering service.
+     *
+     * Every shard keeps its own chain; now and then the leader of shard 0 gathers
+     * the latest committed head of each shard, its height, block hash and state
+     * root, into a checkpoint that links to the one before it. A checkpoint holds
+     * one head per shard, so it costs the same whatever the shards ordered since
+     * the last, and anchoring a block takes one hash chain walk from a checkpoint
+     * down the shard's own chain. The other cloud servers append the checkpoints
+     * they receive, after checking the hash and the link.
+     */
+    class CheckpointChain
+    {
+        public:
+            struct ShardHead
+            {
+                uint32_t shardId;
+                int height;                     // 0 until the shard committed a block
+                Sha256Digest blockHash;
+                Sha256Digest stateRoot;
+            };
+
+            struct Checkpoint
+            {
+                uint64_t number;                // from 1
+                double timeStamp;
+                std::vector<ShardHead> heads;   // one per shard, by shard id
+                Sha256Digest parentHash;
+                Sha256Digest hash;
+            };
+
+            CheckpointChain(void);
+            virtual ~CheckpointChain(void);
+
+            void SetNumberOfShards(uint32_t shards);
+            uint32_t GetNumberOfShards(void) const;
+
+            /*
+             * Keeps the head if it is higher than the last one of its shard.
+             */
+            bool UpdateHead(const ShardHead &head);
+            const ShardHead& GetHead(uint32_t shardId) const;
+
+            /*
+             * Makes the next checkpoint from the latest heads and appends it; false, and
+             * nothing changes, if no shard moved on since the last checkpoint.
+             */
+            bool Seal(double timeStamp, Checkpoint &checkpoint);
+            /*
+             * Appends a checkpoint sealed elsewhere; false if it is not the next one, does
+             * not link to the last or does not hash to its hash.
+             */
+            bool Append(const Checkpoint &checkpoint);
+
+            uint64_t GetHeight(void) const;
+            const Checkpoint* GetLatest(void) const;
+            /*
+             * The highest height of the shard some checkpoint anchors.
+             */
+            int GetAnchoredHeight(uint32_t shardId) const;
+
+            static Sha256Digest ComputeHash(const Checkpoint &checkpoint);
+
+        protected:
+            std::vector<ShardHead> m_heads;
+            std::vector<Checkpoint> m_checkpoints;
+    };
+
+}
+
+#endif /* CHECKPOINT_CHAIN_H */
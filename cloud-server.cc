@@ -14,12 +14,15 @@
 #include "ns3/tcp-socket-factory.h"
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
+#include "ns3/string.h"
 // #include "transaction.h"
 #include "cloud-server.h"
 #include "blockchain.h"
 #include "rsu-node.h"
 #include <fstream>
 #include <random>
+#include <cmath>
+#include <limits>
 #include <time.h>
 #include <sys/time.h>
 
@@ -29,6 +32,26 @@ namespace ns3 {
     NS_LOG_COMPONENT_DEFINE("CloudServer");
     NS_OBJECT_ENSURE_REGISTERED(CloudServer);
 
+    static bool
+    ParseDigest(const rapidjson::Value &hex, Sha256Digest &digest)
+    {
+        if (!hex.IsString() || hex.GetStringLength() != 2 * digest.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < digest.size(); i++)
+        {
+            char byte[3] = {hex.GetString()[2 * i], hex.GetString()[2 * i + 1], 0};
+            char *end;
+            digest[i] = (uint8_t)strtoul(byte, &end, 16);
+            if (end != byte + 2)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
     TypeId
     CloudServer::GetTypeId(void)
     {
@@ -41,6 +64,191 @@ namespace ns3 {
                         AddressValue(),
                         MakeAddressAccessor(&CloudServer::m_nodeIp),
                         MakeAddressChecker())
+        .AddAttribute("CryptoDelay",
+                        "The simulated time an ECDSA verification takes." ,
+                        TimeValue(MilliSeconds(0)),
+                        MakeTimeAccessor(&CloudServer::m_cryptoDelay),
+                        MakeTimeChecker())
+        .AddAttribute("VerificationCacheSize",
+                        "The number of signature check results kept, 0 disables the cache." ,
+                        UintegerValue(4096),
+                        MakeUintegerAccessor(&CloudServer::m_verificationCacheSize),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("EndorsementQuorum",
+                        "The distinct endorsers, none of them the submitter, a REQUEST_BLOCK needs; 0 for every endorser the policy designates." ,
+                        UintegerValue(0),
+                        MakeUintegerAccessor(&CloudServer::m_endorsementQuorum),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("MiningDifficulty",
+                        "The leading zero bits of a block hash, 0 disables proof of work." ,
+                        UintegerValue(0),
+                        MakeUintegerAccessor(&CloudServer::m_miningDifficulty),
+                        MakeUintegerChecker<uint32_t>(0, 32))
+        .AddAttribute("MiningThreads",
+                        "The threads searching the nonce range." ,
+                        UintegerValue(1),
+                        MakeUintegerAccessor(&CloudServer::m_miningThreads),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("MiningHashRate",
+                        "The simulated hashes per second of the miner, 0 uses the rate measured on this machine." ,
+                        DoubleValue(0),
+                        MakeDoubleAccessor(&CloudServer::m_miningHashRate),
+                        MakeDoubleChecker<double>(0))
+        .AddAttribute("ExecutionThreads",
+                        "The threads settling the payments of a block, 1 settles them in order." ,
+                        UintegerValue(1),
+                        MakeUintegerAccessor(&CloudServer::m_executionThreads),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("InitialBalance",
+                        "The balance every account starts with." ,
+                        DoubleValue(1000),
+                        MakeDoubleAccessor(&CloudServer::m_initialBalance),
+                        MakeDoubleChecker<double>(0))
+        .AddAttribute("MaxBlockTransactions",
+                        "The transactions that fill a block, 0 for no limit." ,
+                        UintegerValue(100),
+                        MakeUintegerAccessor(&CloudServer::m_maxBlockTransactions),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("MaxBlockSize",
+                        "The bytes of a full block, header included, 0 for no limit." ,
+                        UintegerValue(1000000),
+                        MakeUintegerAccessor(&CloudServer::m_fixedBlockSize),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("MinBlockInterval",
+                        "The shortest time a block waits for transactions, under the lightest load." ,
+                        TimeValue(MilliSeconds(5)),
+                        MakeTimeAccessor(&CloudServer::m_minBlockInterval),
+                        MakeTimeChecker())
+        .AddAttribute("MaxBlockInterval",
+                        "The longest time a block waits for transactions, once the load would fill it." ,
+                        TimeValue(MilliSeconds(100)),
+                        MakeTimeAccessor(&CloudServer::m_maxBlockInterval),
+                        MakeTimeChecker())
+        .AddAttribute("PipelineQueueSize",
+                        "The items each stage of the ordering pipeline queues, 0 for no bound." ,
+                        UintegerValue(1024),
+                        MakeUintegerAccessor(&CloudServer::m_pipelineQueueSize),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("IngestTime",
+                        "The simulated time the ingest stage takes to decode a REQUEST_BLOCK." ,
+                        TimeValue(MilliSeconds(0)),
+                        MakeTimeAccessor(&CloudServer::m_ingestTime),
+                        MakeTimeChecker())
+        .AddAttribute("OrderTime",
+                        "The simulated time the order stage takes to add a transaction to the open block." ,
+                        TimeValue(MilliSeconds(0)),
+                        MakeTimeAccessor(&CloudServer::m_orderTime),
+                        MakeTimeChecker())
+        .AddAttribute("SealTime",
+                        "The simulated time the seal stage takes per transaction of a block, mining aside." ,
+                        TimeValue(MilliSeconds(0)),
+                        MakeTimeAccessor(&CloudServer::m_sealTime),
+                        MakeTimeChecker())
+        .AddAttribute("DisseminateTime",
+                        "The simulated time the disseminate stage takes to send a block to one peer." ,
+                        TimeValue(MilliSeconds(0)),
+                        MakeTimeAccessor(&CloudServer::m_disseminateTime),
+                        MakeTimeChecker())
+        .AddAttribute("ElectionTimeout",
+                        "The shortest time a follower of the ordering cluster waits for the leader before it runs for election." ,
+                        TimeValue(MilliSeconds(150)),
+                        MakeTimeAccessor(&CloudServer::m_electionTimeout),
+                        MakeTimeChecker())
+        .AddAttribute("HeartbeatInterval",
+                        "The time between two heartbeats of the leader of the ordering cluster." ,
+                        TimeValue(MilliSeconds(50)),
+                        MakeTimeAccessor(&CloudServer::m_heartbeatInterval),
+                        MakeTimeChecker())
+        .AddAttribute("RaftBatchEntries",
+                        "The blocks the leader sends in one AppendEntries, 0 for no limit." ,
+                        UintegerValue(64),
+                        MakeUintegerAccessor(&CloudServer::m_raftBatchEntries),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("RaftInflightAppends",
+                        "The AppendEntries the leader keeps outstanding per follower." ,
+                        UintegerValue(4),
+                        MakeUintegerAccessor(&CloudServer::m_raftInflightAppends),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("ShardId",
+                        "The shard whose rsu nodes this server orders." ,
+                        UintegerValue(0),
+                        MakeUintegerAccessor(&CloudServer::m_shardId),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("NumberOfShards",
+                        "The shards of the ordering service, each with its own chain." ,
+                        UintegerValue(1),
+                        MakeUintegerAccessor(&CloudServer::m_numberOfShards),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("CheckpointInterval",
+                        "The time between two checkpoints of the shard heads, 0 takes none." ,
+                        TimeValue(MilliSeconds(200)),
+                        MakeTimeAccessor(&CloudServer::m_checkpointInterval),
+                        MakeTimeChecker())
+        .AddAttribute("StateSnapshotInterval",
+                        "The blocks between two snapshots of the payment ledger, 0 takes none." ,
+                        UintegerValue(100),
+                        MakeUintegerAccessor(&CloudServer::m_stateSnapshotInterval),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("AdmissionPolicy",
+                        "The order REQUEST_BLOCKs leave the admission queue in and which one a full queue gives up: taildrop, priority or fair." ,
+                        StringValue("taildrop"),
+                        MakeStringAccessor(&CloudServer::m_admissionPolicy),
+                        MakeStringChecker())
+        .AddAttribute("AdmissionQueueSize",
+                        "The REQUEST_BLOCKs the admission queue holds, 0 for no bound." ,
+                        UintegerValue(256),
+                        MakeUintegerAccessor(&CloudServer::m_admissionQueueSize),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("AdmissionWatermark",
+                        "The share of the admission queue past which the senders are asked to slow down." ,
+                        DoubleValue(0.75),
+                        MakeDoubleAccessor(&CloudServer::m_admissionWatermark),
+                        MakeDoubleChecker<double>(0, 1))
+        .AddAttribute("FairShareQuantum",
+                        "The bytes of REQUEST_BLOCK an rsu node may have ingested per round of the fair policy." ,
+                        UintegerValue(2048),
+                        MakeUintegerAccessor(&CloudServer::m_fairShareQuantum),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("MinRetryAfter",
+                        "The shortest time a BACKPRESSURE asks a node to wait." ,
+                        TimeValue(MilliSeconds(10)),
+                        MakeTimeAccessor(&CloudServer::m_minRetryAfter),
+                        MakeTimeChecker())
+        .AddAttribute("Dissemination",
+                        "How a block reaches the rsu nodes: unicast from the server to each, tree over the overlay tree, or chunked as erasure coded shreds down a tree per shred." ,
+                        StringValue("unicast"),
+                        MakeStringAccessor(&CloudServer::m_dissemination),
+                        MakeStringChecker())
+        .AddAttribute("TreeFanout",
+                        "The children of the server and of every rsu node in the overlay tree." ,
+                        UintegerValue(3),
+                        MakeUintegerAccessor(&CloudServer::m_treeFanout),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("TreeAckTimeout",
+                        "The time a member of the overlay tree has to acknowledge a block before the server sends it itself." ,
+                        TimeValue(MilliSeconds(100)),
+                        MakeTimeAccessor(&CloudServer::m_treeAckTimeout),
+                        MakeTimeChecker())
+        .AddAttribute("TreeFailureMisses",
+                        "The blocks in a row a member may miss before it is left out of the overlay tree." ,
+                        UintegerValue(2),
+                        MakeUintegerAccessor(&CloudServer::m_treeFailureMisses),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("ShredSize",
+                        "The bytes of a data shred in chunked dissemination." ,
+                        UintegerValue(1024),
+                        MakeUintegerAccessor(&CloudServer::m_shredSize),
+                        MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("ShredParity",
+                        "The parity shreds per data shred in chunked dissemination." ,
+                        DoubleValue(0.5),
+                        MakeDoubleAccessor(&CloudServer::m_shredParity),
+                        MakeDoubleChecker<double>(0, 4))
+        .AddAttribute("ShredLossRate",
+                        "The share of the SHREDs the cloud server sends that are lost on the way." ,
+                        DoubleValue(0),
+                        MakeDoubleAccessor(&CloudServer::m_shredLossRate),
+                        MakeDoubleChecker<double>(0, 1))
         ;
         return tid;
     }
@@ -54,36 +262,66 @@ namespace ns3 {
         m_previousBlockGenerationTime = 0;
         m_meanNumberofTransactions = 0;
         m_minerGeneratedBlocks = 0;
-        // HARDCODE
-        m_fixedBlockTimeGeneration = 15;
+        m_minerAverageBlockSize = 0;
+        m_nextBlockSize = 0;
+        m_cutPending = false;
+        m_disseminatedHeight = 0;
+        m_redirectedRequests = 0;
+        m_rejectedCertificates = 0;
+        m_reportedHeight = 0;
+        m_pumpWaiting = false;
+        m_backpressureSignals = 0;
+        m_treeDissemination = false;
+        m_relayRound = 0;
+        m_relayRepairs = 0;
+        m_chunkedDissemination = false;
+        m_shreddedBlocks = 0;
+        m_shredsSent = 0;
+    }
 
-        std::random_device rd;
-        m_generator.seed(rd());
+    CloudServer::~CloudServer(void)
+    {
+        NS_LOG_FUNCTION (this);
+    }
 
-        if(m_fixedBlockTimeGeneration > 0)
-        {
-            m_nextBlockTime = m_fixedBlockTimeGeneration;
-        }
-        else
-        {
-            m_nextBlockTime = 0;
-        }
+    void
+    CloudServer::SetClusterPeers(const std::map<uint32_t, Ipv4Address> &peers)
+    {
+        NS_LOG_FUNCTION(this);
+        m_clusterAddresses = peers;
+    }
 
-        if(m_fixedBlockSize > 0)
-        {
-            m_nextBlockSize = m_fixedBlockSize;
-        }
-        else
-        {
-            m_nextBlockSize = 0;
-        }
+    void
+    CloudServer::SetShardPeers(const std::map<uint32_t, std::map<uint32_t, Ipv4Address>> &shards)
+    {
+        NS_LOG_FUNCTION(this);
+        m_shardAddresses = shards;
+    }
 
+    void
+    CloudServer::SetSubmitterPeers(const std::map<uint32_t, std::vector<uint32_t>> &peerIds)
+    {
+        NS_LOG_FUNCTION(this);
+        m_submitterPeerIds = peerIds;
+    }
 
+    bool
+    CloudServer::IsLeader(void) const
+    {
+        return m_raft.IsLeader();
     }
 
-    CloudServer::~CloudServer(void)
+    void
+    CloudServer::Crash(void)
     {
-        NS_LOG_FUNCTION (this);
+        NS_LOG_FUNCTION(this);
+
+        std::cout << "Cloud server " << GetNode()->GetId() << " fails at " << Simulator::Now().GetSeconds() << "s, "
+                  << RaftConsensus::GetRoleName(m_raft.GetRole()) << " of term " << m_raft.GetTerm() << "\n";
+        m_crashed = true;
+        m_raft.Stop();
+        m_nextMiningEvent.Cancel();
+        m_checkpointEvent.Cancel();
     }
 
     void
@@ -108,15 +346,106 @@ namespace ns3 {
                 MakeCallback (&CloudServer::HandlePeerClose, this),
                 MakeCallback (&CloudServer::HandlePeerError, this));
 
+        m_verificationCache.SetCapacity(m_verificationCacheSize);
+        m_miner.SetNumberOfThreads(m_miningThreads);
+        m_executor.SetNumberOfThreads(m_executionThreads);
+        m_executor.SetInitialBalance(m_initialBalance);
+        m_blockchain.SetSnapshotInterval(m_stateSnapshotInterval);
+        m_blockBuilder.SetLimits(m_maxBlockTransactions, m_fixedBlockSize);
+        m_blockBuilder.SetInterval(m_minBlockInterval, m_maxBlockInterval);
+
+        PipelineStage *stages[] = {&m_ingestStage, &m_verifyStage, &m_orderStage, &m_sealStage, &m_replicateStage, &m_disseminateStage};
+        const char *names[] = {"ingest", "verify", "order", "seal", "replicate", "disseminate"};
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            stages[i]->SetName(names[i]);
+            stages[i]->SetCapacity(m_pipelineQueueSize);
+            stages[i]->SetNext(i + 1 < 6 ? stages[i + 1] : nullptr);
+        }
+        // Certificates are checked in batches on the worker pool, as many at a time as arrive
+        m_verifyStage.SetServers(0);
+        // Blocks are replicated in a pipeline, the next one goes out before the last is committed
+        m_replicateStage.SetServers(0);
+
+        AdmissionQueue::Policy policy;
+        if (!AdmissionQueue::ParsePolicy(m_admissionPolicy, policy))
+        {
+            NS_FATAL_ERROR("Unknown admission policy " << m_admissionPolicy);
+        }
+        m_admissionQueue.SetPolicy(policy);
+        m_admissionQueue.SetCapacity(m_admissionQueueSize);
+        m_admissionQueue.SetWatermark(m_admissionWatermark);
+        m_admissionQueue.SetQuantum(m_fairShareQuantum);
+
         // Set up the sending socket for every peer
         for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
         {
             m_peersSockets[*i] = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());
             m_peersSockets[*i]->Connect (InetSocketAddress (*i, m_blockchainPort));
         }
-        // ScheduleNextMiningEvent();
-        
-        std::pair<PublicKey, long> keyPair = ECDSA::generateKey();
+        // BACKPRESSURE goes to the rsu node a request came from
+        NS_ASSERT_MSG(m_peerIds.size() == m_peersAddresses.size(), "every peer address needs its node id");
+        m_peerIdToAddress.clear();
+        for (size_t i = 0; i < m_peerIds.size(); i++)
+        {
+            m_peerIdToAddress[m_peerIds[i]] = m_peersAddresses[i];
+        }
+
+        if (m_dissemination != "unicast" && m_dissemination != "tree" && m_dissemination != "chunked")
+        {
+            NS_FATAL_ERROR("Unknown dissemination " << m_dissemination);
+        }
+        m_treeDissemination = m_dissemination == "tree";
+        m_chunkedDissemination = m_dissemination == "chunked";
+        m_lossRandom.seed(GetNode()->GetId());
+        m_tree.SetFanout(m_treeFanout);
+        m_tree.SetFailureMisses(m_treeFailureMisses);
+        m_tree.SetMembers(m_peerIds);
+
+        // Set up the sending socket for every other cloud server of the cluster
+        std::vector<uint32_t> clusterIds;
+        for (auto &peer : m_clusterAddresses)
+        {
+            clusterIds.push_back(peer.first);
+            m_clusterSockets[peer.first] = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());
+            m_clusterSockets[peer.first]->Connect (InetSocketAddress (peer.second, m_blockchainPort));
+        }
+
+        m_raft.SetId(GetNode()->GetId());
+        m_raft.SetPeers(clusterIds);
+        m_raft.SetElectionTimeout(m_electionTimeout);
+        m_raft.SetHeartbeatInterval(m_heartbeatInterval);
+        m_raft.SetMaxBatchEntries(m_raftBatchEntries);
+        m_raft.SetMaxInflight(m_raftInflightAppends);
+        m_raft.SetSeed(GetNode()->GetId() + 1);
+        m_raft.SetTransport(
+            [this](uint32_t peer, const RaftConsensus::RequestVote &request) { SendRequestVote(peer, request); },
+            [this](uint32_t peer, const RaftConsensus::Vote &vote) { SendVote(peer, vote); },
+            [this](uint32_t peer, const RaftConsensus::AppendEntries &append) { SendAppendEntries(peer, append); },
+            [this](uint32_t peer, const RaftConsensus::AppendReply &reply) { SendAppendReply(peer, reply); });
+        m_raft.SetAppendCallback([this](uint64_t index, const RaftConsensus::Entry &entry) { AppendReplicatedBlock(index, entry); });
+        m_raft.SetTruncateCallback([this](uint64_t index) { RollBack(index); });
+        m_raft.SetCommitCallback([this](uint64_t index, const RaftConsensus::Entry &entry) { CommitBlock(index, entry); });
+        m_raft.SetLeaderCallback([this](uint32_t leaderId) { ChangeLeader(leaderId); });
+        // The lowest id runs for election first, the rsu nodes start out sending to it
+        m_raft.Start(clusterIds.empty() || GetNode()->GetId() < *std::min_element(clusterIds.begin(), clusterIds.end()));
+
+        // Set up the sending socket for every cloud server of the other shards
+        for (auto &shard : m_shardAddresses)
+        {
+            for (auto &peer : shard.second)
+            {
+                m_shardSockets[peer.first] = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());
+                m_shardSockets[peer.first]->Connect (InetSocketAddress (peer.second, m_blockchainPort));
+            }
+        }
+        m_checkpoints.SetNumberOfShards(m_numberOfShards);
+        if (m_numberOfShards > 1 && m_checkpointInterval > Seconds(0))
+        {
+            m_checkpointEvent = Simulator::Schedule(m_checkpointInterval, &CloudServer::Checkpoint, this);
+        }
+
+        std::pair<PublicKey, long> keyPair = KeyPool::GetInstance().GetKey(GetNode()->GetId());
         publicKey = keyPair.first;
         privateKey = keyPair.second;
 
@@ -133,10 +462,22 @@ namespace ns3 {
     {
         NS_LOG_FUNCTION (this);
 
+        m_nextMiningEvent.Cancel();
+        m_checkpointEvent.Cancel();
+        m_raft.Stop();
+
         for (std::vector<Ipv4Address>::iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i) //close the outgoing sockets
         {
             m_peersSockets[*i]->Close ();
         }
+        for (auto &peer : m_clusterSockets)
+        {
+            peer.second->Close ();
+        }
+        for (auto &peer : m_shardSockets)
+        {
+            peer.second->Close ();
+        }
 
         if (m_listenSocket)
         {
@@ -144,6 +485,83 @@ namespace ns3 {
             m_listenSocket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
         }
 
+        std::cout << "Verification cache of node " << GetNode()->GetId() << ": hits = " << m_verificationCache.GetHits()
+                  << ", misses = " << m_verificationCache.GetMisses() << ", evictions = " << m_verificationCache.GetEvictions() << "\n";
+        std::cout << "Certificates of node " << GetNode()->GetId() << ": " << m_rejectedCertificates
+                  << " rejected for missing their endorsement quorum\n";
+
+        if (m_miningDifficulty > 0)
+        {
+            std::cout << "Miner of node " << GetNode()->GetId() << ": " << m_miner.GetTotalHashes() << " hashes in "
+                      << m_miner.GetTotalSeconds() << "s on " << m_miningThreads << " threads, "
+                      << m_miner.GetHashRate() / 1e6 << " MH/s\n";
+        }
+
+        std::cout << "Executor of node " << GetNode()->GetId() << ": " << m_executor.GetTotalTransactions() << " transactions in "
+                  << m_executor.GetTotalExecutions() << " executions, " << m_executor.GetTotalSeconds() << "s on "
+                  << m_executionThreads << " threads\n";
+
+        const PaymentLedger &ledger = m_blockchain.GetLedger();
+        const PaymentLedger *snapshot = m_blockchain.GetLatestSnapshot();
+        std::cout << "Admission queue of node " << GetNode()->GetId() << " (" << AdmissionQueue::GetPolicyName(m_admissionQueue.GetPolicy())
+                  << "): " << m_admissionQueue.GetAdmitted() << " admitted, " << m_admissionQueue.GetRejected() << " rejected, "
+                  << m_admissionQueue.GetEvicted() << " evicted, max depth " << m_admissionQueue.GetMaxDepth() << ", wait mean "
+                  << m_admissionQueue.GetMeanWait() << "s max " << m_admissionQueue.GetMaxWait() << "s, "
+                  << m_backpressureSignals << " BACKPRESSURE sent\n";
+        if (m_treeDissemination || m_chunkedDissemination)
+        {
+            std::cout << "Overlay tree of node " << GetNode()->GetId() << ": fanout " << m_tree.GetFanout() << ", "
+                      << m_tree.GetNumberOfLiveMembers() << " of " << m_peerIds.size() << " members, depth "
+                      << OverlayTree::GetDepth(m_tree.GetNumberOfLiveMembers(), m_tree.GetFanout()) << ", "
+                      << m_tree.GetRebuilds() << " rebuilds, " << m_relayRepairs << " repairs\n";
+            for (uint32_t hop = 0; hop < m_relayHops.size(); hop++)
+            {
+                std::cout << "  hop " << hop + 1 << ": " << m_relayHops[hop].samples << " blocks, "
+                          << m_relayHops[hop].meanDelay << "s from the server, last hop " << m_relayHops[hop].meanHopDelay << "s\n";
+            }
+        }
+        if (m_chunkedDissemination)
+        {
+            std::cout << "Shreds of node " << GetNode()->GetId() << ": " << m_shreddedBlocks << " blocks in " << m_shredsSent
+                      << " shreds, parity " << m_shredParity << ", " << m_shredsLost << " lost on the way out\n";
+        }
+        if (m_nodeStats)
+        {
+            std::cout << "Block egress of node " << GetNode()->GetId() << ": " << m_nodeStats->blockSentBytes << " bytes\n";
+        }
+
+        std::cout << "Ordering pipeline of node " << GetNode()->GetId() << ":\n";
+        for (const PipelineStage *stage : {&m_ingestStage, &m_verifyStage, &m_orderStage, &m_sealStage, &m_replicateStage, &m_disseminateStage})
+        {
+            std::cout << "  ";
+            stage->Print(std::cout);
+        }
+
+        if (m_raft.GetClusterSize() > 1)
+        {
+            std::cout << "Raft of node " << GetNode()->GetId() << ": " << (m_crashed ? "failed " : "")
+                      << RaftConsensus::GetRoleName(m_raft.GetRole()) << " of term " << m_raft.GetTerm() << ", "
+                      << m_raft.GetLastIndex() << " blocks in the log, " << m_raft.GetCommitIndex() << " committed, "
+                      << m_raft.GetElections() << " elections run, " << m_raft.GetAppendsSent() << " AppendEntries sent, "
+                      << m_raft.GetMeanBatchEntries() << " blocks per batch, " << m_raft.GetRetransmissions() << " resent, "
+                      << m_redirectedRequests << " requests redirected\n";
+        }
+
+        if (m_numberOfShards > 1)
+        {
+            std::cout << "Checkpoints of node " << GetNode()->GetId() << " (shard " << m_shardId << "): "
+                      << m_checkpoints.GetHeight() << " sealed, anchored heights";
+            for (uint32_t shardId = 0; shardId < m_numberOfShards; shardId++)
+            {
+                std::cout << " " << m_checkpoints.GetAnchoredHeight(shardId);
+            }
+            std::cout << "\n";
+        }
+
+        std::cout << "Payment ledger of node " << GetNode()->GetId() << " at height " << ledger.GetHeight() << ": "
+                  << ledger.GetNumberOfAccounts() << " accounts, root " << ECDSA::toHex(ledger.GetRoot())
+                  << ", latest snapshot at height " << (snapshot ? snapshot->GetHeight() : 0) << "\n";
+
     }
 
 
@@ -160,6 +578,10 @@ namespace ns3 {
             {
                 break;
             }
+            if (m_crashed)
+            {
+                continue;
+            }
 
             if(InetSocketAddress::IsMatchingType(from))
             {
@@ -173,158 +595,1586 @@ namespace ns3 {
 
                 totalStream << m_bufferedData[from] << packetInfo;
                 std::string totalReceivedData(totalStream.str());
-                size_t pos = totalReceivedData.find(delimiter);
-                parsedPacket = totalReceivedData.substr(0,pos);
+                size_t pos;
 
-                rapidjson::Document d;
-                d.Parse(parsedPacket.c_str());
-
-                if(!d.IsObject())
+                // One packet can carry several messages and end in the middle of one
+                while ((pos = totalReceivedData.find(delimiter)) != std::string::npos)
                 {
-                    NS_LOG_WARN("The parsed packet is corrupted");
-                    totalReceivedData.erase(0, pos + delimiter.length());
-                    continue;
-                }
+                    parsedPacket = totalReceivedData.substr(0,pos);
+
+                    // Full precision, a checkpoint hashes the bits of its time stamp
+                    rapidjson::Document d;
+                    d.Parse<rapidjson::kParseFullPrecisionFlag>(parsedPacket.c_str());
 
-                rapidjson::StringBuffer buffer;
-                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-                d.Accept(writer);
+                    if(!d.IsObject())
+                    {
+                        NS_LOG_WARN("The parsed packet is corrupted");
+                        totalReceivedData.erase(0, pos + delimiter.length());
+                        continue;
+                    }
 
+                    rapidjson::StringBuffer buffer;
+                    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                    d.Accept(writer);
 
-                std::cout << std::endl;
-                switch(d["message"].GetInt())
-                {
-                    case REQUEST_BLOCK:
+
+                    std::cout << std::endl;
+                    switch(d["message"].GetInt())
                     {
-                        rapidjson::Value& trx = d["transactions"];
-                        int rsuNodeId = trx["rsuNodeId"].GetInt();
-                        int transId = trx["transId"].GetInt();
-
-                        int responseFrom = d["responseFrom"].GetInt();
-                        std::cout << "Node " << GetNode()->GetId() << " receives REQUEST_BLOCK from Node " << rsuNodeId << std::endl;
-                        std::cout << parsedPacket << std::endl;
-                        bool isSigned = trx["isSigned"].GetBool();
-                        if (isSigned) {
-                            std::cout << "Verifying signature for transaction id " << transId << " of Rsu Node id " 
-                                                        << rsuNodeId << " requesting from Rsu Node id " << responseFrom << std::endl;
-                            bool isValidSignature = ECDSA::verifySignature(trx["hashMsg"].GetInt64(),
-                                                                           trx["publicKey"]["p"].GetInt64(),
-                                                                           trx["publicKey"]["a"].GetInt64(),
-                                                                           trx["publicKey"]["n"].GetInt64(),
-                                                                           trx["publicKey"]["xG"].GetInt64(),
-                                                                           trx["publicKey"]["yG"].GetInt64(),
-                                                                           trx["publicKey"]["xQ"].GetInt64(),
-                                                                           trx["publicKey"]["yQ"].GetInt64(),
-                                                                           trx["signature"]["r"].GetInt64(),
-                                                                           trx["signature"]["s"].GetInt64()
-                                                                           );
-                            if (isValidSignature) {
-                                std::cout << "This transaction is verified by the cloud server.\n";
-                                trx.AddMember("verified", true, d.GetAllocator());
-
-                                int height = m_blockchain.GetCurrentTopBlock()->GetBlockHeight() + 1;
-                                if(height == 1)
-                                {
-                                    m_fistToMine = true;
-                                    m_timeStart = GetWallTime();
-                                }
+                        case REQUEST_BLOCK:
+                        {
+                            int rsuNodeId = d["transactions"]["rsuNodeId"].GetInt();
 
-                                if(m_fixedBlockSize > 0)
-                                {
-                                    m_nextBlockSize = m_fixedBlockSize;
-                                    
-                                }
-                                else
+                            std::cout << "Node " << GetNode()->GetId() << " receives REQUEST_BLOCK from Node " << rsuNodeId << std::endl;
+                            std::cout << parsedPacket << std::endl;
+
+                            if (m_raft.IsLeader())
+                            {
+                                AdmitRequest(parsedPacket, rsuNodeId, d["transactions"]["transId"].GetInt(),
+                                             d["transactions"]["payment"].GetDouble());
+                            }
+                            else
+                            {
+                                RedirectRequest(parsedPacket, from);
+                            }
+                            break;
+                        }
+
+                        case RELAY_ACK:
+                        {
+                            uint32_t nodeId = d["nodeId"].GetUint();
+                            if (m_tree.Acknowledge(nodeId))
+                            {
+                                std::cout << "Node " << nodeId << " is back in the overlay tree of cloud server " << GetNode()->GetId() << "\n";
+                            }
+                            std::map<uint64_t, RelayRound>::iterator round = m_relayRounds.find(d["round"].GetUint64());
+                            if (round != m_relayRounds.end() && d.HasMember("complete") && !d["complete"].GetBool())
+                            {
+                                round->second.heard.insert(nodeId);
+                                break;
+                            }
+                            if (round == m_relayRounds.end() || !round->second.pending.erase(nodeId))
+                            {
+                                break;
+                            }
+
+                            uint32_t hop = std::max(d["hop"].GetUint(), 1u);
+                            if (m_relayHops.size() < hop)
+                            {
+                                m_relayHops.resize(hop, RelayHopStats());
+                            }
+                            RelayHopStats &stats = m_relayHops[hop - 1];
+                            stats.samples++;
+                            stats.meanDelay += (d["delay"].GetDouble() - stats.meanDelay) / stats.samples;
+                            stats.meanHopDelay += (d["hopDelay"].GetDouble() - stats.meanHopDelay) / stats.samples;
+                            break;
+                        }
+
+                        case RAFT_REQUEST_VOTE:
+                        {
+                            RaftConsensus::RequestVote request;
+                            request.term = d["term"].GetUint64();
+                            request.candidateId = d["candidateId"].GetUint();
+                            request.lastLogIndex = d["lastLogIndex"].GetUint64();
+                            request.lastLogTerm = d["lastLogTerm"].GetUint64();
+                            m_raft.ReceiveRequestVote(request);
+                            break;
+                        }
+
+                        case RAFT_VOTE:
+                        {
+                            RaftConsensus::Vote vote;
+                            vote.term = d["term"].GetUint64();
+                            vote.voterId = d["voterId"].GetUint();
+                            vote.granted = d["granted"].GetBool();
+                            m_raft.ReceiveVote(vote);
+                            break;
+                        }
+
+                        case RAFT_APPEND_ENTRIES:
+                        {
+                            RaftConsensus::AppendEntries append;
+                            append.term = d["term"].GetUint64();
+                            append.leaderId = d["leaderId"].GetUint();
+                            append.prevLogIndex = d["prevLogIndex"].GetUint64();
+                            append.prevLogTerm = d["prevLogTerm"].GetUint64();
+                            append.leaderCommit = d["leaderCommit"].GetUint64();
+                            const rapidjson::Value& entries = d["entries"];
+                            for (rapidjson::SizeType j = 0; j < entries.Size(); j++)
+                            {
+                                RaftConsensus::Entry entry;
+                                entry.term = entries[j]["term"].GetUint64();
+                                entry.data.assign(entries[j]["block"].GetString(), entries[j]["block"].GetStringLength());
+                                append.entries.push_back(entry);
+                            }
+                            m_raft.ReceiveAppendEntries(append);
+                            break;
+                        }
+
+                        case RAFT_APPEND_REPLY:
+                        {
+                            RaftConsensus::AppendReply reply;
+                            reply.term = d["term"].GetUint64();
+                            reply.followerId = d["followerId"].GetUint();
+                            reply.success = d["success"].GetBool();
+                            reply.matchIndex = d["matchIndex"].GetUint64();
+                            reply.entries = d["entries"].GetUint();
+                            m_raft.ReceiveAppendReply(reply);
+                            break;
+                        }
+
+                        case SHARD_HEAD:
+                        {
+                            CheckpointChain::ShardHead head;
+                            head.shardId = d["shardId"].GetUint();
+                            head.height = d["height"].GetInt();
+                            if (ParseDigest(d["blockHash"], head.blockHash) && ParseDigest(d["stateRoot"], head.stateRoot))
+                            {
+                                m_checkpoints.UpdateHead(head);
+                            }
+                            break;
+                        }
+
+                        case CHECKPOINT:
+                        {
+                            CheckpointChain::Checkpoint checkpoint;
+                            checkpoint.number = d["number"].GetUint64();
+                            checkpoint.timeStamp = d["timeStamp"].GetDouble();
+                            bool decoded = ParseDigest(d["parentHash"], checkpoint.parentHash) && ParseDigest(d["hash"], checkpoint.hash);
+                            const rapidjson::Value& heads = d["heads"];
+                            for (rapidjson::SizeType j = 0; j < heads.Size(); j++)
+                            {
+                                CheckpointChain::ShardHead head;
+                                head.shardId = heads[j]["shardId"].GetUint();
+                                head.height = heads[j]["height"].GetInt();
+                                decoded = decoded && ParseDigest(heads[j]["blockHash"], head.blockHash)
+                                          && ParseDigest(heads[j]["stateRoot"], head.stateRoot);
+                                checkpoint.heads.push_back(head);
+                            }
+                            if (!decoded || !m_checkpoints.Append(checkpoint))
+                            {
+                                NS_LOG_WARN("Node " << GetNode()->GetId() << " rejects checkpoint " << checkpoint.number);
+                            }
+                            break;
+                        }
+
+                        case REGISTER_KEY:
+                        {
+                            const rapidjson::Value& key = d["publicKey"];
+                            uint32_t keyId = d["keyId"].GetUint();
+                            uint32_t epoch = d["epoch"].GetUint();
+                            PublicKey registeredKey(key["p"].GetInt64(), key["a"].GetInt64(), key["b"].GetInt64(),
+                                                    {key["xG"].GetInt64(), key["yG"].GetInt64()}, key["n"].GetInt64(),
+                                                    {key["xQ"].GetInt64(), key["yQ"].GetInt64()});
+                            m_keyRegistry.Register(keyId, epoch, registeredKey);
+                            std::cout << "Node " << GetNode()->GetId() << " registers key " << keyId << " epoch " << epoch << "\n";
+
+                            auto waiting = m_unregisteredKeyVerifications.find(std::make_pair(keyId, epoch));
+                            if (waiting != m_unregisteredKeyVerifications.end())
+                            {
+                                for (auto &job : waiting->second)
                                 {
-                                    std::normal_distribution<double> dist(23.0, 2.0);
-                                    m_nextBlockSize = (int)(dist(m_generator)*1000);
+                                    job->key = m_keyRegistry.Find(keyId, epoch);
+                                    QueueVerification(job);
                                 }
-                                Block newBlock(height, GetNode()->GetId(), 0, m_blockchain.GetCurrentTopBlock()->GetMinerId(), m_nextBlockSize,
-                                                Simulator::Now().GetSeconds(), Simulator::Now().GetSeconds(), Ipv4Address("127.0.0.1"));
-                                
-                                /*
-                                * Push transactions to new Blocks
-                                */
+                                m_unregisteredKeyVerifications.erase(waiting);
+                            }
+                            break;
+                        }
+            
+                    }
 
-                                std::vector<Transaction> addedTransaction;
-                                Transaction newTrans; 
-                                newTrans.SetTransId(transId);
-                                newTrans.SetPayment(trx["payment"].GetDouble());
-                                newTrans.SetRsuNodeId(rsuNodeId);
-                                newTrans.SetWinnerId(trx["winnerId"].GetInt());
-                                newTrans.SetTransTimeStamp(trx["timestamp"].GetDouble());
+                    totalReceivedData.erase(0, pos + delimiter.length());
+                }
+                m_bufferedData[from] = totalReceivedData;
+                delete[] packetInfo;
+            }
+        }
+        
+    }
 
-                                addedTransaction.push_back(newTrans);
-                                
-                                newBlock.SetTransactions(addedTransaction);
-                                newBlock.PrintAllTransaction();
-                                m_blockchain.AddBlock(newBlock);
+    void
+    CloudServer::AdmitRequest(const std::string &message, uint32_t rsuNodeId, int transId, double payment)
+    {
+        NS_LOG_FUNCTION(this);
 
+        AdmissionQueue::Request request = {rsuNodeId, transId, payment, message, Simulator::Now()};
+        AdmissionQueue::Request evicted;
+        AdmissionQueue::Outcome outcome = m_admissionQueue.Enqueue(request, evicted);
 
+        if (outcome == AdmissionQueue::REJECTED)
+        {
+            std::cout << "Admission queue of node " << GetNode()->GetId() << " is full, REQUEST_BLOCK of Node " << rsuNodeId
+                      << " transaction id " << transId << " turned away\n";
+            SendBackpressure(rsuNodeId, transId, true);
+            return;
+        }
+        if (outcome == AdmissionQueue::EVICTED)
+        {
+            std::cout << "Admission queue of node " << GetNode()->GetId() << " gives up the REQUEST_BLOCK of Node " << evicted.rsuNodeId
+                      << " transaction id " << evicted.transId << "\n";
+            SendBackpressure(evicted.rsuNodeId, evicted.transId, true);
+        }
 
-                                rapidjson::Document blockD;
-                                blockD.SetObject();
+        // At most one slow down per node while it should still be waiting from the last
+        if (m_admissionQueue.IsCongested(rsuNodeId) && Simulator::Now() >= m_backpressureUntil[rsuNodeId])
+        {
+            SendBackpressure(rsuNodeId, -1, false);
+        }
 
-                                rapidjson::Value value;
-                                rapidjson::Value array(rapidjson::kArrayType);
-                                rapidjson::Value transInfo(rapidjson::kObjectType);
+        PumpAdmission();
+    }
 
-                                value.SetString("block");
-                                blockD.AddMember("type", value, blockD.GetAllocator());
+    void
+    CloudServer::PumpAdmission(void)
+    {
+        NS_LOG_FUNCTION(this);
 
-                                value = BROADCAST_BLOCK;
-                                blockD.AddMember("message", value, blockD.GetAllocator());
+        AdmissionQueue::Request request;
+        while (!m_admissionQueue.IsEmpty() && m_ingestStage.GetQueueDepth() == 0)
+        {
+            m_admissionQueue.Dequeue(request, Simulator::Now());
+            IngestRequest(request.message);
+        }
 
-                                value = height;
-                                blockD.AddMember("blockHeight", value, blockD.GetAllocator());
+        if (!m_admissionQueue.IsEmpty() && !m_pumpWaiting)
+        {
+            m_pumpWaiting = true;
+            m_ingestStage.WhenRoom([this]() {
+                m_pumpWaiting = false;
+                PumpAdmission();
+            });
+        }
+    }
 
-                                value = newTrans.GetRsuNodeId();
-                                transInfo.AddMember("rsuNodeId", value, blockD.GetAllocator());
+    void
+    CloudServer::SendBackpressure(uint32_t rsuNodeId, int transId, bool rejected)
+    {
+        NS_LOG_FUNCTION(this);
 
-                                value = newTrans.GetTransId();
-                                transInfo.AddMember("transId", value, blockD.GetAllocator());
+        std::map<uint32_t, Ipv4Address>::iterator peer = m_peerIdToAddress.find(rsuNodeId);
+        if (peer == m_peerIdToAddress.end())
+        {
+            return;
+        }
 
-                                value.SetDouble(newTrans.GetTransTimeStamp());
-                                transInfo.AddMember("timestamp", value, blockD.GetAllocator());
+        Time retryAfter = std::max(m_minRetryAfter, m_admissionQueue.GetDrainTime(rsuNodeId));
+        m_backpressureUntil[rsuNodeId] = Simulator::Now() + retryAfter;
+        m_backpressureSignals++;
 
-                                value = newTrans.GetPayment();
-                                transInfo.AddMember("payment", value, blockD.GetAllocator());
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Value value;
+        value.SetString("backpressure");
+        d.AddMember("type", value, d.GetAllocator());
+        d.AddMember("message", BACKPRESSURE, d.GetAllocator());
+        d.AddMember("retryAfter", retryAfter.GetSeconds(), d.GetAllocator());
+        d.AddMember("queueDepth", m_admissionQueue.GetDepth(), d.GetAllocator());
+        d.AddMember("rejected", rejected, d.GetAllocator());
+        d.AddMember("transId", transId, d.GetAllocator());
+        SendMessage(REQUEST_BLOCK, BACKPRESSURE, d, m_peersSockets[peer->second]);
+    }
 
-                                value = newTrans.GetWinnerId();
-                                transInfo.AddMember("winnerId", value, blockD.GetAllocator());
+    void
+    CloudServer::IngestRequest(const std::string &message)
+    {
+        NS_LOG_FUNCTION(this);
 
-                                transInfo.AddMember("validation", (bool)true, blockD.GetAllocator());
+        std::shared_ptr<std::shared_ptr<PendingCertificate>> pending = std::make_shared<std::shared_ptr<PendingCertificate>>();
+        bool queued = m_ingestStage.Push(
+            [this, message, pending](PipelineStage::Done done) {
+                *pending = ParseRequest(message);
+                Simulator::Schedule(m_ingestTime, done);
+            },
+            [this, pending]() {
+                std::shared_ptr<PendingCertificate> certificate = *pending;
+                if (!certificate)
+                {
+                    return;
+                }
+                m_verifyStage.Push(
+                    [this, certificate](PipelineStage::Done done) {
+                        certificate->verified = done;
+                        VerifyCertificate(certificate);
+                    },
+                    [this, certificate]() { CompleteCertificate(certificate); });
+            });
 
-                                array.PushBack(transInfo, blockD.GetAllocator());
-                                blockD.AddMember("block", array, blockD.GetAllocator());
+        if (!queued)
+        {
+            std::cout << "Ingest queue of node " << GetNode()->GetId() << " is full, REQUEST_BLOCK dropped\n";
+        }
+    }
 
-                                rapidjson::StringBuffer blockInfo;
-                                rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfo);
-                                blockD.Accept(blockWriter);
-                                // send to peers 
+    std::shared_ptr<PendingCertificate>
+    CloudServer::ParseRequest(const std::string &message)
+    {
+        NS_LOG_FUNCTION(this);
 
-                                for(std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
-                                {
+        rapidjson::Document d;
+        d.Parse(message.c_str());
+        rapidjson::Value& trx = d["transactions"];
+        int rsuNodeId = trx["rsuNodeId"].GetInt();
+        int transId = trx["transId"].GetInt();
 
-                                    SendMessage(REQUEST_BLOCK, BROADCAST_BLOCK, blockD, m_peersSockets[*i]);
-                                    // const uint8_t delimiter[] = "#";
-                                    // m_peersSockets[*i]->Send(reinterpret_cast<const uint8_t*>(blockInfo.GetString()), blockInfo.GetSize(), 0);
-                                    // m_peersSockets[*i]->Send(delimiter, 1, 0);
-                                
-                                }
-                                
-                            } 
-                            else {
-                                std::cout << "This transaction is not verified by the cloud server.\n";
-                                trx.AddMember("verified", false, d.GetAllocator());
-                            }
-                        }
-                    }
-            
-                }
+        std::shared_ptr<PendingCertificate> pending = std::make_shared<PendingCertificate>();
+        if (!d.HasMember("certificate") || !pending->endorsements.FromJson(d["certificate"]) ||
+            pending->endorsements.GetNumberOfEndorsers() == 0) {
+            std::cout << "Transaction id " << transId << " of Rsu Node id " << rsuNodeId << " has no endorsement\n";
+            return nullptr;
+        }
+        if (!MeetsEndorsementPolicy(pending->endorsements, rsuNodeId, transId))
+        {
+            std::cout << "Transaction id " << transId << " of Rsu Node id " << rsuNodeId << " misses its endorsement quorum\n";
+            m_rejectedCertificates++;
+            return nullptr;
+        }
+
+        std::cout << "Verifying " << pending->endorsements.GetNumberOfEndorsers() << " endorsements for transaction id "
+                  << transId << " of Rsu Node id " << rsuNodeId << std::endl;
+
+        pending->message = message;
+        pending->digest = ECDSA::sha256Digest(TransactionFromJson(trx).GetSigningPayload());
+        pending->remaining = pending->endorsements.GetNumberOfEndorsers();
+        pending->isValid = true;
+        return pending;
+    }
+
+    bool
+    CloudServer::MeetsEndorsementPolicy(const EndorsementCertificate &certificate, uint32_t rsuNodeId, int transId) const
+    {
+        // The server draws the endorser set the same way the submitter did
+        std::map<uint32_t, std::vector<uint32_t>>::const_iterator peers = m_submitterPeerIds.find(rsuNodeId);
+        std::set<uint32_t> designated;
+        if (peers != m_submitterPeerIds.end())
+        {
+            std::vector<uint32_t> endorsers = m_endorsementPolicy ?
+                m_endorsementPolicy->SelectEndorsers(rsuNodeId, transId, peers->second) : peers->second;
+            designated.insert(endorsers.begin(), endorsers.end());
+            designated.erase(rsuNodeId);
+        }
+
+        std::set<uint32_t> endorsers;
+        for (const EndorsementCertificate::Endorsement &endorsement : certificate.GetEndorsements())
+        {
+            if (endorsement.endorserId == rsuNodeId)
+            {
+                return false;
+            }
+            if (peers != m_submitterPeerIds.end() && !designated.count(endorsement.endorserId))
+            {
+                return false;
             }
+            endorsers.insert(endorsement.endorserId);
+        }
+
+        // Capped at the designated set like EndorsementTracker does; unknown submitters need the plain quorum
+        uint32_t quorum = m_endorsementQuorum;
+        if (peers != m_submitterPeerIds.end() && (quorum == 0 || quorum > designated.size()))
+        {
+            quorum = designated.size();
+        }
+        return endorsers.size() >= std::max(quorum, 1u);
+    }
+
+    void
+    CloudServer::VerifyCertificate(std::shared_ptr<PendingCertificate> pending)
+    {
+        NS_LOG_FUNCTION(this);
+
+        // One check per endorser; they all land in the same batch
+        for (const EndorsementCertificate::Endorsement &endorsement : pending->endorsements.GetEndorsements())
+        {
+            std::shared_ptr<PendingVerification> job = std::make_shared<PendingVerification>();
+            job->certificate = pending;
+            job->keyId = endorsement.endorserId;
+            job->keyEpoch = endorsement.keyEpoch;
+            job->r = endorsement.r;
+            job->s = endorsement.s;
+            job->isValid = false;
+            job->cached = false;
+
+            job->key = m_keyRegistry.Find(job->keyId, job->keyEpoch);
+            if (job->key) {
+                QueueVerification(job);
+            }
+            else {
+                // The REGISTER_KEY travels on another connection and may still be on its way
+                std::cout << "Key " << job->keyId << " epoch " << job->keyEpoch << " is not registered yet\n";
+                m_unregisteredKeyVerifications[std::make_pair(job->keyId, job->keyEpoch)].push_back(job);
+            }
+        }
+    }
+
+    void
+    CloudServer::QueueVerification(std::shared_ptr<PendingVerification> job)
+    {
+        NS_LOG_FUNCTION(this);
+
+        const PublicKey &publicKey = job->key->key;
+        job->hashMsg = ECDSA::digitizeDigest(job->certificate->digest, publicKey.p);
+        job->p = publicKey.p;
+        job->a = publicKey.a;
+        job->n = publicKey.n;
+        job->xG = publicKey.G.first;
+        job->yG = publicKey.G.second;
+        job->xQ = publicKey.Q.first;
+        job->yQ = publicKey.Q.second;
+
+        // Checks arriving at the same simulated time share one batch
+        if (m_pendingVerifications.empty()) {
+            Simulator::ScheduleNow(&CloudServer::FlushVerifications, this);
+        }
+        m_pendingVerifications.push_back(job);
+    }
+
+    void
+    CloudServer::FlushVerifications(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::vector<std::shared_ptr<PendingVerification>> jobs;
+        std::vector<std::shared_ptr<PendingVerification>> cachedJobs;
+        std::shared_ptr<std::vector<SignatureCheck>> checks = std::make_shared<std::vector<SignatureCheck>>();
+        std::shared_ptr<std::vector<const PrecomputedKey*>> keys = std::make_shared<std::vector<const PrecomputedKey*>>();
+
+        // A signature seen before costs a cache lookup instead of a check on the pool
+        for (auto &job : m_pendingVerifications)
+        {
+            SignatureCheck check = {job->hashMsg, job->p, job->a, job->n, job->xG, job->yG, job->xQ, job->yQ, job->r, job->s};
+            if (m_verificationCache.Lookup(check, job->isValid))
+            {
+                job->cached = true;
+                cachedJobs.push_back(job);
+            }
+            else
+            {
+                checks->push_back(check);
+                keys->push_back(job->key.get());
+                jobs.push_back(job);
+            }
+        }
+        m_pendingVerifications.clear();
+
+        std::promise<void> ready;
+        ready.set_value();
+        std::shared_future<void> cachedDone = ready.get_future().share();
+        for (auto &job : cachedJobs)
+        {
+            job->done = cachedDone;
+            Simulator::ScheduleNow(&CloudServer::CompleteVerification, this, job);
+        }
+
+        if (jobs.empty())
+        {
+            return;
+        }
+
+        // The jobs hold the keys, so the pointers stay valid until the batch is done
+        std::shared_future<void> done = CryptoWorkerPool::GetInstance().Submit([jobs, checks, keys]() {
+            std::unique_ptr<bool[]> results(new bool[checks->size()]);
+            ECDSA::checkSignatureBatch(checks->data(), checks->size(), results.get(), keys->data());
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                jobs[i]->isValid = results[i];
+            }
+        });
+
+        // The certificate leaves the verify stage in CompleteVerification
+        for (auto &job : jobs)
+        {
+            job->done = done;
+            Simulator::Schedule(m_cryptoDelay, &CloudServer::CompleteVerification, this, job);
+        }
+    }
+
+    void
+    CloudServer::CompleteVerification(std::shared_ptr<PendingVerification> job)
+    {
+        NS_LOG_FUNCTION(this);
+
+        job->done.wait();
+
+        // Filled here rather than on the workers, so hits do not depend on thread timing
+        if (!job->cached)
+        {
+            m_verificationCache.Insert({job->hashMsg, job->p, job->a, job->n, job->xG, job->yG, job->xQ, job->yQ, job->r, job->s},
+                                       job->isValid);
+        }
+
+        std::shared_ptr<PendingCertificate> certificate = job->certificate;
+        if (job->isValid) {
+            std::cout << "Endorsement of node " << job->keyId << ": v = r = " << job->r << " => Genuine signature.\n";
+        }
+        else {
+            std::cout << "Endorsement of node " << job->keyId << ": r = " << job->r << ", s = " << job->s << " => Fraud signature.\n";
+            certificate->isValid = false;
+        }
+
+        if (--certificate->remaining == 0)
+        {
+            certificate->verified();
+        }
+    }
+
+    void
+    CloudServer::CompleteCertificate(std::shared_ptr<PendingCertificate> certificate)
+    {
+        NS_LOG_FUNCTION(this);
+
+        rapidjson::Document d;
+        d.Parse(certificate->message.c_str());
+        rapidjson::Value& trx = d["transactions"];
+        int rsuNodeId = trx["rsuNodeId"].GetInt();
+        int transId = trx["transId"].GetInt();
+
+        if (!certificate->isValid) {
+            std::cout << "This transaction is not verified by the cloud server.\n";
+            trx.AddMember("verified", false, d.GetAllocator());
+            return;
+        }
+
+        std::cout << "This transaction is verified by the cloud server.\n";
+        trx.AddMember("verified", true, d.GetAllocator());
+
+        std::shared_ptr<Transaction> newTrans = std::make_shared<Transaction>();
+        newTrans->SetTransId(transId);
+        newTrans->SetPayment(trx["payment"].GetDouble());
+        newTrans->SetRsuNodeId(rsuNodeId);
+        newTrans->SetWinnerId(trx["winnerId"].GetInt());
+        newTrans->SetTransTimeStamp(trx["timestamp"].GetDouble());
+
+        // The verify stage only finishes a certificate when the order stage has room; the
+        // stage's callbacks share the transaction instead of copying it along
+        m_orderStage.Push(
+            [this](PipelineStage::Done done) { Simulator::Schedule(m_orderTime, done); },
+            [this, newTrans]() { AddToBlock(*newTrans); });
+    }
+
+    void
+    CloudServer::AddToBlock(const Transaction &transaction)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (!m_blockBuilder.Fits(transaction))
+        {
+            CutBlock();
+        }
+
+        bool opensBlock = m_blockBuilder.IsEmpty();
+        m_blockBuilder.Add(transaction, Simulator::Now());
+        if (m_blockBuilder.IsFull())
+        {
+            CutBlock();
+        }
+        else if (opensBlock)
+        {
+            ScheduleNextMiningEvent();
+        }
+    }
+
+    void
+    CloudServer::ScheduleNextMiningEvent(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        m_nextMiningEvent.Cancel();
+        m_nextMiningEvent = Simulator::Schedule(m_blockBuilder.GetDeadline() - Simulator::Now(), &CloudServer::CutBlock, this);
+    }
+
+    void
+    CloudServer::CutBlock(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        m_nextMiningEvent.Cancel();
+        if (m_blockBuilder.IsEmpty() || m_cutPending)
+        {
+            return;
+        }
+        if (!m_raft.IsLeader())
+        {
+            std::cout << "Cloud server " << GetNode()->GetId() << " does not lead, drops a block of "
+                      << m_blockBuilder.GetNumberOfTransactions() << " transactions\n";
+            m_blockBuilder.Take();
+            return;
+        }
+        if (!m_sealStage.HasRoom())
+        {
+            m_cutPending = true;
+            m_sealStage.WhenRoom([this]() {
+                m_cutPending = false;
+                CutBlock();
+            });
+            return;
+        }
+
+        SealOpenBlock();
+    }
+
+    void
+    CloudServer::SealOpenBlock(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        uint32_t sizeBytes = m_blockBuilder.GetSizeBytes();
+        std::shared_ptr<std::vector<Transaction>> transactions = std::make_shared<std::vector<Transaction>>(m_blockBuilder.Take());
+        std::shared_ptr<SealedBlock> block = std::make_shared<SealedBlock>();
+        block->term = m_raft.GetTerm();
+        block->committed = false;
+
+        m_sealStage.Push(
+            [this, transactions, sizeBytes, block](PipelineStage::Done done) {
+                // A leader of an earlier term may no longer extend the chain
+                if (!m_raft.IsLeader() || m_raft.GetTerm() != block->term)
+                {
+                    done();
+                    return;
+                }
+                Time sealTime = SealBlock(*transactions, sizeBytes, block->message);
+                Time serviceEnd = std::max(Simulator::Now() + m_sealTime * (int64_t)transactions->size(), sealTime);
+                Simulator::Schedule(serviceEnd - Simulator::Now(), done);
+            },
+            [this, block]() {
+                if (block->message.empty())
+                {
+                    return;
+                }
+                m_replicateStage.Push(
+                    [this, block](PipelineStage::Done done) { ReplicateBlock(block, done); },
+                    [this, block]() {
+                        if (!block->committed)
+                        {
+                            return;
+                        }
+                        m_disseminateStage.Push(
+                            [this, block](PipelineStage::Done done) { DisseminateBlock(block, done); },
+                            []() {});
+                    });
+            });
+    }
+
+    Time
+    CloudServer::SealBlock(const std::vector<Transaction> &addedTransaction, uint32_t sizeBytes, std::string &blockMessage)
+    {
+        NS_LOG_FUNCTION(this);
+
+        m_nextBlockSize = sizeBytes;
+
+        int height = m_blockchain.GetCurrentTopBlock()->GetBlockHeight() + 1;
+        if(height == 1)
+        {
+            m_fistToMine = true;
+            m_timeStart = GetWallTime();
+        }
+
+        Block newBlock(height, GetNode()->GetId(), 0, m_blockchain.GetCurrentTopBlock()->GetMinerId(), m_nextBlockSize,
+                        Simulator::Now().GetSeconds(), Simulator::Now().GetSeconds(), Ipv4Address("127.0.0.1"));
+        newBlock.SetParentHash(m_blockchain.GetCurrentTopBlock()->GetHash());
+
+        newBlock.SetTransactions(addedTransaction);
+
+        // The state root only counts the payments the executor makes, on balances kept aside until the block is mined
+        BlockExecutor::State balances = m_balances;
+        BlockExecutor::Result execution = m_executor.Execute(addedTransaction, balances);
+        newBlock.SetSettled(execution.settled);
+        newBlock.SetStateRoot(m_blockchain.GetLedger().GetRootAfter(addedTransaction, execution.settled));
+        Time sealTime;
+        if (!MineBlock(newBlock, sealTime))
+        {
+            std::cout << "Block " << height << " of node " << GetNode()->GetId() << " misses difficulty "
+                      << m_miningDifficulty << " and is not sealed\n";
+            return sealTime;
+        }
+        m_balances.swap(balances);
+        newBlock.PrintAllTransaction();
+        m_blockchain.AddBlock(newBlock);
+
+        if (m_minerGeneratedBlocks > 0)
+        {
+            m_minerAverageBlockGenInterval = (m_minerAverageBlockGenInterval * (m_minerGeneratedBlocks - 1)
+                                              + sealTime.GetSeconds() - m_previousBlockGenerationTime) / m_minerGeneratedBlocks;
+        }
+        m_minerAverageBlockSize = (m_minerAverageBlockSize * m_minerGeneratedBlocks + m_nextBlockSize) / (m_minerGeneratedBlocks + 1);
+        m_meanNumberofTransactions = (m_meanNumberofTransactions * m_minerGeneratedBlocks + addedTransaction.size())
+                                     / (m_minerGeneratedBlocks + 1);
+        m_minerGeneratedBlocks++;
+        m_previousBlockGenerationTime = sealTime.GetSeconds();
+
+        if (m_nodeStats)
+        {
+            m_nodeStats->rsuNodeId = GetNode()->GetId();
+            m_nodeStats->miner = 1;
+            m_nodeStats->minerGeneratedBlocks = m_minerGeneratedBlocks;
+            m_nodeStats->minerAverageBlockGenInterval = m_minerAverageBlockGenInterval;
+            m_nodeStats->minerAverageBlockSize = m_minerAverageBlockSize;
+            m_nodeStats->meanNumberofTransactions = m_meanNumberofTransactions;
+            m_nodeStats->hashRate = m_miner.GetHashRate();
+        }
+
+        rapidjson::Document blockD;
+        blockD.SetObject();
+
+        rapidjson::Value value;
+        rapidjson::Value array(rapidjson::kArrayType);
+
+        value.SetString("block");
+        blockD.AddMember("type", value, blockD.GetAllocator());
+
+        value = BROADCAST_BLOCK;
+        blockD.AddMember("message", value, blockD.GetAllocator());
+
+        value = height;
+        blockD.AddMember("blockHeight", value, blockD.GetAllocator());
+
+        value = (uint32_t)newBlock.GetNonce();
+        blockD.AddMember("nonce", value, blockD.GetAllocator());
+
+        value = newBlock.GetDifficulty();
+        blockD.AddMember("difficulty", value, blockD.GetAllocator());
+
+        value.SetString(ECDSA::toHex(newBlock.GetHash()).c_str(), blockD.GetAllocator());
+        blockD.AddMember("blockHash", value, blockD.GetAllocator());
+
+        value.SetString(ECDSA::toHex(newBlock.GetStateRoot()).c_str(), blockD.GetAllocator());
+        blockD.AddMember("stateRoot", value, blockD.GetAllocator());
+
+        // The rest of the header, so that the other cloud servers can rebuild the block
+        value.SetString(ECDSA::toHex(newBlock.GetParentHash()).c_str(), blockD.GetAllocator());
+        blockD.AddMember("parentHash", value, blockD.GetAllocator());
+        blockD.AddMember("minerId", newBlock.GetMinerId(), blockD.GetAllocator());
+        blockD.AddMember("parentMinerId", newBlock.GetParentBlockMinerId(), blockD.GetAllocator());
+        blockD.AddMember("timeStamp", newBlock.GetTimeStamp(), blockD.GetAllocator());
+        blockD.AddMember("blockSize", newBlock.GetBlockSizeBytes(), blockD.GetAllocator());
+
+        for (uint32_t i = 0; i < addedTransaction.size(); i++)
+        {
+            const Transaction &newTrans = addedTransaction[i];
+            rapidjson::Value transInfo(rapidjson::kObjectType);
+
+            value = newTrans.GetRsuNodeId();
+            transInfo.AddMember("rsuNodeId", value, blockD.GetAllocator());
+
+            value = newTrans.GetTransId();
+            transInfo.AddMember("transId", value, blockD.GetAllocator());
+
+            value.SetDouble(newTrans.GetTransTimeStamp());
+            transInfo.AddMember("timestamp", value, blockD.GetAllocator());
+
+            value = newTrans.GetPayment();
+            transInfo.AddMember("payment", value, blockD.GetAllocator());
+
+            value = newTrans.GetWinnerId();
+            transInfo.AddMember("winnerId", value, blockD.GetAllocator());
+
+            transInfo.AddMember("validation", (bool)true, blockD.GetAllocator());
+            transInfo.AddMember("settled", (bool)execution.settled[i], blockD.GetAllocator());
+
+            array.PushBack(transInfo, blockD.GetAllocator());
+        }
+        blockD.AddMember("block", array, blockD.GetAllocator());
+
+        rapidjson::StringBuffer blockInfo;
+        rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfo);
+        blockD.Accept(blockWriter);
+
+        // Encoded once for every peer and every cloud server
+        blockMessage.assign(blockInfo.GetString(), blockInfo.GetSize());
+        return sealTime;
+    }
+
+    bool
+    CloudServer::MineBlock(Block &block, Time &sealTime)
+    {
+        NS_LOG_FUNCTION(this);
+
+        block.SetDifficulty(m_miningDifficulty);
+        sealTime = Simulator::Now();
+        if (m_miningDifficulty == 0)
+        {
+            return true;
+        }
+
+        // The time stamp is in the header, so each step of it is a fresh 32-bit nonce space
+        PowMiner::Result result = m_miner.Mine(block.GetHeader(), m_miningDifficulty);
+        uint64_t attempts = result.attempts;
+        for (uint32_t extra = 0; !result.found && extra < MAX_EXTRA_NONCES; extra++)
+        {
+            NS_LOG_INFO("No nonce of block " << block.GetBlockHeight() << " meets difficulty " << m_miningDifficulty
+                        << ", moving its time stamp on");
+            block.SetTimeStamp(std::nextafter(block.GetTimeStamp(), std::numeric_limits<double>::infinity()));
+            result = m_miner.Mine(block.GetHeader(), m_miningDifficulty);
+            attempts += result.attempts;
+        }
+
+        double hashRate = m_miningHashRate > 0 ? m_miningHashRate : m_miner.GetHashRate();
+        Time miningTime = Seconds(hashRate > 0 ? attempts / hashRate : 0);
+        Time start = std::max(Simulator::Now(), m_minerBusyUntil);
+        m_minerBusyUntil = start + miningTime;
+        sealTime = m_minerBusyUntil;
+        if (!result.found)
+        {
+            return false;
+        }
+        block.SetNonce((int)result.nonce);
+
+        std::cout << "Block " << block.GetBlockHeight() << " mined: nonce = " << result.nonce << ", hash = "
+                  << ECDSA::toHex(result.hash) << ", attempts = " << attempts << ", mining time = "
+                  << miningTime.GetSeconds() << "s (" << result.hashes << " hashes in " << result.seconds << "s)\n";
+        return true;
+    }
+
+    void
+    CloudServer::ReplicateBlock(std::shared_ptr<SealedBlock> block, PipelineStage::Done done)
+    {
+        NS_LOG_FUNCTION(this);
+
+        uint64_t index = m_raft.GetLastIndex() + 1;
+        if (!m_raft.IsLeader() || m_raft.GetTerm() != block->term || m_blockchain.GetBlockchainHeight() != (int)index)
+        {
+            // Sealed under an earlier term, the chain goes on from what the log holds
+            RollBack(index);
+            done();
+            return;
+        }
+
+        PendingReplication &pending = m_replicating[index];
+        pending.block = block;
+        pending.proposed = Simulator::Now();
+        pending.done = done;
+        m_raft.Propose(block->message);
+    }
+
+    void
+    CloudServer::CommitBlock(uint64_t index, const RaftConsensus::Entry &entry)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (!m_raft.IsLeader())
+        {
+            return;
+        }
+
+        const Block *block = m_blockchain.GetBlockAtHeight(index);
+        if (m_nodeStats)
+        {
+            m_nodeStats->committedBlocks++;
+            m_nodeStats->committedTransactions += block ? block->GetTransactions().size() : 0;
+        }
+
+        std::map<uint64_t, PendingReplication>::iterator pending = m_replicating.find(index);
+        if (pending != m_replicating.end())
+        {
+            PendingReplication replication = pending->second;
+            m_replicating.erase(pending);
+            if (m_nodeStats)
+            {
+                double latency = (Simulator::Now() - replication.proposed).GetSeconds();
+                m_nodeStats->commitLatencySamples++;
+                m_nodeStats->meanCommitLatency += (latency - m_nodeStats->meanCommitLatency) / m_nodeStats->commitLatencySamples;
+            }
+            replication.block->committed = true;
+            m_disseminatedHeight = std::max(m_disseminatedHeight, index);
+            replication.done();
+            return;
+        }
+
+        // Replicated by an earlier leader and committed along with the first block of this term
+        DisseminateCommitted(index, entry);
+    }
+
+    void
+    CloudServer::DisseminateCommitted(uint64_t index, const RaftConsensus::Entry &entry)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (index <= m_disseminatedHeight)
+        {
+            return;
+        }
+        m_disseminatedHeight = index;
+
+        std::shared_ptr<SealedBlock> sealed = std::make_shared<SealedBlock>();
+        sealed->message = entry.data;
+        sealed->term = entry.term;
+        sealed->committed = true;
+        m_disseminateStage.Push(
+            [this, sealed](PipelineStage::Done done) { DisseminateBlock(sealed, done); },
+            []() {});
+    }
+
+    void
+    CloudServer::AppendReplicatedBlock(uint64_t index, const RaftConsensus::Entry &entry)
+    {
+        NS_LOG_FUNCTION(this);
+
+        Block block;
+        if (!DecodeBlock(entry.data, block) || block.GetBlockHeight() != (int)index)
+        {
+            NS_LOG_WARN("Block " << index << " from the leader is corrupted");
+            return;
+        }
+
+        // Settled here as on the leader, the ledger of the block follows from it
+        BlockExecutor::Result execution = m_executor.Execute(block.GetTransactions(), m_balances);
+        if (execution.settled != block.GetSettled())
+        {
+            NS_LOG_WARN("Node " << GetNode()->GetId() << " settles block " << index << " differently from the leader");
+        }
+        block.SetSettled(execution.settled);
+        m_blockchain.AddBlock(block);
+        if (m_blockchain.GetLedger().GetRoot() != block.GetStateRoot())
+        {
+            NS_LOG_WARN("The payment ledger of node " << GetNode()->GetId() << " does not match the state root of block " << index);
+        }
+        NS_LOG_INFO("Node " << GetNode()->GetId() << " appends block " << index << " of term " << entry.term);
+    }
+
+    void
+    CloudServer::RollBack(uint64_t height)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (m_blockchain.GetBlockchainHeight() < (int)height)
+        {
+            return;
+        }
+
+        std::cout << "Cloud server " << GetNode()->GetId() << " drops the blocks from height " << height << " on\n";
+        m_blockchain.RemoveBlocksAbove(height - 1);
+        m_balances.clear();
+        for (int blockHeight = 1; blockHeight < (int)height; blockHeight++)
+        {
+            const Block *block = m_blockchain.GetBlockAtHeight(blockHeight);
+            if (block)
+            {
+                m_executor.ExecuteSequential(block->GetTransactions(), m_balances);
+            }
+        }
+    }
+
+    void
+    CloudServer::ChangeLeader(uint32_t leaderId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (leaderId == GetNode()->GetId())
+        {
+            if (m_raft.GetClusterSize() > 1)
+            {
+                std::cout << "Cloud server " << GetNode()->GetId() << " leads the ordering cluster in term " << m_raft.GetTerm()
+                          << " at " << Simulator::Now().GetSeconds() << "s\n";
+
+                rapidjson::Document hintD;
+                hintD.SetObject();
+                rapidjson::Value value;
+                value.SetString("leader");
+                hintD.AddMember("type", value, hintD.GetAllocator());
+                hintD.AddMember("message", LEADER_HINT, hintD.GetAllocator());
+                hintD.AddMember("leaderId", GetNode()->GetId(), hintD.GetAllocator());
+                for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+                {
+                    SendMessage(LEADER_HINT, LEADER_HINT, hintD, m_peersSockets[*i]);
+                }
+            }
+
+            // Blocks committed while this server followed were never disseminated
+            for (uint64_t index = m_disseminatedHeight + 1; index <= m_raft.GetCommitIndex(); index++)
+            {
+                DisseminateCommitted(index, m_raft.GetEntry(index));
+            }
+            SealNoOp(m_raft.GetTerm());
+            return;
+        }
+
+        // What this server did not get committed as leader is up to the next one
+        m_nextMiningEvent.Cancel();
+        m_blockBuilder.Take();
+        std::map<uint64_t, PendingReplication> replicating;
+        replicating.swap(m_replicating);
+        for (auto &pending : replicating)
+        {
+            pending.second.done();
+        }
+        RollBack(m_raft.GetLastIndex() + 1);
+
+        // Admitted requests not yet ingested go on to the next leader, or wait for one
+        AdmissionQueue::Request request;
+        while (m_admissionQueue.Dequeue(request, Simulator::Now()))
+        {
+            m_heldRequests.push_back(request.message);
+        }
+
+        if (leaderId != RaftConsensus::NO_LEADER)
+        {
+            std::vector<std::string> held;
+            held.swap(m_heldRequests);
+            for (const std::string &message : held)
+            {
+                RedirectRequest(message, Address());
+            }
+        }
+    }
+
+    void
+    CloudServer::SealNoOp(uint64_t term)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (!m_raft.IsLeader() || m_raft.GetTerm() != term || m_raft.GetCommitIndex() >= m_raft.GetLastIndex()
+            || m_raft.GetEntry(m_raft.GetLastIndex()).term == term)
+        {
+            return;
+        }
+        if (!m_sealStage.HasRoom())
+        {
+            m_sealStage.WhenRoom([this, term]() { SealNoOp(term); });
+            return;
+        }
+
+        SealOpenBlock();
+    }
+
+    void
+    CloudServer::RedirectRequest(const std::string &message, Address from)
+    {
+        NS_LOG_FUNCTION(this);
+
+        const uint8_t delimiter[] = "#";
+
+        std::map<uint32_t, Ptr<Socket>>::iterator leader = m_clusterSockets.find(m_raft.GetLeaderId());
+        if (leader == m_clusterSockets.end())
+        {
+            m_heldRequests.push_back(message);
+            return;
+        }
+
+        m_redirectedRequests++;
+        leader->second->Send(reinterpret_cast<const uint8_t*>(message.data()), message.size(), 0);
+        leader->second->Send(delimiter, 1, 0);
+
+        if (InetSocketAddress::IsMatchingType(from))
+        {
+            rapidjson::Document hintD;
+            hintD.SetObject();
+            rapidjson::Value value;
+            value.SetString("leader");
+            hintD.AddMember("type", value, hintD.GetAllocator());
+            hintD.AddMember("message", LEADER_HINT, hintD.GetAllocator());
+            hintD.AddMember("leaderId", m_raft.GetLeaderId(), hintD.GetAllocator());
+            SendMessage(REQUEST_BLOCK, LEADER_HINT, hintD, from);
+        }
+    }
+
+    void
+    CloudServer::SendRequestVote(uint32_t peer, const RaftConsensus::RequestVote &request)
+    {
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("raft");
+        d.AddMember("type", value, allocator);
+        d.AddMember("message", RAFT_REQUEST_VOTE, allocator);
+        d.AddMember("term", request.term, allocator);
+        d.AddMember("candidateId", request.candidateId, allocator);
+        d.AddMember("lastLogIndex", request.lastLogIndex, allocator);
+        d.AddMember("lastLogTerm", request.lastLogTerm, allocator);
+
+        SendMessage(RAFT_REQUEST_VOTE, RAFT_REQUEST_VOTE, d, m_clusterSockets[peer]);
+    }
+
+    void
+    CloudServer::SendVote(uint32_t peer, const RaftConsensus::Vote &vote)
+    {
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("raft");
+        d.AddMember("type", value, allocator);
+        d.AddMember("message", RAFT_VOTE, allocator);
+        d.AddMember("term", vote.term, allocator);
+        d.AddMember("voterId", vote.voterId, allocator);
+        d.AddMember("granted", vote.granted, allocator);
+
+        SendMessage(RAFT_REQUEST_VOTE, RAFT_VOTE, d, m_clusterSockets[peer]);
+    }
+
+    void
+    CloudServer::SendAppendEntries(uint32_t peer, const RaftConsensus::AppendEntries &append)
+    {
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("raft");
+        d.AddMember("type", value, allocator);
+        d.AddMember("message", RAFT_APPEND_ENTRIES, allocator);
+        d.AddMember("term", append.term, allocator);
+        d.AddMember("leaderId", append.leaderId, allocator);
+        d.AddMember("prevLogIndex", append.prevLogIndex, allocator);
+        d.AddMember("prevLogTerm", append.prevLogTerm, allocator);
+        d.AddMember("leaderCommit", append.leaderCommit, allocator);
+
+        // The blocks travel as the BROADCAST_BLOCK the leader sealed
+        rapidjson::Value entries(rapidjson::kArrayType);
+        for (const RaftConsensus::Entry &entry : append.entries)
+        {
+            rapidjson::Value entryInfo(rapidjson::kObjectType);
+            entryInfo.AddMember("term", entry.term, allocator);
+            value.SetString(entry.data.data(), entry.data.size(), allocator);
+            entryInfo.AddMember("block", value, allocator);
+            entries.PushBack(entryInfo, allocator);
+        }
+        d.AddMember("entries", entries, allocator);
+
+        SendMessage(RAFT_APPEND_ENTRIES, RAFT_APPEND_ENTRIES, d, m_clusterSockets[peer]);
+    }
+
+    void
+    CloudServer::SendAppendReply(uint32_t peer, const RaftConsensus::AppendReply &reply)
+    {
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("raft");
+        d.AddMember("type", value, allocator);
+        d.AddMember("message", RAFT_APPEND_REPLY, allocator);
+        d.AddMember("term", reply.term, allocator);
+        d.AddMember("followerId", reply.followerId, allocator);
+        d.AddMember("success", reply.success, allocator);
+        d.AddMember("matchIndex", reply.matchIndex, allocator);
+        d.AddMember("entries", reply.entries, allocator);
+
+        SendMessage(RAFT_APPEND_ENTRIES, RAFT_APPEND_REPLY, d, m_clusterSockets[peer]);
+    }
+
+    void
+    CloudServer::Checkpoint(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (!m_raft.IsLeader())
+        {
+            m_reportedHeight = 0;
+        }
+        else
+        {
+            int height = m_raft.GetCommitIndex();
+            const Block *block = m_blockchain.GetBlockAtHeight(height);
+            if (block && height > m_reportedHeight)
+            {
+                CheckpointChain::ShardHead head;
+                head.shardId = m_shardId;
+                head.height = height;
+                head.blockHash = block->GetHash();
+                head.stateRoot = block->GetStateRoot();
+                m_reportedHeight = height;
+                if (m_shardId == 0)
+                {
+                    m_checkpoints.UpdateHead(head);
+                }
+                else
+                {
+                    SendShardHead(head);
+                }
+            }
+
+            CheckpointChain::Checkpoint checkpoint;
+            if (m_shardId == 0 && m_checkpoints.Seal(Simulator::Now().GetSeconds(), checkpoint))
+            {
+                std::cout << "Cloud server " << GetNode()->GetId() << " seals checkpoint " << checkpoint.number << " at "
+                          << Simulator::Now().GetSeconds() << "s, shard heights";
+                for (const CheckpointChain::ShardHead &shardHead : checkpoint.heads)
+                {
+                    std::cout << " " << shardHead.height;
+                }
+                std::cout << "\n";
+                SendCheckpoint(checkpoint);
+            }
+        }
+
+        m_checkpointEvent = Simulator::Schedule(m_checkpointInterval, &CloudServer::Checkpoint, this);
+    }
+
+    static void
+    AddShardHead(rapidjson::Value &object, const CheckpointChain::ShardHead &head, rapidjson::Document::AllocatorType &allocator)
+    {
+        rapidjson::Value value;
+        object.AddMember("shardId", head.shardId, allocator);
+        object.AddMember("height", head.height, allocator);
+        value.SetString(ECDSA::toHex(head.blockHash).c_str(), allocator);
+        object.AddMember("blockHash", value, allocator);
+        value.SetString(ECDSA::toHex(head.stateRoot).c_str(), allocator);
+        object.AddMember("stateRoot", value, allocator);
+    }
+
+    void
+    CloudServer::SendShardHead(const CheckpointChain::ShardHead &head)
+    {
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("checkpoint");
+        d.AddMember("type", value, allocator);
+        d.AddMember("message", SHARD_HEAD, allocator);
+        AddShardHead(d, head, allocator);
+
+        // Every server of shard 0, whichever of them leads it
+        std::map<uint32_t, std::map<uint32_t, Ipv4Address>>::const_iterator checkpointers = m_shardAddresses.find(0);
+        if (checkpointers == m_shardAddresses.end())
+        {
+            return;
+        }
+        for (auto &peer : checkpointers->second)
+        {
+            SendMessage(SHARD_HEAD, SHARD_HEAD, d, m_shardSockets[peer.first]);
+        }
+    }
+
+    void
+    CloudServer::SendCheckpoint(const CheckpointChain::Checkpoint &checkpoint)
+    {
+        rapidjson::Document d;
+        d.SetObject();
+        rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("checkpoint");
+        d.AddMember("type", value, allocator);
+        d.AddMember("message", CHECKPOINT, allocator);
+        d.AddMember("number", checkpoint.number, allocator);
+        d.AddMember("timeStamp", checkpoint.timeStamp, allocator);
+        value.SetString(ECDSA::toHex(checkpoint.parentHash).c_str(), allocator);
+        d.AddMember("parentHash", value, allocator);
+        value.SetString(ECDSA::toHex(checkpoint.hash).c_str(), allocator);
+        d.AddMember("hash", value, allocator);
+
+        rapidjson::Value heads(rapidjson::kArrayType);
+        for (const CheckpointChain::ShardHead &head : checkpoint.heads)
+        {
+            rapidjson::Value headInfo(rapidjson::kObjectType);
+            AddShardHead(headInfo, head, allocator);
+            heads.PushBack(headInfo, allocator);
+        }
+        d.AddMember("heads", heads, allocator);
+
+        // The followers of shard 0 keep the global chain too, for when one of them leads
+        for (auto &peer : m_clusterSockets)
+        {
+            SendMessage(CHECKPOINT, CHECKPOINT, d, peer.second);
+        }
+        for (auto &peer : m_shardSockets)
+        {
+            SendMessage(CHECKPOINT, CHECKPOINT, d, peer.second);
+        }
+    }
+
+    bool
+    CloudServer::DecodeBlock(const std::string &blockMessage, Block &block)
+    {
+        // Full precision, the timestamps are part of the header
+        rapidjson::Document d;
+        d.Parse<rapidjson::kParseFullPrecisionFlag>(blockMessage.c_str());
+        const char *fields[] = {"blockHeight", "minerId", "nonce", "parentMinerId", "blockSize", "timeStamp",
+                                "difficulty", "parentHash", "stateRoot", "blockHash", "block"};
+        if (!d.IsObject())
+        {
+            return false;
+        }
+        for (const char *field : fields)
+        {
+            if (!d.HasMember(field))
+            {
+                return false;
+            }
+        }
+
+        Sha256Digest parentHash, stateRoot;
+        if (!ParseDigest(d["parentHash"], parentHash) || !ParseDigest(d["stateRoot"], stateRoot))
+        {
+            return false;
+        }
+
+        Block decoded(d["blockHeight"].GetInt(), d["minerId"].GetInt(), (int)d["nonce"].GetUint(), d["parentMinerId"].GetInt(),
+                      d["blockSize"].GetInt(), d["timeStamp"].GetDouble(), Simulator::Now().GetSeconds(), Ipv4Address("127.0.0.1"));
+        decoded.SetDifficulty(d["difficulty"].GetUint());
+        decoded.SetParentHash(parentHash);
+        decoded.SetStateRoot(stateRoot);
+
+        std::vector<Transaction> transactions;
+        const rapidjson::Value& trxs = d["block"];
+        for (rapidjson::SizeType j = 0; j < trxs.Size(); j++)
+        {
+            transactions.push_back(Transaction(trxs[j]["rsuNodeId"].GetInt(), trxs[j]["transId"].GetInt(), trxs[j]["timestamp"].GetDouble(),
+                                               trxs[j]["payment"].GetDouble(), trxs[j]["winnerId"].GetInt()));
+        }
+        decoded.SetTransactions(transactions);
+
+        std::vector<bool> settled;
+        for (rapidjson::SizeType j = 0; j < trxs.Size(); j++)
+        {
+            settled.push_back(trxs[j].HasMember("settled") && trxs[j]["settled"].IsBool() && trxs[j]["settled"].GetBool());
+        }
+        decoded.SetSettled(settled);
+
+        if (ECDSA::toHex(decoded.GetHash()) != d["blockHash"].GetString())
+        {
+            return false;
+        }
+        block = decoded;
+        return true;
+    }
+
+    void
+    CloudServer::DisseminateBlock(std::shared_ptr<const SealedBlock> block, PipelineStage::Done done)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (m_treeDissemination)
+        {
+            RelayBlock(block, done);
+            return;
+        }
+        if (m_chunkedDissemination)
+        {
+            SpreadShreds(block, done);
+            return;
+        }
+
+        Time offset = Seconds(0);
+        for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+        {
+            Simulator::Schedule(offset, &CloudServer::SendBlock, this, block, *i);
+            offset += m_disseminateTime;
+        }
+        Simulator::Schedule(offset, done);
+    }
+
+    void
+    CloudServer::SendBlock(std::shared_ptr<const SealedBlock> block, Ipv4Address peer)
+    {
+        NS_LOG_FUNCTION(this);
+
+        const uint8_t delimiter[] = "#";
+
+        if (m_crashed)
+        {
+            return;
+        }
+        m_peersSockets[peer]->Send(reinterpret_cast<const uint8_t*>(block->message.data()), block->message.size(), 0);
+        m_peersSockets[peer]->Send(delimiter, 1, 0);
+        if (m_nodeStats)
+        {
+            m_nodeStats->blockSentBytes += block->message.size() + 1;
+        }
+    }
+
+    void
+    CloudServer::RelayBlock(std::shared_ptr<const SealedBlock> block, PipelineStage::Done done)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::vector<uint32_t> order = m_tree.NextOrder();
+        uint64_t round = ++m_relayRound;
+        std::shared_ptr<const std::string> message = MakeRelayMessage(block, order, round);
+
+        // The server only feeds its own children, whatever the number of rsu nodes
+        Time offset = Seconds(0);
+        for (uint32_t child : OverlayTree::GetChildren(order, m_tree.GetFanout(), -1))
+        {
+            Simulator::Schedule(offset, &CloudServer::SendRelay, this, message, child);
+            offset += m_disseminateTime;
+        }
+        Simulator::Schedule(offset, done);
+
+        RelayRound &relay = m_relayRounds[round];
+        relay.block = block;
+        relay.pending.insert(order.begin(), order.end());
+        Simulator::Schedule(offset + m_treeAckTimeout, &CloudServer::ExpireRelay, this, round);
+    }
+
+    void
+    CloudServer::SpreadShreds(std::shared_ptr<const SealedBlock> block, PipelineStage::Done done)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::vector<uint32_t> order = m_tree.NextOrder();
+        uint64_t round = ++m_relayRound;
+        ShredHeader header;
+        std::vector<std::vector<uint8_t>> shreds = CutShreds(block, order, round, header);
+        m_shreddedBlocks++;
+
+        // Each shred leaves the server once, the members pass it on to one another; the
+        // server is busy for DisseminateTime per block's worth of bytes
+        Time offset = Seconds(0);
+        for (uint32_t index = 0; index < shreds.size() && !order.empty(); index++)
+        {
+            std::shared_ptr<const std::string> message = MakeShredMessage(header, index, shreds[index], 1);
+            Simulator::Schedule(offset, &CloudServer::SendShred, this, message, order[index % order.size()]);
+            offset += Seconds(m_disseminateTime.GetSeconds() * shreds[index].size() / std::max(header.length, 1u));
+            m_shredsSent++;
+        }
+        Simulator::Schedule(offset, done);
+
+        RelayRound &relay = m_relayRounds[round];
+        relay.block = block;
+        relay.pending.insert(order.begin(), order.end());
+        Simulator::Schedule(offset + m_treeAckTimeout, &CloudServer::ExpireRelay, this, round);
+    }
+
+    std::vector<std::vector<uint8_t>>
+    CloudServer::CutShreds(std::shared_ptr<const SealedBlock> block, const std::vector<uint32_t> &order,
+                           uint64_t round, ShredHeader &header)
+    {
+        NS_LOG_FUNCTION(this);
+
+        // Data and parity shreds have to fit in GF(2^8); a larger block gets larger shreds
+        uint32_t length = block->message.size();
+        uint32_t dataShreds = std::max((length + m_shredSize - 1) / m_shredSize, 1u);
+        while (dataShreds > 1 && dataShreds + (uint32_t)std::ceil(dataShreds * m_shredParity) > ReedSolomon::MAX_SHREDS)
+        {
+            dataShreds--;
+        }
+        uint32_t parityShreds = std::min((uint32_t)std::ceil(dataShreds * m_shredParity), ReedSolomon::MAX_SHREDS - dataShreds);
+
+        header.origin = GetNode()->GetId();
+        header.round = round;
+        header.dataShreds = dataShreds;
+        header.parityShreds = parityShreds;
+        header.length = length;
+        header.fanout = m_tree.GetFanout();
+        header.members = order;
+        header.disseminatedAt = Simulator::Now().GetSeconds();
+
+        std::vector<std::vector<uint8_t>> shreds = ReedSolomon::Split(block->message, dataShreds);
+        ReedSolomon(dataShreds, parityShreds).Encode(shreds);
+        return shreds;
+    }
+
+    std::shared_ptr<const std::string>
+    CloudServer::MakeRelayMessage(std::shared_ptr<const SealedBlock> block, const std::vector<uint32_t> &order, uint64_t round)
+    {
+        NS_LOG_FUNCTION(this);
+
+        rapidjson::Document relayD;
+        relayD.SetObject();
+        rapidjson::Document::AllocatorType &allocator = relayD.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("relay");
+        relayD.AddMember("type", value, allocator);
+        relayD.AddMember("message", RELAY_BLOCK, allocator);
+        relayD.AddMember("origin", GetNode()->GetId(), allocator);
+        relayD.AddMember("round", round, allocator);
+        relayD.AddMember("fanout", m_tree.GetFanout(), allocator);
+        rapidjson::Value members(rapidjson::kArrayType);
+        for (uint32_t nodeId : order)
+        {
+            members.PushBack(nodeId, allocator);
+        }
+        relayD.AddMember("members", members, allocator);
+        relayD.AddMember("hop", 1, allocator);
+        relayD.AddMember("sentAt", Simulator::Now().GetSeconds(), allocator);
+        relayD.AddMember("disseminatedAt", Simulator::Now().GetSeconds(), allocator);
+
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        relayD.Accept(writer);
+
+        // The sealed BROADCAST_BLOCK goes in as it is, without parsing it again
+        std::string message(buffer.GetString(), buffer.GetSize() - 1);
+        message += ",\"block\":" + block->message + "}";
+        return std::make_shared<const std::string>(message);
+    }
+
+    void
+    CloudServer::SendRelay(std::shared_ptr<const std::string> message, uint32_t nodeId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        const uint8_t delimiter[] = "#";
+
+        std::map<uint32_t, Ipv4Address>::iterator peer = m_peerIdToAddress.find(nodeId);
+        if (m_crashed || peer == m_peerIdToAddress.end())
+        {
+            return;
+        }
+        m_peersSockets[peer->second]->Send(reinterpret_cast<const uint8_t*>(message->data()), message->size(), 0);
+        m_peersSockets[peer->second]->Send(delimiter, 1, 0);
+        if (m_nodeStats)
+        {
+            m_nodeStats->blockSentBytes += message->size() + 1;
+        }
+    }
+
+    void
+    CloudServer::ExpireRelay(uint64_t round)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::map<uint64_t, RelayRound>::iterator relay = m_relayRounds.find(round);
+        if (relay == m_relayRounds.end())
+        {
+            return;
+        }
+        RelayRound expired = relay->second;
+        m_relayRounds.erase(relay);
+        if (m_crashed || expired.pending.empty())
+        {
+            return;
+        }
+
+        std::shared_ptr<const std::string> repair;
+        std::vector<std::shared_ptr<const std::string>> shredRepairs;
+        for (uint32_t nodeId : expired.pending)
+        {
+            if (!m_tree.IsLive(nodeId))
+            {
+                continue;
+            }
+            // A member that sent back for some of the shreds is up, it only lost the rest
+            if (!expired.heard.count(nodeId) && m_tree.Miss(nodeId))
+            {
+                std::cout << "Node " << nodeId << " missed " << m_treeFailureMisses << " blocks and leaves the overlay tree of cloud server "
+                          << GetNode()->GetId() << ", " << m_tree.GetNumberOfLiveMembers() << " members left\n";
+                continue;
+            }
+            // Most likely below a relay that failed, the node still gets the block
+            if (m_chunkedDissemination)
+            {
+                // Every shred, without a tree, the node keeps the ones it has; cut and encoded once per round
+                if (shredRepairs.empty())
+                {
+                    ShredHeader header;
+                    std::vector<std::vector<uint8_t>> shreds = CutShreds(expired.block, std::vector<uint32_t>(), round, header);
+                    for (uint32_t index = 0; index < shreds.size(); index++)
+                    {
+                        shredRepairs.push_back(MakeShredMessage(header, index, shreds[index], 1));
+                    }
+                }
+                for (const std::shared_ptr<const std::string> &message : shredRepairs)
+                {
+                    SendShred(message, nodeId);
+                }
+                m_relayRepairs++;
+                continue;
+            }
+            if (!repair)
+            {
+                repair = MakeRelayMessage(expired.block, std::vector<uint32_t>(), round);
+            }
+            m_relayRepairs++;
+            SendRelay(repair, nodeId);
         }
-        
     }
 }
 
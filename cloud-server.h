@@ -1,5 +1,14 @@
 #include "rsu-node.h"
+#include "verification-cache.h"
+#include "pow-miner.h"
+#include "block-executor.h"
+#include "block-builder.h"
+#include "pipeline-stage.h"
+#include "raft-consensus.h"
+#include "checkpoint-chain.h"
+#include "admission-queue.h"
 #include <random>
+#include <set>
 #ifndef CLOUD_SERVER_H
 #define CLOUD_SERVER_H
 
@@ -9,6 +18,76 @@ namespace ns3{
     class Socket;
     class Packet;
 
+    /*
+     * A REQUEST_BLOCK whose endorsement certificate is being checked.
+     */
+    struct PendingCertificate
+    {
+        std::string message;            // the REQUEST_BLOCK as received
+        EndorsementCertificate endorsements;
+        Sha256Digest digest;            // of the payload every endorser signed
+        uint32_t remaining;             // endorsements still being checked
+        bool isValid;                   // false once one endorsement failed
+        PipelineStage::Done verified;   // ends the certificate's turn in the verify stage
+    };
+
+    /*
+     * The check of one endorsement, run on the crypto worker pool.
+     */
+    struct PendingVerification
+    {
+        std::shared_ptr<PendingCertificate> certificate;
+        long hashMsg;                   // of the payload, set by QueueVerification
+        uint32_t keyId, keyEpoch;
+        std::shared_ptr<const PrecomputedKey> key;
+        long p, a, n;                   // copied from key by QueueVerification
+        long xG, yG, xQ, yQ;
+        long r, s;
+        bool isValid;
+        bool cached;                    // isValid came from the verification cache
+        std::shared_future<void> done;
+    };
+
+    /*
+     * A block from the seal stage to the end of its replication.
+     */
+    struct SealedBlock
+    {
+        std::string message;            // the BROADCAST_BLOCK, empty if the block was not sealed
+        uint64_t term;                  // of the leader that sealed it
+        bool committed;
+    };
+
+    /*
+     * A block of this leader waiting for the cluster to commit it.
+     */
+    struct PendingReplication
+    {
+        std::shared_ptr<SealedBlock> block;
+        Time proposed;
+        PipelineStage::Done done;       // ends the block's turn in the replicate stage
+    };
+
+    /*
+     * A block sent down the overlay tree, until the time its acknowledgements are due.
+     */
+    struct RelayRound
+    {
+        std::shared_ptr<const SealedBlock> block;
+        std::set<uint32_t> pending;     // members whose RELAY_ACK has not come yet
+        std::set<uint32_t> heard;       // pending members that got some of the shreds, they are up
+    };
+
+    /*
+     * The acknowledgements of the members the same number of hops below the server.
+     */
+    struct RelayHopStats
+    {
+        long    samples;
+        double  meanDelay;              // from the dissemination of the block
+        double  meanHopDelay;           // of the last hop
+    };
+
     class CloudServer : public RsuNode
     {
 
@@ -20,6 +99,31 @@ namespace ns3{
 
             ~CloudServer(void);
 
+            /*
+             * The other cloud servers of the ordering cluster, by node id; without any the
+             * server orders on its own.
+             */
+            void SetClusterPeers(const std::map<uint32_t, Ipv4Address> &peers);
+
+            /*
+             * The cloud servers of the other shards, by shard id and node id. The leaders
+             * report their heads to shard 0, whose leader seals the checkpoints.
+             */
+            void SetShardPeers(const std::map<uint32_t, std::map<uint32_t, Ipv4Address>> &shards);
+
+            /*
+             * The peers of every rsu node, by node id, out of which the endorsement policy
+             * picks the endorsers of its transactions.
+             */
+            void SetSubmitterPeers(const std::map<uint32_t, std::vector<uint32_t>> &peerIds);
+
+            bool IsLeader(void) const;
+
+            /*
+             * Stops the server for the rest of the run, as if it failed.
+             */
+            void Crash(void);
+
 
         protected:
 
@@ -27,20 +131,313 @@ namespace ns3{
             virtual void StopApplication(void);
             virtual void HandleRead (Ptr<Socket> socket);
 
+            /*
+             * Puts a REQUEST_BLOCK that reached the leader in the admission queue, and sends
+             * BACKPRESSURE to the node whose request was turned away or evicted, and to the
+             * sender once the queue says it should slow down.
+             */
+            void AdmitRequest(const std::string &message, uint32_t rsuNodeId, int transId, double payment);
+
+            /*
+             * Hands the next admitted request to the ingest stage whenever its queue is
+             * empty, so the admission policy rather than the arrival order decides what
+             * goes in next.
+             */
+            void PumpAdmission(void);
+
+            /*
+             * Tells the node to wait the time the queue takes to drain before it sends
+             * again; with rejected, the request transId was dropped and may be resent.
+             */
+            void SendBackpressure(uint32_t rsuNodeId, int transId, bool rejected);
+
+            /*
+             * Queues a REQUEST_BLOCK on the ingest stage, which decodes its certificate
+             * and hands it to the verify stage.
+             */
+            void IngestRequest(const std::string &message);
+
+            /*
+             * Decodes the transaction and certificate of a REQUEST_BLOCK; nullptr if it
+             * carries no endorsement or fails the endorsement policy.
+             */
+            std::shared_ptr<PendingCertificate> ParseRequest(const std::string &message);
+
+            /*
+             * True if the certificate holds the quorum of distinct endorsers the policy
+             * designates for the transaction, none of them the submitter.
+             */
+            bool MeetsEndorsementPolicy(const EndorsementCertificate &certificate, uint32_t rsuNodeId, int transId) const;
+
+            /*
+             * Queues one check per endorsement of the certificate.
+             */
+            void VerifyCertificate(std::shared_ptr<PendingCertificate> certificate);
+
+            /*
+             * Adds a check whose key is registered to the next batch.
+             */
+            void QueueVerification(std::shared_ptr<PendingVerification> job);
+
+            /*
+             * Checks every signature queued at the current simulated time in one
+             * ECDSA::checkSignatureBatch call on the worker pool.
+             */
+            void FlushVerifications(void);
+
+            /*
+             * Records the result of one endorsement check.
+             */
+            void CompleteVerification(std::shared_ptr<PendingVerification> job);
 
-            uint32_t m_fixedBlockSize;
+            /*
+             * Hands the transaction of a verified certificate to the order stage.
+             */
+            void CompleteCertificate(std::shared_ptr<PendingCertificate> certificate);
+
+            /*
+             * Adds a verified transaction to the open block, cutting the block first if the
+             * transaction does not fit and afterwards if the block is full.
+             */
+            void AddToBlock(const Transaction &transaction);
+
+            /*
+             * Cuts the open block at its deadline.
+             */
+            void ScheduleNextMiningEvent(void);
+
+            /*
+             * Moves the open block to the seal stage, or waits until that stage has room.
+             * A server that is not the leader drops the open block.
+             */
+            void CutBlock(void);
+
+            /*
+             * Pushes the open block, even if it is empty, through seal, replicate and
+             * disseminate.
+             */
+            void SealOpenBlock(void);
+
+            /*
+             * Mines, settles and adds a block and writes its BROADCAST_BLOCK to blockMessage.
+             * Returns the simulated time the block is mined; blockMessage stays empty if no
+             * nonce met the difficulty, and nothing is settled or added then.
+             */
+            Time SealBlock(const std::vector<Transaction> &transactions, uint32_t sizeBytes, std::string &blockMessage);
+
+            /*
+             * Finds the nonce of the block and sets sealTime to the simulated time it is
+             * sealed at: the miner works one block at a time, taking the attempts a single
+             * miner needs over the hash rate; now when the difficulty is 0. When no 32-bit
+             * nonce is valid the time stamp moves on by one step and the search starts over,
+             * up to MAX_EXTRA_NONCES times. False if the block still misses its difficulty.
+             */
+            bool MineBlock(Block &block, Time &sealTime);
+
+            /*
+             * Proposes the block to the cluster; done once it is committed, or at once if
+             * this server stopped leading since it sealed the block.
+             */
+            void ReplicateBlock(std::shared_ptr<SealedBlock> block, PipelineStage::Done done);
+
+            /*
+             * Called for every block the cluster commits. The leader hands its own blocks
+             * back to the replicate stage and disseminates the ones of earlier leaders.
+             */
+            void CommitBlock(uint64_t index, const RaftConsensus::Entry &entry);
+
+            /*
+             * Disseminates a committed block this server did not seal itself.
+             */
+            void DisseminateCommitted(uint64_t index, const RaftConsensus::Entry &entry);
+
+            /*
+             * Adds a block a follower received from the leader to its chain.
+             */
+            void AppendReplicatedBlock(uint64_t index, const RaftConsensus::Entry &entry);
+
+            /*
+             * Drops the blocks from the height on and settles the balances again up to it.
+             */
+            void RollBack(uint64_t height);
+
+            /*
+             * Called when the leader of the cluster changes: a new leader announces itself
+             * and commits the blocks of earlier terms with an empty block, which stands in
+             * for the no-op of Raft; a server that stops leading gives up its open and
+             * uncommitted blocks.
+             */
+            void ChangeLeader(uint32_t leaderId);
+
+            /*
+             * Seals the empty block of a new leader, once the seal stage has room; dropped
+             * if the server no longer leads in the term or a block of the term is in the log.
+             */
+            void SealNoOp(uint64_t term);
+
+            /*
+             * Sends a REQUEST_BLOCK that reached a follower on to the leader and names the
+             * leader to the rsu node; held back while there is no leader.
+             */
+            void RedirectRequest(const std::string &message, Address from);
+
+            void SendRequestVote(uint32_t peer, const RaftConsensus::RequestVote &request);
+            void SendVote(uint32_t peer, const RaftConsensus::Vote &vote);
+            void SendAppendEntries(uint32_t peer, const RaftConsensus::AppendEntries &append);
+            void SendAppendReply(uint32_t peer, const RaftConsensus::AppendReply &reply);
+
+            /*
+             * Every CheckpointInterval the leader of a shard reports its committed head to
+             * shard 0, and the leader of shard 0 seals a checkpoint of the latest heads and
+             * sends it to every other cloud server.
+             */
+            void Checkpoint(void);
+            void SendShardHead(const CheckpointChain::ShardHead &head);
+            void SendCheckpoint(const CheckpointChain::Checkpoint &checkpoint);
+
+            /*
+             * Rebuilds the block of a BROADCAST_BLOCK; false if a field is missing or the
+             * block does not hash to its blockHash.
+             */
+            static bool DecodeBlock(const std::string &blockMessage, Block &block);
+
+            /*
+             * Sends the BROADCAST_BLOCK to the peers one after the other, DisseminateTime apart,
+             * or down the overlay tree in tree dissemination.
+             */
+            void DisseminateBlock(std::shared_ptr<const SealedBlock> block, PipelineStage::Done done);
+            void SendBlock(std::shared_ptr<const SealedBlock> block, Ipv4Address peer);
+
+            /*
+             * Sends the block to the children of the server in the overlay tree, which pass
+             * it on to theirs; the members that do not acknowledge it within TreeAckTimeout
+             * get it straight from the server.
+             */
+            void RelayBlock(std::shared_ptr<const SealedBlock> block, PipelineStage::Done done);
+
+            /*
+             * The RELAY_BLOCK of a block for the members in order; an empty order makes
+             * one for a single node that passes it on to nobody.
+             */
+            std::shared_ptr<const std::string> MakeRelayMessage(std::shared_ptr<const SealedBlock> block,
+                                                                 const std::vector<uint32_t> &order, uint64_t round);
+            void SendRelay(std::shared_ptr<const std::string> message, uint32_t nodeId);
+
+            /*
+             * Sends every shred of the block to the member it starts at, which passes it on
+             * down the tree of that shred; the members that do not rebuild the block within
+             * TreeAckTimeout get every shred straight from the server.
+             */
+            void SpreadShreds(std::shared_ptr<const SealedBlock> block, PipelineStage::Done done);
+
+            /*
+             * Cuts the block into ShredSize data shreds and their parity shreds, and fills in
+             * the header the shreds share.
+             */
+            std::vector<std::vector<uint8_t>> CutShreds(std::shared_ptr<const SealedBlock> block, const std::vector<uint32_t> &order,
+                                                        uint64_t round, ShredHeader &header);
+
+            /*
+             * Counts a miss for every member that did not acknowledge the round, which
+             * leaves the ones that missed TreeFailureMisses in a row out of the next
+             * tree, and repairs the others.
+             */
+            void ExpireRelay(uint64_t round);
+
+
+            static const uint32_t MAX_EXTRA_NONCES = 16;   // time stamps MineBlock tries per block
+
+            uint32_t m_fixedBlockSize;              // bytes of a full block, 0 for no limit
+            uint32_t m_maxBlockTransactions;        // transactions of a full block, 0 for no limit
+            Time    m_minBlockInterval;
+            Time    m_maxBlockInterval;
+            BlockBuilder m_blockBuilder;
             int m_nextBlockSize;
-            std::default_random_engine  m_generator;
             double  m_timeStart;
             bool    m_fistToMine;
             double  m_meanNumberofTransactions;
-            double  m_fixedBlockTimeGeneration;
-            double  m_nextBlockTime;
             int m_minerGeneratedBlocks;
             double  m_minerAverageBlockGenInterval;
             double  m_previousBlockGenerationTime;
             double  m_minerAverageBlockSize;
-            EventId m_nextMiningEvent;
+            EventId m_nextMiningEvent;              // seals the open block at its deadline
+            PowMiner m_miner;
+            uint32_t m_miningDifficulty;
+            uint32_t m_miningThreads;
+            double  m_miningHashRate;               // simulated hashes per second, 0 uses the measured rate
+            Time    m_minerBusyUntil;
+            std::vector<std::shared_ptr<PendingVerification>> m_pendingVerifications;
+            std::map<std::pair<uint32_t, uint32_t>, std::vector<std::shared_ptr<PendingVerification>>> m_unregisteredKeyVerifications;
+            VerificationCache m_verificationCache;
+            uint32_t m_verificationCacheSize;
+            BlockExecutor m_executor;               // settles the payments of every sealed block
+            BlockExecutor::State m_balances;        // of every account after the top block
+            uint32_t m_executionThreads;
+            double  m_initialBalance;
+            uint32_t m_stateSnapshotInterval;
+
+            // ingest -> verify -> order -> seal -> replicate -> disseminate
+            PipelineStage m_ingestStage;
+            PipelineStage m_verifyStage;
+            PipelineStage m_orderStage;
+            PipelineStage m_sealStage;
+            PipelineStage m_replicateStage;
+            PipelineStage m_disseminateStage;
+            uint32_t m_pipelineQueueSize;
+            Time    m_ingestTime;                   // per REQUEST_BLOCK
+            Time    m_orderTime;                    // per transaction
+            Time    m_sealTime;                     // per transaction of the block, mining aside
+            Time    m_disseminateTime;              // per peer
+            bool    m_cutPending;                   // the open block waits for room in the seal stage
+
+            RaftConsensus m_raft;                   // orders the blocks of the cluster, log index = block height
+            std::map<uint32_t, Ipv4Address> m_clusterAddresses;
+            std::map<uint32_t, Ptr<Socket>> m_clusterSockets;
+            Time    m_electionTimeout;
+            Time    m_heartbeatInterval;
+            uint32_t m_raftBatchEntries;            // blocks per AppendEntries, 0 for no limit
+            uint32_t m_raftInflightAppends;         // AppendEntries outstanding per follower
+            std::map<uint64_t, PendingReplication> m_replicating;  // by log index
+            uint64_t m_disseminatedHeight;          // the highest committed block handed to the disseminate stage
+            std::vector<std::string> m_heldRequests;    // REQUEST_BLOCKs waiting for a leader
+            std::map<uint32_t, std::vector<uint32_t>> m_submitterPeerIds;  // peers of every rsu node, by node id
+            long    m_rejectedCertificates;
+            long    m_redirectedRequests;
+
+            uint32_t m_shardId;
+            uint32_t m_numberOfShards;
+            std::map<uint32_t, std::map<uint32_t, Ipv4Address>> m_shardAddresses;  // by shard id, then node id
+            std::map<uint32_t, Ptr<Socket>> m_shardSockets;     // by node id
+            CheckpointChain m_checkpoints;          // the global chain, sealed by the leader of shard 0
+            Time    m_checkpointInterval;
+            EventId m_checkpointEvent;
+            int     m_reportedHeight;               // the last head this leader reported
+
+            AdmissionQueue m_admissionQueue;        // REQUEST_BLOCKs waiting for the ingest stage
+            std::string m_admissionPolicy;
+            uint32_t m_admissionQueueSize;          // requests, 0 for no bound
+            double  m_admissionWatermark;
+            uint32_t m_fairShareQuantum;            // bytes
+            Time    m_minRetryAfter;
+            bool    m_pumpWaiting;                  // PumpAdmission waits for room in the ingest stage
+            std::map<uint32_t, Time> m_backpressureUntil;   // by rsu node, no slow down signal before
+            long    m_backpressureSignals;
+
+            std::string m_dissemination;            // unicast, tree or chunked
+            bool    m_treeDissemination;
+            OverlayTree m_tree;                     // over the rsu nodes of this server
+            uint32_t m_treeFanout;
+            Time    m_treeAckTimeout;
+            uint32_t m_treeFailureMisses;
+            uint64_t m_relayRound;
+            std::map<uint64_t, RelayRound> m_relayRounds;   // by round
+            std::vector<RelayHopStats> m_relayHops;         // by hops - 1
+            long    m_relayRepairs;
+            bool    m_chunkedDissemination;
+            uint32_t m_shredSize;                   // bytes of a data shred, grown for blocks that need more than 255 shreds
+            double  m_shredParity;                  // parity shreds per data shred
+            long    m_shreddedBlocks;
+            long    m_shredsSent;
         
     };
     
@@ -13,6 +13,18 @@ namespace ns3 {
         RESPONSE_TRANS,    //1
         REQUEST_BLOCK,          //2 
         BROADCAST_BLOCK,
+        REGISTER_KEY,           // a node announces its public key (keyId, epoch)
+        LEADER_HINT,            // a cloud server names the leader of the ordering cluster
+        RAFT_REQUEST_VOTE,      // between the cloud servers of the ordering cluster
+        RAFT_VOTE,
+        RAFT_APPEND_ENTRIES,
+        RAFT_APPEND_REPLY,
+        SHARD_HEAD,             // the leader of a shard reports its committed head to shard 0
+        CHECKPOINT,             // the leader of shard 0 anchors the heads of every shard
+        BACKPRESSURE,           // a cloud server asks an rsu node to slow down, or to resend a request it turned away
+        RELAY_BLOCK,            // a block on its way down the overlay tree, with the tree it follows
+        RELAY_ACK,              // an rsu node tells the cloud server it got a block of the tree
+        SHRED,                  // one erasure coded piece of a block, with the tree the piece follows
     };
 }
 
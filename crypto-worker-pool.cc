@@ -0,0 +1,109 @@
+#include "crypto-worker-pool.h"
+
+namespace ns3 {
+
+    CryptoWorkerPool&
+    CryptoWorkerPool::GetInstance(void)
+    {
+        static CryptoWorkerPool instance;
+        return instance;
+    }
+
+    CryptoWorkerPool::CryptoWorkerPool(void)
+    {
+        m_stopping = false;
+        m_totalJobs = 0;
+    }
+
+    CryptoWorkerPool::~CryptoWorkerPool(void)
+    {
+        Shutdown();
+    }
+
+    void
+    CryptoWorkerPool::SetNumberOfThreads(unsigned int numberOfThreads)
+    {
+        Shutdown();
+
+        m_stopping = false;
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            m_workers.emplace_back(&CryptoWorkerPool::WorkerLoop, this);
+        }
+    }
+
+    unsigned int
+    CryptoWorkerPool::GetNumberOfThreads(void) const
+    {
+        return m_workers.size();
+    }
+
+    std::shared_future<void>
+    CryptoWorkerPool::Submit(std::function<void(void)> job)
+    {
+        std::packaged_task<void(void)> task(std::move(job));
+        std::shared_future<void> result = task.get_future().share();
+
+        m_totalJobs++;
+
+        if (m_workers.empty())
+        {
+            task();
+            return result;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(task));
+        }
+        m_condition.notify_one();
+
+        return result;
+    }
+
+    void
+    CryptoWorkerPool::Shutdown(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+
+        for (auto &worker : m_workers)
+        {
+            worker.join();
+        }
+        m_workers.clear();
+    }
+
+    long
+    CryptoWorkerPool::GetTotalJobs(void) const
+    {
+        return m_totalJobs;
+    }
+
+    void
+    CryptoWorkerPool::WorkerLoop(void)
+    {
+        while (true)
+        {
+            std::packaged_task<void(void)> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+
+                // Drain the queue before leaving so no continuation waits forever
+                if (m_jobs.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            task();
+        }
+    }
+
+}
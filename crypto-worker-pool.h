@@ -0,0 +1,63 @@
+#ifndef CRYPTO_WORKER_POOL_H
+#define CRYPTO_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Runs ECDSA signing and verification jobs off the ns-3 event thread.
+     *
+     * A job only touches the data it was handed; the caller schedules the
+     * continuation at a fixed simulated time and waits on the returned future
+     * there, so the simulation does not depend on how fast the workers are.
+     * With zero threads every job runs inline inside Submit(), which gives
+     * exactly the same results as a multithreaded run.
+     */
+    class CryptoWorkerPool
+    {
+        public:
+            static CryptoWorkerPool& GetInstance(void);
+
+            virtual ~CryptoWorkerPool(void);
+
+            /*
+             * Stops the current workers and starts numberOfThreads new ones.
+             * Zero disables the pool.
+             */
+            void SetNumberOfThreads(unsigned int numberOfThreads);
+            unsigned int GetNumberOfThreads(void) const;
+
+            std::shared_future<void> Submit(std::function<void(void)> job);
+
+            /*
+             * Waits for the queued jobs and joins every worker.
+             */
+            void Shutdown(void);
+
+            long GetTotalJobs(void) const;
+
+        protected:
+            CryptoWorkerPool(void);
+            CryptoWorkerPool(const CryptoWorkerPool &) = delete;
+            CryptoWorkerPool& operator = (const CryptoWorkerPool &) = delete;
+
+            void WorkerLoop(void);
+
+            std::vector<std::thread>                    m_workers;
+            std::deque<std::packaged_task<void(void)>>  m_jobs;
+            std::mutex                                  m_mutex;
+            std::condition_variable                     m_condition;
+            bool                                        m_stopping;
+            long                                        m_totalJobs;
+    };
+
+}
+
+#endif /* CRYPTO_WORKER_POOL_H */
@@ -20,6 +20,15 @@ PublicKey::printKey() {
     std::cout << "public key = " << p << ", " << a << ", " << b << ", (" << G.first << ", " << G.second << "), " << n << ", (" << Q.first << ", " << Q.second << ")" << std::endl;
 }
 
+PrecomputedKey::PrecomputedKey() {
+}
+
+PrecomputedKey::PrecomputedKey(const PublicKey &publicKey) {
+    key = publicKey;
+    gTable = ECDSA::doublingTable(publicKey.G, publicKey.p, publicKey.a);
+    qTable = ECDSA::doublingTable(publicKey.Q, publicKey.p, publicKey.a);
+}
+
 
 std::vector<bool> 
 ECDSA::toBinary(long n) {
@@ -45,20 +54,18 @@ ECDSA::modPow(long base, long exp, long modulo) {
         return 0;
     }
 
-    double fbase = (double)base;
-    double fexp = (double)exp;
-    double fmodulo = (double)modulo;
-
-    double result = 1.0;
-    while (fexp > 0) {
-        if (fmod(fexp, 2) == 1) {
-            result = fmod(result * fbase, fmodulo);
+    // Integer square-and-multiply, exact while modulo^2 fits in a long
+    base %= modulo;
+    long result = 1;
+    while (exp > 0) {
+        if (exp & 1) {
+            result = (result * base) % modulo;
         }
-        fexp = floor(fexp / 2);
-        fbase = fmod(fbase * fbase, fmodulo);
+        exp >>= 1;
+        base = (base * base) % modulo;
     }
 
-    return (long)result;
+    return result;
 }
 
 bool 
@@ -105,30 +112,85 @@ ECDSA::modularInverse(long a, long n) {
     return (long)old_s;
 }
 
-std::vector<std::pair<long, long>> 
-ECDSA::calculateEp(long p, long a, long b) {
-    std::vector<long> Qp;
-    for (long x = 1; x <= (long)(p - 1)/2; ++x) {
-        Qp.push_back(mod(x * x, p));
+long
+ECDSA::curveValue(long x, long p, long a, long b) {
+    return mod(mod(mod(x * x, p) * x, p) + mod(a * x, p) + b, p);
+}
+
+long
+ECDSA::legendreSymbol(long a, long p) {
+    a = mod(a, p);
+    if (a == 0) {
+        return 0;
     }
 
-    auto f = [](long x, long p, long a, long b) {
-        return mod((long)(pow(x, 3) + a * x + b), p);
-    };
+    // Euler's criterion: a^((p - 1) / 2) is 1 for residues and p - 1 otherwise
+    return (modPow(a, (p - 1) / 2, p) == 1) ? 1 : -1;
+}
+
+long
+ECDSA::squareRoot(long a, long p) {
+    a = mod(a, p);
+    if (a == 0) {
+        return 0;
+    }
+    if (legendreSymbol(a, p) != 1) {
+        return -1;
+    }
 
+    // Tonelli-Shanks, written p - 1 = q * 2^s with q odd
+    long q = p - 1;
+    long s = 0;
+    while (q % 2 == 0) {
+        q /= 2;
+        s += 1;
+    }
+
+    long z = 2;
+    while (legendreSymbol(z, p) != -1) {
+        z += 1;
+    }
+
+    long m = s;
+    long c = modPow(z, q, p);
+    long t = modPow(a, q, p);
+    long r = modPow(a, (q + 1) / 2, p);
+
+    while (t != 1) {
+        long i = 0;
+        long t2i = t;
+        while (t2i != 1) {
+            t2i = mod(t2i * t2i, p);
+            i += 1;
+        }
+
+        long bb = c;
+        for (long j = 0; j < m - i - 1; ++j) {
+            bb = mod(bb * bb, p);
+        }
+
+        m = i;
+        c = mod(bb * bb, p);
+        t = mod(t * c, p);
+        r = mod(r * bb, p);
+    }
+
+    // The smaller root first, like the residue table calculateEp used to search
+    return std::min(r, p - r);
+}
+
+std::vector<std::pair<long, long>> 
+ECDSA::calculateEp(long p, long a, long b) {
     std::vector<std::pair<long, long>> Ep;
     for (long x = 0; x < p; ++x) {
-        long fx = f(x, p, a, b);
-        auto it = std::find(Qp.begin(), Qp.end(), fx);
-
-        if (it != Qp.end()) {
-            int index = it - Qp.begin() + 1;
-            int y1 = index;
-            int y2 = p - index;
-            Ep.emplace_back(x, y1);
-            Ep.emplace_back(x, y2);
+        long fx = curveValue(x, p, a, b);
+        long y = squareRoot(fx, p);
+
+        if (y > 0) {
+            Ep.emplace_back(x, y);
+            Ep.emplace_back(x, p - y);
         }
-        else if (fx == 0) {
+        else if (y == 0) {
             Ep.emplace_back(x, 0);
         }
     }
@@ -136,6 +198,32 @@ ECDSA::calculateEp(long p, long a, long b) {
     return Ep;
 }
 
+long
+ECDSA::countPoints(long p, long a, long b) {
+    long count = 0;
+    for (long x = 0; x < p; ++x) {
+        count += 1 + legendreSymbol(curveValue(x, p, a, b), p);
+    }
+
+    return count;
+}
+
+std::pair<long, long>
+ECDSA::nthPoint(long index, long p, long a, long b) {
+    for (long x = 0; x < p; ++x) {
+        long fx = curveValue(x, p, a, b);
+        long points = 1 + legendreSymbol(fx, p);
+
+        if (index < points) {
+            long y = squareRoot(fx, p);
+            return {x, (index == 0) ? y : p - y};
+        }
+        index -= points;
+    }
+
+    return {0, 0};
+}
+
 std::pair<long, long> 
 ECDSA::addingPoints(std::pair<long, long> P, std::pair<long, long> Q, long p, long a) {
     static std::pair<long, long> Point_0 = {0, 0};
@@ -219,12 +307,63 @@ ECDSA::doubleAndAdd(long n, std::pair<long, long> P, long p, long a) {
     return result;
 }
 
+std::vector<std::pair<long, long>>
+ECDSA::doublingTable(std::pair<long, long> P, long p, long a) {
+    // doubleAndAdd reduces the scalar mod p, so bits of p - 1 are enough
+    std::vector<std::pair<long, long>> table;
+    size_t bits = toBinary(p - 1).size();
+    std::pair<long, long> addend = P;
+
+    for (size_t i = 0; i < bits; ++i) {
+        table.push_back(addend);
+        addend = doublingPoint(addend, p, a);
+    }
+
+    return table;
+}
+
+std::pair<long, long>
+ECDSA::tableMultiply(long n, const std::vector<std::pair<long, long>> &table, long p, long a) {
+    static std::pair<long, long> Point_0 = {0, 0};
+
+    n = mod(n, p);
+
+    if (table.empty() || n == 0 || table[0] == Point_0) {
+        return Point_0;
+    }
+    else if (n == 1) {
+        return table[0];
+    }
+
+    std::pair<long, long> result = Point_0;
+    std::vector<bool> bits = toBinary(n);
+
+    for (int i = 0; i < (int)bits.size(); ++i) {
+        if (bits[i]) {
+            result = addingPoints(result, table[i], p, a);
+        }
+    }
+
+    return result;
+}
+
+// Each thread draws from its own generator, so keys can be built on several threads
+static std::mt19937&
+randomGenerator() {
+    static thread_local std::mt19937 gen(std::time(nullptr));
+    return gen;
+}
+
+void
+ECDSA::seedRandom(unsigned long seed) {
+    randomGenerator().seed(seed);
+}
+
 long 
 ECDSA::randRange(long left, long right) {
-    static std::mt19937 gen(std::time(nullptr));
     std::uniform_int_distribution<> distr(left, right);
 
-    return distr(gen);
+    return distr(randomGenerator());
 }
 
 bool 
@@ -305,46 +444,161 @@ ECDSA::generatePrime(long digits) {
     return result;
 }
 
+std::vector<long>
+ECDSA::primeFactors(long n) {
+    std::vector<long> factors;
+    for (long q = 2; q * q <= n; ++q) {
+        if (n % q == 0) {
+            factors.push_back(q);
+            while (n % q == 0) {
+                n /= q;
+            }
+        }
+    }
+    if (n > 1) {
+        factors.push_back(n);
+    }
+
+    return factors;
+}
+
+std::pair<long, long>
+ECDSA::addPoints(std::pair<long, long> P, std::pair<long, long> Q, long p, long a) {
+    static std::pair<long, long> Point_0 = {0, 0};
+
+    if (P == Point_0) {
+        return Q;
+    }
+    if (Q == Point_0) {
+        return P;
+    }
+    if (P.first == Q.first) {
+        if (mod(P.second + Q.second, p) == 0) {
+            return Point_0;
+        }
+        return doublingPoint(P, p, a);
+    }
+
+    return addingPoints(P, Q, p, a);
+}
+
+std::pair<long, long>
+ECDSA::multiplyPoint(long k, std::pair<long, long> P, long p, long a) {
+    static std::pair<long, long> Point_0 = {0, 0};
+
+    std::pair<long, long> result = Point_0;
+    std::pair<long, long> addend = P;
+
+    if (k < 0) {
+        k = -k;
+        addend.second = mod(-addend.second, p);
+    }
+
+    while (k > 0) {
+        if (k & 1) {
+            result = addPoints(result, addend, p, a);
+        }
+        addend = addPoints(addend, addend, p, a);
+        k >>= 1;
+    }
+
+    return result;
+}
+
 long 
 ECDSA::findPointOrder(long p, long a, long b, std::pair<long, long> G) {
     static std::pair<long, long> Point_0 = {0, 0};
-    std::pair<long, long> kG = doublingPoint(G, p, a);
-    long k = 2;
 
-    while (kG != Point_0) {
-        k += 1;
-        kG = addingPoints(kG, G, p , a);
+    // Baby-step giant-step for a multiple M of the order inside the Hasse interval
+    // [p + 1 - 2 sqrt(p), p + 1 + 2 sqrt(p)], which always holds the group order
+    long root = (long)std::ceil(2 * std::sqrt((double)p));
+    long low = std::max(1L, p + 1 - root);
+    long width = 2 * root;
+    long w = (long)std::ceil(std::sqrt((double)width / 2)) + 1;
+
+    // Baby steps jG, j = 0..w, keyed by x so that one lookup finds both +jG and -jG.
+    // The identity gets key -1, which no x coordinate can take.
+    std::unordered_map<long, std::pair<long, long>> babySteps;
+    std::pair<long, long> jG = Point_0;
+    babySteps.emplace(-1, std::make_pair(0L, 0L));
+    for (long j = 1; j <= w; ++j) {
+        jG = addPoints(jG, G, p, a);
+        if (jG == Point_0) {
+            return j;
+        }
+        babySteps.emplace(jG.first, std::make_pair(j, jG.second));
+    }
+
+    // Giant steps cG, c = low + w + i(2w + 1), matched against cG = +-jG
+    long M = 0;
+    long c = low + w;
+    std::pair<long, long> cG = multiplyPoint(c, G, p, a);
+    std::pair<long, long> step = multiplyPoint(2 * w + 1, G, p, a);
+    while (M == 0 && c - w <= low + width) {
+        auto it = babySteps.find(cG == Point_0 ? -1 : cG.first);
+        if (it != babySteps.end()) {
+            long j = it->second.first;
+            M = (cG == Point_0 || cG.second == it->second.second) ? c - j : c + j;
+        }
+        c += 2 * w + 1;
+        cG = addPoints(cG, step, p, a);
+    }
+
+    if (M == 0) {
+        return 0;
+    }
+
+    return findPointOrder(p, a, b, G, M);
+}
+
+long
+ECDSA::findPointOrder(long p, long a, long b, std::pair<long, long> G, long multiple) {
+    static std::pair<long, long> Point_0 = {0, 0};
+
+    // The order divides the multiple, strip every prime factor that still leaves the identity
+    long order = multiple;
+    for (long q : primeFactors(multiple)) {
+        while (order % q == 0 && multiplyPoint(order / q, G, p, a) == Point_0) {
+            order /= q;
+        }
     }
 
-    return k;
+    return order;
 }
 
 std::pair<std::pair<long, long>, long> 
-ECDSA::findPrimeOrderPoint(std::vector<std::pair<long, long>> Ep, long p, long a, long b) {
+ECDSA::findPrimeOrderPoint(long p, long a, long b) {
     static std::pair<long, long> Point_0 = {0, 0};
 
-    long Ep_size = (long)Ep.size();
+    long Ep_size = countPoints(p, a, b);
 
     if (isPrime(Ep_size + 1)) {
-        std::pair<long, long> randPoint = Ep[randRange(0, Ep_size - 1)];
+        std::pair<long, long> randPoint = nthPoint(randRange(0, Ep_size - 1), p, a, b);
         std::pair<std::pair<long, long>, long> result = {randPoint, Ep_size + 1};
 
         return result;
     }
 
-    long n;
+    // A point other than the identity has prime order q exactly when qP is the identity for
+    // some prime q dividing the group order, so the orders of the points are never searched
+    std::vector<long> orderFactors = primeFactors(Ep_size + 1);
 
-    for (long i = 0; i < Ep_size; ++i) {
-        if (Ep[i].second == 0) {
+    // Same walk over the points as calculateEp, without keeping them
+    for (long x = 0; x < p; ++x) {
+        long y = squareRoot(curveValue(x, p, a, b), p);
+        if (y <= 0) {
             continue;
         }
 
-        n = findPointOrder(p, a, b, Ep[i]);
+        std::pair<long, long> candidates[2] = {{x, y}, {x, p - y}};
+        for (auto &point : candidates) {
+            for (long n : orderFactors) {
+                if (multiplyPoint(n, point, p, a) == Point_0) {
+                    std::pair<std::pair<long, long>, long> result = {point, n};
 
-        if (isPrime(n)) {
-            std::pair<std::pair<long, long>, long> result = {Ep[i], n};
-
-            return result;
+                    return result;
+                }
+            }
         }
     }
 
@@ -356,14 +610,20 @@ ECDSA::findPrimeOrderPoint(std::vector<std::pair<long, long>> Ep, long p, long a
 std::pair<PublicKey, long> 
 ECDSA::generateKey() {
     long p, a, b;
-    p = a = b = 1;
-    while (!isEllipticCurve(p, a, b)) {
-        p = generatePrime(4);
-        a = generatePrime(3);
-        b = generatePrime(3);
+    std::pair<std::pair<long, long>, long> primeOrderPoint = {{0, 0}, 0};
+
+    // Curves without a point of prime order are skipped, randRange(1, n - 1) needs n >= 2
+    while (primeOrderPoint.second < 2) {
+        p = a = b = 1;
+        while (!isEllipticCurve(p, a, b)) {
+            p = generatePrime(4);
+            a = generatePrime(3);
+            b = generatePrime(3);
+        }
+
+        primeOrderPoint = findPrimeOrderPoint(p, a, b);
     }
 
-    std::pair<std::pair<long, long>, long> primeOrderPoint = findPrimeOrderPoint(calculateEp(p, a, b), p, a, b);
     std::pair<long, long> G = primeOrderPoint.first;
     long n = primeOrderPoint.second;
 
@@ -380,31 +640,41 @@ ECDSA::generateKey() {
 
 std::string 
 ECDSA::sha256(std::string input) {
-    SHA256 ctx = SHA256();
+    return toHex(sha256Digest(input));
+}
 
-    unsigned char digest[ctx.DIGEST_SIZE];
-    memset(digest, 0, ctx.DIGEST_SIZE);
+Sha256Digest
+ECDSA::sha256Digest(const std::string &input) {
+    SHA256 ctx = SHA256();
+    Sha256Digest digest;
 
     ctx.init();
-    ctx.update( (unsigned char*)input.c_str(), input.length());
-    ctx.final(digest);
+    ctx.update((const unsigned char*)input.data(), input.length());
+    ctx.final(digest.data());
 
-    char buf[2*SHA256::DIGEST_SIZE+1];
-    buf[2*SHA256::DIGEST_SIZE] = 0;
+    return digest;
+}
 
-    for (int i = 0; i < (int)SHA256::DIGEST_SIZE; i++)
-        sprintf(buf+i*2, "%02x", digest[i]);
-    return std::string(buf);
+std::string
+ECDSA::toHex(const Sha256Digest &digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * digest.size(), '0');
 
+    for (size_t i = 0; i < digest.size(); i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    return hex;
 }
 
 long 
 ECDSA::digitizeMessage(std::string message, long p) {
-    message = sha256(message).substr(0, 8);
-    std::stringstream ss;
-    long result;
-    ss << std::hex << message;
-    ss >> result;
+    return digitizeDigest(sha256Digest(message), p);
+}
+
+long
+ECDSA::digitizeDigest(const Sha256Digest &digest, long p) {
+    long result = ((long)digest[0] << 24) | ((long)digest[1] << 16) | ((long)digest[2] << 8) | (long)digest[3];
 
     return mod(result, p);
 }
@@ -429,6 +699,13 @@ ECDSA::digitizeMessage(std::string message, long p) {
 
 std::pair<long, long> 
 ECDSA::generateSignature(PublicKey publicKey, long privateKey, long hashMsg) {
+    return generateSignature(publicKey, privateKey, hashMsg, (unsigned long)randRange(0, 2147483647));
+}
+
+std::pair<long, long> 
+ECDSA::generateSignature(PublicKey publicKey, long privateKey, long hashMsg, unsigned long nonceSeed) {
+    std::mt19937 gen(nonceSeed);
+    std::uniform_int_distribution<long> distr(1, publicKey.n - 1);
     long p = publicKey.p;
     long a = publicKey.a;
     long n = publicKey.n;
@@ -437,7 +714,7 @@ ECDSA::generateSignature(PublicKey publicKey, long privateKey, long hashMsg) {
     long idx = 0;
     restart:
     ++idx;
-    long k = randRange(1, n - 1);
+    long k = distr(gen);
     std::pair<long, long> kG = doubleAndAdd(k, G, p, a);
     long r = mod(kG.first, n);
 
@@ -498,6 +775,45 @@ ECDSA::verifySignature(long hashMsg, long p, long a, long n, long xG, long yG, l
     return true;
 }
 
+bool 
+ECDSA::checkSignature(long hashMsg, long p, long a, long n, long xG, long yG, long xQ, long yQ, long r, long s) {
+    std::pair<long, long> G = {xG, yG};
+    std::pair<long, long> Q = {xQ, yQ};
+
+    if (r < 1 || r >= n || s < 1 || s >= n) {
+        return false;
+    }
+
+    long w = modularInverse(s, n);
+    long u1 = mod(hashMsg * w, n);
+    long u2 = mod(r * w, n);
+    std::pair<long, long> A1 = doubleAndAdd(u1, G, p, a);
+    std::pair<long, long> A2 = doubleAndAdd(u2, Q, p, a);
+    std::pair<long, long> A = addingPoints(A1, A2, p, a);
+
+    return mod(A.first, n) == r;
+}
+
+bool
+ECDSA::checkSignature(const PrecomputedKey &key, long hashMsg, long r, long s) {
+    long p = key.key.p;
+    long a = key.key.a;
+    long n = key.key.n;
+
+    if (r < 1 || r >= n || s < 1 || s >= n) {
+        return false;
+    }
+
+    long w = modularInverse(s, n);
+    long u1 = mod(hashMsg * w, n);
+    long u2 = mod(r * w, n);
+    std::pair<long, long> A1 = tableMultiply(u1, key.gTable, p, a);
+    std::pair<long, long> A2 = tableMultiply(u2, key.qTable, p, a);
+    std::pair<long, long> A = addingPoints(A1, A2, p, a);
+
+    return mod(A.first, n) == r;
+}
+
 // bool 
 // ECDSA::verifySignature(PublicKey publicKey, std::pair<long, long> signature, long n, long hashMsg) {
 //     long p = publicKey.p;
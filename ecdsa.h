@@ -10,6 +10,8 @@
 #include <sstream>
 #include <random>
 #include <ctime>
+#include <unordered_map>
+#include "sha256.h"
 
 class PublicKey {
 public:
@@ -20,6 +22,23 @@ public:
     void printKey();
 };
 
+// A public key with the doublings 2^i G and 2^i Q that doubleAndAdd walks through, computed once
+class PrecomputedKey {
+public:
+    PublicKey key;
+    std::vector<std::pair<long, long>> gTable, qTable;
+    PrecomputedKey();
+    explicit PrecomputedKey(const PublicKey &publicKey);
+};
+
+// One signature to check, with the fields of the signer's public key
+struct SignatureCheck {
+    long hashMsg;
+    long p, a, n;
+    long xG, yG, xQ, yQ;
+    long r, s;
+};
+
 class ECDSA {
 public:
     
@@ -28,22 +47,62 @@ public:
     static long modPow(long base, long exp, long modulo);
     static bool isEllipticCurve(long p, long a, long b);
     static long modularInverse(long a, long n);
+    // x^3 + ax + b mod p
+    static long curveValue(long x, long p, long a, long b);
+    // 1, -1 or 0 by Euler's criterion
+    static long legendreSymbol(long a, long p);
+    // The smaller square root of a mod p by Tonelli-Shanks, -1 if a is not a residue
+    static long squareRoot(long a, long p);
     static std::vector<std::pair<long, long>> calculateEp(long p, long a, long b);
+    // calculateEp(p, a, b).size() and calculateEp(p, a, b)[index] without building the list
+    static long countPoints(long p, long a, long b);
+    static std::pair<long, long> nthPoint(long index, long p, long a, long b);
     static std::pair<long, long> addingPoints(std::pair<long, long> P, std::pair<long, long> Q, long p, long a);
     static std::pair<long, long> doublingPoint(std::pair<long, long> P, long p, long a);
+    // Full group law: also handles P == Q, and k is not reduced mod p like in doubleAndAdd
+    static std::pair<long, long> addPoints(std::pair<long, long> P, std::pair<long, long> Q, long p, long a);
+    static std::pair<long, long> multiplyPoint(long k, std::pair<long, long> P, long p, long a);
     static std::pair<long, long> doubleAndAdd(long n, std::pair<long, long> P, long p, long a);
+    // The addends of doubleAndAdd for P, and doubleAndAdd done with them
+    static std::vector<std::pair<long, long>> doublingTable(std::pair<long, long> P, long p, long a);
+    static std::pair<long, long> tableMultiply(long n, const std::vector<std::pair<long, long>> &table, long p, long a);
     static long randRange(long left, long right);
+    // Reseeds the calling thread's randRange generator
+    static void seedRandom(unsigned long seed);
     static bool MillerRabinTest(long n);
     static bool isPrime(long n);
     static long generatePrime(long digits);
+    // Order of G by baby-step giant-step over the Hasse interval
     static long findPointOrder(long p, long a, long b, std::pair<long, long> G);
-    static std::pair<std::pair<long, long>, long> findPrimeOrderPoint(std::vector<std::pair<long, long>> Ep, long p, long a, long b);
+    // Order of G given any multiple of it, such as the group order
+    static long findPointOrder(long p, long a, long b, std::pair<long, long> G, long multiple);
+    static std::vector<long> primeFactors(long n);
+    static std::pair<std::pair<long, long>, long> findPrimeOrderPoint(long p, long a, long b);
     static std::pair<PublicKey, long> generateKey();
+    // The digest in hex, for printing; hashing code should use sha256Digest
     static std::string sha256(std::string input);
+    static Sha256Digest sha256Digest(const std::string &input);
+    static std::string toHex(const Sha256Digest &digest);
     static long digitizeMessage(std::string message, long p);
+    // The first 32 bits of the digest read big-endian, mod p
+    static long digitizeDigest(const Sha256Digest &digest, long p);
     // static std::pair<long, long> generateSignature(long p, long a, long b, std::pair<long, long> G, long n, long privateKey, long hashMsg);
     static std::pair<long, long> generateSignature(PublicKey publicKey, long privateKey, long hashMsg);
+    // Draws the per-signature nonces from its own generator, safe to call from worker threads
+    static std::pair<long, long> generateSignature(PublicKey publicKey, long privateKey, long hashMsg, unsigned long nonceSeed);
     static bool verifySignature(long hashMsg, long p, long a, long n, long xG, long yG, long xQ, long yQ, long r, long s) ;
+    // Same check as verifySignature without any console output
+    static bool checkSignature(long hashMsg, long p, long a, long n, long xG, long yG, long xQ, long yQ, long r, long s);
+    // Same as checkSignature, reading the point multiples from the key's tables
+    static bool checkSignature(const PrecomputedKey &key, long hashMsg, long r, long s);
+    // checkSignature over many signatures, several at a time on AVX2/AVX-512 lanes when the CPU has them
+    // keys[i], when given and not null, is the precomputed key of checks[i] for the checks done in scalar code
+    static void checkSignatureBatch(const SignatureCheck *checks, size_t count, bool *results,
+                                    const PrecomputedKey *const *keys = nullptr);
+    static void checkSignatureBatchScalar(const SignatureCheck *checks, size_t count, bool *results);
+    static const char* batchKernelName();
+    // Forces "avx512", "avx2" or "scalar" ("auto" restores the default); false if the CPU lacks it
+    static bool setBatchKernel(const std::string &name);
     // static bool verifySignature(PublicKey publicKey, std::pair<long, long> signature, long n, long hashMsg);
 
 };
@@ -0,0 +1,128 @@
+#include "endorsement-certificate.h"
+#include <algorithm>
+
+namespace ns3 {
+
+    EndorsementCertificate::EndorsementCertificate(void)
+    {
+    }
+
+    bool
+    EndorsementCertificate::Add(uint32_t endorserId, uint32_t keyEpoch, long r, long s)
+    {
+        const long signatureLimit = 1L << SIGNATURE_BITS;
+        if (r < 0 || r >= signatureLimit || s < 0 || s >= signatureLimit || keyEpoch >= (1U << EPOCH_BITS))
+        {
+            return false;
+        }
+
+        Endorsement endorsement = {endorserId, keyEpoch, r, s};
+        auto it = std::lower_bound(m_endorsements.begin(), m_endorsements.end(), endorserId,
+                                   [](const Endorsement &e, uint32_t id) { return e.endorserId < id; });
+        if (it != m_endorsements.end() && it->endorserId == endorserId)
+        {
+            *it = endorsement;
+        }
+        else
+        {
+            m_endorsements.insert(it, endorsement);
+        }
+
+        return true;
+    }
+
+    bool
+    EndorsementCertificate::HasEndorser(uint32_t endorserId) const
+    {
+        return std::binary_search(m_endorsements.begin(), m_endorsements.end(), Endorsement{endorserId, 0, 0, 0},
+                                  [](const Endorsement &a, const Endorsement &b) { return a.endorserId < b.endorserId; });
+    }
+
+    uint32_t
+    EndorsementCertificate::GetNumberOfEndorsers(void) const
+    {
+        return m_endorsements.size();
+    }
+
+    const std::vector<EndorsementCertificate::Endorsement>&
+    EndorsementCertificate::GetEndorsements(void) const
+    {
+        return m_endorsements;
+    }
+
+    void
+    EndorsementCertificate::ToJson(rapidjson::Value &certificate, rapidjson::Document::AllocatorType &allocator) const
+    {
+        std::vector<uint64_t> bitmap;
+        rapidjson::Value signatures(rapidjson::kArrayType);
+
+        for (const Endorsement &e : m_endorsements)
+        {
+            if (e.endorserId / 64 >= bitmap.size())
+            {
+                bitmap.resize(e.endorserId / 64 + 1, 0);
+            }
+            bitmap[e.endorserId / 64] |= 1ULL << (e.endorserId % 64);
+
+            uint64_t packed = ((uint64_t)e.keyEpoch << (2 * SIGNATURE_BITS)) | ((uint64_t)e.r << SIGNATURE_BITS) | (uint64_t)e.s;
+            signatures.PushBack(rapidjson::Value(packed), allocator);
+        }
+
+        rapidjson::Value endorsers(rapidjson::kArrayType);
+        for (uint64_t word : bitmap)
+        {
+            endorsers.PushBack(rapidjson::Value(word), allocator);
+        }
+
+        certificate.SetObject();
+        certificate.AddMember("endorsers", endorsers, allocator);
+        certificate.AddMember("signatures", signatures, allocator);
+    }
+
+    bool
+    EndorsementCertificate::FromJson(const rapidjson::Value &certificate)
+    {
+        m_endorsements.clear();
+
+        if (!certificate.IsObject() || !certificate.HasMember("endorsers") || !certificate.HasMember("signatures"))
+        {
+            return false;
+        }
+
+        const rapidjson::Value &endorsers = certificate["endorsers"];
+        const rapidjson::Value &signatures = certificate["signatures"];
+        const uint64_t signatureMask = (1ULL << SIGNATURE_BITS) - 1;
+        rapidjson::SizeType next = 0;
+
+        for (rapidjson::SizeType word = 0; word < endorsers.Size(); word++)
+        {
+            uint64_t bits = endorsers[word].GetUint64();
+            for (uint32_t bit = 0; bit < 64; bit++)
+            {
+                if (!(bits & (1ULL << bit)))
+                {
+                    continue;
+                }
+                if (next >= signatures.Size())
+                {
+                    m_endorsements.clear();
+                    return false;
+                }
+
+                uint64_t packed = signatures[next++].GetUint64();
+                m_endorsements.push_back({word * 64 + bit, (uint32_t)(packed >> (2 * SIGNATURE_BITS)),
+                                          (long)((packed >> SIGNATURE_BITS) & signatureMask), (long)(packed & signatureMask)});
+            }
+        }
+
+        return next == signatures.Size();
+    }
+
+    Transaction
+    TransactionFromJson(const rapidjson::Value &trans)
+    {
+        return Transaction(trans["rsuNodeId"].GetInt(), trans["transId"].GetInt(), trans["timestamp"].GetDouble(),
+                           trans["payment"].GetDouble(), trans["winnerId"].GetInt());
+    }
+
+}
@@ -0,0 +1,61 @@
+#ifndef ENDORSEMENT_CERTIFICATE_H
+#define ENDORSEMENT_CERTIFICATE_H
+
+#include "../../rapidjson/document.h"
+#include "blockchain.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * The peer signatures collected for one transaction, sent to the cloud server
+     * in a single REQUEST_BLOCK.
+     *
+     * Every endorser signs Transaction::GetSigningPayload(), so the certificate needs
+     * neither the message nor its hash. In JSON it is a bitmap of endorser node ids
+     * plus one packed number per endorser, in node id order:
+     *     "certificate": {"endorsers": [bitmap words], "signatures": [epoch << 40 | r << 20 | s]}
+     * The keys are looked up by node id and epoch in the KeyRegistry.
+     */
+    class EndorsementCertificate
+    {
+        public:
+            struct Endorsement
+            {
+                uint32_t endorserId;
+                uint32_t keyEpoch;
+                long r, s;
+            };
+
+            EndorsementCertificate(void);
+
+            /*
+             * Adds or replaces the endorsement of endorserId. Returns false if the
+             * signature does not fit the packed format (such a signature cannot be valid).
+             */
+            bool Add(uint32_t endorserId, uint32_t keyEpoch, long r, long s);
+
+            bool HasEndorser(uint32_t endorserId) const;
+            uint32_t GetNumberOfEndorsers(void) const;
+            const std::vector<Endorsement>& GetEndorsements(void) const;    // sorted by endorser id
+
+            void ToJson(rapidjson::Value &certificate, rapidjson::Document::AllocatorType &allocator) const;
+            bool FromJson(const rapidjson::Value &certificate);
+
+        protected:
+            static const int SIGNATURE_BITS = 20;
+            static const int EPOCH_BITS = 24;
+
+            std::vector<Endorsement> m_endorsements;
+    };
+
+    /*
+     * The transaction fields of a REQUEST_TRANS/REQUEST_BLOCK "transactions" object.
+     */
+    Transaction TransactionFromJson(const rapidjson::Value &trans);
+
+}
+
+#endif /* ENDORSEMENT_CERTIFICATE_H */
@@ -0,0 +1,194 @@
+#include "endorsement-policy.h"
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace ns3 {
+
+    EndorsementPolicy::EndorsementPolicy(void)
+    {
+        m_type = ALL_PEERS;
+        m_numberOfEndorsers = 0;
+    }
+
+    EndorsementPolicy::~EndorsementPolicy(void)
+    {
+    }
+
+    bool
+    EndorsementPolicy::ParseType(const std::string &name, Type &type)
+    {
+        if (name == "all")
+        {
+            type = ALL_PEERS;
+        }
+        else if (name == "static")
+        {
+            type = STATIC;
+        }
+        else if (name == "hashed")
+        {
+            type = HASHED;
+        }
+        else if (name == "region")
+        {
+            type = REGION;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    const char*
+    EndorsementPolicy::GetTypeName(Type type)
+    {
+        switch (type)
+        {
+            case ALL_PEERS: return "all";
+            case STATIC: return "static";
+            case HASHED: return "hashed";
+            case REGION: return "region";
+        }
+        return "all";
+    }
+
+    void
+    EndorsementPolicy::SetType(Type type)
+    {
+        m_type = type;
+    }
+
+    EndorsementPolicy::Type
+    EndorsementPolicy::GetType(void) const
+    {
+        return m_type;
+    }
+
+    void
+    EndorsementPolicy::SetNumberOfEndorsers(uint32_t numberOfEndorsers)
+    {
+        m_numberOfEndorsers = numberOfEndorsers;
+    }
+
+    uint32_t
+    EndorsementPolicy::GetNumberOfEndorsers(void) const
+    {
+        return m_numberOfEndorsers;
+    }
+
+    void
+    EndorsementPolicy::SetStaticEndorsers(const std::vector<uint32_t> &endorsers)
+    {
+        m_staticEndorsers = endorsers;
+        std::sort(m_staticEndorsers.begin(), m_staticEndorsers.end());
+    }
+
+    void
+    EndorsementPolicy::SetRegions(const std::map<uint32_t, enum BlockchainRegion> &regions)
+    {
+        m_regions = regions;
+    }
+
+    enum CommitterType
+    EndorsementPolicy::GetRole(uint32_t nodeId) const
+    {
+        if (m_type == STATIC && !IsStaticEndorser(nodeId))
+        {
+            return COMMITTER;
+        }
+        return ENDORSER;
+    }
+
+    std::vector<uint32_t>
+    EndorsementPolicy::SelectEndorsers(uint32_t submitterId, int transId, const std::vector<uint32_t> &peerIds) const
+    {
+        std::vector<uint32_t> endorsers;
+
+        switch (m_type)
+        {
+            case ALL_PEERS:
+                return peerIds;
+
+            case STATIC:
+                for (uint32_t id : peerIds)
+                {
+                    if (IsStaticEndorser(id))
+                    {
+                        endorsers.push_back(id);
+                    }
+                }
+                return endorsers;
+
+            case HASHED:
+                return SelectByHash(submitterId, transId, peerIds);
+
+            case REGION:
+            {
+                std::map<uint32_t, enum BlockchainRegion>::const_iterator own = m_regions.find(submitterId);
+                std::vector<uint32_t> candidates;
+                for (uint32_t id : peerIds)
+                {
+                    std::map<uint32_t, enum BlockchainRegion>::const_iterator it = m_regions.find(id);
+                    if (own != m_regions.end() && it != m_regions.end() && it->second == own->second)
+                    {
+                        candidates.push_back(id);
+                    }
+                }
+                return SelectByHash(submitterId, transId, candidates.empty() ? peerIds : candidates);
+            }
+        }
+        return peerIds;
+    }
+
+    bool
+    EndorsementPolicy::IsStaticEndorser(uint32_t nodeId) const
+    {
+        if (m_staticEndorsers.empty())
+        {
+            // Node 0 is the cloud server, so the default set is rsu nodes 1..m
+            return nodeId > 0 && (m_numberOfEndorsers == 0 || nodeId <= m_numberOfEndorsers);
+        }
+        return std::binary_search(m_staticEndorsers.begin(), m_staticEndorsers.end(), nodeId);
+    }
+
+    std::vector<uint32_t>
+    EndorsementPolicy::SelectByHash(uint32_t submitterId, int transId, const std::vector<uint32_t> &candidates) const
+    {
+        if (m_numberOfEndorsers == 0 || m_numberOfEndorsers >= candidates.size())
+        {
+            return candidates;
+        }
+
+        // Rendezvous hashing: the m candidates with the highest weight for this transaction
+        uint64_t seed = Mix(((uint64_t)submitterId << 32) | (uint32_t)transId);
+        std::vector<std::pair<uint64_t, uint32_t>> weights;
+        weights.reserve(candidates.size());
+        for (uint32_t id : candidates)
+        {
+            weights.push_back(std::make_pair(Mix(seed ^ id), id));
+        }
+        std::partial_sort(weights.begin(), weights.begin() + m_numberOfEndorsers, weights.end(),
+                          std::greater<std::pair<uint64_t, uint32_t>>());
+
+        std::vector<uint32_t> endorsers;
+        for (uint32_t i = 0; i < m_numberOfEndorsers; i++)
+        {
+            endorsers.push_back(weights[i].second);
+        }
+        std::sort(endorsers.begin(), endorsers.end());
+        return endorsers;
+    }
+
+    uint64_t
+    EndorsementPolicy::Mix(uint64_t x)
+    {
+        // splitmix64 finalizer
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+}
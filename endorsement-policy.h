@@ -0,0 +1,89 @@
+#ifndef ENDORSEMENT_POLICY_H
+#define ENDORSEMENT_POLICY_H
+
+#include "blockchain.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Picks the peers that endorse a transaction, so that a transaction costs messages
+     * and signatures in the size of its endorser set rather than of the network.
+     *
+     *     ALL_PEERS   every peer, the original behaviour
+     *     STATIC      a fixed endorser set; the other rsu nodes are committers and never sign
+     *     HASHED      m peers drawn per transaction by rendezvous hashing of (submitter, transId),
+     *                 which spreads the signing work evenly over the network
+     *     REGION      like HASHED, but among the peers in the submitter's region; falls back to
+     *                 every peer when the region has no other node
+     *
+     * The same policy object is shared by every node, so the submitter and the endorsers
+     * agree on who signs without exchanging anything.
+     */
+    class EndorsementPolicy
+    {
+        public:
+            enum Type
+            {
+                ALL_PEERS,
+                STATIC,
+                HASHED,
+                REGION,
+            };
+
+            EndorsementPolicy(void);
+            virtual ~EndorsementPolicy(void);
+
+            /*
+             * "all", "static", "hashed" or "region"; false if name is none of them.
+             */
+            static bool ParseType(const std::string &name, Type &type);
+            static const char* GetTypeName(Type type);
+
+            void SetType(Type type);
+            Type GetType(void) const;
+
+            /*
+             * m of HASHED and REGION, and the size of the default STATIC set; 0 for no limit.
+             */
+            void SetNumberOfEndorsers(uint32_t numberOfEndorsers);
+            uint32_t GetNumberOfEndorsers(void) const;
+
+            /*
+             * The STATIC set; when empty it is rsu nodes 1..m.
+             */
+            void SetStaticEndorsers(const std::vector<uint32_t> &endorsers);
+            void SetRegions(const std::map<uint32_t, enum BlockchainRegion> &regions);
+
+            /*
+             * ENDORSER if the node may be asked to sign, COMMITTER if it only submits and
+             * receives blocks.
+             */
+            enum CommitterType GetRole(uint32_t nodeId) const;
+
+            /*
+             * The endorsers of transaction transId of submitterId, out of its peers.
+             */
+            std::vector<uint32_t> SelectEndorsers(uint32_t submitterId, int transId, const std::vector<uint32_t> &peerIds) const;
+
+            /*
+             * The splitmix64 finalizer, which the topology also hashes rsu nodes onto shards with.
+             */
+            static uint64_t Mix(uint64_t x);
+
+        protected:
+            bool IsStaticEndorser(uint32_t nodeId) const;
+            std::vector<uint32_t> SelectByHash(uint32_t submitterId, int transId, const std::vector<uint32_t> &candidates) const;
+
+            Type m_type;
+            uint32_t m_numberOfEndorsers;
+            std::vector<uint32_t> m_staticEndorsers;
+            std::map<uint32_t, enum BlockchainRegion> m_regions;
+    };
+
+}
+
+#endif /* ENDORSEMENT_POLICY_H */
@@ -0,0 +1,111 @@
+#include "endorsement-tracker.h"
+
+namespace ns3 {
+
+    EndorsementTracker::EndorsementTracker(void)
+    {
+        m_quorum = 0;
+        m_lateResponses = 0;
+    }
+
+    void
+    EndorsementTracker::SetQuorum(uint32_t quorum)
+    {
+        m_quorum = quorum;
+    }
+
+    uint32_t
+    EndorsementTracker::GetQuorum(void) const
+    {
+        return m_quorum;
+    }
+
+    EndorsementTracker::Entry&
+    EndorsementTracker::Open(int transId, const Transaction &transaction, const std::vector<uint32_t> &endorsers, Time start)
+    {
+        Entry &entry = m_entries[transId];
+        entry.transaction = transaction;
+        entry.endorsers.insert(endorsers.begin(), endorsers.end());
+        entry.quorum = (m_quorum == 0 || m_quorum > entry.endorsers.size()) ? entry.endorsers.size() : m_quorum;
+        entry.start = start;
+        return entry;
+    }
+
+    bool
+    EndorsementTracker::IsOpen(int transId) const
+    {
+        return m_entries.find(transId) != m_entries.end();
+    }
+
+    EndorsementTracker::Status
+    EndorsementTracker::AddEndorsement(int transId, uint32_t endorserId, uint32_t keyEpoch, long r, long s)
+    {
+        std::unordered_map<int, Entry>::iterator it = m_entries.find(transId);
+        if (it == m_entries.end() || !it->second.endorsers.count(endorserId))
+        {
+            m_lateResponses++;
+            return LATE;
+        }
+
+        it->second.responders.insert(endorserId);
+        it->second.certificate.Add(endorserId, keyEpoch, r, s);
+        return Evaluate(it->second);
+    }
+
+    EndorsementTracker::Status
+    EndorsementTracker::AddRefusal(int transId, uint32_t endorserId)
+    {
+        std::unordered_map<int, Entry>::iterator it = m_entries.find(transId);
+        if (it == m_entries.end() || !it->second.endorsers.count(endorserId))
+        {
+            m_lateResponses++;
+            return LATE;
+        }
+
+        it->second.responders.insert(endorserId);
+        return Evaluate(it->second);
+    }
+
+    EndorsementTracker::Entry
+    EndorsementTracker::Close(int transId)
+    {
+        Entry entry;
+        std::unordered_map<int, Entry>::iterator it = m_entries.find(transId);
+        if (it != m_entries.end())
+        {
+            entry = it->second;
+            m_entries.erase(it);
+        }
+        return entry;
+    }
+
+    uint32_t
+    EndorsementTracker::GetNumberOfOpen(void) const
+    {
+        return m_entries.size();
+    }
+
+    long
+    EndorsementTracker::GetLateResponses(void) const
+    {
+        return m_lateResponses;
+    }
+
+    EndorsementTracker::Status
+    EndorsementTracker::Evaluate(const Entry &entry) const
+    {
+        uint32_t signatures = entry.certificate.GetNumberOfEndorsers();
+        uint32_t unanswered = entry.endorsers.size() - entry.responders.size();
+
+        if (signatures >= entry.quorum && entry.quorum > 0)
+        {
+            return QUORUM_REACHED;
+        }
+        if (signatures + unanswered < entry.quorum || unanswered == 0)
+        {
+            return QUORUM_FAILED;
+        }
+        return PENDING;
+    }
+
+}
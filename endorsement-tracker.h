@@ -0,0 +1,83 @@
+#ifndef ENDORSEMENT_TRACKER_H
+#define ENDORSEMENT_TRACKER_H
+
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "blockchain.h"
+#include "endorsement-certificate.h"
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * The endorsements an RSU is collecting for its own transactions, one entry per
+     * transaction id.
+     *
+     * A transaction goes to the n endorsers its EndorsementPolicy designates and needs
+     * `quorum` of their signatures (0 means all n). It completes as soon as the quorum
+     * is reached and fails as soon as the endorsers that have not answered cannot make
+     * it up any more. The owner closes completed, failed and expired entries; a response
+     * for a transaction that is no longer open, or from a node that is not one of its
+     * endorsers, is dropped with a single hash lookup.
+     */
+    class EndorsementTracker
+    {
+        public:
+            enum Status
+            {
+                PENDING,            // still waiting for responses
+                QUORUM_REACHED,     // enough signatures, the transaction can go to the cloud server
+                QUORUM_FAILED,      // too many peers refused
+                LATE,               // not open (any more) or not from one of its endorsers, dropped
+            };
+
+            struct Entry
+            {
+                Transaction transaction;
+                EndorsementCertificate certificate;
+                std::set<uint32_t> endorsers;       // the designated endorsers
+                std::set<uint32_t> responders;      // every endorser that answered, signed or not
+                uint32_t quorum;
+                Time start;                         // simulated time the transaction was sent out
+                EventId deadline;
+            };
+
+            EndorsementTracker(void);
+
+            /*
+             * quorum is k of k-of-n, 0 for every endorser; it is capped at each transaction's n.
+             */
+            void SetQuorum(uint32_t quorum);
+            uint32_t GetQuorum(void) const;
+
+            Entry& Open(int transId, const Transaction &transaction, const std::vector<uint32_t> &endorsers, Time start);
+            bool IsOpen(int transId) const;
+
+            /*
+             * Records the response of an endorser. A signature that cannot be valid counts as a refusal.
+             */
+            Status AddEndorsement(int transId, uint32_t endorserId, uint32_t keyEpoch, long r, long s);
+            Status AddRefusal(int transId, uint32_t endorserId);
+
+            /*
+             * Removes the entry and returns it. The caller cancels its deadline.
+             */
+            Entry Close(int transId);
+
+            uint32_t GetNumberOfOpen(void) const;
+            long GetLateResponses(void) const;
+
+        protected:
+            Status Evaluate(const Entry &entry) const;
+
+            std::unordered_map<int, Entry> m_entries;
+            uint32_t m_quorum;
+            long m_lateResponses;
+    };
+
+}
+
+#endif /* ENDORSEMENT_TRACKER_H */
@@ -0,0 +1,292 @@
+#include "key-pool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3 {
+
+    static const char KEYSTORE_MAGIC[4] = {'B', 'C', 'K', 'S'};
+    static const uint32_t KEYSTORE_VERSION = 1;
+
+    struct KeystoreHeader
+    {
+        char        magic[4];
+        uint32_t    version;
+        uint64_t    seed;
+        uint64_t    numOfRecords;
+    };
+
+    struct KeystoreRecord
+    {
+        int64_t nodeId, keyIndex;
+        int64_t p, a, b, n;
+        int64_t xG, yG, xQ, yQ;
+        int64_t privateKey;
+    };
+
+    KeyPool&
+    KeyPool::GetInstance(void)
+    {
+        static KeyPool instance;
+        return instance;
+    }
+
+    KeyPool::KeyPool(void)
+    {
+        m_hits = 0;
+        m_misses = 0;
+        m_buildTime = 0;
+        m_loadedKeys = 0;
+        m_generatedKeys = 0;
+    }
+
+    void
+    KeyPool::Fill(uint32_t numOfNodes, uint32_t keysPerNode, unsigned int numberOfThreads, unsigned long seed,
+                  const std::string &keystorePath, bool regenerate)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::map<KeyId, std::pair<PublicKey, long>> stored;
+        if (!keystorePath.empty() && !regenerate)
+        {
+            stored = LoadKeystore(keystorePath, seed);
+        }
+
+        uint32_t totalKeys = numOfNodes * keysPerNode;
+        std::vector<std::pair<PublicKey, long>> keys(totalKeys);
+        std::vector<uint32_t> missing;
+
+        for (uint32_t k = 0; k < totalKeys; k++)
+        {
+            auto it = stored.find(KeyId(k / keysPerNode, k % keysPerNode));
+            if (it != stored.end())
+            {
+                keys[k] = it->second;
+            }
+            else
+            {
+                missing.push_back(k);
+            }
+        }
+
+        auto generate = [&keys, &missing, keysPerNode, seed](uint32_t first, uint32_t step) {
+            for (uint32_t i = first; i < missing.size(); i += step)
+            {
+                uint32_t k = missing[i];
+                ECDSA::seedRandom(KeySeed(seed, k / keysPerNode, k % keysPerNode));
+                keys[k] = ECDSA::generateKey();
+            }
+        };
+
+        if (numberOfThreads < 2)
+        {
+            generate(0, 1);
+        }
+        else
+        {
+            std::vector<std::thread> workers;
+            for (unsigned int i = 0; i < numberOfThreads; i++)
+            {
+                workers.emplace_back(generate, i, numberOfThreads);
+            }
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        if (!keystorePath.empty() && (regenerate || !missing.empty()))
+        {
+            // Keys of other nodes already in the file are kept
+            for (uint32_t k : missing)
+            {
+                stored[KeyId(k / keysPerNode, k % keysPerNode)] = keys[k];
+            }
+            if (!SaveKeystore(keystorePath, seed, stored))
+            {
+                std::cerr << "Could not write keystore " << keystorePath << "\n";
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_keys.clear();
+        for (uint32_t k = 0; k < totalKeys; k++)
+        {
+            m_keys[k / keysPerNode].push_back(keys[k]);
+        }
+
+        m_loadedKeys = totalKeys - missing.size();
+        m_generatedKeys = missing.size();
+        m_buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    unsigned long
+    KeyPool::KeySeed(unsigned long seed, uint32_t nodeId, uint32_t keyIndex)
+    {
+        // splitmix64 of the seed and the key position
+        uint64_t x = seed + 0x9E3779B97F4A7C15ULL * ((((uint64_t)nodeId << 32) | keyIndex) + 1);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+
+        return x ^ (x >> 31);
+    }
+
+    bool
+    KeyPool::ReadKeystoreSeed(const std::string &keystorePath, unsigned long &seed)
+    {
+        std::ifstream file(keystorePath, std::ios::binary);
+        KeystoreHeader header;
+
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            memcmp(header.magic, KEYSTORE_MAGIC, sizeof(KEYSTORE_MAGIC)) != 0 || header.version != KEYSTORE_VERSION)
+        {
+            return false;
+        }
+
+        seed = header.seed;
+        return true;
+    }
+
+    std::map<KeyPool::KeyId, std::pair<PublicKey, long>>
+    KeyPool::LoadKeystore(const std::string &keystorePath, unsigned long seed)
+    {
+        std::map<KeyId, std::pair<PublicKey, long>> keys;
+
+        int fd = open(keystorePath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return keys;
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(KeystoreHeader))
+        {
+            close(fd);
+            return keys;
+        }
+
+        size_t size = fileStat.st_size;
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            return keys;
+        }
+
+        const KeystoreHeader *header = static_cast<const KeystoreHeader*>(data);
+        const KeystoreRecord *records = reinterpret_cast<const KeystoreRecord*>(header + 1);
+
+        // A file of another seed or format is ignored and rewritten by Fill
+        if (memcmp(header->magic, KEYSTORE_MAGIC, sizeof(KEYSTORE_MAGIC)) == 0 && header->version == KEYSTORE_VERSION &&
+            header->seed == seed && size == sizeof(KeystoreHeader) + header->numOfRecords * sizeof(KeystoreRecord))
+        {
+            for (uint64_t i = 0; i < header->numOfRecords; i++)
+            {
+                const KeystoreRecord &r = records[i];
+                PublicKey publicKey(r.p, r.a, r.b, {r.xG, r.yG}, r.n, {r.xQ, r.yQ});
+                keys[KeyId(r.nodeId, r.keyIndex)] = {publicKey, r.privateKey};
+            }
+        }
+
+        munmap(data, size);
+        return keys;
+    }
+
+    bool
+    KeyPool::SaveKeystore(const std::string &keystorePath, unsigned long seed,
+                          const std::map<KeyId, std::pair<PublicKey, long>> &keys)
+    {
+        KeystoreHeader header;
+        memcpy(header.magic, KEYSTORE_MAGIC, sizeof(KEYSTORE_MAGIC));
+        header.version = KEYSTORE_VERSION;
+        header.seed = seed;
+        header.numOfRecords = keys.size();
+
+        std::vector<KeystoreRecord> records;
+        for (auto &key : keys)
+        {
+            const PublicKey &publicKey = key.second.first;
+            records.push_back({key.first.first, key.first.second, publicKey.p, publicKey.a, publicKey.b, publicKey.n,
+                               publicKey.G.first, publicKey.G.second, publicKey.Q.first, publicKey.Q.second,
+                               key.second.second});
+        }
+
+        // Written aside and renamed, so a crashed run never leaves half a keystore
+        std::string tmpPath = keystorePath + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(KeystoreRecord));
+            if (!file)
+            {
+                return false;
+            }
+        }
+
+        return std::rename(tmpPath.c_str(), keystorePath.c_str()) == 0;
+    }
+
+    std::pair<PublicKey, long>
+    KeyPool::GetKey(uint32_t nodeId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::deque<std::pair<PublicKey, long>> &keys = m_keys[nodeId];
+            if (!keys.empty())
+            {
+                std::pair<PublicKey, long> keyPair = keys.front();
+                keys.pop_front();
+                m_hits++;
+                return keyPair;
+            }
+            m_misses++;
+        }
+
+        return ECDSA::generateKey();
+    }
+
+    uint32_t
+    KeyPool::GetAvailableKeys(uint32_t nodeId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_keys[nodeId].size();
+    }
+
+    long
+    KeyPool::GetHits(void) const
+    {
+        return m_hits;
+    }
+
+    long
+    KeyPool::GetMisses(void) const
+    {
+        return m_misses;
+    }
+
+    double
+    KeyPool::GetBuildTime(void) const
+    {
+        return m_buildTime;
+    }
+
+    long
+    KeyPool::GetLoadedKeys(void) const
+    {
+        return m_loadedKeys;
+    }
+
+    long
+    KeyPool::GetGeneratedKeys(void) const
+    {
+        return m_generatedKeys;
+    }
+
+}
@@ -0,0 +1,84 @@
+#ifndef KEY_POOL_H
+#define KEY_POOL_H
+
+#include "ecdsa.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace ns3 {
+
+    /*
+     * ECDSA key pairs generated before the simulation starts.
+     *
+     * main.cc fills the pool on several threads, a few keys per node, and the nodes
+     * pop their initial key and any replacement key from it instead of running
+     * ECDSA::generateKey() inside an event. Key k of node i is generated from its
+     * own seed derived from (seed, i, k), so the keys do not depend on the number
+     * of threads. A node that runs out of keys falls back to generating one inline
+     * (a miss).
+     *
+     * The keys can be kept in a keystore file between runs. It holds a header
+     *     "BCKS", uint32 version, uint64 seed, uint64 number of records
+     * followed by fixed-size records of int64 fields
+     *     nodeId, keyIndex, p, a, b, n, xG, yG, xQ, yQ, privateKey
+     * in host byte order. A run with the same seed maps the file and only
+     * generates the keys it does not find there.
+     */
+    class KeyPool
+    {
+        public:
+            static KeyPool& GetInstance(void);
+
+            /*
+             * Provides keysPerNode keys for each node id in [0, numOfNodes) and replaces
+             * what the pool held before. With a keystore path, keys of the same seed are
+             * read from it and the file is rewritten if any key had to be generated;
+             * regenerate ignores the file content.
+             */
+            void Fill(uint32_t numOfNodes, uint32_t keysPerNode, unsigned int numberOfThreads, unsigned long seed,
+                      const std::string &keystorePath = "", bool regenerate = false);
+
+            /*
+             * Seed a keystore was written with, false if the file is missing or invalid.
+             */
+            static bool ReadKeystoreSeed(const std::string &keystorePath, unsigned long &seed);
+
+            /*
+             * Takes the next key of nodeId, or generates one if there is none left.
+             */
+            std::pair<PublicKey, long> GetKey(uint32_t nodeId);
+
+            uint32_t GetAvailableKeys(uint32_t nodeId);
+            long GetHits(void) const;
+            long GetMisses(void) const;
+            double GetBuildTime(void) const;       // wall-clock seconds spent in Fill
+            long GetLoadedKeys(void) const;        // keys of the last Fill read from the keystore
+            long GetGeneratedKeys(void) const;     // keys of the last Fill generated
+
+        protected:
+            KeyPool(void);
+            KeyPool(const KeyPool &) = delete;
+            KeyPool& operator = (const KeyPool &) = delete;
+
+            typedef std::pair<uint32_t, uint32_t> KeyId;       // node id, key index
+
+            static unsigned long KeySeed(unsigned long seed, uint32_t nodeId, uint32_t keyIndex);
+            static std::map<KeyId, std::pair<PublicKey, long>> LoadKeystore(const std::string &keystorePath, unsigned long seed);
+            static bool SaveKeystore(const std::string &keystorePath, unsigned long seed,
+                                     const std::map<KeyId, std::pair<PublicKey, long>> &keys);
+
+            std::map<uint32_t, std::deque<std::pair<PublicKey, long>>> m_keys;
+            std::mutex  m_mutex;
+            long        m_hits;
+            long        m_misses;
+            double      m_buildTime;
+            long        m_loadedKeys;
+            long        m_generatedKeys;
+    };
+
+}
+
+#endif /* KEY_POOL_H */
@@ -0,0 +1,52 @@
+#include "key-registry.h"
+
+namespace ns3 {
+
+    KeyRegistry::KeyRegistry(void)
+    {
+        m_numberOfKeys = 0;
+    }
+
+    bool
+    KeyRegistry::Register(uint32_t keyId, uint32_t epoch, const PublicKey &publicKey)
+    {
+        if (keyId >= m_keys.size())
+        {
+            m_keys.resize(keyId + 1);
+        }
+
+        std::shared_ptr<const PrecomputedKey> &key = m_keys[keyId][epoch];
+        if (key)
+        {
+            return false;
+        }
+
+        key = std::make_shared<PrecomputedKey>(publicKey);
+        m_numberOfKeys++;
+        return true;
+    }
+
+    std::shared_ptr<const PrecomputedKey>
+    KeyRegistry::Find(uint32_t keyId, uint32_t epoch) const
+    {
+        if (keyId >= m_keys.size())
+        {
+            return nullptr;
+        }
+
+        auto it = m_keys[keyId].find(epoch);
+        if (it == m_keys[keyId].end())
+        {
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    uint32_t
+    KeyRegistry::GetNumberOfKeys(void) const
+    {
+        return m_numberOfKeys;
+    }
+
+}
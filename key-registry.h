@@ -0,0 +1,42 @@
+#ifndef KEY_REGISTRY_H
+#define KEY_REGISTRY_H
+
+#include "ecdsa.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Public keys announced with REGISTER_KEY, so endorsements only name the key by
+     * (keyId, epoch). The key id is the id of the node owning the key and the epoch
+     * counts its key rotations. Keys are decoded once and kept with their
+     * precomputed tables; older epochs stay available for endorsements still in flight.
+     */
+    class KeyRegistry
+    {
+        public:
+            KeyRegistry(void);
+
+            /*
+             * Returns false if the key id already has a key for that epoch.
+             */
+            bool Register(uint32_t keyId, uint32_t epoch, const PublicKey &publicKey);
+
+            /*
+             * The key, or null if it has not been registered (yet).
+             */
+            std::shared_ptr<const PrecomputedKey> Find(uint32_t keyId, uint32_t epoch) const;
+
+            uint32_t GetNumberOfKeys(void) const;
+
+        protected:
+            std::vector<std::map<uint32_t, std::shared_ptr<const PrecomputedKey>>> m_keys;     // indexed by key id, then epoch
+            uint32_t m_numberOfKeys;
+    };
+
+}
+
+#endif /* KEY_REGISTRY_H */
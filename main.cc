@@ -11,18 +11,29 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <time.h>
 #include <sys/time.h>
+#include <thread>
 #include "topology-helper.h"
 #include "rsu-node.h"
 #include "cloud-server.h"
 #include "ipv4-address-helper-custom.h"
 #include "blockchain.h"
+#include "crypto-worker-pool.h"
+#include "key-pool.h"
+#include "endorsement-policy.h"
+#include "workload-generator.h"
+#include "benchmarks.h"
+#include "sha256.h"
 
 using namespace ns3;
 
 static double GetWallTime();
-void PrintTotalStats(nodeStatistics *stats, uint32_t totalNodes, double tStart, double tFinish);	
+void PrintTotalStats(nodeStatistics *stats, uint32_t totalNodes, const nodeStatistics &cloudServerStats, double tStart, double tFinish, double simulatedTime);	
+nodeStatistics MergeShardStats(const std::vector<nodeStatistics> &shardStats, double simulatedTime);
+static bool ParseNodeId(const std::string &text, uint32_t &id);
+static bool ParseNodeIds(const std::string &list, std::vector<uint32_t> &ids);
 
 NS_LOG_COMPONENT_DEFINE("Blockchain");
 
@@ -41,6 +52,82 @@ int main(int argc, char *argv[])
 	const std::string winnersPath = currentPath + "/scratch/blockchain/auction/winners.txt";
 	const std::string paymentsPath = currentPath + "/scratch/blockchain/auction/payments.txt";
 	double transThreshold = 2.0;
+	uint32_t cryptoThreads = 0;
+	double cryptoDelay = 0;
+	uint32_t keyThreads = std::thread::hardware_concurrency();
+	uint32_t spareKeys = 2;
+	uint32_t keySeed = 0;
+	std::string keystore = "";
+	bool regenerateKeys = false;
+	uint32_t verificationCacheSize = 4096;
+	std::string benchmark = "";
+	uint32_t benchmarkSize = 20000;
+	std::string batchKernel = "auto";
+	std::string shaBackend = "auto";
+	uint32_t endorsementQuorum = 0;
+	double endorsementTimeout = 0;
+	std::string endorsementPolicy = "all";
+	uint32_t numOfEndorsers = 0;
+	std::string staticEndorsers = "";
+	uint32_t numOfRegions = 1;
+	double issueInterval = 950;
+	uint32_t inFlightWindow = 0;
+	double orderingTimeout = 0;
+	std::string workload = "";
+	double arrivalRate = 1.0 / 0.95;
+	double onTime = 1000;
+	double offTime = 1000;
+	double diurnalPeriod = 2000;
+	double diurnalAmplitude = 0.5;
+	std::string traceFile = "";
+	std::string paymentDistribution = "node";
+	double paymentMean = 0;
+	double paymentSpread = 0.5;
+	double hotspotSkew = 0;
+	std::string nodeRates = "";
+	uint32_t workloadSeed = 1;
+	std::string contractFile = "";
+	std::string contracts = "";
+	uint32_t miningDifficulty = 0;
+	uint32_t miningThreads = std::thread::hardware_concurrency();
+	double miningHashRate = 0;
+	uint32_t executionThreads = 1;
+	double initialBalance = 1000;
+	uint32_t stateSnapshotInterval = 100;
+	uint32_t maxBlockTransactions = 100;
+	uint32_t maxBlockSize = 1000000;
+	double minBlockInterval = 5;
+	double maxBlockInterval = 100;
+	uint32_t pipelineQueueSize = 1024;
+	double ingestTime = 0;
+	double orderTime = 0;
+	double sealTime = 0;
+	double disseminateTime = 0;
+	uint32_t clusterSize = 1;
+	double interServerDelay = 2;
+	double electionTimeout = 150;
+	double heartbeatInterval = 50;
+	uint32_t raftBatchEntries = 64;
+	uint32_t raftInflightAppends = 4;
+	double crashLeaderTime = 0;
+	uint32_t numOfShards = 1;
+	std::string shardPartition = "hash";
+	double checkpointInterval = 200;
+	std::string admissionPolicy = "taildrop";
+	uint32_t admissionQueueSize = 256;
+	double admissionWatermark = 0.75;
+	uint32_t fairShareQuantum = 2048;
+	double minRetryAfter = 10;
+	double backoffRecovery = 1000;
+	std::string dissemination = "unicast";
+	uint32_t treeFanout = 3;
+	double treeAckTimeout = 100;
+	uint32_t treeFailureMisses = 2;
+	uint32_t shredSize = 1024;
+	double shredParity = 0.5;
+	double shredLossRate = 0;
+	std::string crashRsus = "";
+	double crashRsuTime = 0;
 	double tStart = 0;
 	double tFinish = 0;
 
@@ -49,9 +136,198 @@ int main(int argc, char *argv[])
 	CommandLine cmd (__FILE__);
 	cmd.AddValue ("numOfRsu", "Number of rsu nodes", numOfRsu);
 	cmd.AddValue ("transThreshold", "The threshold for the payments", transThreshold);
+	cmd.AddValue ("endorsementQuorum", "Peer signatures a transaction needs, 0 for every peer", endorsementQuorum);
+	cmd.AddValue ("endorsementTimeout", "Milliseconds a transaction may wait for its quorum, 0 for no deadline", endorsementTimeout);
+	cmd.AddValue ("endorsementPolicy", "Endorsers of a transaction: all, static, hashed or region", endorsementPolicy);
+	cmd.AddValue ("numOfEndorsers", "Endorsers per transaction (hashed, region) or of the static set, 0 for no limit", numOfEndorsers);
+	cmd.AddValue ("staticEndorsers", "Comma separated node ids of the static endorsers, empty for nodes 1..numOfEndorsers", staticEndorsers);
+	cmd.AddValue ("numOfRegions", "Regions the rsu nodes are dealt to, for the region policy", numOfRegions);
+	cmd.AddValue ("issueInterval", "Milliseconds between two transactions of a node when inFlightWindow is 0", issueInterval);
+	cmd.AddValue ("inFlightWindow", "Transactions a node keeps in flight at once, 0 issues one every issueInterval", inFlightWindow);
+	cmd.AddValue ("orderingTimeout", "Milliseconds an endorsed transaction may wait for its block, 0 for no deadline", orderingTimeout);
+	cmd.AddValue ("workload", "Open-loop arrivals: fixed, poisson, onoff, diurnal or trace; empty issues at issueInterval", workload);
+	cmd.AddValue ("arrivalRate", "Mean transactions per second of one rsu node", arrivalRate);
+	cmd.AddValue ("onTime", "Mean milliseconds of an on period of the onoff workload", onTime);
+	cmd.AddValue ("offTime", "Mean milliseconds of an off period of the onoff workload", offTime);
+	cmd.AddValue ("diurnalPeriod", "Milliseconds of one cycle of the diurnal workload", diurnalPeriod);
+	cmd.AddValue ("diurnalAmplitude", "Swing of the diurnal rate around its mean, 0 to 1", diurnalAmplitude);
+	cmd.AddValue ("traceFile", "Arrivals of the trace workload, one <time ms> <node id> [payment] per line", traceFile);
+	cmd.AddValue ("paymentDistribution", "Payments of the workload: node, uniform, exponential or lognormal", paymentDistribution);
+	cmd.AddValue ("paymentMean", "Mean payment of the workload, 0 for the payment of each node", paymentMean);
+	cmd.AddValue ("paymentSpread", "Relative half width of uniform payments, sigma of lognormal ones", paymentSpread);
+	cmd.AddValue ("hotspotSkew", "Zipf exponent spreading the arrivals over the rsu nodes, 0 for an even load", hotspotSkew);
+	cmd.AddValue ("nodeRates", "Comma separated <node id>:<transactions per second> overriding the rate of single nodes", nodeRates);
+	cmd.AddValue ("workloadSeed", "Seed of the workload", workloadSeed);
+	cmd.AddValue ("contractFile", "Rules every rsu node checks before endorsing, empty for the default contract", contractFile);
+	cmd.AddValue ("contracts", "Comma separated <node id>:<file> giving single rsu nodes their own contract", contracts);
+	cmd.AddValue ("cryptoThreads", "Worker threads for ECDSA signing and verification, 0 runs them inline", cryptoThreads);
+	cmd.AddValue ("cryptoDelay", "Simulated time of one ECDSA operation in milliseconds", cryptoDelay);
+	cmd.AddValue ("keyThreads", "Threads generating the ECDSA key pool before the simulation", keyThreads);
+	cmd.AddValue ("spareKeys", "Keys kept in the pool for each node besides its initial key", spareKeys);
+	cmd.AddValue ("keySeed", "Seed of the ECDSA key pool, 0 takes the keystore's seed or the current time", keySeed);
+	cmd.AddValue ("keystore", "File keeping the ECDSA keys between runs, empty disables it", keystore);
+	cmd.AddValue ("regenerateKeys", "Generate every key again and overwrite the keystore", regenerateKeys);
+	cmd.AddValue ("verificationCacheSize", "Signature check results cached by the cloud server, 0 disables the cache", verificationCacheSize);
+	cmd.AddValue ("batchKernel", "Kernel for batched signature checks: auto, avx512, avx2 or scalar", batchKernel);
+	cmd.AddValue ("miningDifficulty", "Leading zero bits of a block hash, 0 disables proof of work", miningDifficulty);
+	cmd.AddValue ("miningThreads", "Threads searching the nonce range of a block", miningThreads);
+	cmd.AddValue ("miningHashRate", "Simulated hashes per second of the cloud server, 0 uses the measured rate", miningHashRate);
+	cmd.AddValue ("executionThreads", "Threads settling the payments of a block", executionThreads);
+	cmd.AddValue ("initialBalance", "Balance every account starts with", initialBalance);
+	cmd.AddValue ("maxBlockTransactions", "Transactions that fill a block, 0 for no limit", maxBlockTransactions);
+	cmd.AddValue ("maxBlockSize", "Bytes of a full block, 0 for no limit", maxBlockSize);
+	cmd.AddValue ("minBlockInterval", "Milliseconds a block waits for transactions under the lightest load", minBlockInterval);
+	cmd.AddValue ("maxBlockInterval", "Milliseconds a block waits for transactions at most", maxBlockInterval);
+	cmd.AddValue ("pipelineQueueSize", "Items each stage of the ordering pipeline queues, 0 for no bound", pipelineQueueSize);
+	cmd.AddValue ("ingestTime", "Milliseconds the ingest stage takes per request", ingestTime);
+	cmd.AddValue ("orderTime", "Milliseconds the order stage takes per transaction", orderTime);
+	cmd.AddValue ("sealTime", "Milliseconds the seal stage takes per transaction of a block, mining aside", sealTime);
+	cmd.AddValue ("disseminateTime", "Milliseconds the disseminate stage takes per peer", disseminateTime);
+	cmd.AddValue ("clusterSize", "Cloud servers replicating the block order with Raft", clusterSize);
+	cmd.AddValue ("interServerDelay", "Milliseconds of delay on the links between two cloud servers", interServerDelay);
+	cmd.AddValue ("electionTimeout", "Shortest Raft election timeout in milliseconds, each is drawn up to twice that", electionTimeout);
+	cmd.AddValue ("heartbeatInterval", "Milliseconds between two heartbeats of the Raft leader", heartbeatInterval);
+	cmd.AddValue ("raftBatchEntries", "Blocks per Raft AppendEntries, 0 for no limit", raftBatchEntries);
+	cmd.AddValue ("raftInflightAppends", "Raft AppendEntries the leader keeps outstanding per follower", raftInflightAppends);
+	cmd.AddValue ("crashLeaderTime", "Milliseconds into the run the Raft leader crashes at, 0 for never", crashLeaderTime);
+	cmd.AddValue ("numOfShards", "Shards of the ordering service, each a cluster of clusterSize cloud servers with its own chain", numOfShards);
+	cmd.AddValue ("shardPartition", "How the rsu nodes are split over the shards: hash or region", shardPartition);
+	cmd.AddValue ("checkpointInterval", "Milliseconds between two checkpoints of the shard heads, 0 takes none", checkpointInterval);
+	cmd.AddValue ("admissionPolicy", "Admission queue of the cloud server: taildrop, priority (by payment) or fair (per rsu node)", admissionPolicy);
+	cmd.AddValue ("admissionQueueSize", "REQUEST_BLOCKs the admission queue of the cloud server holds, 0 for no bound", admissionQueueSize);
+	cmd.AddValue ("admissionWatermark", "Share of the admission queue past which the rsu nodes are asked to slow down", admissionWatermark);
+	cmd.AddValue ("fairShareQuantum", "Bytes per rsu node per round of the fair admission policy", fairShareQuantum);
+	cmd.AddValue ("minRetryAfter", "Shortest retry-after in milliseconds a BACKPRESSURE carries", minRetryAfter);
+	cmd.AddValue ("backoffRecovery", "Milliseconds an issue rate halved by BACKPRESSURE takes to climb back", backoffRecovery);
+	cmd.AddValue ("dissemination", "How blocks reach the rsu nodes: unicast from the cloud server, tree over an overlay tree or chunked as erasure coded shreds", dissemination);
+	cmd.AddValue ("treeFanout", "Children of the cloud server and of every rsu node in the overlay tree", treeFanout);
+	cmd.AddValue ("treeAckTimeout", "Milliseconds a member of the overlay tree has to acknowledge a block before the cloud server sends it itself", treeAckTimeout);
+	cmd.AddValue ("treeFailureMisses", "Blocks in a row a member may miss before it is left out of the overlay tree", treeFailureMisses);
+	cmd.AddValue ("shredSize", "Bytes of a data shred in chunked dissemination", shredSize);
+	cmd.AddValue ("shredParity", "Parity shreds per data shred in chunked dissemination", shredParity);
+	cmd.AddValue ("shredLossRate", "Share of the shreds every node loses on the way out, from 0 to 1", shredLossRate);
+	cmd.AddValue ("crashRsus", "Comma separated node ids of the rsu nodes that fail at crashRsuTime", crashRsus);
+	cmd.AddValue ("crashRsuTime", "Milliseconds into the run the crashRsus fail at, 0 for never", crashRsuTime);
+	cmd.AddValue ("stateSnapshotInterval", "Blocks between two snapshots of the payment ledger, 0 takes none", stateSnapshotInterval);
+	cmd.AddValue ("shaBackend", "SHA256 backend: auto, shani, avx2, sse2 or scalar", shaBackend);
+	cmd.AddValue ("benchmark", "Run an offline benchmark (ecdsa, sha256, contract or execution) instead of the simulation", benchmark);
+	cmd.AddValue ("benchmarkSize", "Number of operations timed by the benchmark", benchmarkSize);
 	cmd.Parse (argc, argv);
 
-	nodeStatistics *stats = new nodeStatistics[numOfRsu];
+	if (!ECDSA::setBatchKernel(batchKernel)) {
+		std::cerr << "Batch kernel " << batchKernel << " is not available, using " << ECDSA::batchKernelName() << "\n";
+	}
+	if (!SHA256::setBackend(shaBackend)) {
+		std::cerr << "SHA256 backend " << shaBackend << " is not available, using " << SHA256::backendName() << "\n";
+	}
+
+	if (!benchmark.empty()) {
+		return RunBenchmark(benchmark, benchmarkSize);
+	}
+
+	if (miningDifficulty > 32) {
+		std::cerr << "Mining difficulty " << miningDifficulty << " is more than a 32-bit nonce can meet, using 32\n";
+		miningDifficulty = 32;
+	}
+	EndorsementPolicy::Type policyType;
+	if (!EndorsementPolicy::ParseType(endorsementPolicy, policyType)) {
+		std::cerr << "Endorsement policy " << endorsementPolicy << " is unknown, using all\n";
+		policyType = EndorsementPolicy::ALL_PEERS;
+	}
+	std::vector<uint32_t> staticEndorserIds;
+	if (!ParseNodeIds(staticEndorsers, staticEndorserIds)) {
+		std::cerr << "Static endorsers " << staticEndorsers << " are not a list of node ids, using rsu nodes 1.." << numOfEndorsers << "\n";
+	}
+	if (numOfRegions > OTHER + 1) {
+		std::cerr << "There are only " << OTHER + 1 << " regions, using " << OTHER + 1 << " instead of " << numOfRegions << "\n";
+		numOfRegions = OTHER + 1;
+	}
+
+	// One generator drives every rsu node; without -workload the nodes issue on their own
+	WorkloadGenerator workloadGenerator;
+	std::map<uint32_t, double> nodeRateOverrides;
+	bool openLoop = !workload.empty();
+	if (openLoop) {
+		WorkloadGenerator::ArrivalProcess process;
+		if (!WorkloadGenerator::ParseArrivalProcess(workload, process)) {
+			std::cerr << "Workload " << workload << " is unknown, using poisson\n";
+			process = WorkloadGenerator::POISSON;
+		}
+		if (process == WorkloadGenerator::TRACE && !workloadGenerator.LoadTrace(traceFile)) {
+			std::cerr << "Error: could not open the trace " << traceFile << "\n";
+		}
+		WorkloadGenerator::PaymentDistribution distribution;
+		if (!WorkloadGenerator::ParsePaymentDistribution(paymentDistribution, distribution)) {
+			std::cerr << "Payment distribution " << paymentDistribution << " is unknown, using node\n";
+			distribution = WorkloadGenerator::NODE_PAYMENT;
+		}
+		workloadGenerator.SetSeed(workloadSeed);
+		workloadGenerator.SetArrivalProcess(process);
+		workloadGenerator.SetArrivalRate(arrivalRate);
+		workloadGenerator.SetOnOff(MilliSeconds(onTime), MilliSeconds(offTime));
+		workloadGenerator.SetDiurnal(MilliSeconds(diurnalPeriod), diurnalAmplitude);
+		workloadGenerator.SetPaymentDistribution(distribution, paymentMean, paymentSpread);
+		workloadGenerator.SetHotspotSkew(hotspotSkew);
+
+		std::stringstream nodeRatesStream(nodeRates);
+		std::string nodeRate;
+		while (std::getline(nodeRatesStream, nodeRate, ',')) {
+			if (nodeRate.empty()) {
+				continue;
+			}
+			size_t colon = nodeRate.find(':');
+			uint32_t id;
+			std::string rateText = colon == std::string::npos ? "" : nodeRate.substr(colon + 1);
+			char *end = nullptr;
+			double rate = std::strtod(rateText.c_str(), &end);
+			if (colon == std::string::npos || !ParseNodeId(nodeRate.substr(0, colon), id)
+				|| rateText.empty() || *end != '\0' || !(rate >= 0)) {
+				std::cerr << "Node rate " << nodeRate << " is not <node id>:<transactions per second>, skipping it\n";
+				continue;
+			}
+			nodeRateOverrides[id] = rate;
+		}
+	}
+
+	std::map<uint32_t, std::string> nodeContracts;
+	std::stringstream contractsStream(contracts);
+	std::string nodeContract;
+	while (std::getline(contractsStream, nodeContract, ',')) {
+		if (nodeContract.empty()) {
+			continue;
+		}
+		size_t colon = nodeContract.find(':');
+		uint32_t id;
+		if (colon == std::string::npos || colon + 1 == nodeContract.size() || !ParseNodeId(nodeContract.substr(0, colon), id)) {
+			std::cerr << "Contract " << nodeContract << " is not <node id>:<contract file>, skipping it\n";
+			continue;
+		}
+		nodeContracts[id] = nodeContract.substr(colon + 1);
+	}
+
+	enum ShardPartition partition;
+	if (!TopologyHelper::ParseShardPartition(shardPartition, partition)) {
+		std::cerr << "Shard partition " << shardPartition << " is unknown, using hash\n";
+		partition = SHARD_BY_HASH;
+	}
+	AdmissionQueue::Policy admission;
+	if (!AdmissionQueue::ParsePolicy(admissionPolicy, admission)) {
+		std::cerr << "Admission policy " << admissionPolicy << " is unknown, using taildrop\n";
+		admission = AdmissionQueue::TAIL_DROP;
+	}
+	admissionPolicy = AdmissionQueue::GetPolicyName(admission);
+	if (dissemination != "unicast" && dissemination != "tree" && dissemination != "chunked") {
+		std::cerr << "Dissemination " << dissemination << " is unknown, using unicast\n";
+		dissemination = "unicast";
+	}
+	std::vector<uint32_t> crashRsuIds;
+	if (!ParseNodeIds(crashRsus, crashRsuIds)) {
+		std::cerr << "Crashed rsu nodes " << crashRsus << " are not a list of node ids, crashing none\n";
+	}
+	numOfShards = std::max(numOfShards, 1u);
+
+	// One entry per shard, shared by the cloud servers of its cluster
+	std::vector<nodeStatistics> cloudServerStats(numOfShards, nodeStatistics());
 
 	NS_LOG_INFO("\nNumber of Rsu nodes:" << numOfRsu);
 
@@ -104,13 +380,33 @@ int main(int argc, char *argv[])
 		numOfRsu = numOfRsuFromFile;
 	}
 
+	// One entry per rsu node, node ids start at 1 after the cloud server
+	nodeStatistics *stats = new nodeStatistics[numOfRsu]();
+
 	
 	Ipv4InterfaceContainer  ipv4Interfacecontainer;
     std::map<uint32_t, std::vector<Ipv4Address>> nodeToPeerConnections;
+	std::map<uint32_t, std::vector<uint32_t>> nodeToPeerConnectionsIds;
 	std::map<uint32_t, Ipv4Address> nodeToCloudServerConnectionsIp;
 
 	//Initialize the topology
-	TopologyHelper topologyHelper(numOfRsu, cloudServerId);
+	clusterSize = std::max(clusterSize, 1u);
+	TopologyHelper topologyHelper(numOfRsu, cloudServerId, numOfShards * clusterSize, Seconds(interServerDelay / 1000.0));
+	topologyHelper.SetNumberOfRegions(numOfRegions);
+	topologyHelper.SetShards(numOfShards, partition);
+	if (numOfShards > 1) {
+		std::cout << "Shards: " << numOfShards << " of " << clusterSize << " cloud servers, rsu nodes by "
+				  << TopologyHelper::GetShardPartitionName(partition) << "\n";
+	}
+	if (dissemination == "tree") {
+		std::cout << "Dissemination: overlay tree of fanout " << treeFanout << "\n";
+	}
+	if (dissemination == "chunked") {
+		std::cout << "Dissemination: shreds of " << shredSize << " bytes, " << shredParity << " parity per data shred, down trees of fanout "
+				  << treeFanout << ", " << shredLossRate * 100 << "% lost per send\n";
+	}
+	std::cout << "Admission: " << admissionPolicy << " queue of " << admissionQueueSize << " requests, watermark "
+			  << admissionWatermark << "\n";
 
 	//Install internet stack on every node then assign ips for them
 	InternetStackHelper stack;
@@ -119,6 +415,7 @@ int main(int argc, char *argv[])
 
 	ipv4Interfacecontainer = topologyHelper.GetIpv4InterfaceContainer();
     nodeToPeerConnections = topologyHelper.GetNodeToPeerConnectionsIps();
+	nodeToPeerConnectionsIds = topologyHelper.GetNodeToPeerConnectionsIds();
 	nodeToCloudServerConnectionsIp = topologyHelper.GetNodeToCloudServerConnectionsIp();
 
 
@@ -126,14 +423,47 @@ int main(int argc, char *argv[])
 	ApplicationContainer rsuNodes;
 	ApplicationContainer cloudServerContainer;
 	ObjectFactory factory;
+	std::vector<Ptr<CloudServer>> cloudServers;
+	std::map<uint32_t, Ptr<RsuNode>> rsuNodesById;
 
 	std::cout<<"transThreshold: " << transThreshold << "\n";
 
+	// Shared by every rsu node, so submitters and endorsers agree on who signs
+	std::vector<uint32_t> rsuEndorserIds;
+	for (uint32_t id : staticEndorserIds) {
+		if (id >= 1 && id <= numOfRsu) {
+			rsuEndorserIds.push_back(id);
+		}
+		else {
+			std::cerr << "Static endorser " << id << " is not an rsu node, skipping it\n";
+		}
+	}
+	staticEndorserIds = rsuEndorserIds;
+	for (const std::pair<const uint32_t, double> &nodeRate : nodeRateOverrides) {
+		if (nodeRate.first < 1 || nodeRate.first > numOfRsu) {
+			std::cerr << "Node rate of " << nodeRate.first << " is not for an rsu node, skipping it\n";
+			continue;
+		}
+		workloadGenerator.SetNodeRate(nodeRate.first, nodeRate.second);
+	}
+	for (const std::pair<const uint32_t, std::string> &nodeContract : nodeContracts) {
+		if (nodeContract.first < 1 || nodeContract.first > numOfRsu) {
+			std::cerr << "Contract of " << nodeContract.first << " is not for an rsu node, ignoring it\n";
+		}
+	}
+
+	EndorsementPolicy policy;
+	policy.SetType(policyType);
+	policy.SetNumberOfEndorsers(numOfEndorsers);
+	policy.SetStaticEndorsers(staticEndorserIds);
+	policy.SetRegions(topologyHelper.GetRsuNodesRegions());
+	std::cout << "Endorsement policy: " << EndorsementPolicy::GetTypeName(policyType) << ", " << numOfEndorsers << " endorsers\n";
+
     for(auto &node : nodeToPeerConnections)
     {
 		Ptr<Node> targetNode = topologyHelper.GetNode(node.first);
 
-		if (node.first != cloudServerId) {
+		if (!topologyHelper.IsCloudServer(node.first)) {
 			uint32_t winnerId = rsuMapWinner[node.first];
 			double payment = rsuMapPayment[node.first];
 			const std::string typeId = "ns3::RsuNode";
@@ -142,23 +472,84 @@ int main(int argc, char *argv[])
 			factory.Set("WinnerId", UintegerValue(winnerId));
 			factory.Set("Payment", DoubleValue(payment));
 			factory.Set("TransThreshold", DoubleValue(transThreshold));
+			factory.Set("CryptoDelay", TimeValue(Seconds(cryptoDelay / 1000.0)));
+			factory.Set("EndorsementQuorum", UintegerValue(endorsementQuorum));
+			factory.Set("EndorsementTimeout", TimeValue(Seconds(endorsementTimeout / 1000.0)));
+			factory.Set("IssueInterval", TimeValue(Seconds(issueInterval / 1000.0)));
+			factory.Set("InFlightWindow", UintegerValue(inFlightWindow));
+			factory.Set("OrderingTimeout", TimeValue(Seconds(orderingTimeout / 1000.0)));
+			factory.Set("ContractFile", StringValue(nodeContracts.count(node.first) ? nodeContracts[node.first] : contractFile));
+			factory.Set("BackoffRecovery", TimeValue(Seconds(backoffRecovery / 1000.0)));
+			factory.Set("ShredLossRate", DoubleValue(std::min(std::max(shredLossRate, 0.0), 1.0)));
 
 			Ptr<RsuNode> rsuNode = factory.Create<RsuNode>();
 
 			rsuNode->SetPeersAddresses(node.second);
-			rsuNode->SetNodeStats(stats);
+			rsuNode->SetPeerIds(nodeToPeerConnectionsIds[node.first]);
+			rsuNode->SetEndorsementPolicy(&policy);
+			rsuNode->SetOpenLoop(openLoop);
+			if (openLoop) {
+				workloadGenerator.AddNode(node.first, MakeCallback(&RsuNode::SubmitTransaction, rsuNode), payment);
+			}
+			rsuNode->SetNodeStats(&stats[node.first - 1]);
 			rsuNode->SetCloudServerAddress(nodeToCloudServerConnectionsIp[node.first]);	
+			rsuNode->SetCloudServerAddresses(topologyHelper.GetNodeToCloudServersIps()[node.first]);
 			targetNode->AddApplication(rsuNode);
 
 			rsuNodes.Add(rsuNode);
+			rsuNodesById[node.first] = rsuNode;
 		} else {
 			const std::string typeId = "ns3::CloudServer";
 			factory.SetTypeId(typeId);
 			factory.Set("Ip", AddressValue(InetSocketAddress(Ipv4Address::GetAny(), blockchainPort)));
+			factory.Set("CryptoDelay", TimeValue(Seconds(cryptoDelay / 1000.0)));
+			factory.Set("VerificationCacheSize", UintegerValue(verificationCacheSize));
+			factory.Set("EndorsementQuorum", UintegerValue(endorsementQuorum));
+			factory.Set("MiningDifficulty", UintegerValue(miningDifficulty));
+			factory.Set("MiningThreads", UintegerValue(std::max(miningThreads, 1u)));
+			factory.Set("MiningHashRate", DoubleValue(miningHashRate));
+			factory.Set("ExecutionThreads", UintegerValue(std::max(executionThreads, 1u)));
+			factory.Set("InitialBalance", DoubleValue(initialBalance));
+			factory.Set("StateSnapshotInterval", UintegerValue(stateSnapshotInterval));
+			factory.Set("MaxBlockTransactions", UintegerValue(maxBlockTransactions));
+			factory.Set("MaxBlockSize", UintegerValue(maxBlockSize));
+			factory.Set("MinBlockInterval", TimeValue(Seconds(minBlockInterval / 1000.0)));
+			factory.Set("MaxBlockInterval", TimeValue(Seconds(maxBlockInterval / 1000.0)));
+			factory.Set("PipelineQueueSize", UintegerValue(pipelineQueueSize));
+			factory.Set("IngestTime", TimeValue(Seconds(ingestTime / 1000.0)));
+			factory.Set("OrderTime", TimeValue(Seconds(orderTime / 1000.0)));
+			factory.Set("SealTime", TimeValue(Seconds(sealTime / 1000.0)));
+			factory.Set("DisseminateTime", TimeValue(Seconds(disseminateTime / 1000.0)));
+			factory.Set("ElectionTimeout", TimeValue(Seconds(electionTimeout / 1000.0)));
+			factory.Set("HeartbeatInterval", TimeValue(Seconds(heartbeatInterval / 1000.0)));
+			factory.Set("RaftBatchEntries", UintegerValue(raftBatchEntries));
+			factory.Set("RaftInflightAppends", UintegerValue(std::max(raftInflightAppends, 1u)));
+			factory.Set("ShardId", UintegerValue(topologyHelper.GetShard(node.first)));
+			factory.Set("NumberOfShards", UintegerValue(numOfShards));
+			factory.Set("CheckpointInterval", TimeValue(Seconds(checkpointInterval / 1000.0)));
+			factory.Set("AdmissionPolicy", StringValue(admissionPolicy));
+			factory.Set("AdmissionQueueSize", UintegerValue(admissionQueueSize));
+			factory.Set("AdmissionWatermark", DoubleValue(std::min(std::max(admissionWatermark, 0.0), 1.0)));
+			factory.Set("FairShareQuantum", UintegerValue(std::max(fairShareQuantum, 1u)));
+			factory.Set("MinRetryAfter", TimeValue(Seconds(minRetryAfter / 1000.0)));
+			factory.Set("Dissemination", StringValue(dissemination));
+			factory.Set("TreeFanout", UintegerValue(std::max(treeFanout, 1u)));
+			factory.Set("TreeAckTimeout", TimeValue(Seconds(treeAckTimeout / 1000.0)));
+			factory.Set("TreeFailureMisses", UintegerValue(std::max(treeFailureMisses, 1u)));
+			factory.Set("ShredSize", UintegerValue(std::max(shredSize, 1u)));
+			factory.Set("ShredParity", DoubleValue(std::min(std::max(shredParity, 0.0), 4.0)));
+			factory.Set("ShredLossRate", DoubleValue(std::min(std::max(shredLossRate, 0.0), 1.0)));
 
 			Ptr<CloudServer> cloudServer = factory.Create<CloudServer>();
 
 			cloudServer->SetPeersAddresses(node.second);
+			cloudServer->SetPeerIds(nodeToPeerConnectionsIds[node.first]);
+			cloudServer->SetSubmitterPeers(nodeToPeerConnectionsIds);
+			cloudServer->SetEndorsementPolicy(&policy);
+			cloudServer->SetClusterPeers(topologyHelper.GetCloudServerToClusterIps()[node.first]);
+			cloudServer->SetShardPeers(topologyHelper.GetCloudServerToShardsIps()[node.first]);
+			cloudServer->SetNodeStats(&cloudServerStats[topologyHelper.GetShard(node.first)]);
+			cloudServers.push_back(cloudServer);
 
 			targetNode->AddApplication(cloudServer);
 
@@ -166,20 +557,70 @@ int main(int argc, char *argv[])
 		}
     }
 
-    rsuNodes.Start(Seconds(0.1));
-    rsuNodes.Stop(MilliSeconds(2000));
+	const Time appStart = Seconds(0.1);
+	const Time appStop = MilliSeconds(2000);
+
+    rsuNodes.Start(appStart);
+    rsuNodes.Stop(appStop);
 
-	cloudServerContainer.Start(Seconds(0.1));
-	cloudServerContainer.Stop(MilliSeconds(2000));
+	cloudServerContainer.Start(appStart);
+	cloudServerContainer.Stop(appStop);
+
+	if (openLoop) {
+		workloadGenerator.Start(appStart, appStop);
+	}
+
+	// Crash-stop, the leader of the moment goes silent for the rest of the run
+	if (crashLeaderTime > 0) {
+		Simulator::Schedule(Seconds(crashLeaderTime / 1000.0), [cloudServers]() {
+			for (const Ptr<CloudServer> &cloudServer : cloudServers) {
+				if (cloudServer->IsLeader()) {
+					cloudServer->Crash();
+					break;
+				}
+			}
+		});
+	}
+	if (crashRsuTime > 0) {
+		for (uint32_t id : crashRsuIds) {
+			if (id < 1 || id > numOfRsu || !rsuNodesById.count(id)) {
+				std::cerr << "Crashed rsu node " << id << " is not an rsu node, skipping it\n";
+				continue;
+			}
+			Simulator::Schedule(Seconds(crashRsuTime / 1000.0), &RsuNode::Crash, rsuNodesById[id]);
+		}
+	}
+
+	unsigned long poolSeed = keySeed;
+	if (poolSeed == 0 && (keystore.empty() || regenerateKeys || !KeyPool::ReadKeystoreSeed(keystore, poolSeed))) {
+		poolSeed = time(nullptr);
+	}
+	KeyPool::GetInstance().Fill(numOfRsu + numOfShards * clusterSize, 1 + spareKeys, keyThreads, poolSeed, keystore, regenerateKeys);
+	NS_LOG_INFO("Key pool: " << KeyPool::GetInstance().GetLoadedKeys() << " keys loaded, "
+				<< KeyPool::GetInstance().GetGeneratedKeys() << " generated on " << keyThreads << " threads in "
+				<< KeyPool::GetInstance().GetBuildTime() << "s, seed " << poolSeed);
+
+	CryptoWorkerPool::GetInstance().SetNumberOfThreads(cryptoThreads);
+	NS_LOG_INFO("Crypto worker threads: " << cryptoThreads);
+	NS_LOG_INFO("Signature batch kernel: " << ECDSA::batchKernelName());
+	NS_LOG_INFO("SHA256 backend: " << SHA256::backendName());
 
 	tStart = GetWallTime();
 
-    Simulator::Stop(MilliSeconds(2000));
+    Simulator::Stop(appStop);
 	Simulator::Run();
     Simulator::Destroy();
 
+	CryptoWorkerPool::GetInstance().Shutdown();
+
 	tFinish = GetWallTime();
-	PrintTotalStats(stats, numOfRsu, tStart, tFinish);
+
+	if (openLoop) {
+		NS_LOG_INFO("Workload: " << workload << ", " << workloadGenerator.GetArrivals() << " arrivals in "
+					<< workloadGenerator.GetEvents() << " simulator events");
+	}
+	PrintTotalStats(stats, numOfRsu, MergeShardStats(cloudServerStats, (appStop - appStart).GetSeconds()), tStart, tFinish,
+					(appStop - appStart).GetSeconds());
 
 	delete[] stats;
   	return 0;
@@ -187,15 +628,26 @@ int main(int argc, char *argv[])
 }
 
 
-void PrintTotalStats(nodeStatistics *stats, uint32_t totalNodes, double tStart, double tFinish)
+void PrintTotalStats(nodeStatistics *stats, uint32_t totalNodes, const nodeStatistics &cloudServerStats, double tStart, double tFinish, double simulatedTime)
 {
 	double meanLatency = 0.0;
+	double meanEndorsementTime = 0.0;
+	double meanOrderingTime = 0.0;
+	uint32_t endorsingNodes = 0;
+	long confirmedTransactions = 0;
 
 	for (uint32_t it = 0; it < totalNodes; it++ )
     { 
 
-		if(stats[it].responseCount == stats[it].numberOfPeers) {
-			meanLatency = (meanLatency*it + stats[it].meanLatency)/static_cast<double>(it+1);
+		if(stats[it].nodeGeneratedTransaction > 0) {
+			endorsingNodes++;
+			meanEndorsementTime = (meanEndorsementTime*(endorsingNodes - 1) + stats[it].meanEndorsementTime)/static_cast<double>(endorsingNodes);
+		}
+		// Latency is weighted by transactions, a node that got few of them ordered counts less
+		if(stats[it].nodeConfirmedTransaction > 0) {
+			confirmedTransactions += stats[it].nodeConfirmedTransaction;
+			meanLatency += (stats[it].meanLatency - meanLatency)*stats[it].nodeConfirmedTransaction/static_cast<double>(confirmedTransactions);
+			meanOrderingTime += (stats[it].meanOrderingTime - meanOrderingTime)*stats[it].nodeConfirmedTransaction/static_cast<double>(confirmedTransactions);
 		}
 	}
 
@@ -203,8 +655,97 @@ void PrintTotalStats(nodeStatistics *stats, uint32_t totalNodes, double tStart,
 	std::cout << "===============================================\n";
 	std::cout << "Number of Rsu nodes =" << totalNodes <<"\n";
 	std::cout << "Average Latency =" << meanLatency <<"s \n";
+	std::cout << "Average Endorsement Time =" << meanEndorsementTime <<"s \n";
+	std::cout << "Average Ordering Time =" << meanOrderingTime <<"s \n";
+	std::cout << "Confirmed transactions =" << confirmedTransactions << ", throughput =" << confirmedTransactions / simulatedTime <<" tx/s \n";
 	std::cout << "Simulator Time =" << tFinish -  tStart<<"s \n";
+	std::cout << "Crypto jobs =" << CryptoWorkerPool::GetInstance().GetTotalJobs() <<"\n";
+	std::cout << "Key pool build time =" << KeyPool::GetInstance().GetBuildTime() <<"s \n";
+	std::cout << "Key pool hits =" << KeyPool::GetInstance().GetHits() << ", misses =" << KeyPool::GetInstance().GetMisses() <<"\n";
+	std::cout << "Mined blocks =" << cloudServerStats.minerGeneratedBlocks << ", average interval ="
+			  << cloudServerStats.minerAverageBlockGenInterval << "s, hash rate =" << cloudServerStats.hashRate / 1e6 << " MH/s\n";
+	std::cout << "Average block =" << cloudServerStats.meanNumberofTransactions << " transactions, "
+			  << cloudServerStats.minerAverageBlockSize << " bytes\n";
+	double meanBlockPropagationTime = 0.0;
+	double meanHopDelay = 0.0;
+	double meanBlockHops = 0.0;
+	long receivedBlocks = 0;
+	for (uint32_t it = 0; it < totalNodes; it++) {
+		if (stats[it].totalBlocks > 0) {
+			receivedBlocks += stats[it].totalBlocks;
+			double weight = stats[it].totalBlocks / static_cast<double>(receivedBlocks);
+			meanBlockPropagationTime += (stats[it].meanBlockPropagationTime - meanBlockPropagationTime) * weight;
+			meanHopDelay += (stats[it].meanHopDelay - meanHopDelay) * weight;
+			meanBlockHops += (stats[it].meanBlockHops - meanBlockHops) * weight;
+		}
+	}
+	std::cout << "Block propagation =" << meanBlockPropagationTime << "s over " << receivedBlocks << " deliveries, hops ="
+			  << meanBlockHops << ", last hop =" << meanHopDelay << "s, cloud server egress =" << cloudServerStats.blockSentBytes << " bytes\n";
+	std::cout << "Committed blocks =" << cloudServerStats.committedBlocks << ", transactions =" << cloudServerStats.committedTransactions
+			  << ", throughput =" << cloudServerStats.committedTransactions / simulatedTime << " tx/s, average commit latency ="
+			  << cloudServerStats.meanCommitLatency << "s\n";
+
+}
+
+nodeStatistics MergeShardStats(const std::vector<nodeStatistics> &shardStats, double simulatedTime)
+{
+	// Counts and hash rates add up, means are weighted by the blocks or samples behind them
+	nodeStatistics total = {};
+	for (uint32_t shardId = 0; shardId < shardStats.size(); shardId++) {
+		const nodeStatistics &shard = shardStats[shardId];
+		if (shardStats.size() > 1) {
+			std::cout << "Shard " << shardId << ": committed blocks =" << shard.committedBlocks << ", transactions ="
+					  << shard.committedTransactions << ", throughput =" << shard.committedTransactions / simulatedTime << " tx/s\n";
+		}
 
+		total.minerGeneratedBlocks += shard.minerGeneratedBlocks;
+		if (total.minerGeneratedBlocks > 0) {
+			double weight = shard.minerGeneratedBlocks / static_cast<double>(total.minerGeneratedBlocks);
+			total.minerAverageBlockGenInterval += (shard.minerAverageBlockGenInterval - total.minerAverageBlockGenInterval) * weight;
+			total.meanNumberofTransactions += (shard.meanNumberofTransactions - total.meanNumberofTransactions) * weight;
+			total.minerAverageBlockSize += (shard.minerAverageBlockSize - total.minerAverageBlockSize) * weight;
+		}
+		total.hashRate += shard.hashRate;
+		total.blockSentBytes += shard.blockSentBytes;
+		total.committedBlocks += shard.committedBlocks;
+		total.committedTransactions += shard.committedTransactions;
+		total.commitLatencySamples += shard.commitLatencySamples;
+		if (total.commitLatencySamples > 0) {
+			total.meanCommitLatency += (shard.meanCommitLatency - total.meanCommitLatency)
+									   * shard.commitLatencySamples / static_cast<double>(total.commitLatencySamples);
+		}
+	}
+	return total;
+}
+
+// A node id of at most nine digits; false, with id unchanged, otherwise
+static bool ParseNodeId(const std::string &text, uint32_t &id)
+{
+	if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos) {
+		return false;
+	}
+	id = std::stoul(text);
+	return true;
+}
+
+// A comma separated list of node ids; false, with ids left empty, if an entry is not a number
+static bool ParseNodeIds(const std::string &list, std::vector<uint32_t> &ids)
+{
+	ids.clear();
+	std::stringstream stream(list);
+	std::string id;
+	while (std::getline(stream, id, ',')) {
+		if (id.empty()) {
+			continue;
+		}
+		uint32_t nodeId;
+		if (!ParseNodeId(id, nodeId)) {
+			ids.clear();
+			return false;
+		}
+		ids.push_back(nodeId);
+	}
+	return true;
 }
 
 static double GetWallTime()
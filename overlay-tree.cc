@@ -0,0 +1,163 @@
+#include "overlay-tree.h"
+#include <algorithm>
+
+namespace ns3 {
+
+    OverlayTree::OverlayTree(void)
+    {
+        m_fanout = 2;
+        m_failureMisses = 2;
+        m_rotation = 0;
+        m_rebuilds = 0;
+    }
+
+    OverlayTree::~OverlayTree(void)
+    {
+    }
+
+    void
+    OverlayTree::SetFanout(uint32_t fanout)
+    {
+        m_fanout = std::max(fanout, 1u);
+    }
+
+    uint32_t
+    OverlayTree::GetFanout(void) const
+    {
+        return m_fanout;
+    }
+
+    void
+    OverlayTree::SetFailureMisses(uint32_t misses)
+    {
+        m_failureMisses = std::max(misses, 1u);
+    }
+
+    void
+    OverlayTree::SetMembers(const std::vector<uint32_t> &members)
+    {
+        m_members.clear();
+        for (uint32_t nodeId : members)
+        {
+            m_members[nodeId] = {true, 0};
+        }
+    }
+
+    std::vector<uint32_t>
+    OverlayTree::GetLiveMembers(void) const
+    {
+        std::vector<uint32_t> live;
+        for (auto &member : m_members)
+        {
+            if (member.second.live)
+            {
+                live.push_back(member.first);
+            }
+        }
+        return live;
+    }
+
+    uint32_t
+    OverlayTree::GetNumberOfLiveMembers(void) const
+    {
+        return GetLiveMembers().size();
+    }
+
+    bool
+    OverlayTree::IsLive(uint32_t nodeId) const
+    {
+        std::map<uint32_t, Member>::const_iterator member = m_members.find(nodeId);
+        return member != m_members.end() && member->second.live;
+    }
+
+    std::vector<uint32_t>
+    OverlayTree::NextOrder(void)
+    {
+        std::vector<uint32_t> order = GetLiveMembers();
+        if (!order.empty())
+        {
+            std::rotate(order.begin(), order.begin() + m_rotation % order.size(), order.end());
+        }
+        m_rotation++;
+        return order;
+    }
+
+    bool
+    OverlayTree::Acknowledge(uint32_t nodeId)
+    {
+        std::map<uint32_t, Member>::iterator member = m_members.find(nodeId);
+        if (member == m_members.end())
+        {
+            return false;
+        }
+
+        member->second.misses = 0;
+        if (member->second.live)
+        {
+            return false;
+        }
+        member->second.live = true;
+        m_rebuilds++;
+        return true;
+    }
+
+    bool
+    OverlayTree::Miss(uint32_t nodeId)
+    {
+        std::map<uint32_t, Member>::iterator member = m_members.find(nodeId);
+        if (member == m_members.end() || !member->second.live)
+        {
+            return false;
+        }
+
+        if (++member->second.misses < m_failureMisses)
+        {
+            return false;
+        }
+        member->second.live = false;
+        m_rebuilds++;
+        return true;
+    }
+
+    uint64_t
+    OverlayTree::GetRebuilds(void) const
+    {
+        return m_rebuilds;
+    }
+
+    std::vector<uint32_t>
+    OverlayTree::GetChildren(const std::vector<uint32_t> &order, uint32_t fanout, int position)
+    {
+        std::vector<uint32_t> children;
+        size_t first = (size_t)(position + 1) * fanout;
+        for (size_t i = first; i < first + fanout && i < order.size(); i++)
+        {
+            children.push_back(order[i]);
+        }
+        return children;
+    }
+
+    int
+    OverlayTree::GetPosition(const std::vector<uint32_t> &order, uint32_t nodeId)
+    {
+        std::vector<uint32_t>::const_iterator it = std::find(order.begin(), order.end(), nodeId);
+        return it == order.end() ? -1 : it - order.begin();
+    }
+
+    uint32_t
+    OverlayTree::GetDepth(uint32_t members, uint32_t fanout)
+    {
+        // Level d holds fanout^d members
+        uint32_t depth = 0;
+        uint64_t covered = 0, level = 1;
+        fanout = std::max(fanout, 1u);
+        while (covered < members)
+        {
+            level *= fanout;
+            covered += level;
+            depth++;
+        }
+        return depth;
+    }
+
+}
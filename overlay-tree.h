@@ -0,0 +1,88 @@
+#ifndef OVERLAY_TREE_H
+#define OVERLAY_TREE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * The overlay tree a block travels down from the cloud server to its rsu nodes.
+     *
+     * The server is the root and the live members follow it in heap order: the
+     * first fanout members are the children of the server, and the member at
+     * position i has the fanout members from (i + 1) * fanout on. The order goes
+     * out with every block, so a relay finds its children without any state of its
+     * own, and a tree rebuilt without a failed member takes effect with the next
+     * block. The order is rotated from block to block so that every member takes
+     * its turn at relaying.
+     *
+     * A member that misses the acknowledgement of FailureMisses blocks in a row is
+     * left out of the tree; one acknowledgement brings it back.
+     */
+    class OverlayTree
+    {
+        public:
+            OverlayTree(void);
+            virtual ~OverlayTree(void);
+
+            void SetFanout(uint32_t fanout);
+            uint32_t GetFanout(void) const;
+            void SetFailureMisses(uint32_t misses);
+
+            /*
+             * Every node that may join the tree, all of them live.
+             */
+            void SetMembers(const std::vector<uint32_t> &members);
+            std::vector<uint32_t> GetLiveMembers(void) const;
+            uint32_t GetNumberOfLiveMembers(void) const;
+            bool IsLive(uint32_t nodeId) const;
+
+            /*
+             * The live members in the order of the next block.
+             */
+            std::vector<uint32_t> NextOrder(void);
+
+            /*
+             * The member got a block; true if that brings it back into the tree.
+             */
+            bool Acknowledge(uint32_t nodeId);
+            /*
+             * The member did not acknowledge a block in time; true if that leaves it out
+             * of the tree.
+             */
+            bool Miss(uint32_t nodeId);
+
+            uint64_t GetRebuilds(void) const;
+
+            /*
+             * The children of the member at position in order, of the root for -1.
+             */
+            static std::vector<uint32_t> GetChildren(const std::vector<uint32_t> &order, uint32_t fanout, int position);
+            /*
+             * The position of the node in order, -1 if it is not in it.
+             */
+            static int GetPosition(const std::vector<uint32_t> &order, uint32_t nodeId);
+            /*
+             * The levels below the root a tree of the members takes.
+             */
+            static uint32_t GetDepth(uint32_t members, uint32_t fanout);
+
+        protected:
+            struct Member
+            {
+                bool live;
+                uint32_t misses;                // blocks in a row it did not acknowledge
+            };
+
+            uint32_t m_fanout;
+            uint32_t m_failureMisses;
+            std::map<uint32_t, Member> m_members;   // by node id
+            uint64_t m_rotation;
+            uint64_t m_rebuilds;
+    };
+
+}
+
+#endif /* OVERLAY_TREE_H */
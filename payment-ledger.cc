@@ -0,0 +1,454 @@
+#include "payment-ledger.h"
+#include "blockchain.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace ns3 {
+
+    struct PaymentLedger::Node
+    {
+        Sha256Digest hash;
+        NodePtr children[2];
+        bool isLeaf;
+        Sha256Digest key;
+        uint32_t accountId;
+        Account account;
+    };
+
+    static const uint32_t MAX_DEPTH = 256;
+    static const char SNAPSHOT_MAGIC[4] = {'P', 'L', 'S', '1'};
+
+    static uint8_t*
+    PutUint32(uint8_t *out, uint32_t value)
+    {
+        out[0] = (uint8_t)(value >> 24);
+        out[1] = (uint8_t)(value >> 16);
+        out[2] = (uint8_t)(value >> 8);
+        out[3] = (uint8_t)value;
+        return out + 4;
+    }
+
+    static uint8_t*
+    PutDouble(uint8_t *out, double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        out = PutUint32(out, (uint32_t)(bits >> 32));
+        return PutUint32(out, (uint32_t)bits);
+    }
+
+    static uint32_t
+    GetUint32(const uint8_t *in)
+    {
+        return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+    }
+
+    static double
+    GetDouble(const uint8_t *in)
+    {
+        uint64_t bits = ((uint64_t)GetUint32(in) << 32) | GetUint32(in + 4);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    PaymentLedger::PaymentLedger(void)
+    {
+        m_rootHash.fill(0);
+        m_height = 0;
+        m_numberOfAccounts = 0;
+    }
+
+    PaymentLedger::~PaymentLedger(void)
+    {
+    }
+
+    Sha256Digest
+    PaymentLedger::KeyOf(uint32_t accountId)
+    {
+        uint8_t id[4];
+        PutUint32(id, accountId);
+
+        Sha256Digest key;
+        SHA256 ctx;
+        ctx.init();
+        ctx.update(id, sizeof(id));
+        ctx.final(key.data());
+        return key;
+    }
+
+    bool
+    PaymentLedger::BitOf(const Sha256Digest &key, uint32_t depth)
+    {
+        return (key[depth / 8] >> (7 - depth % 8)) & 1;
+    }
+
+    Sha256Digest
+    PaymentLedger::HashOf(const NodePtr &node)
+    {
+        if (!node)
+        {
+            Sha256Digest empty;
+            empty.fill(0);
+            return empty;
+        }
+        return node->hash;
+    }
+
+    Sha256Digest
+    PaymentLedger::HashLeaf(const Sha256Digest &key, uint32_t accountId, const Account &account)
+    {
+        uint8_t data[1 + 32 + 4 + 8 + 8 + 4 + 4];
+        uint8_t *out = data;
+        *out++ = 0x00;
+        out = std::copy(key.begin(), key.end(), out);
+        out = PutUint32(out, accountId);
+        out = PutDouble(out, account.paid);
+        out = PutDouble(out, account.received);
+        out = PutUint32(out, account.paidCount);
+        PutUint32(out, account.receivedCount);
+
+        Sha256Digest digest;
+        SHA256 ctx;
+        ctx.init();
+        ctx.update(data, sizeof(data));
+        ctx.final(digest.data());
+        return digest;
+    }
+
+    Sha256Digest
+    PaymentLedger::HashBranch(const Sha256Digest &left, const Sha256Digest &right)
+    {
+        uint8_t data[1 + 32 + 32];
+        data[0] = 0x01;
+        std::copy(left.begin(), left.end(), data + 1);
+        std::copy(right.begin(), right.end(), data + 33);
+
+        Sha256Digest digest;
+        SHA256 ctx;
+        ctx.init();
+        ctx.update(data, sizeof(data));
+        ctx.final(digest.data());
+        return digest;
+    }
+
+    PaymentLedger::NodePtr
+    PaymentLedger::MakeLeaf(const Sha256Digest &key, uint32_t accountId, const Account &account)
+    {
+        std::shared_ptr<Node> leaf = std::make_shared<Node>();
+        leaf->isLeaf = true;
+        leaf->key = key;
+        leaf->accountId = accountId;
+        leaf->account = account;
+        leaf->hash = HashLeaf(key, accountId, account);
+        return leaf;
+    }
+
+    PaymentLedger::NodePtr
+    PaymentLedger::MakeBranch(const NodePtr &left, const NodePtr &right)
+    {
+        std::shared_ptr<Node> branch = std::make_shared<Node>();
+        branch->isLeaf = false;
+        branch->children[0] = left;
+        branch->children[1] = right;
+        branch->hash = HashBranch(HashOf(left), HashOf(right));
+        return branch;
+    }
+
+    PaymentLedger::NodePtr
+    PaymentLedger::Insert(const NodePtr &node, uint32_t depth, const NodePtr &leaf)
+    {
+        if (!node || (node->isLeaf && node->accountId == leaf->accountId))
+        {
+            return leaf;
+        }
+        if (node->isLeaf)
+        {
+            return Split(node, leaf, depth);
+        }
+
+        NodePtr children[2] = {node->children[0], node->children[1]};
+        bool bit = BitOf(leaf->key, depth);
+        children[bit] = Insert(children[bit], depth + 1, leaf);
+        return MakeBranch(children[0], children[1]);
+    }
+
+    PaymentLedger::NodePtr
+    PaymentLedger::Split(const NodePtr &existing, const NodePtr &leaf, uint32_t depth)
+    {
+        // Two different ids cannot share all 256 bits of their keys
+        bool existingBit = BitOf(existing->key, depth);
+        bool leafBit = BitOf(leaf->key, depth);
+        NodePtr children[2];
+        if (existingBit == leafBit && depth + 1 < MAX_DEPTH)
+        {
+            children[leafBit] = Split(existing, leaf, depth + 1);
+        }
+        else
+        {
+            children[existingBit] = existing;
+            children[leafBit] = leaf;
+        }
+        return MakeBranch(children[0], children[1]);
+    }
+
+    const PaymentLedger::Node*
+    PaymentLedger::Find(const NodePtr &root, uint32_t accountId)
+    {
+        Sha256Digest key = KeyOf(accountId);
+        const Node *node = root.get();
+        for (uint32_t depth = 0; node && !node->isLeaf; depth++)
+        {
+            node = node->children[BitOf(key, depth)].get();
+        }
+        return node && node->accountId == accountId ? node : nullptr;
+    }
+
+    PaymentLedger::NodePtr
+    PaymentLedger::Update(NodePtr root, const std::vector<Transaction> &transactions, const std::vector<bool> &settled,
+                          uint32_t &newAccounts)
+    {
+        // One update per account, however many of the block's payments it took part in
+        std::map<uint32_t, Account> changes;
+        for (size_t i = 0; i < transactions.size() && i < settled.size(); i++)
+        {
+            if (!settled[i])
+            {
+                continue;
+            }
+            const Transaction &transaction = transactions[i];
+            Account &payer = changes[(uint32_t)transaction.GetRsuNodeId()];
+            payer.paid += transaction.GetPayment();
+            payer.paidCount++;
+
+            Account &winner = changes[(uint32_t)transaction.GetWinnerId()];
+            winner.received += transaction.GetPayment();
+            winner.receivedCount++;
+        }
+
+        newAccounts = 0;
+        for (const std::pair<const uint32_t, Account> &change : changes)
+        {
+            Account account = change.second;
+            const Node *current = Find(root, change.first);
+            if (current)
+            {
+                account.paid += current->account.paid;
+                account.received += current->account.received;
+                account.paidCount += current->account.paidCount;
+                account.receivedCount += current->account.receivedCount;
+            }
+            else
+            {
+                newAccounts++;
+            }
+            root = Insert(root, 0, MakeLeaf(KeyOf(change.first), change.first, account));
+        }
+        return root;
+    }
+
+    void
+    PaymentLedger::Apply(int height, const std::vector<Transaction> &transactions, const std::vector<bool> &settled)
+    {
+        uint32_t newAccounts;
+        m_root = Update(m_root, transactions, settled, newAccounts);
+        m_rootHash = HashOf(m_root);
+        m_numberOfAccounts += newAccounts;
+        m_height = height;
+    }
+
+    Sha256Digest
+    PaymentLedger::GetRootAfter(const std::vector<Transaction> &transactions, const std::vector<bool> &settled) const
+    {
+        uint32_t newAccounts;
+        return HashOf(Update(m_root, transactions, settled, newAccounts));
+    }
+
+    const Sha256Digest&
+    PaymentLedger::GetRoot(void) const
+    {
+        return m_rootHash;
+    }
+
+    int
+    PaymentLedger::GetHeight(void) const
+    {
+        return m_height;
+    }
+
+    uint32_t
+    PaymentLedger::GetNumberOfAccounts(void) const
+    {
+        return m_numberOfAccounts;
+    }
+
+    bool
+    PaymentLedger::GetAccount(uint32_t accountId, Account &account) const
+    {
+        const Node *node = Find(m_root, accountId);
+        if (!node)
+        {
+            account = Account();
+            return false;
+        }
+        account = node->account;
+        return true;
+    }
+
+    PaymentLedger::Proof
+    PaymentLedger::GetProof(uint32_t accountId) const
+    {
+        Proof proof;
+        proof.accountId = accountId;
+        proof.hasLeaf = false;
+        proof.leafAccountId = 0;
+        proof.leafAccount = Account();
+
+        Sha256Digest key = KeyOf(accountId);
+        const Node *node = m_root.get();
+        for (uint32_t depth = 0; node && !node->isLeaf; depth++)
+        {
+            bool bit = BitOf(key, depth);
+            proof.siblings.push_back(HashOf(node->children[!bit]));
+            node = node->children[bit].get();
+        }
+        if (node)
+        {
+            proof.hasLeaf = true;
+            proof.leafAccountId = node->accountId;
+            proof.leafAccount = node->account;
+        }
+        return proof;
+    }
+
+    bool
+    PaymentLedger::VerifyProof(const Sha256Digest &root, const Proof &proof, bool &found, Account &account)
+    {
+        found = false;
+        account = Account();
+        if (proof.siblings.size() > MAX_DEPTH)
+        {
+            return false;
+        }
+
+        Sha256Digest key = KeyOf(proof.accountId);
+        Sha256Digest hash = HashOf(NodePtr());
+        if (proof.hasLeaf)
+        {
+            // Another account may only end the path if its key follows the same bits
+            Sha256Digest leafKey = KeyOf(proof.leafAccountId);
+            for (uint32_t depth = 0; depth < proof.siblings.size(); depth++)
+            {
+                if (BitOf(leafKey, depth) != BitOf(key, depth))
+                {
+                    return false;
+                }
+            }
+            hash = HashLeaf(leafKey, proof.leafAccountId, proof.leafAccount);
+        }
+
+        for (uint32_t depth = proof.siblings.size(); depth-- > 0;)
+        {
+            hash = BitOf(key, depth) ? HashBranch(proof.siblings[depth], hash) : HashBranch(hash, proof.siblings[depth]);
+        }
+        if (hash != root)
+        {
+            return false;
+        }
+
+        found = proof.hasLeaf && proof.leafAccountId == proof.accountId;
+        if (found)
+        {
+            account = proof.leafAccount;
+        }
+        return true;
+    }
+
+    void
+    PaymentLedger::Collect(const NodePtr &node, std::vector<const Node*> &leaves)
+    {
+        if (!node)
+        {
+            return;
+        }
+        if (node->isLeaf)
+        {
+            leaves.push_back(node.get());
+            return;
+        }
+        Collect(node->children[0], leaves);
+        Collect(node->children[1], leaves);
+    }
+
+    void
+    PaymentLedger::Write(std::ostream &out) const
+    {
+        std::vector<const Node*> leaves;
+        Collect(m_root, leaves);
+        std::sort(leaves.begin(), leaves.end(), [](const Node *a, const Node *b) { return a->accountId < b->accountId; });
+
+        uint8_t header[4 + 4 + 32 + 4];
+        uint8_t *at = std::copy(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 4, header);
+        at = PutUint32(at, (uint32_t)m_height);
+        at = std::copy(m_rootHash.begin(), m_rootHash.end(), at);
+        PutUint32(at, leaves.size());
+        out.write((const char*)header, sizeof(header));
+
+        for (const Node *leaf : leaves)
+        {
+            uint8_t record[4 + 8 + 8 + 4 + 4];
+            at = PutUint32(record, leaf->accountId);
+            at = PutDouble(at, leaf->account.paid);
+            at = PutDouble(at, leaf->account.received);
+            at = PutUint32(at, leaf->account.paidCount);
+            PutUint32(at, leaf->account.receivedCount);
+            out.write((const char*)record, sizeof(record));
+        }
+    }
+
+    bool
+    PaymentLedger::Read(std::istream &in, std::string &error)
+    {
+        uint8_t header[4 + 4 + 32 + 4];
+        if (!in.read((char*)header, sizeof(header)) || !std::equal(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 4, header))
+        {
+            error = "not a ledger snapshot";
+            return false;
+        }
+        Sha256Digest root;
+        std::copy(header + 8, header + 40, root.begin());
+        uint32_t count = GetUint32(header + 40);
+
+        NodePtr node;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint8_t record[4 + 8 + 8 + 4 + 4];
+            if (!in.read((char*)record, sizeof(record)))
+            {
+                error = "snapshot cut short";
+                return false;
+            }
+            uint32_t accountId = GetUint32(record);
+            Account account;
+            account.paid = GetDouble(record + 4);
+            account.received = GetDouble(record + 12);
+            account.paidCount = GetUint32(record + 20);
+            account.receivedCount = GetUint32(record + 24);
+            node = Insert(node, 0, MakeLeaf(KeyOf(accountId), accountId, account));
+        }
+
+        if (HashOf(node) != root)
+        {
+            error = "snapshot does not match its root";
+            return false;
+        }
+
+        m_root = node;
+        m_rootHash = root;
+        m_height = (int)GetUint32(header + 4);
+        m_numberOfAccounts = count;
+        return true;
+    }
+
+}
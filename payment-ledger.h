@@ -0,0 +1,123 @@
+#ifndef PAYMENT_LEDGER_H
+#define PAYMENT_LEDGER_H
+
+#include "sha256.h"
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    class Transaction;
+
+    /*
+     * What the chain paid per account, kept up to date block by block and committed
+     * to by a sparse Merkle tree.
+     *
+     * An account sits in a binary trie on the bits of SHA256 of its id, at the first
+     * depth where no other account shares its path, so the tree is about log2(n)
+     * deep. A leaf hashes 0x00, its key and its record, a branch hashes 0x01 and its
+     * two children, and an empty subtree is 32 zero bytes. Updates copy the path they
+     * change and share the rest, so a copy of the ledger is a snapshot that costs
+     * nothing until the original moves on. Lookups, updates and proofs are O(log n).
+     */
+    class PaymentLedger
+    {
+        public:
+            struct Account
+            {
+                double paid;                // by this rsu node as rsuNodeId
+                double received;            // by this winner as winnerId
+                uint32_t paidCount;
+                uint32_t receivedCount;
+            };
+
+            /*
+             * The sibling hashes from the root down to where the path of the account ends,
+             * and the leaf found there, if any: the account itself, or another account
+             * sharing the path, which proves the account is absent.
+             */
+            struct Proof
+            {
+                uint32_t accountId;
+                std::vector<Sha256Digest> siblings;
+                bool hasLeaf;
+                uint32_t leafAccountId;
+                Account leafAccount;
+            };
+
+            PaymentLedger(void);
+            virtual ~PaymentLedger(void);
+
+            /*
+             * Adds the payments of one block that were settled and moves to `height`;
+             * settled holds a flag per transaction, one past its end counts as unsettled.
+             */
+            void Apply(int height, const std::vector<Transaction> &transactions, const std::vector<bool> &settled);
+
+            /*
+             * The root after Apply(transactions, settled), leaving the ledger as it is.
+             */
+            Sha256Digest GetRootAfter(const std::vector<Transaction> &transactions, const std::vector<bool> &settled) const;
+
+            const Sha256Digest& GetRoot(void) const;
+            int GetHeight(void) const;
+            uint32_t GetNumberOfAccounts(void) const;
+
+            /*
+             * False, and a zero account, if the id never paid or received.
+             */
+            bool GetAccount(uint32_t accountId, Account &account) const;
+
+            Proof GetProof(uint32_t accountId) const;
+            /*
+             * Checks the proof against root; found tells whether the account is in the tree
+             * and account holds it if so.
+             */
+            static bool VerifyProof(const Sha256Digest &root, const Proof &proof, bool &found, Account &account);
+
+            /*
+             * Writes the height, the root and every account, in id order.
+             */
+            void Write(std::ostream &out) const;
+            /*
+             * Rebuilds the ledger from Write; false if the data is cut short or does not
+             * hash to the root it was written with, in which case the ledger is unchanged.
+             */
+            bool Read(std::istream &in, std::string &error);
+
+        protected:
+            struct Node;
+            typedef std::shared_ptr<const Node> NodePtr;
+
+            static Sha256Digest KeyOf(uint32_t accountId);
+            static bool BitOf(const Sha256Digest &key, uint32_t depth);
+            static Sha256Digest HashOf(const NodePtr &node);
+            static Sha256Digest HashLeaf(const Sha256Digest &key, uint32_t accountId, const Account &account);
+            static Sha256Digest HashBranch(const Sha256Digest &left, const Sha256Digest &right);
+
+            static NodePtr MakeLeaf(const Sha256Digest &key, uint32_t accountId, const Account &account);
+            static NodePtr MakeBranch(const NodePtr &left, const NodePtr &right);
+            static NodePtr Insert(const NodePtr &node, uint32_t depth, const NodePtr &leaf);
+            static NodePtr Split(const NodePtr &existing, const NodePtr &leaf, uint32_t depth);
+            static void Collect(const NodePtr &node, std::vector<const Node*> &leaves);
+
+            /*
+             * The root after adding the settled payments of transactions to the tree under
+             * root; newAccounts counts the accounts that were not in it.
+             */
+            static NodePtr Update(NodePtr root, const std::vector<Transaction> &transactions, const std::vector<bool> &settled,
+                                  uint32_t &newAccounts);
+            static const Node* Find(const NodePtr &root, uint32_t accountId);
+
+            NodePtr m_root;
+            Sha256Digest m_rootHash;
+            int m_height;
+            uint32_t m_numberOfAccounts;
+    };
+
+}
+
+#endif /* PAYMENT_LEDGER_H */
@@ -0,0 +1,244 @@
+#include "pipeline-stage.h"
+#include "ns3/simulator.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace ns3 {
+
+    PipelineStage::PipelineStage(void)
+    {
+        m_capacity = 0;
+        m_servers = 1;
+        m_next = nullptr;
+        m_busy = 0;
+        m_depthTime = 0;
+        m_busyTime = 0;
+        m_blockedTime = 0;
+        m_maxDepth = 0;
+        m_arrivals = 0;
+        m_completed = 0;
+        m_rejected = 0;
+        m_serviceTime = 0;
+        m_wallTime = 0;
+    }
+
+    PipelineStage::~PipelineStage(void)
+    {
+    }
+
+    void
+    PipelineStage::SetName(const std::string &name)
+    {
+        m_name = name;
+    }
+
+    const std::string&
+    PipelineStage::GetName(void) const
+    {
+        return m_name;
+    }
+
+    void
+    PipelineStage::SetCapacity(uint32_t capacity)
+    {
+        m_capacity = capacity;
+    }
+
+    void
+    PipelineStage::SetServers(uint32_t servers)
+    {
+        m_servers = servers;
+    }
+
+    void
+    PipelineStage::SetNext(PipelineStage *next)
+    {
+        m_next = next;
+    }
+
+    bool
+    PipelineStage::HasRoom(void) const
+    {
+        // Without a limit on the servers nothing waits in the queue, so the bound is on
+        // the items in service
+        uint32_t held = m_queue.size() + (m_servers == 0 ? m_busy : 0);
+        return m_capacity == 0 || held < m_capacity;
+    }
+
+    void
+    PipelineStage::WhenRoom(std::function<void(void)> waiter)
+    {
+        m_waiters.push_back(waiter);
+    }
+
+    bool
+    PipelineStage::Push(Start start, Finish finish)
+    {
+        if (m_arrivals == 0 && m_rejected == 0)
+        {
+            m_firstArrival = Simulator::Now();
+            m_lastChange = m_firstArrival;
+        }
+        if (!HasRoom())
+        {
+            m_rejected++;
+            return false;
+        }
+
+        Account();
+        Item item;
+        item.start = start;
+        item.finish = finish;
+        m_queue.push_back(item);
+        m_arrivals++;
+        m_maxDepth = std::max(m_maxDepth, (uint32_t)m_queue.size());
+
+        Serve();
+        return true;
+    }
+
+    void
+    PipelineStage::Serve(void)
+    {
+        while (!m_queue.empty() && (m_servers == 0 || m_busy < m_servers))
+        {
+            Account();
+            std::shared_ptr<Item> item = std::make_shared<Item>(m_queue.front());
+            m_queue.pop_front();
+            m_busy++;
+            item->began = Simulator::Now();
+
+            std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+            item->start([this, item]() { Complete(item); });
+            m_wallTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+            NotifyRoom();
+        }
+    }
+
+    void
+    PipelineStage::Complete(std::shared_ptr<Item> item)
+    {
+        m_serviceTime += (Simulator::Now() - item->began).GetSeconds();
+        Forward(item, Simulator::Now());
+    }
+
+    void
+    PipelineStage::Forward(std::shared_ptr<Item> item, Time blockedSince)
+    {
+        if (m_next && !m_next->HasRoom())
+        {
+            m_next->WhenRoom([this, item, blockedSince]() { Forward(item, blockedSince); });
+            return;
+        }
+
+        Account();
+        m_blockedTime += (Simulator::Now() - blockedSince).GetSeconds();
+        m_busy--;
+        m_completed++;
+        item->finish();
+        Serve();
+        if (m_servers == 0)
+        {
+            NotifyRoom();
+        }
+    }
+
+    void
+    PipelineStage::NotifyRoom(void)
+    {
+        std::vector<std::function<void(void)>> waiters;
+        waiters.swap(m_waiters);
+        for (auto &waiter : waiters)
+        {
+            waiter();
+        }
+    }
+
+    void
+    PipelineStage::Account(void)
+    {
+        double elapsed = (Simulator::Now() - m_lastChange).GetSeconds();
+        m_depthTime += m_queue.size() * elapsed;
+        m_busyTime += m_busy * elapsed;
+        m_lastChange = Simulator::Now();
+    }
+
+    uint32_t
+    PipelineStage::GetQueueDepth(void) const
+    {
+        return m_queue.size();
+    }
+
+    uint32_t
+    PipelineStage::GetMaxQueueDepth(void) const
+    {
+        return m_maxDepth;
+    }
+
+    double
+    PipelineStage::GetMeanQueueDepth(void) const
+    {
+        double elapsed = (Simulator::Now() - m_firstArrival).GetSeconds();
+        double tail = (Simulator::Now() - m_lastChange).GetSeconds();
+        return elapsed > 0 ? (m_depthTime + m_queue.size() * tail) / elapsed : 0;
+    }
+
+    uint64_t
+    PipelineStage::GetCompleted(void) const
+    {
+        return m_completed;
+    }
+
+    uint64_t
+    PipelineStage::GetRejected(void) const
+    {
+        return m_rejected;
+    }
+
+    double
+    PipelineStage::GetMeanServiceTime(void) const
+    {
+        return m_completed > 0 ? m_serviceTime / m_completed : 0;
+    }
+
+    double
+    PipelineStage::GetMeanWallTime(void) const
+    {
+        return m_completed > 0 ? m_wallTime / m_completed : 0;
+    }
+
+    double
+    PipelineStage::GetUtilization(void) const
+    {
+        double elapsed = (Simulator::Now() - m_firstArrival).GetSeconds();
+        double tail = (Simulator::Now() - m_lastChange).GetSeconds();
+        if (elapsed <= 0)
+        {
+            return 0;
+        }
+        double busy = (m_busyTime + m_busy * tail) / elapsed;
+        return m_servers > 0 ? busy / m_servers : busy;
+    }
+
+    double
+    PipelineStage::GetBlockedTime(void) const
+    {
+        return m_blockedTime;
+    }
+
+    void
+    PipelineStage::Print(std::ostream &out) const
+    {
+        out << std::left << std::setw(12) << m_name << std::right
+            << " done " << std::setw(7) << m_completed
+            << "  dropped " << std::setw(5) << m_rejected
+            << "  queue mean " << std::setw(8) << GetMeanQueueDepth() << " max " << std::setw(5) << m_maxDepth
+            << "  service " << std::setw(10) << GetMeanServiceTime() * 1e3 << " ms"
+            << "  wall " << std::setw(10) << GetMeanWallTime() * 1e6 << " us"
+            << (m_servers > 0 ? "  utilization " : "  in service ") << std::setw(8) << GetUtilization()
+            << "  blocked " << m_blockedTime << " s\n";
+    }
+
+}
@@ -0,0 +1,122 @@
+#ifndef PIPELINE_STAGE_H
+#define PIPELINE_STAGE_H
+
+#include "ns3/nstime.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * One stage of the cloud server's ordering pipeline: a bounded queue in front of
+     * a number of servers, in simulated time.
+     *
+     * An item is two functions. Start runs when a server takes the item and is handed
+     * the function to call once the service is over, which it may schedule later.
+     * Finish runs after that, and is where the item moves on to the next stage. If
+     * the next stage's queue is full the item keeps its server until there is room,
+     * so a slow stage backs the ones before it up instead of letting queues grow.
+     *
+     * Each stage measures its queue over simulated time, the simulated time from
+     * start to done, how busy its servers are, and the wall time spent in Start.
+     */
+    class PipelineStage
+    {
+        public:
+            typedef std::function<void(void)> Done;
+            typedef std::function<void(Done)> Start;
+            typedef std::function<void(void)> Finish;
+
+            PipelineStage(void);
+            virtual ~PipelineStage(void);
+
+            void SetName(const std::string &name);
+            const std::string& GetName(void) const;
+
+            /*
+             * Items that may wait in the queue, 0 for no bound; with no limit on the servers,
+             * items in the stage.
+             */
+            void SetCapacity(uint32_t capacity);
+            /*
+             * Items served at the same time, 0 for as many as there are.
+             */
+            void SetServers(uint32_t servers);
+            void SetNext(PipelineStage *next);
+
+            /*
+             * Queues the item; false, and the item is dropped, if the queue is full.
+             */
+            bool Push(Start start, Finish finish);
+            bool HasRoom(void) const;
+            /*
+             * Runs waiter once, the next time an item leaves the queue.
+             */
+            void WhenRoom(std::function<void(void)> waiter);
+
+            uint32_t GetQueueDepth(void) const;
+            uint32_t GetMaxQueueDepth(void) const;
+            double GetMeanQueueDepth(void) const;
+            uint64_t GetCompleted(void) const;
+            uint64_t GetRejected(void) const;
+            double GetMeanServiceTime(void) const;
+            double GetMeanWallTime(void) const;
+            /*
+             * Share of the elapsed time the servers were busy, blocked time included; with
+             * no limit on the servers, the mean number of items in service.
+             */
+            double GetUtilization(void) const;
+            double GetBlockedTime(void) const;
+
+            /*
+             * One line of the metrics above.
+             */
+            void Print(std::ostream &out) const;
+
+        protected:
+            struct Item
+            {
+                Start start;
+                Finish finish;
+                Time began;
+            };
+
+            void Serve(void);
+            void Complete(std::shared_ptr<Item> item);
+            void Forward(std::shared_ptr<Item> item, Time blockedSince);
+            void NotifyRoom(void);
+            /*
+             * Adds the time since the last change at the current depth and load.
+             */
+            void Account(void);
+
+            std::string m_name;
+            uint32_t m_capacity;
+            uint32_t m_servers;
+            PipelineStage *m_next;
+
+            std::deque<Item> m_queue;
+            uint32_t m_busy;
+            std::vector<std::function<void(void)>> m_waiters;
+
+            Time m_firstArrival;
+            Time m_lastChange;
+            double m_depthTime;             // queue depth integrated over seconds
+            double m_busyTime;              // busy servers integrated over seconds
+            double m_blockedTime;
+            uint32_t m_maxDepth;
+            uint64_t m_arrivals;
+            uint64_t m_completed;
+            uint64_t m_rejected;
+            double m_serviceTime;
+            double m_wallTime;
+    };
+
+}
+
+#endif /* PIPELINE_STAGE_H */
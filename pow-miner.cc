@@ -0,0 +1,162 @@
+#include "pow-miner.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+
+    PowMiner::PowMiner(void)
+    {
+        m_numberOfThreads = 1;
+        m_totalHashes = 0;
+        m_totalSeconds = 0;
+    }
+
+    PowMiner::~PowMiner(void)
+    {
+    }
+
+    void
+    PowMiner::SetNumberOfThreads(unsigned int numberOfThreads)
+    {
+        m_numberOfThreads = numberOfThreads > 0 ? numberOfThreads : 1;
+    }
+
+    unsigned int
+    PowMiner::GetNumberOfThreads(void) const
+    {
+        return m_numberOfThreads;
+    }
+
+    bool
+    PowMiner::MeetsDifficulty(const Sha256Digest &hash, uint32_t difficulty)
+    {
+        uint32_t i = 0;
+        for (; difficulty >= 8; difficulty -= 8, i++)
+        {
+            if (i >= hash.size() || hash[i] != 0)
+            {
+                return false;
+            }
+        }
+        return difficulty == 0 || (i < hash.size() && (hash[i] >> (8 - difficulty)) == 0);
+    }
+
+    PowMiner::Result
+    PowMiner::Mine(const Block::Header &header, uint32_t difficulty)
+    {
+        const uint64_t numberOfNonces = (uint64_t)1 << 32;
+        const uint32_t prefixSize = Block::NONCE_OFFSET / 64 * 64;
+        const uint32_t tailSize = Block::HEADER_SIZE - prefixSize;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        SHA256 midstate;
+        midstate.init();
+        midstate.update(header.data(), prefixSize);
+
+        std::atomic<uint64_t> nextChunk(0);
+        std::atomic<uint64_t> bestNonce(numberOfNonces);
+        std::atomic<uint64_t> hashes(0);
+
+        auto search = [&]()
+        {
+            unsigned char tail[tailSize];
+            Sha256Digest hash;
+            uint64_t count = 0;
+
+            memcpy(tail, header.data() + prefixSize, tailSize);
+
+            while (true)
+            {
+                uint64_t first = nextChunk++ * CHUNK_SIZE;
+                if (first >= numberOfNonces || first > bestNonce.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+
+                uint64_t last = std::min(first + CHUNK_SIZE, numberOfNonces);
+                for (uint64_t nonce = first; nonce < last; nonce++)
+                {
+                    unsigned char *out = tail + Block::NONCE_OFFSET - prefixSize;
+                    out[0] = (unsigned char)(nonce >> 24);
+                    out[1] = (unsigned char)(nonce >> 16);
+                    out[2] = (unsigned char)(nonce >> 8);
+                    out[3] = (unsigned char)nonce;
+
+                    SHA256 ctx = midstate;
+                    ctx.update(tail, tailSize);
+                    ctx.final(hash.data());
+                    count++;
+
+                    if (MeetsDifficulty(hash, difficulty))
+                    {
+                        uint64_t best = bestNonce.load();
+                        while (nonce < best && !bestNonce.compare_exchange_weak(best, nonce))
+                        {
+                        }
+                        break;
+                    }
+                }
+            }
+            hashes += count;
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < m_numberOfThreads; i++)
+        {
+            threads.emplace_back(search);
+        }
+        search();
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        Result result;
+        result.found = bestNonce < numberOfNonces;
+        result.nonce = (uint32_t)bestNonce;
+        result.attempts = result.found ? bestNonce + 1 : numberOfNonces;
+        result.hashes = hashes;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.hash.fill(0);
+        if (result.found)
+        {
+            Block::Header solved = header;
+            solved[Block::NONCE_OFFSET] = (uint8_t)(result.nonce >> 24);
+            solved[Block::NONCE_OFFSET + 1] = (uint8_t)(result.nonce >> 16);
+            solved[Block::NONCE_OFFSET + 2] = (uint8_t)(result.nonce >> 8);
+            solved[Block::NONCE_OFFSET + 3] = (uint8_t)result.nonce;
+
+            SHA256 ctx;
+            ctx.init();
+            ctx.update(solved.data(), solved.size());
+            ctx.final(result.hash.data());
+        }
+
+        m_totalHashes += result.hashes;
+        m_totalSeconds += result.seconds;
+        return result;
+    }
+
+    uint64_t
+    PowMiner::GetTotalHashes(void) const
+    {
+        return m_totalHashes;
+    }
+
+    double
+    PowMiner::GetTotalSeconds(void) const
+    {
+        return m_totalSeconds;
+    }
+
+    double
+    PowMiner::GetHashRate(void) const
+    {
+        return m_totalSeconds > 0 ? m_totalHashes / m_totalSeconds : 0;
+    }
+
+}
@@ -0,0 +1,62 @@
+#ifndef POW_MINER_H
+#define POW_MINER_H
+
+#include "blockchain.h"
+#include <cstdint>
+
+namespace ns3 {
+
+    /*
+     * Proof of work over Block::GetHeader(): finds a nonce whose header hash starts
+     * with `difficulty` zero bits.
+     *
+     * The 64-byte blocks of the header before the nonce do not depend on it, so they
+     * are hashed once and every attempt only runs the final SHA256 block. The nonce
+     * range is cut into chunks that the threads take in order; a thread that finds a
+     * nonce stops, and the others finish the chunks below it. The answer is always the lowest valid
+     * nonce, so the chain is the same for any number of threads.
+     */
+    class PowMiner
+    {
+        public:
+            struct Result
+            {
+                bool found;
+                uint32_t nonce;
+                Sha256Digest hash;
+                uint64_t attempts;      // nonces up to and including the answer, what a single miner would try
+                uint64_t hashes;        // headers hashed by all threads, including past the answer
+                double seconds;         // wall time of the search
+            };
+
+            PowMiner(void);
+            virtual ~PowMiner(void);
+
+            void SetNumberOfThreads(unsigned int numberOfThreads);
+            unsigned int GetNumberOfThreads(void) const;
+
+            /*
+             * Searches every 32-bit nonce of the header. found is false if none is valid.
+             */
+            Result Mine(const Block::Header &header, uint32_t difficulty);
+
+            static bool MeetsDifficulty(const Sha256Digest &hash, uint32_t difficulty);
+
+            uint64_t GetTotalHashes(void) const;
+            double GetTotalSeconds(void) const;
+            /*
+             * Hashes per wall-clock second over every Mine() call so far.
+             */
+            double GetHashRate(void) const;
+
+        protected:
+            static const uint64_t CHUNK_SIZE = 1 << 14;
+
+            unsigned int m_numberOfThreads;
+            uint64_t m_totalHashes;
+            double m_totalSeconds;
+    };
+
+}
+
+#endif /* POW_MINER_H */
@@ -0,0 +1,638 @@
+#include "raft-consensus.h"
+#include "ns3/simulator.h"
+#include <algorithm>
+
+namespace ns3 {
+
+    RaftConsensus::RaftConsensus(void)
+    {
+        m_id = 0;
+        m_electionTimeout = MilliSeconds(150);
+        m_heartbeatInterval = MilliSeconds(50);
+        m_maxBatchEntries = 0;
+        m_maxInflight = 1;
+        m_running = false;
+        m_role = FOLLOWER;
+        m_term = 0;
+        m_votedFor = NO_LEADER;
+        m_leaderId = NO_LEADER;
+        m_commitIndex = 0;
+        m_lastApplied = 0;
+        m_elections = 0;
+        m_appendsSent = 0;
+        m_batchedAppends = 0;
+        m_batchedEntries = 0;
+        m_retransmissions = 0;
+
+        // The sentinel, so that index i is m_log[i]
+        Entry sentinel;
+        sentinel.term = 0;
+        m_log.push_back(sentinel);
+    }
+
+    RaftConsensus::~RaftConsensus(void)
+    {
+    }
+
+    void
+    RaftConsensus::SetId(uint32_t id)
+    {
+        m_id = id;
+    }
+
+    uint32_t
+    RaftConsensus::GetId(void) const
+    {
+        return m_id;
+    }
+
+    void
+    RaftConsensus::SetPeers(const std::vector<uint32_t> &peers)
+    {
+        m_peers = peers;
+    }
+
+    uint32_t
+    RaftConsensus::GetClusterSize(void) const
+    {
+        return m_peers.size() + 1;
+    }
+
+    void
+    RaftConsensus::SetElectionTimeout(Time timeout)
+    {
+        m_electionTimeout = timeout;
+    }
+
+    void
+    RaftConsensus::SetHeartbeatInterval(Time interval)
+    {
+        m_heartbeatInterval = interval;
+    }
+
+    void
+    RaftConsensus::SetMaxBatchEntries(uint32_t entries)
+    {
+        m_maxBatchEntries = entries;
+    }
+
+    void
+    RaftConsensus::SetMaxInflight(uint32_t appends)
+    {
+        m_maxInflight = std::max(appends, 1u);
+    }
+
+    void
+    RaftConsensus::SetSeed(uint32_t seed)
+    {
+        m_random.seed(seed);
+    }
+
+    void
+    RaftConsensus::SetTransport(SendRequestVote sendRequestVote, SendVote sendVote,
+                                SendAppendEntries sendAppendEntries, SendAppendReply sendAppendReply)
+    {
+        m_sendRequestVote = sendRequestVote;
+        m_sendVote = sendVote;
+        m_sendAppendEntries = sendAppendEntries;
+        m_sendAppendReply = sendAppendReply;
+    }
+
+    void
+    RaftConsensus::SetAppendCallback(EntryCallback callback)
+    {
+        m_appendCallback = callback;
+    }
+
+    void
+    RaftConsensus::SetTruncateCallback(TruncateCallback callback)
+    {
+        m_truncateCallback = callback;
+    }
+
+    void
+    RaftConsensus::SetCommitCallback(EntryCallback callback)
+    {
+        m_commitCallback = callback;
+    }
+
+    void
+    RaftConsensus::SetLeaderCallback(LeaderCallback callback)
+    {
+        m_leaderCallback = callback;
+    }
+
+    void
+    RaftConsensus::Start(bool campaign)
+    {
+        m_running = true;
+        if (m_peers.empty())
+        {
+            m_term = 1;
+            m_votedFor = m_id;
+            BecomeLeader();
+            return;
+        }
+        ResetElectionTimer(campaign ? Seconds(0) : DrawElectionTimeout());
+    }
+
+    void
+    RaftConsensus::Stop(void)
+    {
+        m_running = false;
+        m_electionEvent.Cancel();
+        m_heartbeatEvent.Cancel();
+        m_flushEvent.Cancel();
+    }
+
+    uint64_t
+    RaftConsensus::Propose(const std::string &data)
+    {
+        if (!m_running || m_role != LEADER)
+        {
+            return 0;
+        }
+
+        Entry entry;
+        entry.term = m_term;
+        entry.data = data;
+        m_log.push_back(entry);
+
+        if (m_peers.empty())
+        {
+            AdvanceCommit();
+        }
+        else
+        {
+            ScheduleFlush();
+        }
+        return GetLastIndex();
+    }
+
+    void
+    RaftConsensus::ReceiveRequestVote(const RequestVote &request)
+    {
+        if (!m_running)
+        {
+            return;
+        }
+        if (request.term > m_term)
+        {
+            StepDown(request.term);
+        }
+
+        // The candidate's log has to be at least as up to date as this one
+        bool upToDate = request.lastLogTerm > GetLastTerm()
+                        || (request.lastLogTerm == GetLastTerm() && request.lastLogIndex >= GetLastIndex());
+        Vote vote;
+        vote.term = m_term;
+        vote.voterId = m_id;
+        vote.granted = request.term == m_term && upToDate
+                       && (m_votedFor == NO_LEADER || m_votedFor == request.candidateId);
+        if (vote.granted)
+        {
+            m_votedFor = request.candidateId;
+            ResetElectionTimer(DrawElectionTimeout());
+        }
+        m_sendVote(request.candidateId, vote);
+    }
+
+    void
+    RaftConsensus::ReceiveVote(const Vote &vote)
+    {
+        if (!m_running)
+        {
+            return;
+        }
+        if (vote.term > m_term)
+        {
+            StepDown(vote.term);
+            return;
+        }
+        if (m_role != CANDIDATE || vote.term != m_term || !vote.granted)
+        {
+            return;
+        }
+
+        m_votes.insert(vote.voterId);
+        if (m_votes.size() * 2 > GetClusterSize())
+        {
+            BecomeLeader();
+        }
+    }
+
+    void
+    RaftConsensus::ReceiveAppendEntries(const AppendEntries &append)
+    {
+        if (!m_running)
+        {
+            return;
+        }
+
+        AppendReply reply;
+        reply.followerId = m_id;
+        reply.success = false;
+        reply.matchIndex = 0;
+        reply.entries = append.entries.size();
+        if (append.term < m_term)
+        {
+            reply.term = m_term;
+            m_sendAppendReply(append.leaderId, reply);
+            return;
+        }
+
+        if (append.term > m_term || m_role != FOLLOWER)
+        {
+            StepDown(append.term);
+        }
+        ResetElectionTimer(DrawElectionTimeout());
+        reply.term = m_term;
+        if (m_leaderId != append.leaderId)
+        {
+            m_leaderId = append.leaderId;
+            if (m_leaderCallback)
+            {
+                m_leaderCallback(m_leaderId);
+            }
+        }
+
+        if (append.prevLogIndex > GetLastIndex() || m_log[append.prevLogIndex].term != append.prevLogTerm)
+        {
+            // Committed entries match the leader's, so it can start over from there
+            reply.matchIndex = append.prevLogIndex > GetLastIndex() ? GetLastIndex()
+                                                                    : std::min(m_commitIndex, append.prevLogIndex - 1);
+            m_sendAppendReply(append.leaderId, reply);
+            return;
+        }
+
+        uint64_t index = append.prevLogIndex;
+        for (const Entry &entry : append.entries)
+        {
+            index++;
+            if (index <= GetLastIndex())
+            {
+                if (m_log[index].term == entry.term)
+                {
+                    continue;
+                }
+                if (m_truncateCallback)
+                {
+                    m_truncateCallback(index);
+                }
+                m_log.resize(index);
+            }
+            m_log.push_back(entry);
+            if (m_appendCallback)
+            {
+                m_appendCallback(index, entry);
+            }
+        }
+
+        if (append.leaderCommit > m_commitIndex)
+        {
+            m_commitIndex = std::max(m_commitIndex, std::min(append.leaderCommit, index));
+            ApplyCommitted();
+        }
+        reply.success = true;
+        reply.matchIndex = index;
+        m_sendAppendReply(append.leaderId, reply);
+    }
+
+    void
+    RaftConsensus::ReceiveAppendReply(const AppendReply &reply)
+    {
+        if (!m_running)
+        {
+            return;
+        }
+        if (reply.term > m_term)
+        {
+            StepDown(reply.term);
+            return;
+        }
+        if (m_role != LEADER || reply.term != m_term)
+        {
+            return;
+        }
+
+        Follower &follower = m_followers[reply.followerId];
+        if (reply.entries > 0 && follower.inflight > 0)
+        {
+            follower.inflight--;
+            follower.oldestSent = Simulator::Now();
+        }
+
+        if (reply.success)
+        {
+            follower.matchIndex = std::max(follower.matchIndex, reply.matchIndex);
+            follower.nextIndex = std::max(follower.nextIndex, follower.matchIndex + 1);
+            AdvanceCommit();
+        }
+        else
+        {
+            // Whatever is still on the way was sent after the mismatch and fails as well
+            follower.nextIndex = std::max(follower.matchIndex, reply.matchIndex) + 1;
+            follower.inflight = 0;
+        }
+        Replicate(reply.followerId, false);
+    }
+
+    RaftConsensus::Role
+    RaftConsensus::GetRole(void) const
+    {
+        return m_role;
+    }
+
+    bool
+    RaftConsensus::IsLeader(void) const
+    {
+        return m_running && m_role == LEADER;
+    }
+
+    uint64_t
+    RaftConsensus::GetTerm(void) const
+    {
+        return m_term;
+    }
+
+    uint32_t
+    RaftConsensus::GetLeaderId(void) const
+    {
+        return m_leaderId;
+    }
+
+    uint64_t
+    RaftConsensus::GetLastIndex(void) const
+    {
+        return m_log.size() - 1;
+    }
+
+    uint64_t
+    RaftConsensus::GetCommitIndex(void) const
+    {
+        return m_commitIndex;
+    }
+
+    const RaftConsensus::Entry&
+    RaftConsensus::GetEntry(uint64_t index) const
+    {
+        return m_log.at(index);
+    }
+
+    uint64_t
+    RaftConsensus::GetElections(void) const
+    {
+        return m_elections;
+    }
+
+    uint64_t
+    RaftConsensus::GetAppendsSent(void) const
+    {
+        return m_appendsSent;
+    }
+
+    double
+    RaftConsensus::GetMeanBatchEntries(void) const
+    {
+        return m_batchedAppends > 0 ? (double)m_batchedEntries / m_batchedAppends : 0;
+    }
+
+    uint64_t
+    RaftConsensus::GetRetransmissions(void) const
+    {
+        return m_retransmissions;
+    }
+
+    const char*
+    RaftConsensus::GetRoleName(Role role)
+    {
+        switch (role)
+        {
+            case FOLLOWER: return "follower";
+            case CANDIDATE: return "candidate";
+            case LEADER: return "leader";
+        }
+        return "";
+    }
+
+    void
+    RaftConsensus::ResetElectionTimer(Time timeout)
+    {
+        m_electionEvent.Cancel();
+        m_electionEvent = Simulator::Schedule(timeout, &RaftConsensus::StartElection, this);
+    }
+
+    Time
+    RaftConsensus::DrawElectionTimeout(void)
+    {
+        std::uniform_int_distribution<int64_t> draw(m_electionTimeout.GetNanoSeconds(), 2 * m_electionTimeout.GetNanoSeconds());
+        return NanoSeconds(draw(m_random));
+    }
+
+    void
+    RaftConsensus::StartElection(void)
+    {
+        if (!m_running || m_role == LEADER)
+        {
+            return;
+        }
+
+        m_role = CANDIDATE;
+        m_term++;
+        m_votedFor = m_id;
+        m_votes.clear();
+        m_votes.insert(m_id);
+        m_leaderId = NO_LEADER;
+        m_elections++;
+        ResetElectionTimer(DrawElectionTimeout());
+
+        RequestVote request;
+        request.term = m_term;
+        request.candidateId = m_id;
+        request.lastLogIndex = GetLastIndex();
+        request.lastLogTerm = GetLastTerm();
+        for (uint32_t peer : m_peers)
+        {
+            m_sendRequestVote(peer, request);
+        }
+    }
+
+    void
+    RaftConsensus::BecomeLeader(void)
+    {
+        m_role = LEADER;
+        m_leaderId = m_id;
+        m_electionEvent.Cancel();
+
+        m_followers.clear();
+        for (uint32_t peer : m_peers)
+        {
+            Follower follower;
+            follower.nextIndex = GetLastIndex() + 1;
+            follower.matchIndex = 0;
+            follower.inflight = 0;
+            follower.oldestSent = Simulator::Now();
+            m_followers[peer] = follower;
+        }
+
+        if (m_leaderCallback)
+        {
+            m_leaderCallback(m_id);
+        }
+        if (m_peers.empty())
+        {
+            AdvanceCommit();
+        }
+        else
+        {
+            Heartbeat();
+        }
+    }
+
+    void
+    RaftConsensus::StepDown(uint64_t term)
+    {
+        if (term > m_term)
+        {
+            m_term = term;
+            m_votedFor = NO_LEADER;
+        }
+        bool wasLeader = m_role == LEADER;
+        m_role = FOLLOWER;
+        m_heartbeatEvent.Cancel();
+        m_flushEvent.Cancel();
+        ResetElectionTimer(DrawElectionTimeout());
+
+        if (wasLeader)
+        {
+            m_leaderId = NO_LEADER;
+            if (m_leaderCallback)
+            {
+                m_leaderCallback(NO_LEADER);
+            }
+        }
+    }
+
+    void
+    RaftConsensus::Heartbeat(void)
+    {
+        for (uint32_t peer : m_peers)
+        {
+            Follower &follower = m_followers[peer];
+            if (follower.inflight > 0 && Simulator::Now() - follower.oldestSent >= m_electionTimeout)
+            {
+                // The follower may be gone; send it everything after what it has again
+                follower.nextIndex = follower.matchIndex + 1;
+                follower.inflight = 0;
+                m_retransmissions++;
+            }
+            Replicate(peer, true);
+        }
+        m_heartbeatEvent = Simulator::Schedule(m_heartbeatInterval, &RaftConsensus::Heartbeat, this);
+    }
+
+    void
+    RaftConsensus::ScheduleFlush(void)
+    {
+        // Everything proposed at this simulated time goes out together
+        if (!m_flushEvent.IsRunning())
+        {
+            m_flushEvent = Simulator::ScheduleNow(&RaftConsensus::Flush, this);
+        }
+    }
+
+    void
+    RaftConsensus::Flush(void)
+    {
+        for (uint32_t peer : m_peers)
+        {
+            Replicate(peer, false);
+        }
+    }
+
+    void
+    RaftConsensus::Replicate(uint32_t peer, bool heartbeat)
+    {
+        Follower &follower = m_followers[peer];
+        bool sent = false;
+        while (follower.inflight < m_maxInflight && follower.nextIndex <= GetLastIndex())
+        {
+            uint64_t last = GetLastIndex();
+            if (m_maxBatchEntries > 0)
+            {
+                last = std::min(last, follower.nextIndex + m_maxBatchEntries - 1);
+            }
+
+            AppendEntries append;
+            append.term = m_term;
+            append.leaderId = m_id;
+            append.prevLogIndex = follower.nextIndex - 1;
+            append.prevLogTerm = m_log[append.prevLogIndex].term;
+            append.leaderCommit = m_commitIndex;
+            append.entries.assign(m_log.begin() + follower.nextIndex, m_log.begin() + last + 1);
+
+            if (follower.inflight == 0)
+            {
+                follower.oldestSent = Simulator::Now();
+            }
+            follower.inflight++;
+            follower.nextIndex = last + 1;
+            m_appendsSent++;
+            m_batchedAppends++;
+            m_batchedEntries += append.entries.size();
+            m_sendAppendEntries(peer, append);
+            sent = true;
+        }
+
+        if (!sent && heartbeat)
+        {
+            AppendEntries append;
+            append.term = m_term;
+            append.leaderId = m_id;
+            append.prevLogIndex = follower.nextIndex - 1;
+            append.prevLogTerm = m_log[append.prevLogIndex].term;
+            append.leaderCommit = m_commitIndex;
+            m_appendsSent++;
+            m_sendAppendEntries(peer, append);
+        }
+    }
+
+    void
+    RaftConsensus::AdvanceCommit(void)
+    {
+        // The highest index a majority has, counting the leader, if it is of this term
+        std::vector<uint64_t> matched(1, GetLastIndex());
+        for (const auto &follower : m_followers)
+        {
+            matched.push_back(follower.second.matchIndex);
+        }
+        std::sort(matched.begin(), matched.end(), std::greater<uint64_t>());
+        uint64_t majority = matched[matched.size() / 2];
+
+        if (majority > m_commitIndex && m_log[majority].term == m_term)
+        {
+            m_commitIndex = majority;
+            ApplyCommitted();
+        }
+    }
+
+    void
+    RaftConsensus::ApplyCommitted(void)
+    {
+        while (m_lastApplied < m_commitIndex)
+        {
+            m_lastApplied++;
+            if (m_commitCallback)
+            {
+                m_commitCallback(m_lastApplied, m_log[m_lastApplied]);
+            }
+        }
+    }
+
+    uint64_t
+    RaftConsensus::GetLastTerm(void) const
+    {
+        return m_log.back().term;
+    }
+
+}
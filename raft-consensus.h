@@ -0,0 +1,250 @@
+#ifndef RAFT_CONSENSUS_H
+#define RAFT_CONSENSUS_H
+
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Raft among the cloud servers of the ordering cluster, in simulated time.
+     *
+     * The class keeps the term, the vote, the log and the timers; what it sends goes
+     * through the transport functions and the caller hands it whatever arrives. An
+     * entry is opaque to it. Log indices start at 1, entry 0 is an empty sentinel.
+     *
+     * The leader replicates in the background of Propose: everything proposed at the
+     * same simulated time is sent together, at most MaxBatchEntries per AppendEntries,
+     * and it keeps up to MaxInflight AppendEntries outstanding per follower, moving
+     * nextIndex on before the replies are back. A follower whose log does not match
+     * answers with its commit index and the leader starts over from there. An append
+     * that stays unanswered for an election timeout is sent again.
+     */
+    class RaftConsensus
+    {
+        public:
+            enum Role
+            {
+                FOLLOWER,
+                CANDIDATE,
+                LEADER,
+            };
+
+            static const uint32_t NO_LEADER = 0xffffffff;
+
+            struct Entry
+            {
+                uint64_t term;
+                std::string data;
+            };
+
+            struct RequestVote
+            {
+                uint64_t term;
+                uint32_t candidateId;
+                uint64_t lastLogIndex;
+                uint64_t lastLogTerm;
+            };
+
+            struct Vote
+            {
+                uint64_t term;
+                uint32_t voterId;
+                bool granted;
+            };
+
+            struct AppendEntries
+            {
+                uint64_t term;
+                uint32_t leaderId;
+                uint64_t prevLogIndex;
+                uint64_t prevLogTerm;
+                uint64_t leaderCommit;
+                std::vector<Entry> entries;
+            };
+
+            /*
+             * On success matchIndex is the last index the follower has from the leader;
+             * otherwise it is where the leader may start again.
+             */
+            struct AppendReply
+            {
+                uint64_t term;
+                uint32_t followerId;
+                bool success;
+                uint64_t matchIndex;
+                uint32_t entries;               // of the append answered, 0 for a heartbeat
+            };
+
+            typedef std::function<void(uint32_t, const RequestVote&)> SendRequestVote;
+            typedef std::function<void(uint32_t, const Vote&)> SendVote;
+            typedef std::function<void(uint32_t, const AppendEntries&)> SendAppendEntries;
+            typedef std::function<void(uint32_t, const AppendReply&)> SendAppendReply;
+            typedef std::function<void(uint64_t, const Entry&)> EntryCallback;
+            typedef std::function<void(uint64_t)> TruncateCallback;
+            typedef std::function<void(uint32_t)> LeaderCallback;
+
+            RaftConsensus(void);
+            virtual ~RaftConsensus(void);
+
+            void SetId(uint32_t id);
+            uint32_t GetId(void) const;
+            /*
+             * The other members of the cluster.
+             */
+            void SetPeers(const std::vector<uint32_t> &peers);
+            uint32_t GetClusterSize(void) const;
+
+            /*
+             * Each election timeout is drawn from [timeout, 2 timeout).
+             */
+            void SetElectionTimeout(Time timeout);
+            void SetHeartbeatInterval(Time interval);
+            /*
+             * Entries per AppendEntries, 0 for no limit.
+             */
+            void SetMaxBatchEntries(uint32_t entries);
+            /*
+             * AppendEntries outstanding per follower, at least 1.
+             */
+            void SetMaxInflight(uint32_t appends);
+            void SetSeed(uint32_t seed);
+
+            void SetTransport(SendRequestVote sendRequestVote, SendVote sendVote,
+                              SendAppendEntries sendAppendEntries, SendAppendReply sendAppendReply);
+            /*
+             * Called on a follower for every entry it appends from the leader.
+             */
+            void SetAppendCallback(EntryCallback callback);
+            /*
+             * Called on a follower before it drops the entries from an index on, which the
+             * leader does not have.
+             */
+            void SetTruncateCallback(TruncateCallback callback);
+            /*
+             * Called on every member for every entry, in log order, once it is committed.
+             */
+            void SetCommitCallback(EntryCallback callback);
+            /*
+             * Called when the leader changes: the leader's id once it is known, NO_LEADER
+             * when this member stops being the leader.
+             */
+            void SetLeaderCallback(LeaderCallback callback);
+
+            /*
+             * A cluster of one is its own leader right away; otherwise campaign starts the
+             * first election now instead of after a timeout.
+             */
+            void Start(bool campaign);
+            /*
+             * Stops the timers and ignores every message from now on, like a crash.
+             */
+            void Stop(void);
+
+            /*
+             * Appends the data to the log of the leader and replicates it. Returns its
+             * index, or 0 if this member is not the leader.
+             */
+            uint64_t Propose(const std::string &data);
+
+            void ReceiveRequestVote(const RequestVote &request);
+            void ReceiveVote(const Vote &vote);
+            void ReceiveAppendEntries(const AppendEntries &append);
+            void ReceiveAppendReply(const AppendReply &reply);
+
+            Role GetRole(void) const;
+            bool IsLeader(void) const;
+            uint64_t GetTerm(void) const;
+            uint32_t GetLeaderId(void) const;
+            uint64_t GetLastIndex(void) const;
+            uint64_t GetCommitIndex(void) const;
+            const Entry& GetEntry(uint64_t index) const;
+
+            uint64_t GetElections(void) const;
+            uint64_t GetAppendsSent(void) const;
+            /*
+             * Entries per AppendEntries that carried any.
+             */
+            double GetMeanBatchEntries(void) const;
+            uint64_t GetRetransmissions(void) const;
+
+            static const char* GetRoleName(Role role);
+
+        protected:
+            struct Follower
+            {
+                uint64_t nextIndex;
+                uint64_t matchIndex;
+                uint32_t inflight;
+                Time oldestSent;                // of the appends outstanding
+            };
+
+            void ResetElectionTimer(Time timeout);
+            Time DrawElectionTimeout(void);
+            void StartElection(void);
+            void BecomeLeader(void);
+            /*
+             * Follows term, which is at least the current one, and forgets the vote if it is newer.
+             */
+            void StepDown(uint64_t term);
+
+            void Heartbeat(void);
+            void ScheduleFlush(void);
+            void Flush(void);
+            /*
+             * Sends the follower what the pipeline has room for, or an empty append if
+             * heartbeat is set and there is nothing to send.
+             */
+            void Replicate(uint32_t peer, bool heartbeat);
+            void AdvanceCommit(void);
+            void ApplyCommitted(void);
+            uint64_t GetLastTerm(void) const;
+
+            uint32_t m_id;
+            std::vector<uint32_t> m_peers;
+            Time m_electionTimeout;
+            Time m_heartbeatInterval;
+            uint32_t m_maxBatchEntries;
+            uint32_t m_maxInflight;
+            std::mt19937 m_random;
+
+            SendRequestVote m_sendRequestVote;
+            SendVote m_sendVote;
+            SendAppendEntries m_sendAppendEntries;
+            SendAppendReply m_sendAppendReply;
+            EntryCallback m_appendCallback;
+            TruncateCallback m_truncateCallback;
+            EntryCallback m_commitCallback;
+            LeaderCallback m_leaderCallback;
+
+            bool m_running;
+            Role m_role;
+            uint64_t m_term;
+            uint32_t m_votedFor;
+            uint32_t m_leaderId;
+            std::set<uint32_t> m_votes;
+            std::vector<Entry> m_log;
+            uint64_t m_commitIndex;
+            uint64_t m_lastApplied;
+            std::map<uint32_t, Follower> m_followers;
+            EventId m_electionEvent;
+            EventId m_heartbeatEvent;
+            EventId m_flushEvent;
+
+            uint64_t m_elections;
+            uint64_t m_appendsSent;
+            uint64_t m_batchedAppends;
+            uint64_t m_batchedEntries;
+            uint64_t m_retransmissions;
+    };
+
+}
+
+#endif /* RAFT_CONSENSUS_H */
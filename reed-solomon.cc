@@ -0,0 +1,262 @@
+#include "reed-solomon.h"
+#include <algorithm>
+
+namespace ns3 {
+
+    /*
+     * Exponents and logarithms of GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1.
+     */
+    struct GaloisTables
+    {
+        uint8_t exp[512];
+        uint8_t log[256];
+
+        GaloisTables(void)
+        {
+            uint32_t x = 1;
+            for (uint32_t i = 0; i < 255; i++)
+            {
+                exp[i] = (uint8_t)x;
+                log[x] = (uint8_t)i;
+                x <<= 1;
+                if (x & 0x100)
+                {
+                    x ^= 0x11d;
+                }
+            }
+            for (uint32_t i = 255; i < 512; i++)
+            {
+                exp[i] = exp[i - 255];
+            }
+            log[0] = 0;
+        }
+    };
+
+    static const GaloisTables&
+    GetGaloisTables(void)
+    {
+        static const GaloisTables tables;
+        return tables;
+    }
+
+    ReedSolomon::ReedSolomon(uint32_t dataShreds, uint32_t parityShreds)
+    {
+        m_dataShreds = std::max(dataShreds, 1u);
+        m_parityShreds = std::min(parityShreds, MAX_SHREDS - std::min(m_dataShreds, MAX_SHREDS));
+
+        // Cauchy matrix 1 / (x_i + y_j), x_i = dataShreds + i and y_j = j all distinct
+        m_parityMatrix.assign(m_parityShreds, std::vector<uint8_t>(m_dataShreds));
+        for (uint32_t i = 0; i < m_parityShreds; i++)
+        {
+            for (uint32_t j = 0; j < m_dataShreds; j++)
+            {
+                m_parityMatrix[i][j] = Inverse((uint8_t)((m_dataShreds + i) ^ j));
+            }
+        }
+    }
+
+    ReedSolomon::~ReedSolomon(void)
+    {
+    }
+
+    uint32_t
+    ReedSolomon::GetDataShreds(void) const
+    {
+        return m_dataShreds;
+    }
+
+    uint32_t
+    ReedSolomon::GetParityShreds(void) const
+    {
+        return m_parityShreds;
+    }
+
+    void
+    ReedSolomon::Encode(std::vector<std::vector<uint8_t>> &shreds) const
+    {
+        size_t size = shreds.empty() ? 0 : shreds[0].size();
+        shreds.resize(m_dataShreds, std::vector<uint8_t>(size));
+        for (uint32_t i = 0; i < m_parityShreds; i++)
+        {
+            std::vector<uint8_t> parity(size);
+            for (uint32_t j = 0; j < m_dataShreds; j++)
+            {
+                MultiplyAdd(m_parityMatrix[i][j], shreds[j], parity);
+            }
+            shreds.push_back(parity);
+        }
+    }
+
+    bool
+    ReedSolomon::Reconstruct(std::vector<std::vector<uint8_t>> &shreds) const
+    {
+        uint32_t total = m_dataShreds + m_parityShreds;
+        shreds.resize(total);
+
+        // The first data shreds that are left, data shreds first since their rows are the identity
+        std::vector<uint32_t> rows;
+        size_t size = 0;
+        for (uint32_t index = 0; index < total && rows.size() < m_dataShreds; index++)
+        {
+            if (!shreds[index].empty())
+            {
+                rows.push_back(index);
+                size = shreds[index].size();
+            }
+        }
+        if (rows.size() < m_dataShreds)
+        {
+            return false;
+        }
+
+        bool dataLost = false;
+        for (uint32_t j = 0; j < m_dataShreds; j++)
+        {
+            dataLost = dataLost || shreds[j].empty();
+        }
+
+        if (dataLost)
+        {
+            // The rows of the encoding matrix for the shreds left, inverted by Gauss-Jordan
+            uint32_t k = m_dataShreds;
+            std::vector<std::vector<uint8_t>> matrix(k, std::vector<uint8_t>(k));
+            std::vector<std::vector<uint8_t>> inverse(k, std::vector<uint8_t>(k));
+            for (uint32_t r = 0; r < k; r++)
+            {
+                if (rows[r] < k)
+                {
+                    matrix[r][rows[r]] = 1;
+                }
+                else
+                {
+                    matrix[r] = m_parityMatrix[rows[r] - k];
+                }
+                inverse[r][r] = 1;
+            }
+
+            for (uint32_t column = 0; column < k; column++)
+            {
+                uint32_t pivot = column;
+                while (matrix[pivot][column] == 0)
+                {
+                    pivot++;
+                }
+                std::swap(matrix[pivot], matrix[column]);
+                std::swap(inverse[pivot], inverse[column]);
+
+                uint8_t scale = Inverse(matrix[column][column]);
+                for (uint32_t c = 0; c < k; c++)
+                {
+                    matrix[column][c] = Multiply(matrix[column][c], scale);
+                    inverse[column][c] = Multiply(inverse[column][c], scale);
+                }
+                for (uint32_t r = 0; r < k; r++)
+                {
+                    uint8_t factor = matrix[r][column];
+                    if (r == column || factor == 0)
+                    {
+                        continue;
+                    }
+                    for (uint32_t c = 0; c < k; c++)
+                    {
+                        matrix[r][c] ^= Multiply(factor, matrix[column][c]);
+                        inverse[r][c] ^= Multiply(factor, inverse[column][c]);
+                    }
+                }
+            }
+
+            // Row j of the inverse gives data shred j from the shreds left
+            for (uint32_t j = 0; j < k; j++)
+            {
+                if (!shreds[j].empty())
+                {
+                    continue;
+                }
+                std::vector<uint8_t> data(size);
+                for (uint32_t r = 0; r < k; r++)
+                {
+                    MultiplyAdd(inverse[j][r], shreds[rows[r]], data);
+                }
+                shreds[j] = data;
+            }
+        }
+
+        for (uint32_t i = 0; i < m_parityShreds; i++)
+        {
+            if (!shreds[m_dataShreds + i].empty())
+            {
+                continue;
+            }
+            std::vector<uint8_t> parity(size);
+            for (uint32_t j = 0; j < m_dataShreds; j++)
+            {
+                MultiplyAdd(m_parityMatrix[i][j], shreds[j], parity);
+            }
+            shreds[m_dataShreds + i] = parity;
+        }
+        return true;
+    }
+
+    std::vector<std::vector<uint8_t>>
+    ReedSolomon::Split(const std::string &bytes, uint32_t dataShreds)
+    {
+        dataShreds = std::max(dataShreds, 1u);
+        size_t size = std::max((bytes.size() + dataShreds - 1) / dataShreds, (size_t)1);
+        std::vector<std::vector<uint8_t>> shreds(dataShreds, std::vector<uint8_t>(size));
+        for (size_t i = 0; i < bytes.size(); i++)
+        {
+            shreds[i / size][i % size] = (uint8_t)bytes[i];
+        }
+        return shreds;
+    }
+
+    std::string
+    ReedSolomon::Join(const std::vector<std::vector<uint8_t>> &shreds, uint32_t dataShreds, uint32_t length)
+    {
+        std::string bytes;
+        bytes.reserve(length);
+        for (uint32_t j = 0; j < dataShreds && j < shreds.size() && bytes.size() < length; j++)
+        {
+            size_t take = std::min(shreds[j].size(), (size_t)length - bytes.size());
+            bytes.append(reinterpret_cast<const char*>(shreds[j].data()), take);
+        }
+        return bytes;
+    }
+
+    uint8_t
+    ReedSolomon::Multiply(uint8_t a, uint8_t b)
+    {
+        const GaloisTables &tables = GetGaloisTables();
+        return a == 0 || b == 0 ? 0 : tables.exp[tables.log[a] + tables.log[b]];
+    }
+
+    uint8_t
+    ReedSolomon::Inverse(uint8_t a)
+    {
+        const GaloisTables &tables = GetGaloisTables();
+        return a == 0 ? 0 : tables.exp[255 - tables.log[a]];
+    }
+
+    void
+    ReedSolomon::MultiplyAdd(uint8_t coefficient, const std::vector<uint8_t> &in, std::vector<uint8_t> &out)
+    {
+        if (coefficient == 0)
+        {
+            return;
+        }
+
+        // One row of the product table per call, the shreds are long
+        const GaloisTables &tables = GetGaloisTables();
+        uint8_t row[256];
+        row[0] = 0;
+        for (uint32_t x = 1; x < 256; x++)
+        {
+            row[x] = tables.exp[tables.log[coefficient] + tables.log[x]];
+        }
+        for (size_t i = 0; i < in.size() && i < out.size(); i++)
+        {
+            out[i] ^= row[in[i]];
+        }
+    }
+
+}
@@ -0,0 +1,67 @@
+#ifndef REED_SOLOMON_H
+#define REED_SOLOMON_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * A systematic Reed-Solomon erasure code over GF(2^8).
+     *
+     * A block is cut into data shreds of the same size, and parity shreds are
+     * computed from them with a Cauchy matrix; any data shreds of the data and
+     * parity shreds together give the block back, whichever were lost. Every
+     * square part of a Cauchy matrix can be inverted, so no set of shreds is
+     * worse than another. The data and parity shreds add up to at most 255.
+     */
+    class ReedSolomon
+    {
+        public:
+            static const uint32_t MAX_SHREDS = 255;
+
+            ReedSolomon(uint32_t dataShreds, uint32_t parityShreds);
+            virtual ~ReedSolomon(void);
+
+            uint32_t GetDataShreds(void) const;
+            uint32_t GetParityShreds(void) const;
+
+            /*
+             * shreds holds the data shreds, all of the same size; the parity shreds are
+             * appended to it.
+             */
+            void Encode(std::vector<std::vector<uint8_t>> &shreds) const;
+
+            /*
+             * shreds holds every shred by index, the lost ones empty; fills in the lost
+             * ones. False, and nothing changes, if fewer than the data shreds are left.
+             */
+            bool Reconstruct(std::vector<std::vector<uint8_t>> &shreds) const;
+
+            /*
+             * Cuts the bytes into dataShreds shreds of the same size, the last padded
+             * with zeros.
+             */
+            static std::vector<std::vector<uint8_t>> Split(const std::string &bytes, uint32_t dataShreds);
+            /*
+             * The first length bytes of the data shreds.
+             */
+            static std::string Join(const std::vector<std::vector<uint8_t>> &shreds, uint32_t dataShreds, uint32_t length);
+
+        protected:
+            static uint8_t Multiply(uint8_t a, uint8_t b);
+            static uint8_t Inverse(uint8_t a);
+            /*
+             * out ^= coefficient * in, byte by byte.
+             */
+            static void MultiplyAdd(uint8_t coefficient, const std::vector<uint8_t> &in, std::vector<uint8_t> &out);
+
+            uint32_t m_dataShreds;
+            uint32_t m_parityShreds;
+            std::vector<std::vector<uint8_t>> m_parityMatrix;  // parity shreds x data shreds
+    };
+
+}
+
+#endif /* REED_SOLOMON_H */
@@ -14,13 +14,11 @@
 #include "ns3/tcp-socket-factory.h"
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
+#include "ns3/string.h"
 #include "rsu-node.h"
 #include "blockchain.h"
 #include <fstream>
-#include <time.h>
-#include <sys/time.h>
-
-static double GetWallTime();
+#include <cstring>
 
 namespace ns3 {
 
@@ -28,6 +26,54 @@ namespace ns3 {
     NS_LOG_COMPONENT_DEFINE("RsuNode");
     NS_OBJECT_ENSURE_REGISTERED(RsuNode);
 
+    static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    /*
+     * The bytes of a shred as a JSON string.
+     */
+    static std::string
+    EncodeBase64(const std::vector<uint8_t> &bytes)
+    {
+        std::string text;
+        text.reserve((bytes.size() + 2) / 3 * 4);
+        for (size_t i = 0; i < bytes.size(); i += 3)
+        {
+            uint32_t group = bytes[i] << 16;
+            group |= i + 1 < bytes.size() ? bytes[i + 1] << 8 : 0;
+            group |= i + 2 < bytes.size() ? bytes[i + 2] : 0;
+            text.push_back(base64Alphabet[(group >> 18) & 0x3f]);
+            text.push_back(base64Alphabet[(group >> 12) & 0x3f]);
+            text.push_back(i + 1 < bytes.size() ? base64Alphabet[(group >> 6) & 0x3f] : '=');
+            text.push_back(i + 2 < bytes.size() ? base64Alphabet[group & 0x3f] : '=');
+        }
+        return text;
+    }
+
+    static std::vector<uint8_t>
+    DecodeBase64(const std::string &text)
+    {
+        std::vector<uint8_t> bytes;
+        bytes.reserve(text.size() / 4 * 3);
+        uint32_t group = 0;
+        int bits = 0;
+        for (char c : text)
+        {
+            const char *digit = c != '\0' ? std::strchr(base64Alphabet, c) : nullptr;
+            if (!digit)
+            {
+                continue;
+            }
+            group = (group << 6) | (uint32_t)(digit - base64Alphabet);
+            bits += 6;
+            if (bits >= 8)
+            {
+                bits -= 8;
+                bytes.push_back((uint8_t)(group >> bits));
+            }
+        }
+        return bytes;
+    }
+
     TypeId
     RsuNode::GetTypeId(void)
     {
@@ -55,6 +101,51 @@ namespace ns3 {
                         DoubleValue(0),
                         MakeDoubleAccessor(&RsuNode::m_transThreshold),
                         MakeDoubleChecker<double>())
+        .AddAttribute("CryptoDelay",
+                        "The simulated time an ECDSA signature takes." ,
+                        TimeValue(MilliSeconds(0)),
+                        MakeTimeAccessor(&RsuNode::m_cryptoDelay),
+                        MakeTimeChecker())
+        .AddAttribute("EndorsementQuorum",
+                        "The peer signatures a transaction needs before it goes to the cloud server, 0 for every peer." ,
+                        UintegerValue(0),
+                        MakeUintegerAccessor(&RsuNode::m_endorsementQuorum),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("EndorsementTimeout",
+                        "The time a transaction may wait for its quorum, 0 for no deadline." ,
+                        TimeValue(Seconds(0)),
+                        MakeTimeAccessor(&RsuNode::m_endorsementTimeout),
+                        MakeTimeChecker())
+        .AddAttribute("IssueInterval",
+                        "The time between two transactions when the in-flight window is 0." ,
+                        TimeValue(MilliSeconds(950)),
+                        MakeTimeAccessor(&RsuNode::m_issueInterval),
+                        MakeTimeChecker())
+        .AddAttribute("InFlightWindow",
+                        "The transactions a node keeps between creation and their block, 0 issues one every IssueInterval." ,
+                        UintegerValue(0),
+                        MakeUintegerAccessor(&RsuNode::m_inFlightWindow),
+                        MakeUintegerChecker<uint32_t>())
+        .AddAttribute("OrderingTimeout",
+                        "The time an endorsed transaction may wait for its block before its slot is freed, 0 for no deadline." ,
+                        TimeValue(Seconds(0)),
+                        MakeTimeAccessor(&RsuNode::m_orderingTimeout),
+                        MakeTimeChecker())
+        .AddAttribute("ContractFile",
+                        "The rules a transaction must meet before this node endorses it, empty for the default contract." ,
+                        StringValue(""),
+                        MakeStringAccessor(&RsuNode::m_contractFile),
+                        MakeStringChecker())
+        .AddAttribute("BackoffRecovery",
+                        "The time the issue rate a BACKPRESSURE halved takes to climb back before the limit is lifted." ,
+                        TimeValue(Seconds(1)),
+                        MakeTimeAccessor(&RsuNode::m_backoffRecovery),
+                        MakeTimeChecker())
+        .AddAttribute("ShredLossRate",
+                        "The share of the SHREDs this node sends that are lost on the way." ,
+                        DoubleValue(0),
+                        MakeDoubleAccessor(&RsuNode::m_shredLossRate),
+                        MakeDoubleChecker<double>(0, 1))
         ;
         return tid;
     }
@@ -67,7 +158,11 @@ namespace ns3 {
         m_cloudServerSocket = 0;
         m_numberOfPeers = m_peersAddresses.size();
         m_transactionId = 1;
-        m_responseCount = 0;
+        m_meanEndorsementTime = 0;
+        m_failedEndorsements = 0;
+        m_endorsementPolicy = 0;
+        m_committerType = ENDORSER;
+        m_endorsementRequests = 0;
         m_meanOrderingTime = 0;
         m_meanBlockReceiveTime = 0;
         m_previousBlockReceiveTime = 0;
@@ -76,8 +171,25 @@ namespace ns3 {
         m_totalOrdering = 0;
         m_meanLatency = 0;
         m_totalCreatedTransaction = 0;
-        m_tStart = 0;
-        m_tFinish = 0;
+        m_issuing = false;
+        m_orderingTimeouts = 0;
+        m_openLoop = false;
+        m_receivedArrivals = 0;
+        m_keyEpoch = 0;
+        m_nodeStats = 0;
+        m_rateLimit = 0;
+        m_rateBeforeCut = 0;
+        m_meanIssueGap = 0;
+        m_backpressureSignals = 0;
+        m_resentRequests = 0;
+        m_receivedBlockCount = 0;
+        m_meanHopDelay = 0;
+        m_meanBlockHops = 0;
+        m_crashed = false;
+        m_shredsReceived = 0;
+        m_duplicateShreds = 0;
+        m_shredsRecovered = 0;
+        m_shredsLost = 0;
     }
 
     RsuNode::~RsuNode(void)
@@ -116,6 +228,20 @@ namespace ns3 {
         m_numberOfPeers = m_peersAddresses.size();
     }
 
+    void
+    RsuNode::SetPeerIds (const std::vector<uint32_t> &peerIds)
+    {
+        NS_LOG_FUNCTION (this);
+        m_peerIds = peerIds;
+    }
+
+    void
+    RsuNode::SetEndorsementPolicy (const EndorsementPolicy *policy)
+    {
+        NS_LOG_FUNCTION (this);
+        m_endorsementPolicy = policy;
+    }
+
     void
     RsuNode::SetCloudServerAddress (const Ipv4Address &cloudServerAddr)
     {
@@ -123,6 +249,13 @@ namespace ns3 {
         m_cloudServerAddr = cloudServerAddr;
     }
 
+    void
+    RsuNode::SetCloudServerAddresses (const std::map<uint32_t, Ipv4Address> &cloudServerAddrs)
+    {
+        NS_LOG_FUNCTION (this);
+        m_cloudServerAddrs = cloudServerAddrs;
+    }
+
     void
     RsuNode::SetProtocolType(enum ProtocolType protocolType)
     {
@@ -139,6 +272,38 @@ namespace ns3 {
         m_nodeStats = nodeStats;
     }
 
+    void
+    RsuNode::SetOpenLoop (bool openLoop)
+    {
+        NS_LOG_FUNCTION(this);
+        m_openLoop = openLoop;
+    }
+
+    void
+    RsuNode::SubmitTransaction (double payment)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (!m_issuing)
+        {
+            return;
+        }
+        m_receivedArrivals++;
+        m_pendingArrivals.push_back(std::make_pair(Simulator::Now(), payment));
+        IssueTransactions();
+    }
+
+    void
+    RsuNode::Crash (void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::cout << "Node " << GetNode()->GetId() << " fails at " << Simulator::Now().GetSeconds() << "s\n";
+        m_crashed = true;
+        m_issuing = false;
+        Simulator::Cancel(m_nextIssueEvent);
+    }
+
     void
     RsuNode::StartApplication ()    // Called at time specified by Start
     {
@@ -171,11 +336,47 @@ namespace ns3 {
         m_nodeStats->rsuNodeId = GetNode()->GetId();
         m_nodeStats->meanLatency = 0;
 
+        m_endorsementTracker.SetQuorum(m_endorsementQuorum);
+
+        // Each node compiles its own contract, with its own threshold
+        std::map<std::string, double> constants;
+        constants["threshold"] = m_transThreshold;
+        std::string error;
+        if (!m_contractFile.empty() && !m_contract.LoadFile(m_contractFile, constants, error))
+        {
+            std::cerr << "Node " << GetNode()->GetId() << ": contract " << m_contractFile << " rejected, " << error << "\n";
+        }
+        if (m_contract.GetSource().empty())
+        {
+            m_contract.Compile(SmartContract::DefaultSource(), constants, error);
+        }
+        std::cout << "Node " << GetNode()->GetId() << " endorses transactions meeting:\n" << m_contract.GetSource();
+
+        NS_ASSERT_MSG(m_peerIds.size() == m_peersAddresses.size(), "every peer address needs its node id");
+        m_peerIdToAddress.clear();
+        for (size_t i = 0; i < m_peerIds.size(); i++)
+        {
+            m_peerIdToAddress[m_peerIds[i]] = m_peersAddresses[i];
+        }
+        m_committerType = m_endorsementPolicy ? m_endorsementPolicy->GetRole(GetNode()->GetId()) : ENDORSER;
+        m_lossRandom.seed(GetNode()->GetId());
+        std::cout << "Node " << GetNode()->GetId() << " is a " << getCommitterType(m_committerType) << "\n";
+
         //Set up the sending socket for cloud server
         m_cloudServerSocket = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());
         m_cloudServerSocket->Connect (InetSocketAddress (m_cloudServerAddr, m_blockchainPort));
+        for (auto &cloudServer : m_cloudServerAddrs)
+        {
+            if (cloudServer.second == m_cloudServerAddr)
+            {
+                m_cloudServerSockets[cloudServer.first] = m_cloudServerSocket;
+                continue;
+            }
+            m_cloudServerSockets[cloudServer.first] = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());
+            m_cloudServerSockets[cloudServer.first]->Connect (InetSocketAddress (cloudServer.second, m_blockchainPort));
+        }
 
-        std::pair<PublicKey, long> keyPair = ECDSA::generateKey();
+        std::pair<PublicKey, long> keyPair = KeyPool::GetInstance().GetKey(GetNode()->GetId());
         publicKey = keyPair.first;
         privateKey = keyPair.second;
 
@@ -185,9 +386,10 @@ namespace ns3 {
         std::cout << "private key = " << privateKey << "\n";
         std::cout << "===============================================\n";
 
-        m_tStart = GetWallTime();
+        RegisterKey();
 
-        CreateTransaction();
+        m_issuing = true;
+        IssueTransactions();
 
     }
 
@@ -196,6 +398,9 @@ namespace ns3 {
     {
         NS_LOG_FUNCTION (this);
 
+        m_issuing = false;
+        Simulator::Cancel(m_nextIssueEvent);
+
         for (std::vector<Ipv4Address>::iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i) //close the outgoing sockets
         {
             m_peersSockets[*i]->Close ();
@@ -212,9 +417,44 @@ namespace ns3 {
             m_cloudServerSocket->Close ();
             m_cloudServerSocket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
         }
+        for (auto &cloudServer : m_cloudServerSockets)
+        {
+            if (cloudServer.second != m_cloudServerSocket)
+            {
+                cloudServer.second->Close ();
+            }
+        }
 
         m_nodeStats->meanLatency = m_meanLatency;
-    
+
+        std::cout << "Endorsements of node " << GetNode()->GetId() << ": " << m_totalCreatedTransaction << " reached their quorum, "
+                  << m_failedEndorsements << " failed, " << m_endorsementTracker.GetNumberOfOpen() << " still open, "
+                  << m_endorsementTracker.GetLateResponses() << " late responses dropped, "
+                  << m_endorsementRequests << " endorsement requests sent\n";
+        std::cout << "Ordering of node " << GetNode()->GetId() << ": " << m_totalOrdering << " transactions in blocks, "
+                  << m_orderingTimeouts << " timed out, " << m_inFlight.size() << " still in flight";
+        if (m_openLoop)
+        {
+            std::cout << ", " << m_receivedArrivals << " arrivals, " << m_pendingArrivals.size() << " waiting for a slot";
+        }
+        std::cout << "\n";
+        if (m_receivedBlockCount > 0)
+        {
+            std::cout << "Blocks of node " << GetNode()->GetId() << ": " << m_receivedBlockCount << " received in "
+                      << m_meanBlockPropagationTime << "s on average, " << m_meanBlockHops << " hops, last hop "
+                      << m_meanHopDelay << "s, " << m_nodeStats->blockSentBytes << " bytes relayed\n";
+        }
+        if (m_shredsReceived > 0)
+        {
+            std::cout << "Shreds of node " << GetNode()->GetId() << ": " << m_shredsReceived << " received, "
+                      << m_duplicateShreds << " duplicates, " << m_shredsRecovered << " forwarded from rebuilt blocks, "
+                      << m_shredsLost << " lost on the way out\n";
+        }
+        if (m_backpressureSignals > 0)
+        {
+            std::cout << "Backpressure of node " << GetNode()->GetId() << ": " << m_backpressureSignals << " signals, "
+                      << m_resentRequests << " requests resent, issue rate limit " << GetRateLimit() << "/s\n";
+        }
 
     }
 
@@ -230,6 +470,10 @@ namespace ns3 {
             {
                 break;
             }
+            if (m_crashed)
+            {
+                continue;
+            }
 
             if(InetSocketAddress::IsMatchingType(from))
             {
@@ -243,180 +487,274 @@ namespace ns3 {
 
                 totalStream << m_bufferedData[from] << packetInfo;
                 std::string totalReceivedData(totalStream.str());
-                size_t pos = totalReceivedData.find(delimiter);
-                parsedPacket = totalReceivedData.substr(0,pos);
+                size_t pos;
+
+                // One packet can carry several messages and end in the middle of one
+                while ((pos = totalReceivedData.find(delimiter)) != std::string::npos)
+                {
+                    parsedPacket = totalReceivedData.substr(0,pos);
 
-                rapidjson::Document d;
-                d.Parse(parsedPacket.c_str());
+                    rapidjson::Document d;
+                    d.Parse(parsedPacket.c_str());
 
-                // std::cout << "message = " << parsedPacket << std::endl;
+                    // std::cout << "message = " << parsedPacket << std::endl;
 
 
-                // if (d.HasParseError()) {
-                //     std::cout<< GetNode()->GetId() << ": Parsing error: " << GetParseError_En(d.GetParseError()) << "\n";
-                //     totalReceivedData.erase(0, pos + delimiter.length());
-                //     continue;
-                // }
+                    // if (d.HasParseError()) {
+                    //     std::cout<< GetNode()->GetId() << ": Parsing error: " << GetParseError_En(d.GetParseError()) << "\n";
+                    //     totalReceivedData.erase(0, pos + delimiter.length());
+                    //     continue;
+                    // }
 
 
-                // if(!d.IsObject())
-                // {
-                //     std::cout<<"The parsed packet is corrupted"<< "\n";
-                //     totalReceivedData.erase(0, pos + delimiter.length());
-                //     continue;
-                // }
+                    // if(!d.IsObject())
+                    // {
+                    //     std::cout<<"The parsed packet is corrupted"<< "\n";
+                    //     totalReceivedData.erase(0, pos + delimiter.length());
+                    //     continue;
+                    // }
 
-                rapidjson::StringBuffer buffer;
-                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-                d.Accept(writer);
+                    rapidjson::StringBuffer buffer;
+                    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                    d.Accept(writer);
 
-                rapidjson::Document::AllocatorType& d_allocator = d.GetAllocator();
+                    rapidjson::Document::AllocatorType& d_allocator = d.GetAllocator();
 
-                std::cout << std::endl;
-                switch(d["message"].GetInt())
-                {
-                    case REQUEST_TRANS:
+                    std::cout << std::endl;
+                    switch(d["message"].GetInt())
                     {
-                        std::cout << "Node " << GetNode()->GetId() << " - REQUEST_TRANS from node " << 
-                            (uint32_t) d["transactions"]["rsuNodeId"].GetInt()  << "\n";
-                        // TODO: verify the transaction using smart contract - Tuan
-                        rapidjson::Value& trans = d["transactions"];
-
-                        double trx_timestamp = trans["timestamp"].GetDouble(); 
-                        double trx_payment = trans["payment"].GetDouble();
-
-                        static double trx_payment_low = m_transThreshold;
-                        static double trx_payment_high = 100000.0;
-                        static double trx_timestamp_low = 0.0;
-                        static double trx_timestamp_high = 1000000000.0;
-
-                        long hashMsg = ECDSA::digitizeMessage(parsedPacket, publicKey.p);
-
-                        // // TODO: If valid, sign transaction - Tuan
-                        std::cout << "message = " << parsedPacket << std::endl;
-                        std::cout << "hashed message = " << ECDSA::sha256(parsedPacket) << std::endl;
-                        std::cout << "digitize hash = " << hashMsg << std::endl;
-                        std::cout << "If transaction payment >= " << trx_payment_low << " and < " << trx_payment_high <<
-                            ", transaction timestamp >= " << trx_timestamp_low << " and < " << trx_timestamp_high <<
-                            ", the transaction will be verified\n";
-
-                        if (trx_payment >= trx_payment_low && trx_payment < trx_payment_high && 
-                            trx_timestamp >= trx_timestamp_low && trx_timestamp < trx_payment_high) {
-                            // sign
-                            std::cout << "Payment = " << trx_payment << " and timestamp = " << trx_timestamp << std::endl;
-                            std::cout << "The condition is satisfied, this transaction will be verified\n";
-                            std::cout << "Signing transaction using ECDSA keys pair\n";
-                            publicKey.printKey();
-                            std::cout << "private key = " << privateKey << std::endl;
-                            std::pair<long, long> signature = {0, 0};
-                            std::pair<long, long> Point_0 = {0, 0};
-                            while (true) {
-                                signature = ECDSA::generateSignature(publicKey, privateKey, hashMsg);
-                                if (signature == Point_0) {
-                                    std::cout << "Failed to generate signature with current key pair, re-initialize public and private key\n";
-                                    std::pair<PublicKey, long> keyPair = ECDSA::generateKey();
-                                    publicKey = keyPair.first;
-                                    privateKey = keyPair.second;
-                                    std::cout << "===============================================\n";
-                                    std::cout << "generating ECDSA key pair for current rsu node id " << GetNode()->GetId() << ":\n";
-                                    publicKey.printKey();
-                                    std::cout << "private key = " << privateKey << "\n";
-                                    std::cout << "===============================================\n";
-                                } 
+                        case REQUEST_TRANS:
+                        {
+                            std::cout << "Node " << GetNode()->GetId() << " - REQUEST_TRANS from node " << 
+                                (uint32_t) d["transactions"]["rsuNodeId"].GetInt()  << "\n";
+
+                            // Only endorsers sign, a committer has no endorsement work at all
+                            if (m_committerType != ENDORSER)
+                            {
+                                std::cout << "Node " << GetNode()->GetId() << " is a " << getCommitterType(m_committerType)
+                                          << ", ignoring the request\n";
+                                break;
+                            }
+                            rapidjson::Value& trans = d["transactions"];
+                            Transaction transaction = TransactionFromJson(trans);
+
+                            // Every endorser signs the same payload, so the signatures fit one certificate
+                            std::string payload = transaction.GetSigningPayload();
+                            Sha256Digest digest = ECDSA::sha256Digest(payload);
+                            long hashMsg = ECDSA::digitizeDigest(digest, publicKey.p);
+
+                            std::cout << "message = " << parsedPacket << std::endl;
+                            std::cout << "hashed message = " << ECDSA::toHex(digest) << std::endl;
+                            std::cout << "digitize hash = " << hashMsg << std::endl;
+
+                            if (m_contract.Evaluate(transaction)) {
+                                // sign
+                                std::cout << "Payment = " << transaction.GetPayment() << " and timestamp = " << transaction.GetTransTimeStamp() << std::endl;
+                                std::cout << "The condition is satisfied, this transaction will be verified\n";
+                                std::cout << "Signing transaction using ECDSA keys pair\n";
+                                publicKey.printKey();
+                                std::cout << "private key = " << privateKey << std::endl;
+
+                                std::shared_ptr<PendingSignature> job = std::make_shared<PendingSignature>();
+                                job->message = parsedPacket;
+                                job->from = from;
+                                job->publicKey = publicKey;
+                                job->keyEpoch = m_keyEpoch;
+                                job->privateKey = privateKey;
+                                job->digest = digest;
+                                job->hashMsg = hashMsg;
+                                job->nonceSeed = (unsigned long)ECDSA::randRange(0, 2147483647);
+                                job->done = CryptoWorkerPool::GetInstance().Submit([job]() {
+                                    job->signature = ECDSA::generateSignature(job->publicKey, job->privateKey, job->hashMsg, job->nonceSeed);
+                                });
+
+                                // The response is sent by CompleteSignature
+                                Simulator::Schedule(m_cryptoDelay, &RsuNode::CompleteSignature, this, job);
+                                break;
+                            }
+                            else {
+                                trans.AddMember("isSigned", false, d_allocator);
+                            }
+
+                            // After signing, send response
+                            d.AddMember("responseFrom", GetNode()->GetId(), d_allocator);
+                            SendMessage(REQUEST_TRANS, RESPONSE_TRANS, d, from);
+                            break;
+                        }
+
+                        case RESPONSE_TRANS:
+                        {
+    
+                            uint32_t responseFrom = (uint32_t) d["responseFrom"].GetInt();
+                            uint32_t requestTransFrom = (uint32_t) d["transactions"]["rsuNodeId"].GetInt();
+                            //double timestamp = d["transactions"]["timestamp"].GetDouble();
+
+                            if (requestTransFrom == GetNode()->GetId()) {
+                                std::cout<<"Node " << GetNode()->GetId() << " receives - RESPONSE_TRANS from " << responseFrom << "\n";
+
+                                rapidjson::Value& trans = d["transactions"];
+                                int transId = trans["transId"].GetInt();
+                                EndorsementTracker::Status status;
+                                if (trans.HasMember("isSigned") && trans["isSigned"].GetBool()) {
+                                    status = m_endorsementTracker.AddEndorsement(transId, responseFrom, trans["keyEpoch"].GetUint(),
+                                                                                 trans["signature"]["r"].GetInt64(),
+                                                                                 trans["signature"]["s"].GetInt64());
+                                }
                                 else {
-                                    break;
+                                    status = m_endorsementTracker.AddRefusal(transId, responseFrom);
+                                }
+
+                                // Each response only touches the entry of its own transaction
+                                switch (status)
+                                {
+                                    case EndorsementTracker::QUORUM_REACHED:
+                                        CompleteEndorsement(transId);
+                                        break;
+                                    case EndorsementTracker::QUORUM_FAILED:
+                                        FailEndorsement(transId, "too many endorsers refused to endorse it");
+                                        break;
+                                    case EndorsementTracker::LATE:
+                                        std::cout << "Transaction id " << transId << " is already closed, dropping the response\n";
+                                        break;
+                                    case EndorsementTracker::PENDING:
+                                        break;
                                 }
                             }
-                            std::cout << "signature = (" << signature.first << ", " << signature.second << ")\n";
-
-                            trans.AddMember("isSigned", true, d_allocator);
-                            trans.AddMember("hashMsg", hashMsg, d_allocator);
-                            
-                            rapidjson::Value publicKeyInfo(rapidjson::kObjectType);
-                            publicKeyInfo.AddMember("p", publicKey.p, d_allocator);
-                            publicKeyInfo.AddMember("a", publicKey.a, d_allocator);
-                            publicKeyInfo.AddMember("n", publicKey.n, d_allocator);
-                            publicKeyInfo.AddMember("xG", publicKey.G.first, d_allocator);
-                            publicKeyInfo.AddMember("yG", publicKey.G.second, d_allocator);
-                            publicKeyInfo.AddMember("xQ", publicKey.Q.first, d_allocator);
-                            publicKeyInfo.AddMember("yQ", publicKey.Q.second, d_allocator);
-                            trans.AddMember("publicKey", publicKeyInfo, d_allocator);
-
-                            rapidjson::Value signatureInfo(rapidjson::kObjectType);
-                            signatureInfo.AddMember("r", signature.first, d_allocator);
-                            signatureInfo.AddMember("s", signature.second, d_allocator);
-                            trans.AddMember("signature", signatureInfo, d_allocator);
+                            break;
+                        
                         }
-                        else {
-                            trans.AddMember("isSigned", false, d_allocator);
+
+                        case BROADCAST_BLOCK:
+                        {
+                            std::cout<<"Node " << GetNode()->GetId() << " receives - BROADCAST_BLOCK from cloud server id 0" << "\n";
+                            std::cout << parsedPacket << "\n";
+
+                            const rapidjson::Value& block = d["block"];
+                            for (rapidjson::SizeType j = 0; j < block.Size(); j++)
+                            {
+                                if ((uint32_t) block[j]["rsuNodeId"].GetInt() == GetNode()->GetId())
+                                {
+                                    ConfirmTransaction(block[j]["transId"].GetInt());
+                                }
+                            }
+                            if (m_receivedBlocks.insert(d["blockHash"].GetString()).second)
+                            {
+                                double delay = Simulator::Now().GetSeconds() - d["timeStamp"].GetDouble();
+                                RecordBlockReceipt(delay, delay, 1, parsedPacket.size() + 1);
+                            }
+                            break;
+                        
                         }
 
-                        // After signing, send response
-                        d.AddMember("responseFrom", GetNode()->GetId(), d_allocator);
-                        SendMessage(REQUEST_TRANS, RESPONSE_TRANS, d, from);
-                        break;
-                    }
+                        case RELAY_BLOCK:
+                        {
+                            std::cout << "Node " << GetNode()->GetId() << " receives - RELAY_BLOCK of height "
+                                      << d["block"]["blockHeight"].GetInt() << " at hop " << d["hop"].GetUint() << "\n";
+                            RelayBlock(d, parsedPacket.size() + 1);
+                            break;
+                        }
 
-                    case RESPONSE_TRANS:
-                    {
-    
-                        uint32_t responseFrom = (uint32_t) d["responseFrom"].GetInt();
-                        uint32_t requestTransFrom = (uint32_t) d["transactions"]["rsuNodeId"].GetInt();
-                        //double timestamp = d["transactions"]["timestamp"].GetDouble();
-
-                        if (requestTransFrom == GetNode()->GetId()) {
-                             // TODO: Handle response, if get response valid from all peers then send the valid transaction to cloud sever - Tien
-                            std::cout<<"Node " << GetNode()->GetId() << " receives - RESPONSE_TRANS from " << responseFrom << "\n";
-                             // // If the response is valid, then count up the "m_responseCount"
-                            m_responseCount++;
-                            
-                            m_nodeStats->responseCount = m_responseCount;
-                            m_nodeStats->numberOfPeers = m_numberOfPeers;
-                            
-                             // If the number of valid responses equals to number of peers, then the transaction is valid. 
-                            if (m_responseCount == m_numberOfPeers){
-                                
-                                std::cout<< "Sending the  Valid Transaction of " << GetNode()->GetId() <<  " to  Cloud Server\n";
-                                SendMessage(RESPONSE_TRANS, REQUEST_BLOCK, d, m_cloudServerSocket);
-                                m_totalCreatedTransaction++;
-                                m_tFinish = GetWallTime();
-        
-                                m_meanLatency = (m_meanLatency*static_cast<double>(m_totalCreatedTransaction - 1) + (m_tFinish - m_tStart))/static_cast<double>(m_totalCreatedTransaction);
-                                m_nodeStats->meanLatency = m_meanLatency;
-                                m_nodeStats->rsuNodeId = GetNode()->GetId();
-                                
-                                
-                                //Measure latency for each node
-                                std::cout<<"Latency: "<< m_meanLatency <<"s , Node "<<GetNode()->GetId()<< " confirmed that transactions had succeeded\n";
-                                //std::cout<< "Node: " << m_nodeStats->rsuNodeId <<  "\n";
-                                //std::cout<< "Check: " << m_nodeStats->meanLatency <<  "\n";
-                
-                                m_responseCount = 0;
+                        case SHRED:
+                        {
+                            ReceiveShred(d, parsedPacket.size() + 1);
+                            break;
+                        }
 
+                        case LEADER_HINT:
+                        {
+                            uint32_t leaderId = d["leaderId"].GetUint();
+                            std::map<uint32_t, Ptr<Socket>>::iterator leader = m_cloudServerSockets.find(leaderId);
+                            if (leader != m_cloudServerSockets.end() && leader->second != m_cloudServerSocket)
+                            {
+                                std::cout << "Node " << GetNode()->GetId() << " sends its transactions to cloud server "
+                                          << leaderId << " from now on\n";
+                                m_cloudServerSocket = leader->second;
                             }
+                            break;
                         }
 
-                        // TODO: Handle response, if get response valid from all peers then send the valid transaction to cloud sever - Tien
-                        std::cout<<"Node " << GetNode()->GetId() << " receives - RESPONSE_TRANS from " << responseFrom << "\n";
-                        d.EraseMember("responseFrom");
-                        d.AddMember("requestBlockFrom", GetNode()->GetId(), d.GetAllocator());
-                        break;
-                        
-                    }
+                        case BACKPRESSURE:
+                        {
+                            HandleBackpressure(Seconds(d["retryAfter"].GetDouble()), d["rejected"].GetBool(), d["transId"].GetInt());
+                            break;
+                        }
 
-                    case BROADCAST_BLOCK:
-                    {
-                        std::cout<<"Node " << GetNode()->GetId() << " receives - BROADCAST_BLOCK from cloud server id 0" << "\n";
-                        std::cout << parsedPacket << "\n";
-                        break;
-                        
+                        case REGISTER_KEY:
+                        {
+                            const rapidjson::Value& key = d["publicKey"];
+                            PublicKey registeredKey(key["p"].GetInt64(), key["a"].GetInt64(), key["b"].GetInt64(),
+                                                    {key["xG"].GetInt64(), key["yG"].GetInt64()}, key["n"].GetInt64(),
+                                                    {key["xQ"].GetInt64(), key["yQ"].GetInt64()});
+                            m_keyRegistry.Register(d["keyId"].GetUint(), d["epoch"].GetUint(), registeredKey);
+                            std::cout << "Node " << GetNode()->GetId() << " registers key " << d["keyId"].GetUint()
+                                      << " epoch " << d["epoch"].GetUint() << "\n";
+                            break;
+                        }
                     }
+
+                    totalReceivedData.erase(0, pos + delimiter.length());
                 }
+                m_bufferedData[from] = totalReceivedData;
+                delete[] packetInfo;
             }
         }
         
     }
 
+    void
+    RsuNode::CompleteSignature(std::shared_ptr<PendingSignature> job)
+    {
+        NS_LOG_FUNCTION(this);
+
+        job->done.wait();
+        if (m_crashed)
+        {
+            return;
+        }
+
+        std::pair<long, long> Point_0 = {0, 0};
+        while (job->signature == Point_0) {
+            std::cout << "Failed to generate signature with current key pair, re-initialize public and private key\n";
+            std::pair<PublicKey, long> keyPair = KeyPool::GetInstance().GetKey(GetNode()->GetId());
+            publicKey = keyPair.first;
+            privateKey = keyPair.second;
+            std::cout << "===============================================\n";
+            std::cout << "generating ECDSA key pair for current rsu node id " << GetNode()->GetId() << ":\n";
+            publicKey.printKey();
+            std::cout << "private key = " << privateKey << "\n";
+            std::cout << "===============================================\n";
+
+            m_keyEpoch++;
+            RegisterKey();
+
+            job->publicKey = publicKey;
+            job->keyEpoch = m_keyEpoch;
+            job->privateKey = privateKey;
+            job->hashMsg = ECDSA::digitizeDigest(job->digest, publicKey.p);
+            job->signature = ECDSA::generateSignature(publicKey, privateKey, job->hashMsg);
+        }
+        std::cout << "signature = (" << job->signature.first << ", " << job->signature.second << ")\n";
+
+        rapidjson::Document d;
+        d.Parse(job->message.c_str());
+        rapidjson::Document::AllocatorType& d_allocator = d.GetAllocator();
+        rapidjson::Value& trans = d["transactions"];
+
+        trans.AddMember("isSigned", true, d_allocator);
+
+        // The key itself went out with REGISTER_KEY
+        trans.AddMember("keyId", GetNode()->GetId(), d_allocator);
+        trans.AddMember("keyEpoch", job->keyEpoch, d_allocator);
+
+        rapidjson::Value signatureInfo(rapidjson::kObjectType);
+        signatureInfo.AddMember("r", job->signature.first, d_allocator);
+        signatureInfo.AddMember("s", job->signature.second, d_allocator);
+        trans.AddMember("signature", signatureInfo, d_allocator);
+
+        d.AddMember("responseFrom", GetNode()->GetId(), d_allocator);
+        SendMessage(REQUEST_TRANS, RESPONSE_TRANS, d, job->from);
+    }
+
     void
     RsuNode::HandleAccept(Ptr<Socket> socket, const Address& from)
     {
@@ -437,7 +775,60 @@ namespace ns3 {
     }
 
     void
-    RsuNode::CreateTransaction()
+    RsuNode::IssueTransactions(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (!m_issuing)
+        {
+            return;
+        }
+
+        if (m_openLoop)
+        {
+            // Arrivals that found no endorser are dropped, the workload does not repeat them
+            while (!m_pendingArrivals.empty() && (m_inFlightWindow == 0 || m_inFlight.size() < m_inFlightWindow))
+            {
+                if (!PaceIssue())
+                {
+                    return;
+                }
+                std::pair<Time, double> arrival = m_pendingArrivals.front();
+                m_pendingArrivals.pop_front();
+                CreateTransaction(arrival.second, arrival.first);
+            }
+            return;
+        }
+
+        if (m_inFlightWindow == 0)
+        {
+            if (!PaceIssue())
+            {
+                return;
+            }
+            CreateTransaction(m_payment, Simulator::Now());
+            m_nextIssueEvent = Simulator::Schedule(m_issueInterval, &RsuNode::IssueTransactions, this);
+            return;
+        }
+
+        // Pipelined: fill the window, each transaction that leaves it makes room for the next
+        while (m_inFlight.size() < m_inFlightWindow)
+        {
+            if (!PaceIssue())
+            {
+                return;
+            }
+            if (!CreateTransaction(m_payment, Simulator::Now()))
+            {
+                // Nobody to endorse it now, try again later rather than spinning
+                m_nextIssueEvent = Simulator::Schedule(m_issueInterval, &RsuNode::IssueTransactions, this);
+                return;
+            }
+        }
+    }
+
+    bool
+    RsuNode::CreateTransaction(double payment, Time arrival)
     {
         NS_LOG_FUNCTION(this);
 
@@ -447,7 +838,7 @@ namespace ns3 {
         double tranTimestamp = Simulator::Now().GetMilliSeconds();
         transD.SetObject();
 
-        Transaction newTrans(GetNode()->GetId(), transId, tranTimestamp, m_payment, m_winnerId);
+        Transaction newTrans(GetNode()->GetId(), transId, tranTimestamp, payment, m_winnerId);
 
         rapidjson::Value value;
         rapidjson::Value array(rapidjson::kArrayType);
@@ -478,12 +869,35 @@ namespace ns3 {
 
         transD.AddMember("toRsuIp", 0, transD.GetAllocator());
 
+        std::vector<uint32_t> endorsers = m_endorsementPolicy ?
+            m_endorsementPolicy->SelectEndorsers(GetNode()->GetId(), transId, m_peerIds) : m_peerIds;
+        if (endorsers.empty())
+        {
+            std::cout << "Node " << GetNode()->GetId() << " has no endorser for transaction id " << transId << "\n";
+            m_failedEndorsements++;
+            m_transactionId++;
+            return false;
+        }
+
         m_transaction.push_back(newTrans);
+        m_inFlight[transId].start = arrival;
+        std::vector<Ipv4Address> endorserAddresses;
+        for (uint32_t id : endorsers)
+        {
+            endorserAddresses.push_back(m_peerIdToAddress[id]);
+        }
 
+        EndorsementTracker::Entry &entry = m_endorsementTracker.Open(transId, newTrans, endorsers, Simulator::Now());
+        if (m_endorsementTimeout.IsStrictlyPositive())
+        {
+            entry.deadline = Simulator::Schedule(m_endorsementTimeout, &RsuNode::ExpireEndorsement, this, transId);
+        }
 
-        // send to peers 
+        // send to the endorsers of this transaction only
+        std::cout << "Node " << GetNode()->GetId() << " sends transaction id " << transId << " to "
+                  << endorserAddresses.size() << " of " << m_numberOfPeers << " peers\n";
 
-        for(std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+        for(std::vector<Ipv4Address>::const_iterator i = endorserAddresses.begin(); i != endorserAddresses.end(); ++i)
         {
             rapidjson::Value::MemberIterator it = transD.FindMember("toRsuIp");
             if (it != transD.MemberEnd()) {
@@ -496,13 +910,652 @@ namespace ns3 {
             const uint8_t delimiter[] = "#";
             m_peersSockets[*i]->Send(reinterpret_cast<const uint8_t*>(transactionInfo.GetString()), transactionInfo.GetSize(), 0);
             m_peersSockets[*i]->Send(delimiter, 1, 0);
+            m_endorsementRequests++;
         
         }
+        if (m_lastIssue.IsStrictlyPositive())
+        {
+            double gap = (Simulator::Now() - m_lastIssue).GetSeconds();
+            m_meanIssueGap = m_meanIssueGap > 0 ? 0.875 * m_meanIssueGap + 0.125 * gap : gap;
+        }
+        m_lastIssue = Simulator::Now();
         m_transactionId++;
+        return true;
+    }
+
+    void
+    RsuNode::RelayBlock(rapidjson::Document &d, uint32_t bytes)
+    {
+        NS_LOG_FUNCTION(this);
+
+        const rapidjson::Value &block = d["block"];
+        const rapidjson::Value &transactions = block["block"];
+        for (rapidjson::SizeType j = 0; j < transactions.Size(); j++)
+        {
+            if ((uint32_t) transactions[j]["rsuNodeId"].GetInt() == GetNode()->GetId())
+            {
+                ConfirmTransaction(transactions[j]["transId"].GetInt());
+            }
+        }
+
+        double now = Simulator::Now().GetSeconds();
+        uint32_t hops = d["hop"].GetUint();
+        bool fresh = m_receivedBlocks.insert(block["blockHash"].GetString()).second;
+        if (fresh)
+        {
+            RecordBlockReceipt(now - block["timeStamp"].GetDouble(), now - d["sentAt"].GetDouble(), hops, bytes);
+        }
+
+        // Acknowledged every time, a repair that arrives after the tree copy still shows the node is up
+        SendRelayAck(d["origin"].GetUint(), d["round"].GetUint64(), hops, d["disseminatedAt"].GetDouble(), d["sentAt"].GetDouble(), true);
+
+        if (!fresh)
+        {
+            return;
+        }
+
+        std::vector<uint32_t> order;
+        const rapidjson::Value &members = d["members"];
+        for (rapidjson::SizeType j = 0; j < members.Size(); j++)
+        {
+            order.push_back(members[j].GetUint());
+        }
+        int position = OverlayTree::GetPosition(order, GetNode()->GetId());
+        if (position < 0)
+        {
+            return;
+        }
+        std::vector<uint32_t> children = OverlayTree::GetChildren(order, d["fanout"].GetUint(), position);
+        if (children.empty())
+        {
+            return;
+        }
+
+        d["hop"].SetUint(hops + 1);
+        d["sentAt"].SetDouble(now);
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        d.Accept(writer);
+
+        const uint8_t delimiter[] = "#";
+        for (uint32_t child : children)
+        {
+            std::map<uint32_t, Ipv4Address>::iterator peer = m_peerIdToAddress.find(child);
+            if (peer == m_peerIdToAddress.end())
+            {
+                continue;
+            }
+            m_peersSockets[peer->second]->Send(reinterpret_cast<const uint8_t*>(buffer.GetString()), buffer.GetSize(), 0);
+            m_peersSockets[peer->second]->Send(delimiter, 1, 0);
+            m_nodeStats->blockSentBytes += buffer.GetSize() + 1;
+        }
+        std::cout << "Node " << GetNode()->GetId() << " relays block " << block["blockHeight"].GetInt() << " to "
+                  << children.size() << " children\n";
+    }
 
-        int miliSec = 950;
-        Simulator::Schedule(MilliSeconds(miliSec), &RsuNode::CreateTransaction, this);
+    void
+    RsuNode::SendRelayAck(uint32_t origin, uint64_t round, uint32_t hops, double disseminatedAt, double sentAt, bool complete)
+    {
+        NS_LOG_FUNCTION(this);
 
+        std::map<uint32_t, Ptr<Socket>>::iterator server = m_cloudServerSockets.find(origin);
+        if (server == m_cloudServerSockets.end())
+        {
+            return;
+        }
+
+        double now = Simulator::Now().GetSeconds();
+        rapidjson::Document ackD;
+        ackD.SetObject();
+        rapidjson::Value value;
+        value.SetString("relay");
+        ackD.AddMember("type", value, ackD.GetAllocator());
+        ackD.AddMember("message", RELAY_ACK, ackD.GetAllocator());
+        ackD.AddMember("round", round, ackD.GetAllocator());
+        ackD.AddMember("nodeId", GetNode()->GetId(), ackD.GetAllocator());
+        ackD.AddMember("hop", hops, ackD.GetAllocator());
+        ackD.AddMember("delay", now - disseminatedAt, ackD.GetAllocator());
+        ackD.AddMember("hopDelay", now - sentAt, ackD.GetAllocator());
+        ackD.AddMember("complete", complete, ackD.GetAllocator());
+        SendMessage(RELAY_BLOCK, RELAY_ACK, ackD, server->second);
+    }
+
+    void
+    RsuNode::ReceiveShred(const rapidjson::Document &d, uint32_t bytes)
+    {
+        NS_LOG_FUNCTION(this);
+
+        ShredHeader header;
+        header.origin = d["origin"].GetUint();
+        header.round = d["round"].GetUint64();
+        header.dataShreds = d["dataShreds"].GetUint();
+        header.parityShreds = d["parityShreds"].GetUint();
+        header.length = d["length"].GetUint();
+        header.fanout = d["fanout"].GetUint();
+        const rapidjson::Value &members = d["members"];
+        for (rapidjson::SizeType j = 0; j < members.Size(); j++)
+        {
+            header.members.push_back(members[j].GetUint());
+        }
+        header.disseminatedAt = d["disseminatedAt"].GetDouble();
+
+        uint32_t index = d["index"].GetUint();
+        uint32_t hops = d["hop"].GetUint();
+        uint32_t total = header.dataShreds + header.parityShreds;
+        double now = Simulator::Now().GetSeconds();
+        m_shredsReceived++;
+        if (header.dataShreds == 0 || total > ReedSolomon::MAX_SHREDS)
+        {
+            NS_LOG_WARN("Shred " << index << " of cloud server " << header.origin << " has a malformed header");
+            m_nodeStats->blockReceivedBytes += bytes;
+            return;
+        }
+
+        // Rounds far behind the newest of the origin are over, the cloud server no longer repairs them
+        std::pair<uint32_t, uint64_t> key(header.origin, header.round);
+        uint64_t &newest = m_newestShredRounds[header.origin];
+        if (header.round > newest)
+        {
+            newest = header.round;
+            if (newest >= SHRED_ROUNDS)
+            {
+                std::pair<uint32_t, uint64_t> from(header.origin, 0);
+                std::pair<uint32_t, uint64_t> to(header.origin, newest - SHRED_ROUNDS + 1);
+                m_shredAssemblies.erase(m_shredAssemblies.lower_bound(from), m_shredAssemblies.lower_bound(to));
+                m_rebuiltShreds.erase(m_rebuiltShreds.lower_bound(from), m_rebuiltShreds.lower_bound(to));
+            }
+        }
+        if (header.round + SHRED_ROUNDS <= newest || m_rebuiltShreds.count(key))
+        {
+            m_duplicateShreds++;
+            m_nodeStats->blockReceivedBytes += bytes;
+            return;
+        }
+
+        bool first = m_shredAssemblies.find(key) == m_shredAssemblies.end();
+        ShredAssembly &assembly = m_shredAssemblies[key];
+        if (first)
+        {
+            assembly.shreds.resize(total);
+            assembly.seen.resize(total, false);
+            assembly.received = 0;
+            assembly.bytes = 0;
+
+            // Tells the cloud server the node is up, even if the block takes a repair to complete
+            SendRelayAck(header.origin, header.round, hops, header.disseminatedAt, d["sentAt"].GetDouble(), false);
+        }
+        if (index >= assembly.seen.size() || assembly.seen[index])
+        {
+            m_duplicateShreds++;
+            m_nodeStats->blockReceivedBytes += bytes;
+            return;
+        }
+        assembly.seen[index] = true;
+        assembly.received++;
+        assembly.bytes += bytes;
+
+        // Cut-through: the shred goes on before the rest of the block is in
+        std::vector<uint8_t> payload = DecodeBase64(d["payload"].GetString());
+        std::vector<uint32_t> children = GetShredChildren(header, index, GetNode()->GetId());
+        if (!children.empty())
+        {
+            std::shared_ptr<const std::string> message = MakeShredMessage(header, index, payload, hops + 1);
+            for (uint32_t child : children)
+            {
+                SendShred(message, child);
+            }
+        }
+
+        assembly.shreds[index] = payload;
+        if (assembly.received < header.dataShreds)
+        {
+            return;
+        }
+
+        // In place, so the shreds stay for the next try if these do not give the block
+        ReedSolomon code(header.dataShreds, header.parityShreds);
+        if (assembly.shreds.size() != total || !code.Reconstruct(assembly.shreds))
+        {
+            return;
+        }
+        std::vector<std::vector<uint8_t>> shreds;
+        shreds.swap(assembly.shreds);
+        uint32_t received = assembly.received;
+        uint32_t receivedBytes = assembly.bytes;
+        std::vector<bool> seen;
+        seen.swap(assembly.seen);
+        m_shredAssemblies.erase(key);
+        m_rebuiltShreds.insert(key);
+
+        rapidjson::Document block;
+        std::string blockMessage = ReedSolomon::Join(shreds, header.dataShreds, header.length);
+        block.Parse<rapidjson::kParseFullPrecisionFlag>(blockMessage.c_str());
+        if (block.HasParseError() || !block.IsObject())
+        {
+            std::cout << "Node " << GetNode()->GetId() << " rebuilt block " << header.round << " of cloud server "
+                      << header.origin << " from " << received << " shreds but cannot parse it\n";
+            return;
+        }
+        std::cout << "Node " << GetNode()->GetId() << " rebuilds block " << block["blockHeight"].GetInt() << " from "
+                  << received << " of " << total << " shreds at hop " << hops << "\n";
+
+        const rapidjson::Value &transactions = block["block"];
+        for (rapidjson::SizeType j = 0; j < transactions.Size(); j++)
+        {
+            if ((uint32_t) transactions[j]["rsuNodeId"].GetInt() == GetNode()->GetId())
+            {
+                ConfirmTransaction(transactions[j]["transId"].GetInt());
+            }
+        }
+        if (m_receivedBlocks.insert(block["blockHash"].GetString()).second)
+        {
+            RecordBlockReceipt(now - block["timeStamp"].GetDouble(), now - d["sentAt"].GetDouble(), hops, receivedBytes);
+        }
+        SendRelayAck(header.origin, header.round, hops, header.disseminatedAt, d["sentAt"].GetDouble(), true);
+
+        // The shreds lost above this node are rebuilt here, so the loss stops at this node
+        for (uint32_t missing = 0; missing < total; missing++)
+        {
+            if (seen[missing])
+            {
+                continue;
+            }
+            children = GetShredChildren(header, missing, GetNode()->GetId());
+            if (children.empty())
+            {
+                continue;
+            }
+            std::shared_ptr<const std::string> message = MakeShredMessage(header, missing, shreds[missing], hops + 1);
+            for (uint32_t child : children)
+            {
+                SendShred(message, child);
+            }
+            m_shredsRecovered++;
+        }
+    }
+
+    std::shared_ptr<const std::string>
+    RsuNode::MakeShredMessage(const ShredHeader &header, uint32_t index, const std::vector<uint8_t> &payload, uint32_t hop)
+    {
+        NS_LOG_FUNCTION(this);
+
+        rapidjson::Document shredD;
+        shredD.SetObject();
+        rapidjson::Document::AllocatorType &allocator = shredD.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("shred");
+        shredD.AddMember("type", value, allocator);
+        shredD.AddMember("message", SHRED, allocator);
+        shredD.AddMember("origin", header.origin, allocator);
+        shredD.AddMember("round", header.round, allocator);
+        shredD.AddMember("index", index, allocator);
+        shredD.AddMember("dataShreds", header.dataShreds, allocator);
+        shredD.AddMember("parityShreds", header.parityShreds, allocator);
+        shredD.AddMember("length", header.length, allocator);
+        shredD.AddMember("fanout", header.fanout, allocator);
+        rapidjson::Value members(rapidjson::kArrayType);
+        for (uint32_t nodeId : header.members)
+        {
+            members.PushBack(nodeId, allocator);
+        }
+        shredD.AddMember("members", members, allocator);
+        shredD.AddMember("hop", hop, allocator);
+        shredD.AddMember("sentAt", Simulator::Now().GetSeconds(), allocator);
+        shredD.AddMember("disseminatedAt", header.disseminatedAt, allocator);
+        value.SetString(EncodeBase64(payload).c_str(), allocator);
+        shredD.AddMember("payload", value, allocator);
+
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        shredD.Accept(writer);
+        return std::make_shared<const std::string>(buffer.GetString(), buffer.GetSize());
+    }
+
+    void
+    RsuNode::SendShred(std::shared_ptr<const std::string> message, uint32_t nodeId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        const uint8_t delimiter[] = "#";
+
+        std::map<uint32_t, Ipv4Address>::iterator peer = m_peerIdToAddress.find(nodeId);
+        if (m_crashed || peer == m_peerIdToAddress.end())
+        {
+            return;
+        }
+        // The links are TCP, so a lossy link is played out here, one SHRED at a time
+        if (m_shredLossRate > 0 && std::uniform_real_distribution<double>(0, 1)(m_lossRandom) < m_shredLossRate)
+        {
+            m_shredsLost++;
+            return;
+        }
+        m_peersSockets[peer->second]->Send(reinterpret_cast<const uint8_t*>(message->data()), message->size(), 0);
+        m_peersSockets[peer->second]->Send(delimiter, 1, 0);
+        if (m_nodeStats)
+        {
+            m_nodeStats->blockSentBytes += message->size() + 1;
+        }
+    }
+
+    std::vector<uint32_t>
+    RsuNode::GetShredChildren(const ShredHeader &header, uint32_t index, uint32_t nodeId)
+    {
+        if (header.members.empty())
+        {
+            return std::vector<uint32_t>();
+        }
+
+        // Shred i starts at the member i places along, so every shred takes a different path
+        std::vector<uint32_t> order = header.members;
+        std::rotate(order.begin(), order.begin() + index % order.size(), order.end());
+        int position = OverlayTree::GetPosition(order, nodeId);
+        if (position < 0)
+        {
+            return std::vector<uint32_t>();
+        }
+        std::vector<uint32_t> below(order.begin() + 1, order.end());
+        return OverlayTree::GetChildren(below, header.fanout, position - 1);
+    }
+
+    void
+    RsuNode::RecordBlockReceipt(double delay, double hopDelay, uint32_t hops, uint32_t bytes)
+    {
+        NS_LOG_FUNCTION(this);
+
+        m_receivedBlockCount++;
+        m_meanBlockPropagationTime += (delay - m_meanBlockPropagationTime) / m_receivedBlockCount;
+        m_meanHopDelay += (hopDelay - m_meanHopDelay) / m_receivedBlockCount;
+        m_meanBlockHops += (hops - m_meanBlockHops) / m_receivedBlockCount;
+
+        m_nodeStats->totalBlocks = m_receivedBlockCount;
+        m_nodeStats->meanBlockPropagationTime = m_meanBlockPropagationTime;
+        m_nodeStats->meanHopDelay = m_meanHopDelay;
+        m_nodeStats->meanBlockHops = m_meanBlockHops;
+        m_nodeStats->blockReceivedBytes += bytes;
+    }
+
+    bool
+    RsuNode::PaceIssue(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        Time next = m_resumeAt;
+        double rate = GetRateLimit();
+        if (rate > 0)
+        {
+            next = std::max(next, m_lastIssue + Seconds(1.0 / rate));
+        }
+        if (next <= Simulator::Now())
+        {
+            return true;
+        }
+
+        if (!m_nextIssueEvent.IsRunning())
+        {
+            m_nextIssueEvent = Simulator::Schedule(next - Simulator::Now(), &RsuNode::IssueTransactions, this);
+        }
+        return false;
+    }
+
+    double
+    RsuNode::GetRateLimit(void)
+    {
+        if (m_rateLimit <= 0)
+        {
+            return 0;
+        }
+
+        double elapsed = (Simulator::Now() - m_rateCutAt).GetSeconds();
+        if (elapsed >= m_backoffRecovery.GetSeconds())
+        {
+            m_rateLimit = 0;
+            return 0;
+        }
+        return m_rateLimit + (m_rateBeforeCut - m_rateLimit) * elapsed / m_backoffRecovery.GetSeconds();
+    }
+
+    void
+    RsuNode::HandleBackpressure(Time retryAfter, bool rejected, int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        m_backpressureSignals++;
+
+        // One cut per retry-after, the signals of the same backlog halve the rate once
+        if (Simulator::Now() >= m_resumeAt)
+        {
+            double rate = GetRateLimit();
+            if (rate == 0)
+            {
+                rate = m_meanIssueGap > 0 ? 1.0 / m_meanIssueGap
+                     : m_issueInterval.IsStrictlyPositive() ? 1.0 / m_issueInterval.GetSeconds() : 0;
+            }
+            if (rate > 0)
+            {
+                m_rateBeforeCut = rate;
+                m_rateLimit = rate / 2;
+                m_rateCutAt = Simulator::Now();
+            }
+        }
+        m_resumeAt = std::max(m_resumeAt, Simulator::Now() + retryAfter);
+
+        std::cout << "Node " << GetNode()->GetId() << " holds back for " << retryAfter.GetSeconds() << "s, issue rate limit "
+                  << GetRateLimit() << "/s";
+        if (rejected)
+        {
+            std::cout << ", transaction id " << transId << " to be resent";
+            Simulator::Schedule(retryAfter, &RsuNode::ResendTransaction, this, transId);
+        }
+        std::cout << "\n";
+    }
+
+    void
+    RsuNode::ResendTransaction(int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::unordered_map<int, InFlightTransaction>::iterator it = m_inFlight.find(transId);
+        if (!m_issuing || it == m_inFlight.end() || !it->second.endorsed.IsStrictlyPositive())
+        {
+            return;
+        }
+        m_resentRequests++;
+        SendEndorsedTransaction(it->second.transaction, it->second.certificate);
+    }
+
+    void
+    RsuNode::CompleteEndorsement(int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        EndorsementTracker::Entry entry = m_endorsementTracker.Close(transId);
+        Simulator::Cancel(entry.deadline);
+
+        std::cout<< "Sending the  Valid Transaction of " << GetNode()->GetId() <<  " to  Cloud Server\n";
+        SendEndorsedTransaction(entry.transaction, entry.certificate);
+        m_totalCreatedTransaction++;
+
+        double endorsementTime = (Simulator::Now() - entry.start).GetSeconds();
+        m_meanEndorsementTime = (m_meanEndorsementTime*static_cast<double>(m_totalCreatedTransaction - 1) + endorsementTime)/static_cast<double>(m_totalCreatedTransaction);
+        m_nodeStats->meanEndorsementTime = m_meanEndorsementTime;
+        m_nodeStats->nodeGeneratedTransaction = m_totalCreatedTransaction;
+        m_nodeStats->rsuNodeId = GetNode()->GetId();
+
+        std::cout<<"Transaction id " << transId << " reached " << entry.certificate.GetNumberOfEndorsers() << " endorsements in "
+                 << endorsementTime << "s\n";
+
+        std::unordered_map<int, InFlightTransaction>::iterator it = m_inFlight.find(transId);
+        if (it != m_inFlight.end())
+        {
+            it->second.endorsed = Simulator::Now();
+            it->second.transaction = entry.transaction;
+            it->second.certificate = entry.certificate;
+            if (m_orderingTimeout.IsStrictlyPositive())
+            {
+                it->second.timeout = Simulator::Schedule(m_orderingTimeout, &RsuNode::ExpireOrdering, this, transId);
+            }
+        }
+    }
+
+    void
+    RsuNode::ConfirmTransaction(int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::unordered_map<int, InFlightTransaction>::iterator it = m_inFlight.find(transId);
+        if (it == m_inFlight.end())
+        {
+            return;
+        }
+
+        m_totalOrdering++;
+        double latency = (Simulator::Now() - it->second.start).GetSeconds();
+        double orderingTime = (Simulator::Now() - it->second.endorsed).GetSeconds();
+        m_meanLatency = (m_meanLatency*static_cast<double>(m_totalOrdering - 1) + latency)/static_cast<double>(m_totalOrdering);
+        m_meanOrderingTime = (m_meanOrderingTime*static_cast<double>(m_totalOrdering - 1) + orderingTime)/static_cast<double>(m_totalOrdering);
+        m_nodeStats->meanLatency = m_meanLatency;
+        m_nodeStats->meanOrderingTime = m_meanOrderingTime;
+        m_nodeStats->nodeConfirmedTransaction = m_totalOrdering;
+
+        //Measure latency for each node
+        std::cout<<"Latency: "<< latency <<"s (mean " << m_meanLatency << "s), Node "<<GetNode()->GetId()
+                 << " confirmed that transaction id " << transId << " had succeeded\n";
+
+        ReleaseTransaction(transId);
+    }
+
+    void
+    RsuNode::ExpireOrdering(int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (m_inFlight.count(transId))
+        {
+            std::cout << "Transaction id " << transId << " of Node " << GetNode()->GetId() << " got no block in time\n";
+            m_orderingTimeouts++;
+            ReleaseTransaction(transId);
+        }
+    }
+
+    void
+    RsuNode::ReleaseTransaction(int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        std::unordered_map<int, InFlightTransaction>::iterator it = m_inFlight.find(transId);
+        if (it == m_inFlight.end())
+        {
+            return;
+        }
+        Simulator::Cancel(it->second.timeout);
+        m_inFlight.erase(it);
+
+        // Issued from its own event so a completion never recurses into CreateTransaction
+        if (m_inFlightWindow > 0 && m_issuing && !m_nextIssueEvent.IsRunning() && (!m_openLoop || !m_pendingArrivals.empty()))
+        {
+            m_nextIssueEvent = Simulator::ScheduleNow(&RsuNode::IssueTransactions, this);
+        }
+    }
+
+    void
+    RsuNode::FailEndorsement(int transId, const std::string &reason)
+    {
+        NS_LOG_FUNCTION(this);
+
+        EndorsementTracker::Entry entry = m_endorsementTracker.Close(transId);
+        Simulator::Cancel(entry.deadline);
+        m_failedEndorsements++;
+
+        std::cout << "Transaction id " << transId << " of Node " << GetNode()->GetId() << " got "
+                  << entry.certificate.GetNumberOfEndorsers() << " of " << entry.quorum
+                  << " endorsements and is dropped: " << reason << "\n";
+
+        ReleaseTransaction(transId);
+    }
+
+    void
+    RsuNode::ExpireEndorsement(int transId)
+    {
+        NS_LOG_FUNCTION(this);
+
+        if (m_endorsementTracker.IsOpen(transId))
+        {
+            FailEndorsement(transId, "the deadline passed");
+        }
+    }
+
+    void
+    RsuNode::SendEndorsedTransaction(const Transaction &transaction, const EndorsementCertificate &certificate)
+    {
+        NS_LOG_FUNCTION(this);
+
+        rapidjson::Document blockD;
+        blockD.SetObject();
+        rapidjson::Document::AllocatorType& allocator = blockD.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("transaction");
+        blockD.AddMember("type", value, allocator);
+        blockD.AddMember("message", REQUEST_BLOCK, allocator);
+
+        // Only the transaction fields, the signatures travel in the certificate
+        rapidjson::Value transInfo(rapidjson::kObjectType);
+        transInfo.AddMember("rsuNodeId", transaction.GetRsuNodeId(), allocator);
+        transInfo.AddMember("transId", transaction.GetTransId(), allocator);
+        transInfo.AddMember("timestamp", transaction.GetTransTimeStamp(), allocator);
+        transInfo.AddMember("payment", transaction.GetPayment(), allocator);
+        transInfo.AddMember("winnerId", transaction.GetWinnerId(), allocator);
+        blockD.AddMember("transactions", transInfo, allocator);
+
+        rapidjson::Value certificateInfo;
+        certificate.ToJson(certificateInfo, allocator);
+        blockD.AddMember("certificate", certificateInfo, allocator);
+        blockD.AddMember("requestBlockFrom", GetNode()->GetId(), allocator);
+
+        SendMessage(RESPONSE_TRANS, REQUEST_BLOCK, blockD, m_cloudServerSocket);
+    }
+
+    void
+    RsuNode::RegisterKey(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        rapidjson::Document keyD;
+        keyD.SetObject();
+        rapidjson::Document::AllocatorType& allocator = keyD.GetAllocator();
+
+        rapidjson::Value value;
+        value.SetString("key");
+        keyD.AddMember("type", value, allocator);
+        keyD.AddMember("message", REGISTER_KEY, allocator);
+        keyD.AddMember("keyId", GetNode()->GetId(), allocator);
+        keyD.AddMember("epoch", m_keyEpoch, allocator);
+
+        rapidjson::Value keyInfo(rapidjson::kObjectType);
+        keyInfo.AddMember("p", publicKey.p, allocator);
+        keyInfo.AddMember("a", publicKey.a, allocator);
+        keyInfo.AddMember("b", publicKey.b, allocator);
+        keyInfo.AddMember("n", publicKey.n, allocator);
+        keyInfo.AddMember("xG", publicKey.G.first, allocator);
+        keyInfo.AddMember("yG", publicKey.G.second, allocator);
+        keyInfo.AddMember("xQ", publicKey.Q.first, allocator);
+        keyInfo.AddMember("yQ", publicKey.Q.second, allocator);
+        keyD.AddMember("publicKey", keyInfo, allocator);
+
+        // Every cloud server of the cluster checks signatures once it leads
+        SendMessage(REGISTER_KEY, REGISTER_KEY, keyD, m_cloudServerSocket);
+        for (auto &cloudServer : m_cloudServerSockets)
+        {
+            if (cloudServer.second != m_cloudServerSocket)
+            {
+                SendMessage(REGISTER_KEY, REGISTER_KEY, keyD, cloudServer.second);
+            }
+        }
+        for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+        {
+            SendMessage(REGISTER_KEY, REGISTER_KEY, keyD, m_peersSockets[*i]);
+        }
     }
 
     void
@@ -552,13 +1605,3 @@ namespace ns3 {
 
 
 }
-
-static double GetWallTime()
-{
-    struct timeval time;
-    if(gettimeofday(&time, NULL))
-    {
-        return 0;
-    }
-    return (double)time.tv_sec + (double)time.tv_usec * .000001;
-}
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "ns3/traced-callback.h"
 #include "ns3/address.h"
 #include "ns3/boolean.h"
+#include "ns3/nstime.h"
 #include "../../rapidjson/document.h"
 #include "../../rapidjson/writer.h"
 #include "../../rapidjson/stringbuffer.h"
@@ -13,6 +14,20 @@
 #include "blockchain.h"
 #include "ecdsa.h"
 #include "sha256.h"
+#include "crypto-worker-pool.h"
+#include "key-pool.h"
+#include "key-registry.h"
+#include "endorsement-certificate.h"
+#include "endorsement-tracker.h"
+#include "endorsement-policy.h"
+#include "smart-contract.h"
+#include "overlay-tree.h"
+#include "reed-solomon.h"
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <deque>
+#include <set>
 
 #ifndef RSU_NODE_H
 #define RSU_NODE_H
@@ -23,6 +38,61 @@ class Address;
 class Socket;
 class Packet;
 
+/*
+ * A REQUEST_TRANS endorsement whose signature is computed by the crypto worker pool.
+ */
+struct PendingSignature
+{
+    std::string message;                // the REQUEST_TRANS as received
+    Address from;
+    PublicKey publicKey;
+    uint32_t keyEpoch;                  // epoch under which publicKey was registered
+    long privateKey;
+    Sha256Digest digest;                // of the signing payload, digitized again if the key changes
+    long hashMsg;                       // digest mod the p of publicKey
+    unsigned long nonceSeed;            // drawn on the simulator thread so runs are repeatable
+    std::pair<long, long> signature;
+    std::shared_future<void> done;
+};
+
+/*
+ * An own transaction between its creation and the block that orders it.
+ */
+struct InFlightTransaction
+{
+    Time start;                         // simulated time it was created
+    Time endorsed;                      // simulated time its quorum was reached, 0 before that
+    EventId timeout;                    // gives the slot back if no block orders it
+    Transaction transaction;            // set once endorsed, to resend it if the cloud server turns it away
+    EndorsementCertificate certificate;
+};
+
+/*
+ * What every shred of a block carries besides its own index and bytes.
+ */
+struct ShredHeader
+{
+    uint32_t origin;                    // the cloud server that shredded the block
+    uint64_t round;                     // of the origin, names the block
+    uint32_t dataShreds;
+    uint32_t parityShreds;
+    uint32_t length;                    // bytes of the BROADCAST_BLOCK
+    uint32_t fanout;
+    std::vector<uint32_t> members;      // the tree of shred i is rooted at members[i % size], the rest follow in order
+    double disseminatedAt;
+};
+
+/*
+ * The shreds of a block that came in so far.
+ */
+struct ShredAssembly
+{
+    std::vector<std::vector<uint8_t>> shreds;  // by index, empty until the shred comes
+    std::vector<bool> seen;             // by index, the shred was taken or forwarded already
+    uint32_t received;
+    uint32_t bytes;                     // of the SHREDs as received
+};
+
 class RsuNode : public Application{
     public:
 
@@ -40,13 +110,47 @@ class RsuNode : public Application{
 
         void SetPeersAddresses (const std::vector<Ipv4Address> &peers);
 
+        /**
+         * \brief Sets the node ids of the peers, in the same order as their addresses
+         */
+        void SetPeerIds (const std::vector<uint32_t> &peerIds);
+
+        /**
+         * \brief Sets the policy that picks the endorsers of each transaction; without one every peer endorses
+         * \param policy shared by every node, owned by the caller
+         */
+        void SetEndorsementPolicy (const EndorsementPolicy *policy);
+
         void SetCloudServerAddress (const Ipv4Address &cloudServerAddr);
 
+        /**
+         * \brief Sets every cloud server of the ordering cluster; the node sends to the one
+         *        at the cloud server address until a LEADER_HINT names another
+         * \param cloudServerAddrs the address of each cloud server, by node id
+         */
+        void SetCloudServerAddresses (const std::map<uint32_t, Ipv4Address> &cloudServerAddrs);
+
         PublicKey publicKey;
         
         void SetProtocolType (enum ProtocolType protocolType);
 
         void SetNodeStats (nodeStatistics *nodeStats); 
+
+        /**
+         * \brief Takes transactions from SubmitTransaction instead of issuing them at IssueInterval
+         */
+        void SetOpenLoop (bool openLoop);
+
+        /**
+         * \brief An arrival of the workload; it waits for a slot when the in-flight window is full
+         * \param payment the payment of the transaction
+         */
+        void SubmitTransaction (double payment);
+
+        /**
+         * \brief Stops the node for the rest of the run, as if it failed
+         */
+        virtual void Crash (void);
         
 
     protected:
@@ -63,7 +167,163 @@ class RsuNode : public Application{
 
         void HandlePeerError (Ptr<Socket> socket);
 
-        void CreateTransaction();
+        /**
+         * \brief Issues transactions: one every IssueInterval, or as many as the in-flight window has room for
+         */
+        void IssueTransactions(void);
+
+        /**
+         * \brief Creates one transaction and sends it to its endorsers
+         * \param payment the payment of the transaction
+         * \param arrival the time the transaction arrived, its latency counts from there
+         * \return false if the endorsement policy designated no endorser for it
+         */
+        bool CreateTransaction(double payment, Time arrival);
+
+        /**
+         * \brief Called when a block orders one of this node's transactions; records its latency
+         * \param transId the id of the transaction
+         */
+        void ConfirmTransaction(int transId);
+
+        /**
+         * \brief Called at the ordering deadline of a transaction; gives its slot back if it is still in flight
+         * \param transId the id of the transaction
+         */
+        void ExpireOrdering(int transId);
+
+        /**
+         * \brief Checks the issue rate BACKPRESSURE left the node with; if the next transaction
+         *        has to wait, schedules IssueTransactions for when it may go
+         * \return true if the node may create a transaction now
+         */
+        bool PaceIssue(void);
+
+        /**
+         * \brief The rate the node may issue at, 0 for no limit. A BACKPRESSURE halves the rate
+         *        and it climbs back in a straight line over BackoffRecovery, then the limit is lifted
+         */
+        double GetRateLimit(void);
+
+        /**
+         * \brief Called on BACKPRESSURE: holds the node back for the retry-after time, halves its
+         *        rate and resends the request the cloud server turned away
+         * \param retryAfter the time the cloud server asks the node to wait
+         * \param rejected the request transId was dropped
+         * \param transId the id of the transaction
+         */
+        void HandleBackpressure(Time retryAfter, bool rejected, int transId);
+
+        /**
+         * \brief Sends an endorsed transaction to the cloud server again, if it is still in flight
+         * \param transId the id of the transaction
+         */
+        void ResendTransaction(int transId);
+
+        /**
+         * \brief Forgets an in-flight transaction and, in pipelined mode, issues the next one
+         * \param transId the id of the transaction
+         */
+        void ReleaseTransaction(int transId);
+
+        /**
+         * \brief Sends a transaction with the signatures of its endorsers to the cloud server as REQUEST_BLOCK
+         * \param transaction the endorsed transaction
+         * \param certificate the endorsements collected for it
+         */
+        void SendEndorsedTransaction(const Transaction &transaction, const EndorsementCertificate &certificate);
+
+        /**
+         * \brief Forwards a transaction whose endorsement quorum is reached and updates the node stats
+         * \param transId the id of the transaction
+         */
+        void CompleteEndorsement(int transId);
+
+        /**
+         * \brief Gives up on a transaction that could not reach its quorum
+         * \param transId the id of the transaction
+         * \param reason what went wrong, for the log
+         */
+        void FailEndorsement(int transId, const std::string &reason);
+
+        /**
+         * \brief Called at the deadline of a transaction; fails it if it is still open
+         * \param transId the id of the transaction
+         */
+        void ExpireEndorsement(int transId);
+
+        /**
+         * \brief Takes a RELAY_BLOCK: confirms the transactions of its block, acknowledges it to the
+         *        cloud server and forwards it to this node's children in the overlay tree
+         * \param d the RELAY_BLOCK, its hop and send time are rewritten for the children
+         * \param bytes the size of the RELAY_BLOCK as received
+         */
+        void RelayBlock(rapidjson::Document &d, uint32_t bytes);
+
+        /**
+         * \brief Acknowledges a block of the overlay tree, or of its shreds, to the cloud server that sent it
+         * \param origin the node id of the cloud server
+         * \param round the round of the block
+         * \param hops the hops the block, or the shred that completed it, took from the cloud server
+         * \param disseminatedAt the time the cloud server sent the block
+         * \param sentAt the time of the last hop
+         * \param complete false if the node only got some of the shreds so far
+         */
+        void SendRelayAck(uint32_t origin, uint64_t round, uint32_t hops, double disseminatedAt, double sentAt, bool complete);
+
+        /**
+         * \brief Takes a SHRED: forwards it to this node's children in the tree of the shred at once, and
+         *        rebuilds the block as soon as enough shreds came; the shreds that had not come by then
+         *        are forwarded from the rebuilt block
+         * \param d the SHRED
+         * \param bytes the size of the SHRED as received
+         */
+        void ReceiveShred(const rapidjson::Document &d, uint32_t bytes);
+
+        /**
+         * \brief The SHRED of one shred of a block
+         * \param header what every shred of the block carries
+         * \param index the index of the shred, the data shreds first
+         * \param payload the bytes of the shred
+         * \param hop the hops the SHRED will have taken from the cloud server once it arrives
+         */
+        std::shared_ptr<const std::string> MakeShredMessage(const ShredHeader &header, uint32_t index,
+                                                            const std::vector<uint8_t> &payload, uint32_t hop);
+
+        /**
+         * \brief Sends a SHRED to a peer, unless ShredLossRate drops it on the way
+         * \param message the SHRED
+         * \param nodeId the node id of the peer
+         */
+        void SendShred(std::shared_ptr<const std::string> message, uint32_t nodeId);
+
+        /**
+         * \brief The children of a node in the tree of one shred
+         * \param header what every shred of the block carries
+         * \param index the index of the shred
+         * \param nodeId the node id
+         */
+        static std::vector<uint32_t> GetShredChildren(const ShredHeader &header, uint32_t index, uint32_t nodeId);
+
+        /**
+         * \brief Records the delays of a block this node received
+         * \param delay seconds from the block's time stamp
+         * \param hopDelay seconds of the last hop
+         * \param hops from the cloud server
+         * \param bytes of the message that carried the block
+         */
+        void RecordBlockReceipt(double delay, double hopDelay, uint32_t hops, uint32_t bytes);
+
+        /**
+         * \brief Announces the current public key to the cloud server and every peer with REGISTER_KEY
+         */
+        void RegisterKey(void);
+
+        /**
+         * \brief Attaches a finished signature to the endorsement and answers the requesting node
+         * \param job the signing job submitted from HandleRead
+         */
+        void CompleteSignature(std::shared_ptr<PendingSignature> job);
 
         bool HasResultTransaction(int rsuNodeId, int transId, double winnerId, int payment);
 
@@ -90,14 +350,17 @@ class RsuNode : public Application{
         Address m_nodeIp;
         Ptr<Node> m_node;
         Ptr<Socket> m_listenSocket;
-        Ptr<Socket> m_cloudServerSocket;
+        Ptr<Socket> m_cloudServerSocket;       // to the leader of the ordering cluster, as far as the node knows
         Ipv4Address m_cloudServerAddr;
+        std::map<uint32_t, Ipv4Address> m_cloudServerAddrs;
+        std::map<uint32_t, Ptr<Socket>> m_cloudServerSockets;
         int m_numberOfPeers;
         int m_transactionId;
-        int m_responseCount; // Count the number of valid responses from peers
         uint32_t m_winnerId;
         double m_payment;
         double m_transThreshold;
+        std::string m_contractFile;            // Rules of this node's contract, empty for SmartContract::DefaultSource
+        SmartContract m_contract;              // Checked on every REQUEST_TRANS before signing
         int m_totalOrdering;
         Blockchain m_blockchain;                   //The node's blockchain
         double m_meanOrderingTime;
@@ -106,13 +369,55 @@ class RsuNode : public Application{
         double m_meanBlockPropagationTime;     //The mean time that the node has to wait in order to receive a newly mined block
         double m_meanBlockSize;                //The mean Block size
         nodeStatistics *m_nodeStats;                       // Struct holding the node stats
-        double m_meanLatency;
+        double m_meanLatency;                  // mean time from creating a transaction to the block that orders it
         int m_totalCreatedTransaction;
-        double m_tStart;
-        double m_tFinish;
+        Time m_issueInterval;                  // Time between two transactions when the window is 0
+        uint32_t m_inFlightWindow;             // Transactions in flight at once, 0 issues at a fixed interval
+        Time m_orderingTimeout;                // Time an endorsed transaction may wait for its block, 0 for no deadline
+        bool m_issuing;
+        EventId m_nextIssueEvent;
+        long m_orderingTimeouts;
+        std::unordered_map<int, InFlightTransaction> m_inFlight;
+        bool m_openLoop;                       // Transactions come from SubmitTransaction
+        std::deque<std::pair<Time, double>> m_pendingArrivals;  // Arrival time and payment, waiting for a slot
+        long m_receivedArrivals;
+        Time m_cryptoDelay;                    // Simulated time between submitting a crypto job and using its result
+        uint32_t m_endorsementQuorum;          // Signatures a transaction needs, 0 for every peer
+        Time m_endorsementTimeout;             // Time a transaction may wait for its quorum, 0 for no deadline
+        double m_meanEndorsementTime;
+        long m_failedEndorsements;
+        Time m_backoffRecovery;                // Time a halved issue rate takes to climb back
+        double m_rateLimit;                    // Transactions per second right after the last cut, 0 for no limit
+        double m_rateBeforeCut;
+        Time m_rateCutAt;
+        Time m_resumeAt;                       // No transaction before, from the last retry-after
+        Time m_lastIssue;
+        double m_meanIssueGap;                 // seconds between two transactions of this node
+        long m_backpressureSignals;
+        long m_resentRequests;
+        std::set<std::string> m_receivedBlocks;  // Hashes of the blocks received, each is relayed once
+        long m_receivedBlockCount;
+        double m_meanHopDelay;
+        double m_meanBlockHops;
+        bool m_crashed;
+        double m_shredLossRate;                // Share of the SHREDs this node sends that are lost on the way
+        std::mt19937 m_lossRandom;
+        static const uint64_t SHRED_ROUNDS = 64;  // rounds of an origin behind its newest that are given up
+        std::map<std::pair<uint32_t, uint64_t>, ShredAssembly> m_shredAssemblies;  // by origin and round, until rebuilt
+        std::set<std::pair<uint32_t, uint64_t>> m_rebuiltShreds;  // by origin and round, later shreds are duplicates
+        std::map<uint32_t, uint64_t> m_newestShredRounds;  // by origin
+        long m_shredsReceived;
+        long m_duplicateShreds;
+        long m_shredsRecovered;                // forwarded from a rebuilt block, they never came
+        long m_shredsLost;
 
         std::vector<Transaction> m_resultTransaction;
         std::vector<Ipv4Address> m_peersAddresses;
+        std::vector<uint32_t> m_peerIds;
+        std::map<uint32_t, Ipv4Address> m_peerIdToAddress;
+        const EndorsementPolicy *m_endorsementPolicy;
+        enum CommitterType m_committerType;    // ENDORSER signs REQUEST_TRANS, COMMITTER ignores it
+        long m_endorsementRequests;            // REQUEST_TRANS sent, one per endorser per transaction
         std::map<Ipv4Address, Ptr<Socket>> m_peersSockets;
         std::map<Address, std::string> m_bufferedData;
         std::vector<Transaction> m_transaction;
@@ -121,6 +426,9 @@ class RsuNode : public Application{
         const int m_blockchainPort;
 
         long privateKey;
+        uint32_t m_keyEpoch;                   // Bumped each time the node takes a new key pair
+        KeyRegistry m_keyRegistry;             // Keys registered by the other nodes
+        EndorsementTracker m_endorsementTracker;  // Signatures collected per own transaction id
         const int m_headersSizeBytes;         //81Bytes
         double m_averageTransacionSize;        //The average transaction size, Needed for compressed blocks
         const int m_countBytes;               //The size of count variable in message, 4 Bytes
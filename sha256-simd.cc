@@ -0,0 +1,327 @@
+#include "sha256.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_X86 1
+#endif
+
+/*
+ * Accelerated SHA256 backends and the CPU dispatch between them.
+ *
+ * transformShaNi() runs the compression function on the SHA extensions, four
+ * rounds per sha256rnds2 pair, with the message schedule from sha256msg1/msg2.
+ *
+ * hashLanes<W>() hashes W messages at once, one per 32-bit lane, written with
+ * GCC vector extensions like ecdsa-simd.cc and instantiated for 8 lanes (AVX2)
+ * and 4 lanes (SSE2). Every lane runs the same rounds on its own block; a lane
+ * whose message has no block left still computes but adds nothing to its state,
+ * so messages of different lengths can share a group.
+ *
+ * SHA-NI is the default where the CPU has it: one message at a time it kept up
+ * with the AVX2 kernel on 32-byte messages and beat it on longer ones. Without
+ * it batches go to AVX2, or SSE2, and single messages to the portable loop.
+ */
+
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace {
+
+    template <int W>
+    struct Lanes
+    {
+        typedef unsigned int Vec __attribute__((vector_size(W * sizeof(unsigned int))));
+    };
+
+    template <class Vec>
+    __attribute__((always_inline)) inline Vec
+    rotr(Vec x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    inline unsigned int
+    loadBigEndian(const unsigned char *p)
+    {
+        return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+    }
+
+    inline void
+    storeBigEndian(unsigned int x, unsigned char *p)
+    {
+        p[0] = (unsigned char)(x >> 24);
+        p[1] = (unsigned char)(x >> 16);
+        p[2] = (unsigned char)(x >> 8);
+        p[3] = (unsigned char)x;
+    }
+
+}
+
+#ifdef SHA256_X86
+__attribute__((target("sha,sse4.1,ssse3")))
+#endif
+void
+SHA256::transformShaNi(uint32 *h, const unsigned char *message, unsigned int block_nb)
+{
+#ifdef SHA256_X86
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions keep the state as ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (unsigned int block = 0; block < block_nb; block++, message += SHA224_256_BLOCK_SIZE) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i msg[4];
+
+        for (int i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(message + 16 * i)), byteSwap);
+        }
+
+        // msg[] is a ring of the last four groups of four schedule words
+        #pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            if (i >= 4) {
+                __m128i w7 = _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4);
+                msg[i & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(_mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]), w7), msg[(i + 3) & 3]);
+            }
+            tmp = _mm_add_epi32(msg[i & 3], _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i *)&h[0], _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i *)&h[4], _mm_alignr_epi8(state1, tmp, 8));
+#else
+    transformScalar(h, message, block_nb);
+#endif
+}
+
+unsigned int
+SHA256::padTail(const unsigned char *message, unsigned int len, unsigned char *tail)
+{
+    unsigned int rem_len = len % SHA224_256_BLOCK_SIZE;
+    unsigned int tail_nb = rem_len < SHA224_256_BLOCK_SIZE - 8 ? 1 : 2;
+    uint64 len_b = (uint64)len << 3;
+
+    memset(tail, 0, tail_nb * SHA224_256_BLOCK_SIZE);
+    memcpy(tail, message + len - rem_len, rem_len);
+    tail[rem_len] = 0x80;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_nb * SHA224_256_BLOCK_SIZE - 1 - i] = (uint8)(len_b >> (8 * i));
+    }
+    return tail_nb;
+}
+
+template <int W>
+__attribute__((always_inline)) inline void
+SHA256::hashLanes(const unsigned char *const *messages, const unsigned int *lengths,
+                  unsigned int count, unsigned char *digests)
+{
+    typedef typename Lanes<W>::Vec Vec;
+
+    for (unsigned int first = 0; first < count; first += W) {
+        unsigned int lanes = count - first < (unsigned int)W ? count - first : W;
+        unsigned char tails[W][2 * SHA224_256_BLOCK_SIZE];
+        const unsigned char *message[W];
+        unsigned int full_nb[W];
+        unsigned int total_nb[W];
+        unsigned int max_nb = 0;
+
+        for (int lane = 0; lane < W; lane++) {
+            if ((unsigned int)lane < lanes) {
+                message[lane] = messages[first + lane];
+                full_nb[lane] = lengths[first + lane] / SHA224_256_BLOCK_SIZE;
+                total_nb[lane] = full_nb[lane] + padTail(message[lane], lengths[first + lane], tails[lane]);
+            }
+            else {
+                // Spare lanes hash a copy of lane 0 and are never stored
+                message[lane] = message[0];
+                full_nb[lane] = full_nb[0];
+                total_nb[lane] = 0;
+                memcpy(tails[lane], tails[0], sizeof(tails[lane]));
+            }
+            max_nb = total_nb[lane] > max_nb ? total_nb[lane] : max_nb;
+        }
+
+        Vec h[8];
+        for (int j = 0; j < 8; j++) {
+            h[j] = Vec{} + sha256_h0[j];
+        }
+
+        for (unsigned int block = 0; block < max_nb; block++) {
+            Vec w[16];
+            Vec active;
+            for (int lane = 0; lane < W; lane++) {
+                unsigned int b = block < total_nb[lane] ? block : 0;
+                const unsigned char *sub_block = b < full_nb[lane]
+                    ? message[lane] + (b << 6) : tails[lane] + ((b - full_nb[lane]) << 6);
+                for (int j = 0; j < 16; j++) {
+                    w[j][lane] = loadBigEndian(sub_block + (j << 2));
+                }
+                active[lane] = block < total_nb[lane] ? 0xffffffffu : 0;
+            }
+
+            Vec wv[8];
+            for (int j = 0; j < 8; j++) {
+                wv[j] = h[j];
+            }
+            for (int j = 0; j < 64; j++) {
+                if (j >= 16) {
+                    Vec w2 = w[(j - 2) & 15];
+                    Vec w15 = w[(j - 15) & 15];
+                    w[j & 15] += (rotr(w2, 17) ^ rotr(w2, 19) ^ (w2 >> 10)) + w[(j - 7) & 15]
+                               + (rotr(w15, 7) ^ rotr(w15, 18) ^ (w15 >> 3));
+                }
+                Vec t1 = wv[7] + (rotr(wv[4], 6) ^ rotr(wv[4], 11) ^ rotr(wv[4], 25))
+                       + ((wv[4] & wv[5]) ^ (~wv[4] & wv[6])) + sha256_k[j] + w[j & 15];
+                Vec t2 = (rotr(wv[0], 2) ^ rotr(wv[0], 13) ^ rotr(wv[0], 22))
+                       + ((wv[0] & wv[1]) ^ (wv[0] & wv[2]) ^ (wv[1] & wv[2]));
+                wv[7] = wv[6];
+                wv[6] = wv[5];
+                wv[5] = wv[4];
+                wv[4] = wv[3] + t1;
+                wv[3] = wv[2];
+                wv[2] = wv[1];
+                wv[1] = wv[0];
+                wv[0] = t1 + t2;
+            }
+            for (int j = 0; j < 8; j++) {
+                h[j] += wv[j] & active;
+            }
+        }
+
+        for (unsigned int lane = 0; lane < lanes; lane++) {
+            for (int j = 0; j < 8; j++) {
+                storeBigEndian(h[j][lane], digests + (first + lane) * DIGEST_SIZE + (j << 2));
+            }
+        }
+    }
+}
+
+void
+SHA256::hashLanes4(const unsigned char *const *messages, const unsigned int *lengths,
+                   unsigned int count, unsigned char *digests)
+{
+    hashLanes<4>(messages, lengths, count, digests);
+}
+
+#ifdef SHA256_X86
+__attribute__((target("avx2")))
+#endif
+void
+SHA256::hashLanes8(const unsigned char *const *messages, const unsigned int *lengths,
+                   unsigned int count, unsigned char *digests)
+{
+    hashLanes<8>(messages, lengths, count, digests);
+}
+
+void
+SHA256::hashSerial(TransformFunction transform, const unsigned char *message, unsigned int len, unsigned char *digest)
+{
+    uint32 h[8];
+    unsigned char tail[2 * SHA224_256_BLOCK_SIZE];
+
+    memcpy(h, sha256_h0, sizeof(h));
+    transform(h, message, len / SHA224_256_BLOCK_SIZE);
+    transform(h, tail, padTail(message, len, tail));
+    for (int j = 0; j < 8; j++) {
+        storeBigEndian(h[j], digest + (j << 2));
+    }
+}
+
+void
+SHA256::hashSerialScalar(const unsigned char *const *messages, const unsigned int *lengths,
+                         unsigned int count, unsigned char *digests)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        hashSerial(transformScalar, messages[i], lengths[i], digests + i * DIGEST_SIZE);
+    }
+}
+
+void
+SHA256::hashSerialShaNi(const unsigned char *const *messages, const unsigned int *lengths,
+                        unsigned int count, unsigned char *digests)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        hashSerial(transformShaNi, messages[i], lengths[i], digests + i * DIGEST_SIZE);
+    }
+}
+
+bool
+SHA256::cpuSupports(const std::string &name)
+{
+#ifdef SHA256_X86
+    if (name == "shani") {
+        return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+    }
+    if (name == "avx2") {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (name == "sse2") {
+        return true;
+    }
+#endif
+    return name == "scalar";
+}
+
+SHA256::Backend
+SHA256::backendByName(const std::string &name)
+{
+    if (name == "shani") {
+        return {"shani", transformShaNi, hashSerialShaNi};
+    }
+    if (name == "avx2") {
+        return {"avx2", transformScalar, hashLanes8};
+    }
+    if (name == "sse2") {
+        return {"sse2", transformScalar, hashLanes4};
+    }
+    return {"scalar", transformScalar, hashSerialScalar};
+}
+
+SHA256::Backend&
+SHA256::selectedBackend()
+{
+    static Backend backend = backendByName(cpuSupports("shani") ? "shani" : cpuSupports("avx2") ? "avx2"
+                                           : cpuSupports("sse2") ? "sse2" : "scalar");
+    return backend;
+}
+
+void
+SHA256::hashBatch(const unsigned char *const *messages, const unsigned int *lengths,
+                  unsigned int count, unsigned char *digests)
+{
+    selectedBackend().batch(messages, lengths, count, digests);
+}
+
+const char*
+SHA256::backendName()
+{
+    return selectedBackend().name;
+}
+
+bool
+SHA256::setBackend(const std::string &name)
+{
+    if (name == "auto") {
+        selectedBackend() = backendByName(cpuSupports("shani") ? "shani" : cpuSupports("avx2") ? "avx2"
+                                          : cpuSupports("sse2") ? "sse2" : "scalar");
+        return true;
+    }
+    if (!cpuSupports(name)) {
+        return false;
+    }
+    selectedBackend() = backendByName(name);
+    return true;
+}
@@ -21,7 +21,16 @@ const unsigned int SHA256::sha256_k[64] = //UL = uint32
              0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
              0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
 
+const unsigned int SHA256::sha256_h0[8] =
+            {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
 void SHA256::transform(const unsigned char *message, unsigned int block_nb)
+{
+    selectedBackend().transform(m_h, message, block_nb);
+}
+
+void SHA256::transformScalar(uint32 *h, const unsigned char *message, unsigned int block_nb)
 {
     uint32 w[64];
     uint32 wv[8];
@@ -38,7 +47,7 @@ void SHA256::transform(const unsigned char *message, unsigned int block_nb)
             w[j] =  SHA256_F4(w[j -  2]) + w[j -  7] + SHA256_F3(w[j - 15]) + w[j - 16];
         }
         for (j = 0; j < 8; j++) {
-            wv[j] = m_h[j];
+            wv[j] = h[j];
         }
         for (j = 0; j < 64; j++) {
             t1 = wv[7] + SHA256_F2(wv[4]) + SHA2_CH(wv[4], wv[5], wv[6])
@@ -54,21 +63,14 @@ void SHA256::transform(const unsigned char *message, unsigned int block_nb)
             wv[0] = t1 + t2;
         }
         for (j = 0; j < 8; j++) {
-            m_h[j] += wv[j];
+            h[j] += wv[j];
         }
     }
 }
 
 void SHA256::init()
 {
-    m_h[0] = 0x6a09e667;
-    m_h[1] = 0xbb67ae85;
-    m_h[2] = 0x3c6ef372;
-    m_h[3] = 0xa54ff53a;
-    m_h[4] = 0x510e527f;
-    m_h[5] = 0x9b05688c;
-    m_h[6] = 0x1f83d9ab;
-    m_h[7] = 0x5be0cd19;
+    memcpy(m_h, sha256_h0, sizeof(m_h));
     m_len = 0;
     m_tot_len = 0;
 }
@@ -93,14 +95,14 @@ void SHA256::update(const unsigned char *message, unsigned int len)
     rem_len = new_len % SHA224_256_BLOCK_SIZE;
     memcpy(m_block, &shifted_message[block_nb << 6], rem_len);
     m_len = rem_len;
-    m_tot_len += (block_nb + 1) << 6;
+    m_tot_len += (uint64) (block_nb + 1) << 6;
 }
 
 void SHA256::final(unsigned char *digest)
 {
     unsigned int block_nb;
     unsigned int pm_len;
-    unsigned int len_b;
+    uint64 len_b;
     int i;
     block_nb = (1 + ((SHA224_256_BLOCK_SIZE - 9)
                      < (m_len % SHA224_256_BLOCK_SIZE)));
@@ -108,7 +110,8 @@ void SHA256::final(unsigned char *digest)
     pm_len = block_nb << 6;
     memset(m_block + m_len, 0, pm_len - m_len);
     m_block[m_len] = 0x80;
-    SHA2_UNPACK32(len_b, m_block + pm_len - 4);
+    SHA2_UNPACK32((uint32) (len_b >> 32), m_block + pm_len - 8);
+    SHA2_UNPACK32((uint32) len_b, m_block + pm_len - 4);
     transform(m_block, block_nb);
     for (i = 0 ; i < 8; i++) {
         SHA2_UNPACK32(m_h[i], &digest[i << 2]);
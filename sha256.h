@@ -2,7 +2,18 @@
 #ifndef SHA256_H
 #define SHA256_H
 #include <string>
+#include <array>
+#include <cstdint>
 
+typedef std::array<uint8_t, 32> Sha256Digest;
+
+/*
+ * The compression function has three backends, picked once from the CPU:
+ * the portable loop, the SHA extensions (SHA-NI) for a single message, and
+ * a multi-buffer kernel that runs 8 (AVX2) or 4 (SSE2) independent messages
+ * in the lanes of one vector. init/update/final always hash one message and
+ * use SHA-NI when it is there; hashBatch() also uses the multi-buffer kernel.
+ */
 class SHA256
 {
 protected:
@@ -11,6 +22,7 @@ protected:
     typedef unsigned long long uint64;
 
     const static uint32 sha256_k[];
+    const static uint32 sha256_h0[];
     static const unsigned int SHA224_256_BLOCK_SIZE = (512/8);
 public:
     void init();
@@ -18,9 +30,59 @@ public:
     void final(unsigned char *digest);
     static const unsigned int DIGEST_SIZE = ( 256 / 8);
 
+    /*
+     * Hashes count messages in one call, message i into
+     * digests + i * DIGEST_SIZE.
+     */
+    static void hashBatch(const unsigned char *const *messages, const unsigned int *lengths,
+                          unsigned int count, unsigned char *digests);
+
+    /*
+     * The backend name is one of "shani", "avx2", "sse2" or "scalar".
+     * setBackend() forces one, or "auto" for the best this CPU runs, and
+     * returns false if the CPU lacks it. "avx2" and "sse2" only change
+     * hashBatch(); single messages then use the portable loop.
+     */
+    static const char* backendName();
+    static bool setBackend(const std::string &name);
+
 protected:
+    typedef void (*TransformFunction)(uint32 *h, const unsigned char *message, unsigned int block_nb);
+    typedef void (*BatchFunction)(const unsigned char *const *messages, const unsigned int *lengths,
+                                  unsigned int count, unsigned char *digests);
+
+    struct Backend
+    {
+        const char *name;
+        TransformFunction transform;
+        BatchFunction batch;
+    };
+
+    static bool cpuSupports(const std::string &name);
+    static Backend backendByName(const std::string &name);
+    static Backend& selectedBackend();
+
+    static void transformScalar(uint32 *h, const unsigned char *message, unsigned int block_nb);
+    static void transformShaNi(uint32 *h, const unsigned char *message, unsigned int block_nb);
+
+    // Copies the last partial block of a message and its padding into tail, returns the tail blocks
+    static unsigned int padTail(const unsigned char *message, unsigned int len, unsigned char *tail);
+    static void hashSerial(TransformFunction transform, const unsigned char *message, unsigned int len,
+                           unsigned char *digest);
+    static void hashSerialScalar(const unsigned char *const *messages, const unsigned int *lengths,
+                                 unsigned int count, unsigned char *digests);
+    static void hashSerialShaNi(const unsigned char *const *messages, const unsigned int *lengths,
+                                unsigned int count, unsigned char *digests);
+    static void hashLanes4(const unsigned char *const *messages, const unsigned int *lengths,
+                           unsigned int count, unsigned char *digests);
+    static void hashLanes8(const unsigned char *const *messages, const unsigned int *lengths,
+                           unsigned int count, unsigned char *digests);
+    template <int W>
+    static void hashLanes(const unsigned char *const *messages, const unsigned int *lengths,
+                          unsigned int count, unsigned char *digests);
+
     void transform(const unsigned char *message, unsigned int block_nb);
-    unsigned int m_tot_len;
+    uint64 m_tot_len;
     unsigned int m_len;
     unsigned char m_block[2*SHA224_256_BLOCK_SIZE];
     uint32 m_h[8];
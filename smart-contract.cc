@@ -0,0 +1,556 @@
+#include "smart-contract.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+namespace ns3 {
+
+    /*
+     * Recursive descent over one rule, emitting postfix code:
+     *     rule       := and ('||' and)*
+     *     and        := unary ('&&' unary)*
+     *     unary      := '!' unary | '(' rule ')' | 'true' | 'false' | comparison
+     *     comparison := operand ('<' | '<=' | '>' | '>=' | '==' | '!=') operand
+     *     operand    := field | constant | number
+     */
+    class SmartContract::Parser
+    {
+        public:
+            Parser(const std::string &text, const std::map<std::string, double> &constants, std::vector<Instruction> &code)
+                : m_text(text), m_position(0), m_constants(constants), m_code(code), m_depth(0), m_maxDepth(0)
+            {
+            }
+
+            bool ParseRule(std::string &error)
+            {
+                if (!ParseOr(error))
+                {
+                    return false;
+                }
+                SkipSpaces();
+                if (m_position != m_text.size())
+                {
+                    error = "unexpected '" + m_text.substr(m_position) + "'";
+                    return false;
+                }
+                return true;
+            }
+
+            uint32_t GetMaxDepth(void) const
+            {
+                return m_maxDepth;
+            }
+
+        protected:
+            bool ParseOr(std::string &error)
+            {
+                if (!ParseAnd(error))
+                {
+                    return false;
+                }
+                while (Accept("||"))
+                {
+                    if (!ParseAnd(error))
+                    {
+                        return false;
+                    }
+                    Emit(OR);
+                }
+                return true;
+            }
+
+            bool ParseAnd(std::string &error)
+            {
+                if (!ParseUnary(error))
+                {
+                    return false;
+                }
+                while (Accept("&&"))
+                {
+                    if (!ParseUnary(error))
+                    {
+                        return false;
+                    }
+                    Emit(AND);
+                }
+                return true;
+            }
+
+            bool ParseUnary(std::string &error)
+            {
+                if (Accept("!"))
+                {
+                    if (!ParseUnary(error))
+                    {
+                        return false;
+                    }
+                    Emit(NOT);
+                    return true;
+                }
+                if (Accept("("))
+                {
+                    if (!ParseOr(error))
+                    {
+                        return false;
+                    }
+                    if (!Accept(")"))
+                    {
+                        error = "missing ')'";
+                        return false;
+                    }
+                    return true;
+                }
+                if (AcceptWord("true"))
+                {
+                    Emit(PUSH_TRUE);
+                    return true;
+                }
+                if (AcceptWord("false"))
+                {
+                    Emit(PUSH_TRUE);
+                    Emit(NOT);
+                    return true;
+                }
+                return ParseComparison(error);
+            }
+
+            bool ParseComparison(std::string &error)
+            {
+                uint8_t lhs, rhs;
+                double lhsValue, rhsValue;
+                if (!ParseOperand(lhs, lhsValue, error))
+                {
+                    return false;
+                }
+
+                // Two-character operators first
+                static const char *operators[] = {"<=", ">=", "==", "!=", "<", ">"};
+                static const uint8_t opCodes[] = {LESS_EQUAL, GREATER_EQUAL, EQUAL, NOT_EQUAL, LESS, GREATER};
+                int found = -1;
+                for (int i = 0; i < 6 && found < 0; i++)
+                {
+                    if (Accept(operators[i]))
+                    {
+                        found = i;
+                    }
+                }
+                if (found < 0)
+                {
+                    error = "expected a comparison after an operand";
+                    return false;
+                }
+                uint8_t op = opCodes[found];
+
+                if (!ParseOperand(rhs, rhsValue, error))
+                {
+                    return false;
+                }
+
+                Instruction instruction;
+                if (lhs == NUMBER_OF_FIELDS && rhs == NUMBER_OF_FIELDS)
+                {
+                    // Both sides are known now
+                    Emit(PUSH_TRUE);
+                    if (!Compare(op, lhsValue, rhsValue))
+                    {
+                        Emit(NOT);
+                    }
+                    return true;
+                }
+                if (lhs == NUMBER_OF_FIELDS)
+                {
+                    // The field always goes left: 5 < payment is payment > 5
+                    static const uint8_t mirrored[] = {GREATER, GREATER_EQUAL, LESS, LESS_EQUAL, EQUAL, NOT_EQUAL};
+                    op = mirrored[op];
+                    std::swap(lhs, rhs);
+                    std::swap(lhsValue, rhsValue);
+                }
+                instruction.op = op;
+                instruction.lhs = lhs;
+                instruction.rhs = rhs;
+                instruction.constant = rhsValue;
+                m_code.push_back(instruction);
+                Push(1);
+                return true;
+            }
+
+            /*
+             * field is NUMBER_OF_FIELDS for a number or a constant, whose value goes in value.
+             */
+            bool ParseOperand(uint8_t &field, double &value, std::string &error)
+            {
+                SkipSpaces();
+                field = NUMBER_OF_FIELDS;
+                value = 0;
+
+                std::string word = ReadWord();
+                if (!word.empty())
+                {
+                    static const char *fields[] = {"payment", "timestamp", "winnerId", "rsuNodeId", "transId"};
+                    for (uint8_t i = 0; i < NUMBER_OF_FIELDS; i++)
+                    {
+                        if (word == fields[i])
+                        {
+                            field = i;
+                            return true;
+                        }
+                    }
+                    std::map<std::string, double>::const_iterator it = m_constants.find(word);
+                    if (it == m_constants.end())
+                    {
+                        error = "unknown name '" + word + "'";
+                        return false;
+                    }
+                    value = it->second;
+                    return true;
+                }
+
+                const char *start = m_text.c_str() + m_position;
+                char *end;
+                value = strtod(start, &end);
+                if (end == start)
+                {
+                    error = "expected a field, a constant or a number at '" + m_text.substr(m_position) + "'";
+                    return false;
+                }
+                m_position += end - start;
+                return true;
+            }
+
+            std::string ReadWord(void)
+            {
+                size_t end = m_position;
+                if (end < m_text.size() && (isalpha(m_text[end]) || m_text[end] == '_'))
+                {
+                    while (end < m_text.size() && (isalnum(m_text[end]) || m_text[end] == '_'))
+                    {
+                        end++;
+                    }
+                }
+                std::string word = m_text.substr(m_position, end - m_position);
+                m_position = end;
+                return word;
+            }
+
+            bool Accept(const char *token)
+            {
+                SkipSpaces();
+                size_t length = strlen(token);
+                if (m_text.compare(m_position, length, token) == 0)
+                {
+                    m_position += length;
+                    return true;
+                }
+                return false;
+            }
+
+            bool AcceptWord(const char *word)
+            {
+                SkipSpaces();
+                size_t saved = m_position;
+                if (ReadWord() == word)
+                {
+                    return true;
+                }
+                m_position = saved;
+                return false;
+            }
+
+            void SkipSpaces(void)
+            {
+                while (m_position < m_text.size() && isspace(m_text[m_position]))
+                {
+                    m_position++;
+                }
+            }
+
+            void Emit(uint8_t op)
+            {
+                Instruction instruction;
+                instruction.op = op;
+                instruction.lhs = NUMBER_OF_FIELDS;
+                instruction.rhs = NUMBER_OF_FIELDS;
+                instruction.constant = 0;
+                m_code.push_back(instruction);
+                Push(op == PUSH_TRUE ? 1 : (op == NOT ? 0 : -1));
+            }
+
+            void Push(int delta)
+            {
+                m_depth += delta;
+                m_maxDepth = std::max(m_maxDepth, m_depth);
+            }
+
+            const std::string &m_text;
+            size_t m_position;
+            const std::map<std::string, double> &m_constants;
+            std::vector<Instruction> &m_code;
+            uint32_t m_depth;
+            uint32_t m_maxDepth;
+    };
+
+    SmartContract::SmartContract(void)
+    {
+        Instruction accept = {PUSH_TRUE, NUMBER_OF_FIELDS, NUMBER_OF_FIELDS, 0};
+        m_code.push_back(accept);
+    }
+
+    SmartContract::~SmartContract(void)
+    {
+    }
+
+    std::string
+    SmartContract::DefaultSource(void)
+    {
+        return "const maxPayment = 100000\n"
+               "const maxTimestamp = 1000000000\n"
+               "payment >= threshold && payment < maxPayment\n"
+               "timestamp >= 0 && timestamp < maxTimestamp\n";
+    }
+
+    bool
+    SmartContract::Compile(const std::string &source, const std::map<std::string, double> &constants, std::string &error)
+    {
+        std::map<std::string, double> names = constants;
+        std::vector<Instruction> code;
+        uint32_t rules = 0;
+
+        std::istringstream lines(source);
+        std::string line;
+        for (uint32_t number = 1; std::getline(lines, line); number++)
+        {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+
+            std::ostringstream where;
+            where << "line " << number << ": ";
+
+            std::istringstream words(line);
+            std::string keyword, name, equals;
+            words >> keyword;
+            if (keyword == "const")
+            {
+                double value;
+                if (!(words >> name >> equals >> value) || equals != "=")
+                {
+                    error = where.str() + "expected const <name> = <number>";
+                    return false;
+                }
+                names[name] = value;
+                continue;
+            }
+
+            Parser parser(line, names, code);
+            std::string parseError;
+            if (!parser.ParseRule(parseError))
+            {
+                error = where.str() + parseError;
+                return false;
+            }
+            // One more entry for the rules before this one
+            if (parser.GetMaxDepth() + 1 > MAX_STACK_DEPTH)
+            {
+                error = where.str() + "the rule is nested too deeply";
+                return false;
+            }
+            if (rules++ > 0)
+            {
+                Instruction all = {AND, NUMBER_OF_FIELDS, NUMBER_OF_FIELDS, 0};
+                code.push_back(all);
+            }
+        }
+
+        if (rules == 0)
+        {
+            Instruction accept = {PUSH_TRUE, NUMBER_OF_FIELDS, NUMBER_OF_FIELDS, 0};
+            code.push_back(accept);
+        }
+
+        m_code.swap(code);
+        m_source = source;
+        return true;
+    }
+
+    bool
+    SmartContract::LoadFile(const std::string &path, const std::map<std::string, double> &constants, std::string &error)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            error = "could not open " + path;
+            return false;
+        }
+        std::stringstream source;
+        source << file.rdbuf();
+        return Compile(source.str(), constants, error);
+    }
+
+    void
+    SmartContract::Load(const Transaction &transaction, double *fields)
+    {
+        fields[PAYMENT] = transaction.GetPayment();
+        fields[TIMESTAMP] = transaction.GetTransTimeStamp();
+        fields[WINNER_ID] = transaction.GetWinnerId();
+        fields[RSU_NODE_ID] = transaction.GetRsuNodeId();
+        fields[TRANS_ID] = transaction.GetTransId();
+    }
+
+    bool
+    SmartContract::Compare(uint8_t op, double lhs, double rhs)
+    {
+        switch (op)
+        {
+            case LESS: return lhs < rhs;
+            case LESS_EQUAL: return lhs <= rhs;
+            case GREATER: return lhs > rhs;
+            case GREATER_EQUAL: return lhs >= rhs;
+            case EQUAL: return lhs == rhs;
+            case NOT_EQUAL: return lhs != rhs;
+        }
+        return false;
+    }
+
+    bool
+    SmartContract::Evaluate(const Transaction &transaction) const
+    {
+        double fields[NUMBER_OF_FIELDS];
+        Load(transaction, fields);
+
+        bool stack[MAX_STACK_DEPTH];
+        uint32_t top = 0;
+        for (const Instruction &instruction : m_code)
+        {
+            switch (instruction.op)
+            {
+                case AND:
+                    top--;
+                    stack[top - 1] = stack[top - 1] && stack[top];
+                    break;
+                case OR:
+                    top--;
+                    stack[top - 1] = stack[top - 1] || stack[top];
+                    break;
+                case NOT:
+                    stack[top - 1] = !stack[top - 1];
+                    break;
+                case PUSH_TRUE:
+                    stack[top++] = true;
+                    break;
+                default:
+                    stack[top++] = Compare(instruction.op, fields[instruction.lhs],
+                                           instruction.rhs == NUMBER_OF_FIELDS ? instruction.constant : fields[instruction.rhs]);
+                    break;
+            }
+        }
+        return stack[0];
+    }
+
+    template <uint8_t OP>
+    uint64_t
+    SmartContract::CompareLanes(const double *lhs, const double *rhs, double constant, size_t lanes)
+    {
+        unsigned char bits[64];
+        for (size_t i = 0; i < 64; i++)
+        {
+            bits[i] = Compare(OP, lhs[i], rhs ? rhs[i] : constant);
+        }
+        uint64_t mask = 0;
+        for (size_t i = 0; i < lanes; i++)
+        {
+            mask |= (uint64_t)bits[i] << i;
+        }
+        return mask;
+    }
+
+    void
+    SmartContract::Evaluate(const Transaction *transactions, size_t count, bool *results) const
+    {
+        // One column per field, 64 transactions per pass; lanes past count hold zeros
+        double columns[NUMBER_OF_FIELDS][64];
+        uint64_t stack[MAX_STACK_DEPTH];
+
+        for (size_t first = 0; first < count; first += 64)
+        {
+            size_t lanes = std::min<size_t>(64, count - first);
+            for (size_t i = 0; i < 64; i++)
+            {
+                double fields[NUMBER_OF_FIELDS] = {0};
+                if (i < lanes)
+                {
+                    Load(transactions[first + i], fields);
+                }
+                for (uint32_t f = 0; f < NUMBER_OF_FIELDS; f++)
+                {
+                    columns[f][i] = fields[f];
+                }
+            }
+
+            uint32_t top = 0;
+            for (const Instruction &instruction : m_code)
+            {
+                const double *lhs = columns[instruction.lhs < NUMBER_OF_FIELDS ? instruction.lhs : 0];
+                const double *rhs = instruction.rhs < NUMBER_OF_FIELDS ? columns[instruction.rhs] : nullptr;
+                switch (instruction.op)
+                {
+                    case AND:
+                        top--;
+                        stack[top - 1] &= stack[top];
+                        break;
+                    case OR:
+                        top--;
+                        stack[top - 1] |= stack[top];
+                        break;
+                    case NOT:
+                        stack[top - 1] = ~stack[top - 1];
+                        break;
+                    case PUSH_TRUE:
+                        stack[top++] = ~(uint64_t)0;
+                        break;
+                    case LESS:
+                        stack[top++] = CompareLanes<LESS>(lhs, rhs, instruction.constant, lanes);
+                        break;
+                    case LESS_EQUAL:
+                        stack[top++] = CompareLanes<LESS_EQUAL>(lhs, rhs, instruction.constant, lanes);
+                        break;
+                    case GREATER:
+                        stack[top++] = CompareLanes<GREATER>(lhs, rhs, instruction.constant, lanes);
+                        break;
+                    case GREATER_EQUAL:
+                        stack[top++] = CompareLanes<GREATER_EQUAL>(lhs, rhs, instruction.constant, lanes);
+                        break;
+                    case EQUAL:
+                        stack[top++] = CompareLanes<EQUAL>(lhs, rhs, instruction.constant, lanes);
+                        break;
+                    case NOT_EQUAL:
+                        stack[top++] = CompareLanes<NOT_EQUAL>(lhs, rhs, instruction.constant, lanes);
+                        break;
+                }
+            }
+
+            for (size_t i = 0; i < lanes; i++)
+            {
+                results[first + i] = (stack[0] >> i) & 1;
+            }
+        }
+    }
+
+    const std::string&
+    SmartContract::GetSource(void) const
+    {
+        return m_source;
+    }
+
+    uint32_t
+    SmartContract::GetNumberOfInstructions(void) const
+    {
+        return m_code.size();
+    }
+
+}
@@ -0,0 +1,106 @@
+#ifndef SMART_CONTRACT_H
+#define SMART_CONTRACT_H
+
+#include "blockchain.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * The rules an endorser checks before it signs a transaction.
+     *
+     * A contract is text, one rule per line, and a transaction passes when every rule
+     * holds. A rule compares the fields of the transaction (payment, timestamp,
+     * winnerId, rsuNodeId, transId), numbers and named constants, and combines the
+     * comparisons with &&, || and !:
+     *
+     *     # the default contract
+     *     const maxPayment = 100000
+     *     payment >= threshold && payment < maxPayment
+     *     timestamp >= 0 && timestamp < 1000000000
+     *
+     * Constants are fixed when the contract is compiled, `threshold` comes from the node.
+     * The rules compile to postfix bytecode whose stack depth is known, so Evaluate
+     * allocates nothing. The batch Evaluate runs each instruction over 64 transactions
+     * at a time: comparisons fill one bit per transaction in a loop the compiler can
+     * vectorize and the logic operators are single 64-bit operations.
+     */
+    class SmartContract
+    {
+        public:
+            enum Field
+            {
+                PAYMENT,
+                TIMESTAMP,
+                WINNER_ID,
+                RSU_NODE_ID,
+                TRANS_ID,
+                NUMBER_OF_FIELDS,
+            };
+
+            static const uint32_t MAX_STACK_DEPTH = 32;
+
+            SmartContract(void);
+            virtual ~SmartContract(void);
+
+            /*
+             * The rules of the original hard-coded check; they need the constant threshold.
+             */
+            static std::string DefaultSource(void);
+
+            /*
+             * Compiles the rules; on a syntax error returns false, keeps the previous
+             * contract and describes the problem in error.
+             */
+            bool Compile(const std::string &source, const std::map<std::string, double> &constants, std::string &error);
+            bool LoadFile(const std::string &path, const std::map<std::string, double> &constants, std::string &error);
+
+            bool Evaluate(const Transaction &transaction) const;
+            void Evaluate(const Transaction *transactions, size_t count, bool *results) const;
+
+            const std::string& GetSource(void) const;
+            uint32_t GetNumberOfInstructions(void) const;
+
+        protected:
+            enum OpCode
+            {
+                LESS,
+                LESS_EQUAL,
+                GREATER,
+                GREATER_EQUAL,
+                EQUAL,
+                NOT_EQUAL,
+                AND,
+                OR,
+                NOT,
+                PUSH_TRUE,
+            };
+
+            /*
+             * A comparison reads field lhs, and field rhs or the constant if rhs is NUMBER_OF_FIELDS.
+             */
+            struct Instruction
+            {
+                uint8_t op;
+                uint8_t lhs;
+                uint8_t rhs;
+                double constant;
+            };
+
+            class Parser;
+
+            static void Load(const Transaction &transaction, double *fields);
+            static bool Compare(uint8_t op, double lhs, double rhs);
+            template <uint8_t OP>
+            static uint64_t CompareLanes(const double *lhs, const double *rhs, double constant, size_t lanes);
+
+            std::vector<Instruction> m_code;
+            std::string m_source;
+    };
+
+}
+
+#endif /* SMART_CONTRACT_H */
@@ -13,16 +13,24 @@
 #include <sys/time.h>
 #include "topology-helper.h"
 #include "ipv4-address-helper-custom.h"
+#include "endorsement-policy.h"
 
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("TopologyHelper");
 
-TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId): m_numberOfRsu(numberOfRsu), m_cloudServerId (cloudServerId), m_totalNoLinks (0)
+TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId, uint32_t numberOfCloudServers, Time cloudServerDelay): m_numberOfRsu(numberOfRsu), m_cloudServerId (cloudServerId), m_totalNoLinks (0), m_numberOfShards (1)
 	{
 
-		uint32_t totalNodes = m_numberOfRsu + 1; //include all rsu nodes and one cloud server node
+		uint32_t totalNodes = m_numberOfRsu + std::max(numberOfCloudServers, 1u); //include all rsu nodes and the cloud servers
+
+		// The first cloud server keeps its id, the others come after the rsu nodes
+		m_cloudServerIds.push_back(m_cloudServerId);
+		for (uint32_t id = m_numberOfRsu + 1; id < totalNodes; id++)
+		{
+			m_cloudServerIds.push_back(id);
+		}
 
 		for(uint32_t i = 0; i < totalNodes; i++)
 		{
@@ -39,6 +47,10 @@ TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId): m
 		pointToPoint.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
   		pointToPoint.SetChannelAttribute("Delay", StringValue("2ms"));
 
+		PointToPointHelper clusterPointToPoint;
+		clusterPointToPoint.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
+		clusterPointToPoint.SetChannelAttribute("Delay", TimeValue(cloudServerDelay));
+
 		for (uint32_t i = 0; i < totalNodes; i++)
 		{
 			NodeContainer currentNode;
@@ -53,13 +65,17 @@ TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId): m
 				if(*it > node.first) {
 					m_totalNoLinks++;
 					NetDeviceContainer newDevices;
-					newDevices.Add (pointToPoint.Install (m_nodes.at(node.first).Get(0),m_nodes.at (*it).Get (0)));
+					PointToPointHelper &link = IsCloudServer(node.first) && IsCloudServer(*it) ? clusterPointToPoint : pointToPoint;
+					newDevices.Add (link.Install (m_nodes.at(node.first).Get(0),m_nodes.at (*it).Get (0)));
 					m_devices.push_back (newDevices);
 				}
 			}
 		}
 
 		NS_LOG_INFO("\nThe total number of links is: " << m_totalNoLinks);
+
+		SetNumberOfRegions(1);
+		SetShards(1, SHARD_BY_HASH);
 	}
 
 	TopologyHelper::~TopologyHelper ()
@@ -88,6 +104,13 @@ TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId): m
 	{
 		NS_LOG_FUNCTION(this);
 		
+		// A cloud server whose shard has no rsu node still runs
+		for (uint32_t id : m_cloudServerIds)
+		{
+			m_nodeToPeerConnectionsIps[id];
+			m_nodeToPeerConnectionsIds[id];
+		}
+
 		// Assign addresses to all devices in the network.
 		// These devices are stored in a vector. 
 		for (uint32_t i = 0; i < m_devices.size (); ++i)
@@ -103,15 +126,34 @@ TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId): m
 			uint32_t node1 = (currentContainer.Get (0))->GetNode()->GetId();
 			uint32_t node2 = (currentContainer.Get (1))->GetNode()->GetId();
 
-			if (node1 == m_cloudServerId){
-				m_nodeToPeerConnectionsIps[node1].push_back(interfaceAddress2);
-				m_nodeToCloudServerConnectionsIp[node2] = interfaceAddress1;
-			} else if (node2 == m_cloudServerId) {
-				m_nodeToPeerConnectionsIps[node2].push_back(interfaceAddress1);
-				m_nodeToCloudServerConnectionsIp[node1] = interfaceAddress2;
+			if (IsCloudServer(node1) && IsCloudServer(node2)) {
+				if (GetShard(node1) == GetShard(node2)) {
+					m_cloudServerToClusterIps[node1][node2] = interfaceAddress2;
+					m_cloudServerToClusterIps[node2][node1] = interfaceAddress1;
+				} else {
+					m_cloudServerToShardsIps[node1][GetShard(node2)][node2] = interfaceAddress2;
+					m_cloudServerToShardsIps[node2][GetShard(node1)][node1] = interfaceAddress1;
+				}
+			} else if (IsCloudServer(node1) || IsCloudServer(node2)){
+				uint32_t cloudServer = IsCloudServer(node1) ? node1 : node2;
+				uint32_t rsu = IsCloudServer(node1) ? node2 : node1;
+				Ipv4Address cloudServerIp = IsCloudServer(node1) ? interfaceAddress1 : interfaceAddress2;
+				Ipv4Address rsuIp = IsCloudServer(node1) ? interfaceAddress2 : interfaceAddress1;
+
+				// Every cloud server learns the key of every rsu node, only those of its shard order its requests
+				m_nodeToCloudServersIps[rsu][cloudServer] = cloudServerIp;
+				if (GetShard(cloudServer) == GetShard(rsu)) {
+					m_nodeToPeerConnectionsIps[cloudServer].push_back(rsuIp);
+					m_nodeToPeerConnectionsIds[cloudServer].push_back(rsu);
+					if (cloudServer == GetShardCloudServerIds(GetShard(rsu)).front()) {
+						m_nodeToCloudServerConnectionsIp[rsu] = cloudServerIp;
+					}
+				}
 			} else {
 				m_nodeToPeerConnectionsIps[node1].push_back(interfaceAddress2);
 				m_nodeToPeerConnectionsIps[node2].push_back(interfaceAddress1);
+				m_nodeToPeerConnectionsIds[node1].push_back(node2);
+				m_nodeToPeerConnectionsIds[node2].push_back(node1);
 			}
 						 
 			ip.NewNetwork ();
@@ -138,12 +180,151 @@ TopologyHelper::TopologyHelper (uint32_t numberOfRsu, uint32_t cloudServerId): m
 		return m_nodeToPeerConnectionsIps;
 	}
 
+	std::map<uint32_t, std::vector<uint32_t>>
+	TopologyHelper::GetNodeToPeerConnectionsIds (void) const
+	{
+		return m_nodeToPeerConnectionsIds;
+	}
+
+	void
+	TopologyHelper::SetNumberOfRegions (uint32_t numberOfRegions)
+	{
+		NS_LOG_FUNCTION(this);
+
+		// The rsu nodes are dealt to the regions in turn, the cloud server has none
+		if (numberOfRegions == 0)
+		{
+			numberOfRegions = 1;
+		}
+		m_rsuNodesRegion.clear();
+		uint32_t count = 0;
+		for (uint32_t id = 0; id <= m_numberOfRsu; id++)
+		{
+			if (id != m_cloudServerId)
+			{
+				m_rsuNodesRegion[id] = getBlockchainEnum(count++ % numberOfRegions);
+			}
+		}
+	}
+
+	std::map<uint32_t, enum BlockchainRegion>
+	TopologyHelper::GetRsuNodesRegions (void) const
+	{
+		return m_rsuNodesRegion;
+	}
+
 		std::map<uint32_t, Ipv4Address>
 	TopologyHelper::GetNodeToCloudServerConnectionsIp (void) const
 	{
 		return m_nodeToCloudServerConnectionsIp;
 	}
 
+	std::vector<uint32_t>
+	TopologyHelper::GetCloudServerIds (void) const
+	{
+		return m_cloudServerIds;
+	}
+
+	bool
+	TopologyHelper::IsCloudServer (uint32_t id) const
+	{
+		return std::find(m_cloudServerIds.begin(), m_cloudServerIds.end(), id) != m_cloudServerIds.end();
+	}
+
+	std::map<uint32_t, std::map<uint32_t, Ipv4Address>>
+	TopologyHelper::GetNodeToCloudServersIps (void) const
+	{
+		return m_nodeToCloudServersIps;
+	}
+
+	std::map<uint32_t, std::map<uint32_t, Ipv4Address>>
+	TopologyHelper::GetCloudServerToClusterIps (void) const
+	{
+		return m_cloudServerToClusterIps;
+	}
+
+	void
+	TopologyHelper::SetShards (uint32_t numberOfShards, enum ShardPartition partition)
+	{
+		NS_LOG_FUNCTION(this);
+
+		m_numberOfShards = std::max(std::min(numberOfShards, (uint32_t)m_cloudServerIds.size()), 1u);
+		uint32_t serversPerShard = m_cloudServerIds.size() / m_numberOfShards;
+
+		m_nodesShard.clear();
+		for (uint32_t i = 0; i < m_cloudServerIds.size(); i++)
+		{
+			m_nodesShard[m_cloudServerIds[i]] = std::min(i / serversPerShard, m_numberOfShards - 1);
+		}
+		for (auto &rsu : m_rsuNodesRegion)
+		{
+			uint64_t key = partition == SHARD_BY_REGION ? (uint64_t)rsu.second : EndorsementPolicy::Mix(rsu.first);
+			m_nodesShard[rsu.first] = key % m_numberOfShards;
+		}
+	}
+
+	uint32_t
+	TopologyHelper::GetNumberOfShards (void) const
+	{
+		return m_numberOfShards;
+	}
+
+	uint32_t
+	TopologyHelper::GetShard (uint32_t id) const
+	{
+		auto shard = m_nodesShard.find(id);
+		return shard != m_nodesShard.end() ? shard->second : 0;
+	}
+
+	std::vector<uint32_t>
+	TopologyHelper::GetShardCloudServerIds (uint32_t shardId) const
+	{
+		std::vector<uint32_t> ids;
+		for (uint32_t id : m_cloudServerIds)
+		{
+			if (GetShard(id) == shardId)
+			{
+				ids.push_back(id);
+			}
+		}
+		return ids;
+	}
+
+	std::map<uint32_t, std::map<uint32_t, std::map<uint32_t, Ipv4Address>>>
+	TopologyHelper::GetCloudServerToShardsIps (void) const
+	{
+		return m_cloudServerToShardsIps;
+	}
+
+	bool
+	TopologyHelper::ParseShardPartition (const std::string &name, enum ShardPartition &partition)
+	{
+		if (name == "hash")
+		{
+			partition = SHARD_BY_HASH;
+		}
+		else if (name == "region")
+		{
+			partition = SHARD_BY_REGION;
+		}
+		else
+		{
+			return false;
+		}
+		return true;
+	}
+
+	const char*
+	TopologyHelper::GetShardPartitionName (enum ShardPartition partition)
+	{
+		switch (partition)
+		{
+			case SHARD_BY_HASH: return "hash";
+			case SHARD_BY_REGION: return "region";
+		}
+		return "unknown";
+	}
+
 	Ptr<Node> 
 	TopologyHelper::GetNode (uint32_t id)
 	{
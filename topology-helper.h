@@ -8,17 +8,37 @@
 #include "ns3/ipv4-interface-container.h"
 #include "ns3/ipv6-interface-container.h"
 #include "ns3/net-device-container.h"
+#include "ns3/nstime.h"
 #include <random>
+#include <string>
 #include <vector>
 #include "ipv4-address-helper-custom.h"
+#include "blockchain.h"
 
 
 namespace ns3 {
+
+    /*
+     * How the rsu nodes are split over the shards of the ordering service.
+     */
+    enum ShardPartition
+    {
+        SHARD_BY_HASH,          // a hash of the node id
+        SHARD_BY_REGION,        // the region of the node, modulo the shards
+    };
+
     class TopologyHelper {
         public: 
 
 
-        TopologyHelper (uint32_t numberOfRsu, uint32_t m_cloudServerId);
+        /**
+         * \brief Every node is linked to every other one
+         * \param numberOfCloudServers the cloud servers of the ordering cluster, the first is
+         *        cloudServerId and the others take the ids after the rsu nodes
+         * \param cloudServerDelay the delay of the links between two cloud servers
+         */
+        TopologyHelper (uint32_t numberOfRsu, uint32_t m_cloudServerId, uint32_t numberOfCloudServers = 1,
+                        Time cloudServerDelay = MilliSeconds(2));
 
         ~TopologyHelper ();
 
@@ -28,16 +48,45 @@ namespace ns3 {
         void AssignIpv4Addresses (Ipv4AddressHelperCustom ip);
         Ipv4InterfaceContainer GetIpv4InterfaceContainer (void) const;
         std::map<uint32_t, std::vector<Ipv4Address>> GetNodeToPeerConnectionsIps (void) const;
+        std::map<uint32_t, std::vector<uint32_t>> GetNodeToPeerConnectionsIds (void) const;   //!< same order as the ips
+        void SetNumberOfRegions (uint32_t numberOfRegions);
+        std::map<uint32_t, enum BlockchainRegion> GetRsuNodesRegions (void) const;
         std::map<uint32_t, Ipv4Address> GetNodeToCloudServerConnectionsIp (void) const;
+        std::vector<uint32_t> GetCloudServerIds (void) const;
+        bool IsCloudServer (uint32_t id) const;
+        std::map<uint32_t, std::map<uint32_t, Ipv4Address>> GetNodeToCloudServersIps (void) const;     //!< key = rsu node id, then cloud server id
+        std::map<uint32_t, std::map<uint32_t, Ipv4Address>> GetCloudServerToClusterIps (void) const;   //!< key = cloud server id, then the other's id
+
+        /**
+         * \brief Splits the ordering service into shards, each with its own cluster of cloud
+         *        servers and chain; call it after SetNumberOfRegions and before AssignIpv4Addresses
+         * \param numberOfShards divides the cloud servers, which are dealt to the shards in
+         *        blocks of the same size, cloudServerId leading shard 0
+         */
+        void SetShards (uint32_t numberOfShards, enum ShardPartition partition);
+        uint32_t GetNumberOfShards (void) const;
+        uint32_t GetShard (uint32_t id) const;
+        std::vector<uint32_t> GetShardCloudServerIds (uint32_t shardId) const;
+        std::map<uint32_t, std::map<uint32_t, std::map<uint32_t, Ipv4Address>>> GetCloudServerToShardsIps (void) const;  //!< key = cloud server id, then shard id, then the other's id
+        static bool ParseShardPartition (const std::string &name, enum ShardPartition &partition);
+        static const char* GetShardPartitionName (enum ShardPartition partition);
 
 
         uint32_t     m_numberOfRsu;                  //!< The total number of nodes
         uint32_t     m_cloudServerId;
+        std::vector<uint32_t> m_cloudServerIds;       //!< m_cloudServerId first
         uint32_t     m_totalNoLinks; 
         std::vector<Ipv4InterfaceContainer>             m_interfaces;  
         std::map<uint32_t, std::vector<uint32_t>>       m_nodesConnections;        //!< key = nodeId
         std::map<uint32_t, std::vector<Ipv4Address>>    m_nodeToPeerConnectionsIps;     //!< key = nodeId
+        std::map<uint32_t, std::vector<uint32_t>>       m_nodeToPeerConnectionsIds;     //!< key = nodeId
+        std::map<uint32_t, enum BlockchainRegion>       m_rsuNodesRegion;          //!< key = nodeId
         std::map<uint32_t, Ipv4Address>   m_nodeToCloudServerConnectionsIp;     //!< key = nodeId
+        std::map<uint32_t, std::map<uint32_t, Ipv4Address>>  m_nodeToCloudServersIps;      //!< key = nodeId
+        std::map<uint32_t, std::map<uint32_t, Ipv4Address>>  m_cloudServerToClusterIps;    //!< key = nodeId
+        std::map<uint32_t, std::map<uint32_t, std::map<uint32_t, Ipv4Address>>>  m_cloudServerToShardsIps;    //!< key = nodeId
+        uint32_t     m_numberOfShards;
+        std::map<uint32_t, uint32_t>                    m_nodesShard;              //!< key = nodeId
         std::vector<NodeContainer>                      m_nodes;                   //!< all the nodes in the network
         std::vector<NetDeviceContainer>                 m_devices;                 //!< NetDevices in the network
 
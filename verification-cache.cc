@@ -0,0 +1,156 @@
+#include "verification-cache.h"
+
+namespace ns3 {
+
+    static bool
+    SameCheck(const SignatureCheck &a, const SignatureCheck &b)
+    {
+        return a.hashMsg == b.hashMsg && a.p == b.p && a.a == b.a && a.n == b.n && a.xG == b.xG && a.yG == b.yG &&
+               a.xQ == b.xQ && a.yQ == b.yQ && a.r == b.r && a.s == b.s;
+    }
+
+    VerificationCache::VerificationCache(void) : m_shards(new Shard[NUM_OF_SHARDS])
+    {
+        m_capacity = 0;
+        m_hits = 0;
+        m_misses = 0;
+        m_evictions = 0;
+        SetCapacity(0);
+    }
+
+    void
+    VerificationCache::SetCapacity(uint32_t capacity)
+    {
+        m_capacity = capacity;
+
+        for (uint32_t i = 0; i < NUM_OF_SHARDS; i++)
+        {
+            Shard &shard = m_shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            // The first shards take the remainder, so the capacities add up exactly
+            shard.capacity = capacity / NUM_OF_SHARDS + (i < capacity % NUM_OF_SHARDS ? 1 : 0);
+            shard.entries.clear();
+            shard.entries.reserve(shard.capacity);
+            shard.index.clear();
+            shard.index.reserve(shard.capacity);
+            shard.hand = 0;
+        }
+    }
+
+    uint32_t
+    VerificationCache::GetCapacity(void) const
+    {
+        return m_capacity;
+    }
+
+    uint64_t
+    VerificationCache::Digest(const SignatureCheck &check)
+    {
+        const long fields[] = {check.hashMsg, check.p, check.a, check.n, check.xG, check.yG,
+                               check.xQ, check.yQ, check.r, check.s};
+
+        // Each field goes through a splitmix64 round before it is folded in
+        uint64_t digest = 0x84222325CBF29CE4ULL;
+        for (long field : fields)
+        {
+            uint64_t x = digest + 0x9E3779B97F4A7C15ULL + (uint64_t)field;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            digest = x ^ (x >> 31);
+        }
+
+        return digest;
+    }
+
+    VerificationCache::Shard&
+    VerificationCache::GetShard(uint64_t digest)
+    {
+        return m_shards[digest % NUM_OF_SHARDS];
+    }
+
+    bool
+    VerificationCache::Lookup(const SignatureCheck &check, bool &isValid)
+    {
+        uint64_t digest = Digest(check);
+        Shard &shard = GetShard(digest);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(digest);
+        if (it == shard.index.end() || !SameCheck(shard.entries[it->second].check, check))
+        {
+            m_misses++;
+            return false;
+        }
+
+        Entry &entry = shard.entries[it->second];
+        entry.referenced = true;
+        isValid = entry.isValid;
+        m_hits++;
+        return true;
+    }
+
+    void
+    VerificationCache::Insert(const SignatureCheck &check, bool isValid)
+    {
+        uint64_t digest = Digest(check);
+        Shard &shard = GetShard(digest);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        if (shard.capacity == 0)
+        {
+            return;
+        }
+
+        // Same digest: refresh the slot in place, even for a colliding check
+        auto it = shard.index.find(digest);
+        if (it != shard.index.end())
+        {
+            Entry &entry = shard.entries[it->second];
+            entry.check = check;
+            entry.isValid = isValid;
+            entry.referenced = true;
+            return;
+        }
+
+        if (shard.entries.size() < shard.capacity)
+        {
+            shard.index[digest] = shard.entries.size();
+            shard.entries.push_back({digest, check, isValid, false});
+            return;
+        }
+
+        // CLOCK: clear reference bits until the hand finds an entry not used since its last pass
+        while (shard.entries[shard.hand].referenced)
+        {
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.capacity;
+        }
+
+        Entry &victim = shard.entries[shard.hand];
+        shard.index.erase(victim.digest);
+        victim = {digest, check, isValid, false};
+        shard.index[digest] = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.capacity;
+        m_evictions++;
+    }
+
+    long
+    VerificationCache::GetHits(void) const
+    {
+        return m_hits;
+    }
+
+    long
+    VerificationCache::GetMisses(void) const
+    {
+        return m_misses;
+    }
+
+    long
+    VerificationCache::GetEvictions(void) const
+    {
+        return m_evictions;
+    }
+
+}
@@ -0,0 +1,76 @@
+#ifndef VERIFICATION_CACHE_H
+#define VERIFICATION_CACHE_H
+
+#include "ecdsa.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Bounded cache of signature check results, keyed by a 64-bit digest of the
+     * public key, message hash and signature.
+     *
+     * Entries are spread over independently locked shards so worker threads can
+     * use it concurrently. Each shard evicts with CLOCK: a hit only sets a
+     * reference bit, and the hand gives every referenced entry a second chance
+     * before reusing its slot, which keeps lookups cheap under heavy churn. The
+     * full check is stored next to its result, so two checks sharing a digest
+     * never share a result.
+     */
+    class VerificationCache
+    {
+        public:
+            VerificationCache(void);
+
+            /*
+             * Drops every entry and keeps at most capacity results. Zero disables the cache.
+             */
+            void SetCapacity(uint32_t capacity);
+            uint32_t GetCapacity(void) const;
+
+            bool Lookup(const SignatureCheck &check, bool &isValid);
+            void Insert(const SignatureCheck &check, bool isValid);
+
+            static uint64_t Digest(const SignatureCheck &check);
+
+            long GetHits(void) const;
+            long GetMisses(void) const;
+            long GetEvictions(void) const;
+
+        protected:
+            struct Entry
+            {
+                uint64_t        digest;
+                SignatureCheck  check;
+                bool            isValid;
+                bool            referenced;
+            };
+
+            struct Shard
+            {
+                std::mutex                              mutex;
+                std::vector<Entry>                      entries;
+                std::unordered_map<uint64_t, uint32_t>  index;      // digest -> slot in entries
+                uint32_t                                capacity;
+                uint32_t                                hand;
+            };
+
+            static const uint32_t NUM_OF_SHARDS = 16;
+
+            Shard& GetShard(uint64_t digest);
+
+            std::unique_ptr<Shard[]>    m_shards;
+            uint32_t                    m_capacity;
+            std::atomic<long>           m_hits;
+            std::atomic<long>           m_misses;
+            std::atomic<long>           m_evictions;
+    };
+
+}
+
+#endif /* VERIFICATION_CACHE_H */
@@ -0,0 +1,427 @@
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "workload-generator.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace ns3 {
+
+    NS_LOG_COMPONENT_DEFINE("WorkloadGenerator");
+
+    WorkloadGenerator::WorkloadGenerator(void)
+    {
+        m_process = FIXED;
+        m_paymentDistribution = NODE_PAYMENT;
+        m_rate = 1.0 / 0.95;
+        m_paymentMean = 0;
+        m_paymentSpread = 0;
+        m_skew = 0;
+        m_meanOn = Seconds(1);
+        m_meanOff = Seconds(1);
+        m_period = Seconds(1);
+        m_amplitude = 0;
+        m_sequence = 0;
+        m_totalArrivals = 0;
+        m_totalEvents = 0;
+    }
+
+    WorkloadGenerator::~WorkloadGenerator(void)
+    {
+    }
+
+    bool
+    WorkloadGenerator::ParseArrivalProcess(const std::string &name, ArrivalProcess &process)
+    {
+        if (name == "fixed")
+        {
+            process = FIXED;
+        }
+        else if (name == "poisson")
+        {
+            process = POISSON;
+        }
+        else if (name == "onoff")
+        {
+            process = ON_OFF;
+        }
+        else if (name == "diurnal")
+        {
+            process = DIURNAL;
+        }
+        else if (name == "trace")
+        {
+            process = TRACE;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    bool
+    WorkloadGenerator::ParsePaymentDistribution(const std::string &name, PaymentDistribution &distribution)
+    {
+        if (name == "node")
+        {
+            distribution = NODE_PAYMENT;
+        }
+        else if (name == "uniform")
+        {
+            distribution = UNIFORM;
+        }
+        else if (name == "exponential")
+        {
+            distribution = EXPONENTIAL;
+        }
+        else if (name == "lognormal")
+        {
+            distribution = LOGNORMAL;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void
+    WorkloadGenerator::SetSeed(uint64_t seed)
+    {
+        m_random.seed(seed);
+    }
+
+    void
+    WorkloadGenerator::SetArrivalProcess(ArrivalProcess process)
+    {
+        m_process = process;
+    }
+
+    void
+    WorkloadGenerator::SetArrivalRate(double rate)
+    {
+        m_rate = rate;
+    }
+
+    void
+    WorkloadGenerator::SetOnOff(Time meanOn, Time meanOff)
+    {
+        // Periods of length 0 would make the exponential draws divide by zero
+        m_meanOn = std::max(meanOn, MilliSeconds(1));
+        m_meanOff = std::max(meanOff, MilliSeconds(1));
+    }
+
+    void
+    WorkloadGenerator::SetDiurnal(Time period, double amplitude)
+    {
+        m_period = period;
+        m_amplitude = std::min(std::max(amplitude, 0.0), 1.0);
+    }
+
+    bool
+    WorkloadGenerator::LoadTrace(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        m_trace.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            std::istringstream fields(line);
+            double timeMs;
+            TraceArrival arrival;
+            if (!(fields >> timeMs >> arrival.nodeId))
+            {
+                continue;
+            }
+            arrival.at = MilliSeconds(timeMs);
+            if (!(fields >> arrival.payment))
+            {
+                arrival.payment = -1;
+            }
+            m_trace.push_back(arrival);
+        }
+        return true;
+    }
+
+    void
+    WorkloadGenerator::SetPaymentDistribution(PaymentDistribution distribution, double mean, double spread)
+    {
+        m_paymentDistribution = distribution;
+        m_paymentMean = mean;
+        m_paymentSpread = spread;
+    }
+
+    void
+    WorkloadGenerator::SetHotspotSkew(double skew)
+    {
+        m_skew = skew;
+    }
+
+    void
+    WorkloadGenerator::AddNode(uint32_t nodeId, Callback<void, double> submit, double payment)
+    {
+        Source source;
+        source.nodeId = nodeId;
+        source.submit = submit;
+        source.payment = payment;
+        source.rate = 0;
+        source.isOn = true;
+        source.arrivals = 0;
+
+        m_sourceOfNode[nodeId] = m_sources.size();
+        m_sources.push_back(source);
+    }
+
+    void
+    WorkloadGenerator::SetNodeRate(uint32_t nodeId, double rate)
+    {
+        m_nodeRates[nodeId] = rate;
+    }
+
+    double
+    WorkloadGenerator::GetNodeRate(uint32_t nodeId) const
+    {
+        std::map<uint32_t, uint32_t>::const_iterator it = m_sourceOfNode.find(nodeId);
+        return it != m_sourceOfNode.end() ? m_sources[it->second].rate : 0;
+    }
+
+    void
+    WorkloadGenerator::Start(Time start, Time stop)
+    {
+        m_start = start;
+        m_stop = stop;
+        ComputeRates();
+        Simulator::Schedule(start, &WorkloadGenerator::Begin, this);
+    }
+
+    uint64_t
+    WorkloadGenerator::GetArrivals(void) const
+    {
+        return m_totalArrivals;
+    }
+
+    uint64_t
+    WorkloadGenerator::GetEvents(void) const
+    {
+        return m_totalEvents;
+    }
+
+    void
+    WorkloadGenerator::ComputeRates(void)
+    {
+        // Zipf shares in node id order, node 1 is the hottest
+        std::vector<double> weights(m_sources.size());
+        double totalWeight = 0;
+        uint32_t rank = 1;
+        for (std::map<uint32_t, uint32_t>::const_iterator it = m_sourceOfNode.begin(); it != m_sourceOfNode.end(); ++it, ++rank)
+        {
+            weights[it->second] = 1.0 / std::pow(rank, m_skew);
+            totalWeight += weights[it->second];
+        }
+
+        for (uint32_t i = 0; i < m_sources.size(); i++)
+        {
+            std::map<uint32_t, double>::const_iterator rate = m_nodeRates.find(m_sources[i].nodeId);
+            m_sources[i].rate = rate != m_nodeRates.end() ? rate->second
+                                                          : m_rate * m_sources.size() * weights[i] / totalWeight;
+        }
+    }
+
+    void
+    WorkloadGenerator::Begin(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        Time now = Simulator::Now();
+
+        if (m_process == TRACE)
+        {
+            for (const TraceArrival &arrival : m_trace)
+            {
+                std::map<uint32_t, uint32_t>::const_iterator it = m_sourceOfNode.find(arrival.nodeId);
+                if (it != m_sourceOfNode.end() && now + arrival.at < m_stop)
+                {
+                    Push(now + arrival.at, it->second, arrival.payment);
+                }
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < m_sources.size(); i++)
+            {
+                Source &source = m_sources[i];
+                double onShare = m_meanOn.GetSeconds() / (m_meanOn + m_meanOff).GetSeconds();
+                source.isOn = std::uniform_real_distribution<double>(0, 1)(m_random) < onShare;
+                source.stateEnd = now + Exponential(1.0 / (source.isOn ? m_meanOn : m_meanOff).GetSeconds());
+
+                Time first = now;
+                if (m_process == FIXED && source.rate > 0)
+                {
+                    // A random phase, so the nodes do not all send at the same instant
+                    first = now + Seconds(std::uniform_real_distribution<double>(0, 1.0 / source.rate)(m_random));
+                }
+                else
+                {
+                    first = DrawNext(source, now);
+                }
+                if (first < m_stop)
+                {
+                    Push(first, i, -1);
+                }
+            }
+        }
+
+        ScheduleNext();
+    }
+
+    void
+    WorkloadGenerator::Fire(void)
+    {
+        NS_LOG_FUNCTION(this);
+
+        m_totalEvents++;
+        Time now = Simulator::Now();
+
+        // Every arrival that is due, whichever node it belongs to, in this one event
+        while (!m_arrivals.empty() && m_arrivals.top().at <= now)
+        {
+            Arrival arrival = m_arrivals.top();
+            m_arrivals.pop();
+
+            Source &source = m_sources[arrival.source];
+            source.arrivals++;
+            m_totalArrivals++;
+            source.submit(arrival.payment >= 0 ? arrival.payment : DrawPayment(source));
+
+            if (m_process != TRACE)
+            {
+                Time next = DrawNext(source, now);
+                if (next < m_stop)
+                {
+                    Push(next, arrival.source, -1);
+                }
+            }
+        }
+
+        ScheduleNext();
+    }
+
+    void
+    WorkloadGenerator::Push(Time at, uint32_t source, double payment)
+    {
+        Arrival arrival;
+        arrival.at = at;
+        arrival.sequence = m_sequence++;
+        arrival.source = source;
+        arrival.payment = payment;
+        m_arrivals.push(arrival);
+    }
+
+    void
+    WorkloadGenerator::ScheduleNext(void)
+    {
+        if (!m_arrivals.empty())
+        {
+            m_nextEvent = Simulator::Schedule(m_arrivals.top().at - Simulator::Now(), &WorkloadGenerator::Fire, this);
+        }
+    }
+
+    Time
+    WorkloadGenerator::DrawNext(Source &source, Time from)
+    {
+        if (source.rate <= 0)
+        {
+            return m_stop;
+        }
+
+        switch (m_process)
+        {
+            case FIXED:
+                return from + Seconds(1.0 / source.rate);
+
+            case POISSON:
+                return from + Exponential(source.rate);
+
+            case ON_OFF:
+            {
+                // Walk the on and off periods until an arrival falls inside an on period
+                double onRate = source.rate * (m_meanOn + m_meanOff).GetSeconds() / m_meanOn.GetSeconds();
+                Time t = from;
+                while (t < m_stop)
+                {
+                    if (source.isOn)
+                    {
+                        Time next = t + Exponential(onRate);
+                        if (next < source.stateEnd)
+                        {
+                            return next;
+                        }
+                    }
+                    t = source.stateEnd;
+                    source.isOn = !source.isOn;
+                    source.stateEnd = t + Exponential(1.0 / (source.isOn ? m_meanOn : m_meanOff).GetSeconds());
+                }
+                return m_stop;
+            }
+
+            case DIURNAL:
+            {
+                // Thinning: candidates at the peak rate, each kept with rate(t) / peak
+                double peak = source.rate * (1 + m_amplitude);
+                Time t = from;
+                while (t < m_stop)
+                {
+                    t += Exponential(peak);
+                    double phase = 2 * M_PI * (t - m_start).GetSeconds() / m_period.GetSeconds();
+                    double rate = source.rate * (1 + m_amplitude * std::sin(phase));
+                    if (std::uniform_real_distribution<double>(0, peak)(m_random) < rate)
+                    {
+                        return t;
+                    }
+                }
+                return m_stop;
+            }
+
+            case TRACE:
+                break;
+        }
+        return m_stop;
+    }
+
+    double
+    WorkloadGenerator::DrawPayment(const Source &source)
+    {
+        double mean = m_paymentMean > 0 ? m_paymentMean : source.payment;
+
+        switch (m_paymentDistribution)
+        {
+            case NODE_PAYMENT:
+                return source.payment;
+            case UNIFORM:
+                return std::uniform_real_distribution<double>(mean * (1 - m_paymentSpread), mean * (1 + m_paymentSpread))(m_random);
+            case EXPONENTIAL:
+                return mean > 0 ? std::exponential_distribution<double>(1.0 / mean)(m_random) : 0;
+            case LOGNORMAL:
+                return mean > 0 ? std::lognormal_distribution<double>(std::log(mean), m_paymentSpread)(m_random) : 0;
+        }
+        return source.payment;
+    }
+
+    Time
+    WorkloadGenerator::Exponential(double rate)
+    {
+        return Seconds(std::exponential_distribution<double>(rate)(m_random));
+    }
+
+}
@@ -0,0 +1,176 @@
+#ifndef WORKLOAD_GENERATOR_H
+#define WORKLOAD_GENERATOR_H
+
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include <cstdint>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+    /*
+     * Open-loop transaction arrivals for every rsu node: arrivals do not wait for
+     * earlier transactions to finish.
+     *
+     * The next arrival of every node sits in one heap and a single simulator event is
+     * pending for the earliest of them, so the event queue does not grow with the
+     * number of nodes. All draws come from one generator seeded once, which makes a
+     * run repeatable.
+     *
+     *     FIXED       one arrival every 1/rate, with a random phase per node
+     *     POISSON     exponential gaps
+     *     ON_OFF      Poisson while on, silent while off; the on and off periods are
+     *                 exponential, the rate while on keeps the mean rate
+     *     DIURNAL     Poisson with rate * (1 + amplitude * sin(2 pi t / period))
+     *     TRACE       the arrivals of a file, one "<time ms> <node id> [payment]" per line
+     *
+     * The mean rate of the network is rate * nodes. With a hot-spot skew s it is split
+     * over the nodes like a Zipf law, node k in id order getting a share in 1/k^s.
+     */
+    class WorkloadGenerator
+    {
+        public:
+            enum ArrivalProcess
+            {
+                FIXED,
+                POISSON,
+                ON_OFF,
+                DIURNAL,
+                TRACE,
+            };
+
+            enum PaymentDistribution
+            {
+                NODE_PAYMENT,       // the payment of the node from payments.txt
+                UNIFORM,            // mean * (1 +- spread)
+                EXPONENTIAL,        // mean
+                LOGNORMAL,          // median mean, sigma spread
+            };
+
+            WorkloadGenerator(void);
+            virtual ~WorkloadGenerator(void);
+
+            /*
+             * "fixed", "poisson", "onoff", "diurnal" or "trace"; false if name is none of them.
+             */
+            static bool ParseArrivalProcess(const std::string &name, ArrivalProcess &process);
+            /*
+             * "node", "uniform", "exponential" or "lognormal"; false if name is none of them.
+             */
+            static bool ParsePaymentDistribution(const std::string &name, PaymentDistribution &distribution);
+
+            void SetSeed(uint64_t seed);
+            void SetArrivalProcess(ArrivalProcess process);
+            /*
+             * Mean transactions per second of one node.
+             */
+            void SetArrivalRate(double rate);
+            void SetOnOff(Time meanOn, Time meanOff);
+            void SetDiurnal(Time period, double amplitude);
+            /*
+             * Reads the arrivals of TRACE; false if the file cannot be read.
+             */
+            bool LoadTrace(const std::string &path);
+
+            /*
+             * mean 0 takes the payment of each node.
+             */
+            void SetPaymentDistribution(PaymentDistribution distribution, double mean, double spread);
+            void SetHotspotSkew(double skew);
+
+            /*
+             * submit is called with the payment of each arrival of the node.
+             */
+            void AddNode(uint32_t nodeId, Callback<void, double> submit, double payment);
+            /*
+             * Overrides the rate the node gets from the arrival rate and the skew.
+             */
+            void SetNodeRate(uint32_t nodeId, double rate);
+            double GetNodeRate(uint32_t nodeId) const;
+
+            /*
+             * Arrivals are generated in [start, stop).
+             */
+            void Start(Time start, Time stop);
+
+            uint64_t GetArrivals(void) const;
+            uint64_t GetEvents(void) const;
+
+        protected:
+            struct Source
+            {
+                uint32_t nodeId;
+                Callback<void, double> submit;
+                double payment;
+                double rate;
+                bool isOn;
+                Time stateEnd;      // end of the current on or off period
+                uint64_t arrivals;
+            };
+
+            struct Arrival
+            {
+                Time at;
+                uint64_t sequence;  // orders arrivals at the same time, so runs repeat
+                uint32_t source;
+                double payment;     // negative to draw it when the arrival fires
+
+                bool operator>(const Arrival &other) const
+                {
+                    return at != other.at ? at > other.at : sequence > other.sequence;
+                }
+            };
+
+            void Begin(void);
+            void Fire(void);
+            void Push(Time at, uint32_t source, double payment);
+            void ScheduleNext(void);
+            void ComputeRates(void);
+
+            /*
+             * The first arrival of the source after `from`, or m_stop if there is none.
+             */
+            Time DrawNext(Source &source, Time from);
+            double DrawPayment(const Source &source);
+            Time Exponential(double rate);
+
+            ArrivalProcess m_process;
+            PaymentDistribution m_paymentDistribution;
+            double m_rate;
+            double m_paymentMean;
+            double m_paymentSpread;
+            double m_skew;
+            Time m_meanOn;
+            Time m_meanOff;
+            Time m_period;
+            double m_amplitude;
+            Time m_start;
+            Time m_stop;
+
+            std::vector<Source> m_sources;
+            std::map<uint32_t, uint32_t> m_sourceOfNode;
+            std::map<uint32_t, double> m_nodeRates;
+            struct TraceArrival
+            {
+                Time at;
+                uint32_t nodeId;
+                double payment;
+            };
+            std::vector<TraceArrival> m_trace;
+
+            std::priority_queue<Arrival, std::vector<Arrival>, std::greater<Arrival>> m_arrivals;
+            uint64_t m_sequence;
+            EventId m_nextEvent;
+            std::mt19937_64 m_random;
+            uint64_t m_totalArrivals;
+            uint64_t m_totalEvents;
+    };
+
+}
+
+#endif /* WORKLOAD_GENERATOR_H */